@@ -40,8 +40,11 @@ from math import log
 import json
 
 from khmer._khmer import Countgraph as _Countgraph
+from khmer._khmer import BlockedCountgraph as _BlockedCountgraph
+from khmer._khmer import PackedCountgraph as _PackedCountgraph
 from khmer._khmer import GraphLabels as _GraphLabels
 from khmer._khmer import Nodegraph as _Nodegraph
+from khmer._khmer import BlockedNodegraph as _BlockedNodegraph
 from khmer._khmer import HLLCounter as _HLLCounter
 from khmer._khmer import ReadAligner as _ReadAligner
 
@@ -59,11 +62,18 @@ from khmer._khmer import hash_no_rc_murmur3  # tests/test_functions.py
 from khmer._khmer import get_version_cpp as __version_cpp__
 # tests/test_version.py
 
+from khmer._khmer import read_chunked_table  # tests/test_countgraph.py
+from khmer._khmer import merge_graph_files  # scripts/merge-graphs.py
+from khmer._khmer import interleave_reads  # scripts/interleave-reads.py
+from khmer._khmer import paired_reads_to_files
+# scripts/{split,extract}-paired-reads.py
+
 from khmer._khmer import ReadParser  # sandbox/to-casava-1.8-fastq.py
 # tests/test_read_parsers.py,scripts/{filter-abund-single,load-graph}.py
 # scripts/{abundance-dist-single,load-into-counting}.py
 
 import sys
+import gzip
 
 from struct import pack, unpack
 
@@ -72,30 +82,80 @@ __version__ = get_versions()['version']
 del get_versions
 
 
-def load_nodegraph(filename):
+def load_nodegraph(filename, mmap_mode=None, threads=1):
     """Load a nodegraph object from the given filename and return it.
 
-    Keyword argument:
+    Keyword arguments:
     filename -- the name of the nodegraph file
+    mmap_mode -- 'r' or 'c' to map the tables of a page-aligned file
+    read-only or copy-on-write instead of reading them
+    threads -- the number of threads decompressing a chunked file
     """
-    nodegraph = _Nodegraph(1, [1])
-    nodegraph.load(filename)
+    if _read_graph_type(filename) == _SAVED_BLOCKED_HASHBITS:
+        nodegraph = _BlockedNodegraph(1, 1, 1)
+    else:
+        nodegraph = _Nodegraph(1, [1])
+    nodegraph.load(filename, mmap_mode, threads)
 
     return nodegraph
 
 
-def load_countgraph(filename):
+def load_countgraph(filename, mmap_mode=None, threads=1):
     """Load a countgraph object from the given filename and return it.
 
-    Keyword argument:
+    Keyword arguments:
     filename -- the name of the countgraph file
+    mmap_mode -- 'r' or 'c' to map the tables of a page-aligned file
+    read-only or copy-on-write instead of reading them
+    threads -- the number of threads decompressing a chunked file
     """
-    countgraph = _Countgraph(1, [1])
-    countgraph.load(filename)
+    graph_type = _read_graph_type(filename)
+    if graph_type == _SAVED_BLOCKED_COUNTING_HT:
+        countgraph = _BlockedCountgraph(1, 1, 1)
+    elif graph_type == _SAVED_COUNTING_HT_4BIT:
+        countgraph = _PackedCountgraph(1, [1], 4)
+    elif graph_type == _SAVED_COUNTING_HT_2BIT:
+        countgraph = _PackedCountgraph(1, [1], 2)
+    else:
+        countgraph = _Countgraph(1, [1])
+    countgraph.load(filename, mmap_mode, threads)
 
     return countgraph
 
 
+# table type flags from the headers of saved graph files; see lib/khmer.hh.
+_SAVED_BLOCKED_COUNTING_HT = 7
+_SAVED_BLOCKED_HASHBITS = 8
+_SAVED_COUNTING_HT_4BIT = 9
+_SAVED_COUNTING_HT_2BIT = 10
+_SAVED_FLAG_FASTRANGE = 0x80
+_SAVED_FLAG_PAGE_ALIGNED = 0x40
+_SAVED_FLAG_CHUNKED = 0x20
+_SAVED_FLAG_SPARSE = 0x10
+
+
+def _read_graph_type(filename):
+    """Return the table type flag from a saved graph file, or None.
+
+    Any problem reading the file is left for the loader to report.
+    """
+    try:
+        if filename.endswith('.gz'):
+            graphfile = gzip.open(filename, 'rb')
+        else:
+            graphfile = open(filename, 'rb')
+        with graphfile:
+            header = graphfile.read(6)
+    except (IOError, OSError):
+        return None
+    if len(header) < 6:
+        return None
+    return bytearray(header)[5] & ~(_SAVED_FLAG_FASTRANGE |
+                                    _SAVED_FLAG_PAGE_ALIGNED |
+                                    _SAVED_FLAG_CHUNKED |
+                                    _SAVED_FLAG_SPARSE)
+
+
 def extract_nodegraph_info(filename):
     """Open the given nodegraph file and return a tuple of information.
 
@@ -185,7 +245,7 @@ def calc_expected_collisions(graph, force=False, max_false_pos=.2):
     graph: the countgraph or nodegraph object to inspect
     """
     sizes = graph.hashsizes()
-    n_ht = float(len(sizes))
+    n_ht = float(graph.n_tables())
     occupancy = float(graph.n_occupied())
     min_size = min(sizes)
 
@@ -227,16 +287,23 @@ def is_prime(number):
     return True
 
 
-def get_n_primes_near_x(number, target):
+def get_n_primes_near_x(number, target, fastrange=False):
     """Backward-find primes smaller than target.
 
     Step backwards until a number of primes (other than 2) have been
     found that are smaller than the target and return them.
 
+    Tables using fastrange indexing don't need prime sizes, so with
+    fastrange=True this just returns number copies of int(target).
+
     Keyword arguments:
     number -- the number of primes to find
     target -- the number to step backwards from
+    fastrange -- return sizes for fastrange-indexed tables
     """
+    if fastrange:
+        return [max(int(target), 1)] * number
+
     if target == 1 and number == 1:
         return [1]
 
@@ -264,9 +331,36 @@ def get_n_primes_near_x(number, target):
 
 class Countgraph(_Countgraph):
 
+    def __new__(cls, k, starting_size, n_tables, fastrange=False):
+        primes = get_n_primes_near_x(n_tables, starting_size, fastrange)
+        c = _Countgraph.__new__(cls, k, primes, fastrange)
+        c.primes = primes
+        return c
+
+
+class BlockedCountgraph(_BlockedCountgraph):
+    """A countgraph keeping each k-mer's counters in one cache line.
+
+    Takes the same arguments as Countgraph and uses the same amount of
+    memory, starting_size * n_tables bytes, in a single table.
+    """
+
     def __new__(cls, k, starting_size, n_tables):
-        primes = get_n_primes_near_x(n_tables, starting_size)
-        c = _Countgraph.__new__(cls, k, primes)
+        tablesize = int(starting_size * n_tables)
+        return _BlockedCountgraph.__new__(cls, k, tablesize, n_tables)
+
+
+class PackedCountgraph(_PackedCountgraph):
+    """A countgraph with 4-bit or 2-bit counters.
+
+    starting_size is the number of counters per table, as for Countgraph,
+    but two or four of them share a byte. Counts stop at 15 or 3.
+    """
+
+    def __new__(cls, k, starting_size, n_tables, counter_bits=4,
+                fastrange=False):
+        primes = get_n_primes_near_x(n_tables, starting_size, fastrange)
+        c = _PackedCountgraph.__new__(cls, k, primes, counter_bits, fastrange)
         c.primes = primes
         return c
 
@@ -292,13 +386,25 @@ class CountingGraphLabels(_GraphLabels):
 
 class Nodegraph(_Nodegraph):
 
-    def __new__(cls, k, starting_size, n_tables):
-        primes = get_n_primes_near_x(n_tables, starting_size)
-        c = _Nodegraph.__new__(cls, k, primes)
+    def __new__(cls, k, starting_size, n_tables, fastrange=False):
+        primes = get_n_primes_near_x(n_tables, starting_size, fastrange)
+        c = _Nodegraph.__new__(cls, k, primes, fastrange)
         c.primes = primes
         return c
 
 
+class BlockedNodegraph(_BlockedNodegraph):
+    """A nodegraph keeping each k-mer's bits in one cache line.
+
+    Takes the same arguments as Nodegraph and uses the same amount of
+    memory, starting_size * n_tables bits, in a single table.
+    """
+
+    def __new__(cls, k, starting_size, n_tables):
+        tablesize = int(starting_size * n_tables)
+        return _BlockedNodegraph.__new__(cls, k, tablesize, n_tables)
+
+
 class HLLCounter(_HLLCounter):
 
     """HyperLogLog counter.
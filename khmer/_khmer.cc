@@ -50,10 +50,12 @@ Contact: khmer-project@idyll.org
 #include "hashtable.hh"
 #include "hashbits.hh"
 #include "counting.hh"
+#include "graph_merge.hh"
 #include "read_aligner.hh"
 #include "labelhash.hh"
 #include "khmer_exception.hh"
 #include "hllcounter.hh"
+#include "traversal.hh"
 
 using namespace khmer;
 using namespace read_parsers;
@@ -253,6 +255,17 @@ typedef struct {
 } khmer_ReadPairIterator_Object;
 
 
+typedef struct {
+    PyObject_HEAD
+    //! Pointer to Python parser object for reference counting purposes.
+    PyObject *  parent;
+    //! Reads per batch.
+    Py_ssize_t  batch_size;
+    //! Reused across invocations.
+    std::vector< Read > *   reads;
+} khmer_ReadBatchIterator_Object;
+
+
 static
 void
 _ReadParser_dealloc(khmer_ReadParser_Object * obj)
@@ -273,6 +286,18 @@ khmer_ReadPairIterator_dealloc(khmer_ReadPairIterator_Object * obj)
 }
 
 
+static
+void
+khmer_ReadBatchIterator_dealloc(khmer_ReadBatchIterator_Object * obj)
+{
+    Py_DECREF(obj->parent);
+    obj->parent = NULL;
+    delete obj->reads;
+    obj->reads = NULL;
+    Py_TYPE(obj)->tp_free((PyObject*)obj);
+}
+
+
 static
 PyObject *
 _ReadParser_new( PyTypeObject * subtype, PyObject * args, PyObject * kwds )
@@ -290,12 +315,21 @@ _ReadParser_new( PyTypeObject * subtype, PyObject * args, PyObject * kwds )
     }
     khmer_ReadParser_Object * myself  = (khmer_ReadParser_Object *)self;
 
-    // Wrap the low-level parser object.
+    // Wrap the low-level parser object. Opening a FIFO waits for a writer,
+    // which may be another Python thread.
+    PyObject   *exc_type        = NULL;
+    std::string exc_message;
+    Py_BEGIN_ALLOW_THREADS
     try {
         myself->parser =
             IParser:: get_parser( ifile_name );
     } catch (khmer_file_exception &exc) {
-        PyErr_SetString( PyExc_OSError, exc.what() );
+        exc_type = PyExc_OSError;
+        exc_message = exc.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (exc_type != NULL) {
+        PyErr_SetString( exc_type, exc_message.c_str() );
         return NULL;
     }
     return self;
@@ -310,8 +344,9 @@ _ReadParser_iternext( PyObject * self )
     IParser *       parser  = myself->parser;
 
     bool        stop_iteration  = false;
-    const char *value_exception = NULL;
-    const char *file_exception  = NULL;
+    // the message is copied; the exception is gone once it has been caught.
+    PyObject   *exc_type        = NULL;
+    std::string exc_message;
     Read       *the_read_PTR    = NULL;
     try {
         the_read_PTR = new Read( );
@@ -327,9 +362,11 @@ _ReadParser_iternext( PyObject * self )
         } catch (NoMoreReadsAvailable &exc) {
             stop_iteration = true;
         } catch (khmer_file_exception &exc) {
-            file_exception = exc.what();
+            exc_type = PyExc_OSError;
+            exc_message = exc.what();
         } catch (khmer_value_exception &exc) {
-            value_exception = exc.what();
+            exc_type = PyExc_ValueError;
+            exc_message = exc.what();
         }
     }
     Py_END_ALLOW_THREADS
@@ -341,14 +378,9 @@ _ReadParser_iternext( PyObject * self )
         return NULL;
     }
 
-    if (file_exception != NULL) {
-        delete the_read_PTR;
-        PyErr_SetString(PyExc_OSError, file_exception);
-        return NULL;
-    }
-    if (value_exception != NULL) {
+    if (exc_type != NULL) {
         delete the_read_PTR;
-        PyErr_SetString(PyExc_ValueError, value_exception);
+        PyErr_SetString(exc_type, exc_message.c_str());
         return NULL;
     }
 
@@ -368,8 +400,9 @@ _ReadPairIterator_iternext(khmer_ReadPairIterator_Object * myself)
 
     ReadPair    the_read_pair;
     bool        stop_iteration  = false;
-    const char *value_exception = NULL;
-    const char *file_exception  = NULL;
+    // the message is copied; the exception is gone once it has been caught.
+    PyObject   *exc_type        = NULL;
+    std::string exc_message;
 
     Py_BEGIN_ALLOW_THREADS
     stop_iteration = parser->is_complete( );
@@ -379,9 +412,11 @@ _ReadPairIterator_iternext(khmer_ReadPairIterator_Object * myself)
         } catch (NoMoreReadsAvailable &exc) {
             stop_iteration = true;
         } catch (khmer_file_exception &exc) {
-            file_exception = exc.what();
+            exc_type = PyExc_OSError;
+            exc_message = exc.what();
         } catch (khmer_value_exception &exc) {
-            value_exception = exc.what();
+            exc_type = PyExc_ValueError;
+            exc_message = exc.what();
         }
     }
     Py_END_ALLOW_THREADS
@@ -390,12 +425,8 @@ _ReadPairIterator_iternext(khmer_ReadPairIterator_Object * myself)
     if (stop_iteration) {
         return NULL;
     }
-    if (file_exception != NULL) {
-        PyErr_SetString(PyExc_OSError, file_exception);
-        return NULL;
-    }
-    if (value_exception != NULL) {
-        PyErr_SetString(PyExc_ValueError, value_exception);
+    if (exc_type != NULL) {
+        PyErr_SetString(exc_type, exc_message.c_str());
         return NULL;
     }
 
@@ -452,6 +483,95 @@ static PyTypeObject khmer_ReadPairIterator_Type = {
 
 
 
+static
+PyObject *
+_ReadBatchIterator_iternext(khmer_ReadBatchIterator_Object * myself)
+{
+    khmer_ReadParser_Object * parent = (khmer_ReadParser_Object*)myself->parent;
+    IParser    *parser    = parent->parser;
+    std::vector< Read > &reads = *myself->reads;
+
+    size_t      n_reads         = 0;
+    PyObject   *exc_type        = NULL;
+    std::string exc_message;
+
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        n_reads = parser->imprint_next_read_batch(reads, myself->batch_size);
+    } catch (khmer_file_exception &exc) {
+        exc_type = PyExc_OSError;
+        exc_message = exc.what();
+    } catch (khmer_value_exception &exc) {
+        exc_type = PyExc_ValueError;
+        exc_message = exc.what();
+    } catch (std::bad_alloc &exc) {
+        exc_type = PyExc_MemoryError;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (exc_type != NULL) {
+        PyErr_SetString(exc_type, exc_message.c_str());
+        return NULL;
+    }
+    // Note: Can return NULL instead of setting the StopIteration exception.
+    if (n_reads == 0) {
+        return NULL;
+    }
+
+    PyObject * batch = PyList_New(n_reads);
+    if (batch == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < n_reads; i++) {
+        PyObject * read_OBJECT = khmer_Read_Type.tp_alloc( &khmer_Read_Type, 1 );
+        if (read_OBJECT == NULL) {
+            Py_DECREF(batch);
+            return NULL;
+        }
+        try {
+            ((khmer_Read_Object *)read_OBJECT)->read = new Read( reads[i] );
+        } catch (std::bad_alloc &e) {
+            Py_DECREF(read_OBJECT);
+            Py_DECREF(batch);
+            return PyErr_NoMemory();
+        }
+        PyList_SET_ITEM(batch, i, read_OBJECT);
+    }
+    return batch;
+}
+
+static PyTypeObject khmer_ReadBatchIterator_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)              /* init & ob_size */
+    "_khmer.ReadBatchIterator",                  /* tp_name */
+    sizeof(khmer_ReadBatchIterator_Object),     /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)khmer_ReadBatchIterator_dealloc, /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    "Iterates over 'ReadParser' objects and returns lists of reads.", /* tp_doc */
+    0,                                          /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    PyObject_SelfIter,                          /* tp_iter */
+    (iternextfunc)_ReadBatchIterator_iternext,  /* tp_iternext */
+};
+
+
+
 static
 PyObject *
 ReadParser_iter_reads(PyObject * self, PyObject * args )
@@ -495,6 +615,45 @@ ReadParser_iter_read_pairs(PyObject * self, PyObject * args )
 }
 
 
+static
+PyObject *
+ReadParser_iter_read_batches(PyObject * self, PyObject * args )
+{
+    Py_ssize_t  batch_size  = DEFAULT_READ_BATCH_SIZE;
+
+    if (!PyArg_ParseTuple( args, "|n", &batch_size )) {
+        return NULL;
+    }
+    if (batch_size < 1) {
+        PyErr_SetString(PyExc_ValueError, "batch size must be at least 1");
+        return NULL;
+    }
+
+    PyObject * obj = khmer_ReadBatchIterator_Type.tp_alloc(
+                         &khmer_ReadBatchIterator_Type, 1
+                     );
+    if (obj == NULL) {
+        return NULL;
+    }
+    khmer_ReadBatchIterator_Object * rbi = (khmer_ReadBatchIterator_Object *)obj;
+    rbi->parent             = self;
+    rbi->batch_size         = batch_size;
+
+    // Increment reference count on existing ReadParser object so that it
+    // will not go away until all ReadBatchIterator instances have gone away.
+    Py_INCREF( self );
+
+    try {
+        rbi->reads = new std::vector< Read >();
+    } catch (std::bad_alloc &e) {
+        Py_DECREF(obj);
+        return PyErr_NoMemory();
+    }
+
+    return obj;
+}
+
+
 static PyMethodDef _ReadParser_methods [ ] = {
     {
         "iter_reads",       (PyCFunction)ReadParser_iter_reads,
@@ -504,6 +663,12 @@ static PyMethodDef _ReadParser_methods [ ] = {
         "iter_read_pairs",  (PyCFunction)ReadParser_iter_read_pairs,
         METH_VARARGS,       "Iterates over paired reads as pairs."
     },
+    {
+        "iter_read_batches",    (PyCFunction)ReadParser_iter_read_batches,
+        METH_VARARGS,
+        "Iterates over lists of up to the given number of reads, taken from "
+        "the parser in one go."
+    },
     { NULL, NULL, 0, NULL } // sentinel
 };
 
@@ -569,6 +734,7 @@ void _init_ReadParser_Type_constants()
     }
 
     // Place pair mode constants into class dictionary.
+    // PyDict_SetItemString returns 0 on success.
     int result;
 
     PyObject * value = PyLong_FromLong( IParser:: PAIR_MODE_ALLOW_UNPAIRED );
@@ -579,7 +745,7 @@ void _init_ReadParser_Type_constants()
     result = PyDict_SetItemString(cls_attrs_DICT,
                                   "PAIR_MODE_ALLOW_UNPAIRED", value);
     Py_XDECREF(value);
-    if (!result) {
+    if (result) {
         Py_DECREF(cls_attrs_DICT);
         return;
     }
@@ -592,7 +758,7 @@ void _init_ReadParser_Type_constants()
     result = PyDict_SetItemString(cls_attrs_DICT,
                                   "PAIR_MODE_IGNORE_UNPAIRED", value );
     Py_XDECREF(value);
-    if (!result) {
+    if (result) {
         Py_DECREF(cls_attrs_DICT);
         return;
     }
@@ -605,7 +771,7 @@ void _init_ReadParser_Type_constants()
     result = PyDict_SetItemString(cls_attrs_DICT,
                                   "PAIR_MODE_ERROR_ON_UNPAIRED", value);
     Py_XDECREF(value);
-    if (!result) {
+    if (result) {
         Py_DECREF(cls_attrs_DICT);
         return;
     }
@@ -816,20 +982,31 @@ hashtable_count(khmer_KHashtable_Object * me, PyObject * args)
         return NULL;
     }
 
-    hashtable->count(kmer);
+    try {
+        hashtable->count(kmer);
+    } catch (khmer_value_exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
 
     return PyLong_FromLong(1);
 }
 
 static
 PyObject *
-hashtable_consume_fasta(khmer_KHashtable_Object * me, PyObject * args)
+hashtable_consume_fasta(khmer_KHashtable_Object * me, PyObject * args,
+                        PyObject * kwds)
 {
     Hashtable * hashtable  = me->hashtable;
 
     const char * filename;
+    unsigned int n_threads = 1;
 
-    if (!PyArg_ParseTuple(args, "s", &filename)) {
+    static const char* const_kwlist[] = {"filename", "threads", NULL};
+    static char** kwlist = const_cast<char**>(const_kwlist);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|I", kwlist,
+                                     &filename, &n_threads)) {
         return NULL;
     }
 
@@ -837,7 +1014,7 @@ hashtable_consume_fasta(khmer_KHashtable_Object * me, PyObject * args)
     unsigned long long  n_consumed    = 0;
     unsigned int          total_reads   = 0;
     try {
-        hashtable->consume_fasta(filename, total_reads, n_consumed);
+        hashtable->consume_fasta(filename, total_reads, n_consumed, n_threads);
     } catch (khmer_file_exception &exc) {
         PyErr_SetString(PyExc_OSError, exc.what());
         return NULL;
@@ -852,13 +1029,18 @@ hashtable_consume_fasta(khmer_KHashtable_Object * me, PyObject * args)
 static
 PyObject *
 hashtable_consume_fasta_with_reads_parser(khmer_KHashtable_Object * me,
-        PyObject * args)
+        PyObject * args, PyObject * kwds)
 {
     Hashtable * hashtable = me->hashtable;
 
     PyObject * rparser_obj = NULL;
+    unsigned int n_threads = 1;
+
+    static const char* const_kwlist[] = {"rparser", "threads", NULL};
+    static char** kwlist = const_cast<char**>(const_kwlist);
 
-    if (!PyArg_ParseTuple(args, "O", &rparser_obj)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|I", kwlist,
+                                     &rparser_obj, &n_threads)) {
         return NULL;
     }
 
@@ -868,25 +1050,24 @@ hashtable_consume_fasta_with_reads_parser(khmer_KHashtable_Object * me,
     // call the C++ function, and trap signals => Python
     unsigned long long  n_consumed      = 0;
     unsigned int        total_reads     = 0;
-    const char         *value_exception = NULL;
-    const char         *file_exception  = NULL;
+    // the message is copied; the exception is gone once it has been caught.
+    PyObject           *exc_type        = NULL;
+    std::string         exc_message;
 
     Py_BEGIN_ALLOW_THREADS
     try {
-        hashtable->consume_fasta(rparser, total_reads, n_consumed);
+        hashtable->consume_fasta(rparser, total_reads, n_consumed, n_threads);
     } catch (khmer_file_exception &exc) {
-        file_exception = exc.what();
+        exc_type = PyExc_OSError;
+        exc_message = exc.what();
     } catch (khmer_value_exception &exc) {
-        value_exception = exc.what();
+        exc_type = PyExc_ValueError;
+        exc_message = exc.what();
     }
     Py_END_ALLOW_THREADS
 
-    if (file_exception != NULL) {
-        PyErr_SetString(PyExc_OSError, file_exception);
-        return NULL;
-    }
-    if (value_exception != NULL) {
-        PyErr_SetString(PyExc_ValueError, value_exception);
+    if (exc_type != NULL) {
+        PyErr_SetString(exc_type, exc_message.c_str());
         return NULL;
     }
 
@@ -912,7 +1093,12 @@ hashtable_consume(khmer_KHashtable_Object * me, PyObject * args)
     }
 
     unsigned int n_consumed;
-    n_consumed = hashtable->consume_string(long_str);
+    try {
+        n_consumed = hashtable->consume_string(long_str);
+    } catch (khmer_value_exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
 
     return PyLong_FromLong(n_consumed);
 }
@@ -964,18 +1150,44 @@ hashtable_get(khmer_KHashtable_Object * me, PyObject * args)
 
 static
 PyObject *
-hashtable_load(khmer_KHashtable_Object * me, PyObject * args)
+hashtable_load(khmer_KHashtable_Object * me, PyObject * args,
+               PyObject * kwds)
 {
     Hashtable * hashtable = me->hashtable;
 
     const char * filename = NULL;
+    const char * mmap_mode = NULL;
+    unsigned int n_threads = 1;
 
-    if (!PyArg_ParseTuple(args, "s", &filename)) {
+    static const char* const_kwlist[] = {"filename", "mmap_mode", "threads",
+                                         NULL
+                                        };
+    static char** kwlist = const_cast<char**>(const_kwlist);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|zI", kwlist,
+                                     &filename, &mmap_mode, &n_threads)) {
+        return NULL;
+    }
+    if (n_threads == 0) {
+        PyErr_SetString(PyExc_ValueError, "threads must be at least 1");
+        return NULL;
+    }
+
+    TableLoadMode mode;
+    if (mmap_mode == NULL) {
+        mode = LOAD_TABLES_READ;
+    } else if (!strcmp(mmap_mode, "r")) {
+        mode = LOAD_TABLES_MAP_READ_ONLY;
+    } else if (!strcmp(mmap_mode, "c")) {
+        mode = LOAD_TABLES_MAP_COPY_ON_WRITE;
+    } else {
+        PyErr_SetString(PyExc_ValueError,
+                        "mmap_mode must be None, 'r' or 'c'");
         return NULL;
     }
 
     try {
-        hashtable->load(filename);
+        hashtable->load(filename, mode, n_threads);
     } catch (khmer_file_exception &e) {
         PyErr_SetString(PyExc_OSError, e.what());
         return NULL;
@@ -984,28 +1196,114 @@ hashtable_load(khmer_KHashtable_Object * me, PyObject * args)
     Py_RETURN_NONE;
 }
 
+static
+bool
+convert_chunk_codec(const char * name, ChunkCodec &codec)
+{
+    if (!strcmp(name, "zlib")) {
+        codec = CHUNK_CODEC_ZLIB;
+    } else if (!strcmp(name, "none")) {
+        codec = CHUNK_CODEC_NONE;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "codec must be 'zlib' or 'none'");
+        return false;
+    }
+    return true;
+}
+
 static
 PyObject *
-hashtable_save(khmer_KHashtable_Object * me, PyObject * args)
+hashtable_save(khmer_KHashtable_Object * me, PyObject * args,
+               PyObject * kwds)
 {
     Hashtable * hashtable = me->hashtable;
 
     const char * filename = NULL;
+    PyObject * page_aligned_o = NULL;
 
-    if (!PyArg_ParseTuple(args, "s", &filename)) {
+    static const char* const_kwlist[] = {"filename", "page_aligned", NULL};
+    static char** kwlist = const_cast<char**>(const_kwlist);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|O", kwlist,
+                                     &filename, &page_aligned_o)) {
+        return NULL;
+    }
+
+    bool page_aligned = page_aligned_o != NULL
+                        && PyObject_IsTrue(page_aligned_o);
+
+    try {
+        hashtable->save(filename, page_aligned);
+    } catch (khmer_file_exception &e) {
+        PyErr_SetString(PyExc_OSError, e.what());
+        return NULL;
+    } catch (khmer_value_exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static
+PyObject *
+hashtable_save_chunked(khmer_KHashtable_Object * me, PyObject * args,
+                       PyObject * kwds)
+{
+    Hashtable * hashtable = me->hashtable;
+
+    const char * filename = NULL;
+    const char * codec_name = "zlib";
+    unsigned int n_threads = 1;
+
+    static const char* const_kwlist[] = {"filename", "codec", "threads",
+                                         NULL
+                                        };
+    static char** kwlist = const_cast<char**>(const_kwlist);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|sI", kwlist,
+                                     &filename, &codec_name, &n_threads)) {
+        return NULL;
+    }
+
+    ChunkCodec codec;
+    if (!convert_chunk_codec(codec_name, codec)) {
+        return NULL;
+    }
+    if (n_threads == 0) {
+        PyErr_SetString(PyExc_ValueError, "threads must be at least 1");
         return NULL;
     }
 
     try {
-        hashtable->save(filename);
+        hashtable->save_chunked(filename, codec, n_threads);
     } catch (khmer_file_exception &e) {
         PyErr_SetString(PyExc_OSError, e.what());
         return NULL;
+    } catch (khmer_value_exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
     }
 
     Py_RETURN_NONE;
 }
 
+static
+PyObject *
+hashtable_is_read_only(khmer_KHashtable_Object * me, PyObject * args)
+{
+    Hashtable * hashtable = me->hashtable;
+
+    if (!PyArg_ParseTuple(args, "")) {
+        return NULL;
+    }
+
+    if (hashtable->is_read_only()) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
 static
 PyObject *
 hashtable_get_hashsizes(khmer_KHashtable_Object * me, PyObject * args)
@@ -1027,6 +1325,65 @@ hashtable_get_hashsizes(khmer_KHashtable_Object * me, PyObject * args)
     return x;
 }
 
+static
+PyObject *
+hashtable_get_use_fastrange(khmer_KHashtable_Object * me, PyObject * args)
+{
+    Hashtable * hashtable = me->hashtable;
+
+    if (!PyArg_ParseTuple(args, "")) {
+        return NULL;
+    }
+
+    bool val = hashtable->get_use_fastrange();
+
+    return PyBool_FromLong((int)val);
+}
+
+static
+PyObject *
+hashtable_set_prefetch_distance(khmer_KHashtable_Object * me,
+                                PyObject * args)
+{
+    Hashtable * hashtable = me->hashtable;
+
+    unsigned int distance;
+    if (!PyArg_ParseTuple(args, "I", &distance)) {
+        return NULL;
+    }
+
+    hashtable->set_prefetch_distance(distance);
+
+    Py_RETURN_NONE;
+}
+
+static
+PyObject *
+hashtable_get_prefetch_distance(khmer_KHashtable_Object * me,
+                                PyObject * args)
+{
+    Hashtable * hashtable = me->hashtable;
+
+    if (!PyArg_ParseTuple(args, "")) {
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLong(hashtable->get_prefetch_distance());
+}
+
+static
+PyObject *
+hashtable_get_n_tables(khmer_KHashtable_Object * me, PyObject * args)
+{
+    Hashtable * hashtable = me->hashtable;
+
+    if (!PyArg_ParseTuple(args, "")) {
+        return NULL;
+    }
+
+    return PyLong_FromSize_t(hashtable->n_tables());
+}
+
 static
 PyObject *
 hashtable_consume_and_tag(khmer_KHashtable_Object * me, PyObject * args)
@@ -1044,7 +1401,12 @@ hashtable_consume_and_tag(khmer_KHashtable_Object * me, PyObject * args)
     unsigned long long n_consumed = 0;
 
     // @CTB needs to normalize
-    hashtable->consume_sequence_and_tag(seq, n_consumed);
+    try {
+        hashtable->consume_sequence_and_tag(seq, n_consumed);
+    } catch (khmer_value_exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
 
     return Py_BuildValue("K", n_consumed);
 }
@@ -1213,6 +1575,40 @@ hashtable_median_at_least(khmer_KHashtable_Object * me, PyObject * args)
 
 }
 
+static
+PyObject *
+hashtable_consume_if_median_below(khmer_KHashtable_Object * me,
+                                  PyObject * args)
+{
+    Hashtable * hashtable = me->hashtable;
+
+    const char * long_str;
+    unsigned int cutoff;
+
+    if (!PyArg_ParseTuple(args, "sI", &long_str, &cutoff)) {
+        return NULL;
+    }
+
+    if (strlen(long_str) < hashtable->ksize()) {
+        PyErr_SetString(PyExc_ValueError,
+                        "string length must >= the hashtable k-mer size");
+        return NULL;
+    }
+
+    bool consumed;
+    try {
+        consumed = hashtable->consume_if_median_below(long_str, cutoff);
+    } catch (khmer_value_exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
+
+    if (consumed) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
 static
 PyObject *
 hashtable_n_tags(khmer_KHashtable_Object * me, PyObject * args)
@@ -1342,8 +1738,8 @@ hashtable_calc_connected_graph_size(khmer_KHashtable_Object * me,
     Kmer start_kmer = hashtable->build_kmer(_kmer);
 
     Py_BEGIN_ALLOW_THREADS
-    KmerSet keeper;
-    hashtable->calc_connected_graph_size(start_kmer, size, keeper, max_size,
+    TraversalContext context;
+    hashtable->calc_connected_graph_size(start_kmer, size, context, max_size,
                                          break_on_circum);
     Py_END_ALLOW_THREADS
 
@@ -1473,6 +1869,61 @@ hashtable_do_subset_partition(khmer_KHashtable_Object * me, PyObject * args)
 }
 
 
+static
+PyObject *
+hashtable_do_partition(khmer_KHashtable_Object * me, PyObject * args,
+                       PyObject * kwds)
+{
+    Hashtable * hashtable = me->hashtable;
+
+    unsigned int n_threads = 1;
+    PyObject * break_on_stop_tags_o = NULL;
+    PyObject * stop_big_traversals_o = NULL;
+
+    static const char* const_kwlist[] = {"threads", "break_on_stop_tags",
+                                         "stop_big_traversals", NULL
+                                        };
+    static char** kwlist = const_cast<char**>(const_kwlist);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|IOO", kwlist, &n_threads,
+                                     &break_on_stop_tags_o,
+                                     &stop_big_traversals_o)) {
+        return NULL;
+    }
+
+    bool break_on_stop_tags = false;
+    if (break_on_stop_tags_o && PyObject_IsTrue(break_on_stop_tags_o)) {
+        break_on_stop_tags = true;
+    }
+    bool stop_big_traversals = false;
+    if (stop_big_traversals_o && PyObject_IsTrue(stop_big_traversals_o)) {
+        stop_big_traversals = true;
+    }
+
+    PyObject *exc_type = NULL;
+    std::string exc_message;
+
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        hashtable->partition->do_partition_parallel(n_threads,
+                break_on_stop_tags,
+                stop_big_traversals);
+    } catch (std::bad_alloc &exc) {
+        exc_type = PyExc_MemoryError;
+    } catch (khmer_exception &exc) {
+        exc_type = PyExc_RuntimeError;
+        exc_message = exc.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (exc_type) {
+        PyErr_SetString(exc_type, exc_message.c_str());
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
 static
 PyObject *
 hashtable_join_partitions_by_path(khmer_KHashtable_Object * me, PyObject * args)
@@ -1773,7 +2224,7 @@ hashtable_get_tagset(khmer_KHashtable_Object * me, PyObject * args)
     }
 
     WordLength k = hashtable->ksize();
-    SeenSet::const_iterator si;
+    ConcurrentTagSet::const_iterator si;
 
     PyObject * x = PyList_New(hashtable->all_tags.size());
     unsigned long long i = 0;
@@ -2447,6 +2898,27 @@ static PyMethodDef khmer_hashtable_methods[] = {
         "Returns the k-mer size of this graph."
     },
     { "hashsizes", (PyCFunction)hashtable_get_hashsizes, METH_VARARGS, "" },
+    {
+        "n_tables", (PyCFunction)hashtable_get_n_tables, METH_VARARGS,
+        "Return the number of hash functions (counters per k-mer)."
+    },
+    {
+        "get_use_fastrange", (PyCFunction)hashtable_get_use_fastrange,
+        METH_VARARGS,
+        "Return True if the tables use fastrange rather than modulo-prime "
+        "indexing."
+    },
+    {
+        "set_prefetch_distance",
+        (PyCFunction)hashtable_set_prefetch_distance, METH_VARARGS,
+        "Set how many k-mers ahead consume and the median functions "
+        "prefetch table entries; 0 turns prefetching off."
+    },
+    {
+        "get_prefetch_distance",
+        (PyCFunction)hashtable_get_prefetch_distance, METH_VARARGS,
+        "Get how many k-mers ahead table entries are prefetched."
+    },
     {
         "n_unique_kmers",
         (PyCFunction)hashtable_n_unique_kmers, METH_VARARGS,
@@ -2468,14 +2940,16 @@ static PyMethodDef khmer_hashtable_methods[] = {
     },
     {
         "consume_fasta",
-        (PyCFunction)hashtable_consume_fasta, METH_VARARGS,
+        (PyCFunction)hashtable_consume_fasta, METH_VARARGS | METH_KEYWORDS,
         "Incrment the counts of all the k-mers in the sequences in the "
-        "given file"
+        "given file, using the optional number of worker threads."
     },
     {
         "consume_fasta_with_reads_parser",
-        (PyCFunction)hashtable_consume_fasta_with_reads_parser, METH_VARARGS,
-        "Count all k-mers retrieved with this reads parser object."
+        (PyCFunction)hashtable_consume_fasta_with_reads_parser,
+        METH_VARARGS | METH_KEYWORDS,
+        "Count all k-mers retrieved with this reads parser object, using "
+        "the optional number of worker threads."
     },
     {
         "get",
@@ -2484,13 +2958,29 @@ static PyMethodDef khmer_hashtable_methods[] = {
     },
     {
         "load",
-        (PyCFunction)hashtable_load, METH_VARARGS,
-        "Load the graph from the specified file."
+        (PyCFunction)hashtable_load, METH_VARARGS | METH_KEYWORDS,
+        "Load the graph from the specified file. With mmap_mode 'r' or "
+        "'c', the tables of a page-aligned file are mapped from it "
+        "read-only or copy-on-write instead of read; the blocks of a "
+        "chunked file are decompressed on the given number of threads."
     },
     {
         "save",
-        (PyCFunction)hashtable_save, METH_VARARGS,
-        "Save the graph to the specified file."
+        (PyCFunction)hashtable_save, METH_VARARGS | METH_KEYWORDS,
+        "Save the graph to the specified file; page_aligned=True saves it "
+        "so that load can map the tables."
+    },
+    {
+        "save_chunked",
+        (PyCFunction)hashtable_save_chunked, METH_VARARGS | METH_KEYWORDS,
+        "Save the graph to the specified file with its tables split into "
+        "blocks compressed separately with codec ('zlib' or 'none') on "
+        "the given number of threads."
+    },
+    {
+        "is_read_only",
+        (PyCFunction)hashtable_is_read_only, METH_VARARGS,
+        "Were the tables mapped read-only by load?"
     },
     {
         "get_median_count",
@@ -2544,6 +3034,7 @@ static PyMethodDef khmer_hashtable_methods[] = {
     { "consume_fasta_and_tag", (PyCFunction)hashtable_consume_fasta_and_tag, METH_VARARGS, "Count all k-mers in a given file" },
     { "get_median_count", (PyCFunction)hashtable_get_median_count, METH_VARARGS, "Get the median, average, and stddev of the k-mer counts in the string" },
     { "median_at_least", (PyCFunction)hashtable_median_at_least, METH_VARARGS, "Return true if the median is at least the given cutoff" },
+    { "consume_if_median_below", (PyCFunction)hashtable_consume_if_median_below, METH_VARARGS, "Count all k-mers in the given string if its median is below the given cutoff, and return whether it did" },
     { "extract_unique_paths", (PyCFunction)hashtable_extract_unique_paths, METH_VARARGS, "" },
     { "print_tagset", (PyCFunction)hashtable_print_tagset, METH_VARARGS, "" },
     { "add_tag", (PyCFunction)hashtable_add_tag, METH_VARARGS, "" },
@@ -2557,6 +3048,12 @@ static PyMethodDef khmer_hashtable_methods[] = {
 
     // partitioning
     { "do_subset_partition", (PyCFunction)hashtable_do_subset_partition, METH_VARARGS, "" },
+    {
+        "do_partition",
+        (PyCFunction)hashtable_do_partition, METH_VARARGS | METH_KEYWORDS,
+        "Partition all of the tags into the graph's own partition map, "
+        "using the optional number of threads."
+    },
     { "find_all_tags", (PyCFunction)hashtable_find_all_tags, METH_VARARGS, "" },
     { "assign_partition_id", (PyCFunction)hashtable_assign_partition_id, METH_VARARGS, "" },
     { "output_partitions", (PyCFunction)hashtable_output_partitions, METH_VARARGS, "" },
@@ -2796,13 +3293,13 @@ count_get_raw_tables(khmer_KCountingHash_Object * self, PyObject * args)
     CountingHash * counting = self->counting;
 
     khmer::Byte ** table_ptrs = counting->get_raw_tables();
-    std::vector<HashIntoType> sizes = counting->get_tablesizes();
+    std::vector<HashIntoType> sizes = counting->get_raw_table_sizes();
 
     PyObject * raw_tables = PyList_New(sizes.size());
     for (unsigned int i=0; i<sizes.size(); ++i) {
         Py_buffer buffer;
-        int res = PyBuffer_FillInfo(&buffer, NULL, table_ptrs[i], sizes[i], 0,
-                                    PyBUF_FULL_RO);
+        int res = PyBuffer_FillInfo(&buffer, NULL, table_ptrs[i], sizes[i],
+                                    counting->is_read_only(), PyBUF_FULL_RO);
         if (res == -1) {
             return NULL;
         }
@@ -2830,7 +3327,12 @@ count_set_use_bigcount(khmer_KCountingHash_Object * me, PyObject * args)
     if (setme < 0) {
         return NULL;
     }
-    counting->set_use_bigcount((bool)setme);
+    try {
+        counting->set_use_bigcount((bool)setme);
+    } catch (khmer_value_exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
 
     Py_RETURN_NONE;
 }
@@ -2850,6 +3352,19 @@ count_get_use_bigcount(khmer_KCountingHash_Object * me, PyObject * args)
     return PyBool_FromLong((int)val);
 }
 
+static
+PyObject *
+count_get_counter_bits(khmer_KCountingHash_Object * me, PyObject * args)
+{
+    CountingHash * counting = me->counting;
+
+    if (!PyArg_ParseTuple(args, "")) {
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLong(counting->get_counter_bits());
+}
+
 static
 PyObject *
 count_get_min_count(khmer_KCountingHash_Object * me, PyObject * args)
@@ -3040,34 +3555,32 @@ count_abundance_distribution(khmer_KCountingHash_Object * me, PyObject * args)
 
     const char * filename = NULL;
     khmer_KHashbits_Object * tracking_obj = NULL;
-    if (!PyArg_ParseTuple(args, "sO!", &filename, &khmer_KNodegraph_Type,
-                          &tracking_obj)) {
+    unsigned int n_threads = 1;
+    if (!PyArg_ParseTuple(args, "sO!|I", &filename, &khmer_KNodegraph_Type,
+                          &tracking_obj, &n_threads)) {
         return NULL;
     }
 
     Hashbits           *hashbits        = tracking_obj->hashbits;
     HashIntoType       *dist            = NULL;
-    const char         *value_exception = NULL;
-    const char         *file_exception  = NULL;
+    // the message is copied; the exception is gone once it has been caught.
+    PyObject           *exc_type        = NULL;
+    std::string         exc_message;
     Py_BEGIN_ALLOW_THREADS
     try {
-        dist = counting->abundance_distribution(filename, hashbits);
+        dist = counting->abundance_distribution(filename, hashbits,
+                                                n_threads);
     } catch (khmer_file_exception &exc) {
-        file_exception = exc.what();
+        exc_type = PyExc_OSError;
+        exc_message = exc.what();
     } catch (khmer_value_exception &exc) {
-        value_exception = exc.what();
+        exc_type = PyExc_ValueError;
+        exc_message = exc.what();
     }
     Py_END_ALLOW_THREADS
 
-    if (file_exception != NULL) {
-        PyErr_SetString(PyExc_OSError, file_exception);
-        if (dist != NULL) {
-            delete []dist;
-        }
-        return NULL;
-    }
-    if (value_exception != NULL) {
-        PyErr_SetString(PyExc_ValueError, value_exception);
+    if (exc_type != NULL) {
+        PyErr_SetString(exc_type, exc_message.c_str());
         if (dist != NULL) {
             delete []dist;
         }
@@ -3150,6 +3663,10 @@ count_do_subset_partition_with_abundance(khmer_KCountingHash_Object * me,
 static PyMethodDef khmer_counting_methods[] = {
     { "set_use_bigcount", (PyCFunction)count_set_use_bigcount, METH_VARARGS, "" },
     { "get_use_bigcount", (PyCFunction)count_get_use_bigcount, METH_VARARGS, "" },
+    {
+        "get_counter_bits", (PyCFunction)count_get_counter_bits,
+        METH_VARARGS, "Get the width of the counters in bits."
+    },
     { "output_fasta_kmer_pos_freq", (PyCFunction)count_output_fasta_kmer_pos_freq, METH_VARARGS, "" },
     { "get_min_count", (PyCFunction)count_get_min_count, METH_VARARGS, "Get the smallest count of all the k-mers in the string" },
     { "get_max_count", (PyCFunction)count_get_max_count, METH_VARARGS, "Get the largest count of all the k-mers in the string" },
@@ -3216,6 +3733,33 @@ CPYCHECKER_TYPE_OBJECT_FOR_TYPEDEF("khmer_KCountingHash_Object")
 
 #define is_counting_obj(v)  (Py_TYPE(v) == &khmer_KCountgraph_Type)
 
+// convert a list of table sizes for a Countgraph; on error, set the Python
+// exception and return false.
+static bool convert_counting_sizes(PyListObject * sizes_list_o,
+                                   std::vector<HashIntoType> &sizes)
+{
+    Py_ssize_t sizes_list_o_length = PyList_GET_SIZE(sizes_list_o);
+    if (sizes_list_o_length == -1) {
+        PyErr_SetString(PyExc_ValueError, "error with hashtable primes!");
+        return false;
+    }
+    for (Py_ssize_t i = 0; i < sizes_list_o_length; i++) {
+        PyObject * size_o = PyList_GET_ITEM(sizes_list_o, i);
+        if (PyLong_Check(size_o)) {
+            sizes.push_back((HashIntoType) PyLong_AsUnsignedLongLong(size_o));
+        } else if (PyInt_Check(size_o)) {
+            sizes.push_back((HashIntoType) PyInt_AsLong(size_o));
+        } else if (PyFloat_Check(size_o)) {
+            sizes.push_back((HashIntoType) PyFloat_AS_DOUBLE(size_o));
+        } else {
+            PyErr_SetString(PyExc_TypeError,
+                            "2nd argument must be a list of ints, longs, or floats");
+            return false;
+        }
+    }
+    return true;
+}
+
 //
 // _new_counting_hash
 //
@@ -3230,37 +3774,200 @@ static PyObject* _new_counting_hash(PyTypeObject * type, PyObject * args,
     if (self != NULL) {
         WordLength k = 0;
         PyListObject * sizes_list_o = NULL;
+        PyObject * fastrange_o = NULL;
+
+        if (!PyArg_ParseTuple(args, "bO!|O", &k, &PyList_Type, &sizes_list_o,
+                              &fastrange_o)) {
+            Py_DECREF(self);
+            return NULL;
+        }
+        bool fastrange = fastrange_o != NULL && PyObject_IsTrue(fastrange_o);
+
+        std::vector<HashIntoType> sizes;
+        if (!convert_counting_sizes(sizes_list_o, sizes)) {
+            Py_DECREF(self);
+            return NULL;
+        }
+
+        try {
+            self->counting = new CountingHash(k, sizes, fastrange);
+        } catch (std::bad_alloc &e) {
+            Py_DECREF(self);
+            return PyErr_NoMemory();
+        }
+        self->khashtable.hashtable = dynamic_cast<Hashtable*>(self->counting);
+    }
+
+    return (PyObject *) self;
+}
+
+static PyObject* _new_blocked_counting_hash(PyTypeObject * type,
+        PyObject * args, PyObject * kwds);
+
+static PyTypeObject khmer_KBlockedCountgraph_Type
+CPYCHECKER_TYPE_OBJECT_FOR_TYPEDEF("khmer_KCountingHash_Object")
+= {
+    PyVarObject_HEAD_INIT(NULL, 0)       /* init & ob_size */
+    "_khmer.BlockedCountgraph",          /*tp_name*/
+    sizeof(khmer_KCountingHash_Object),  /*tp_basicsize*/
+    0,                                   /*tp_itemsize*/
+    (destructor)khmer_counting_dealloc,  /*tp_dealloc*/
+    0,                                   /*tp_print*/
+    0,                                   /*tp_getattr*/
+    0,                                   /*tp_setattr*/
+    0,                                   /*tp_compare*/
+    0,                                   /*tp_repr*/
+    0,                                   /*tp_as_number*/
+    0,                                   /*tp_as_sequence*/
+    0,                                   /*tp_as_mapping*/
+    0,                                   /*tp_hash */
+    0,                                   /*tp_call*/
+    0,                                   /*tp_str*/
+    0,                                   /*tp_getattro*/
+    0,                                   /*tp_setattro*/
+    0,                                   /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,                  /*tp_flags*/
+    "counting hash object with cache-line blocked counters", /* tp_doc */
+    0,                                   /* tp_traverse */
+    0,                                   /* tp_clear */
+    0,                                   /* tp_richcompare */
+    0,                                   /* tp_weaklistoffset */
+    0,                                   /* tp_iter */
+    0,                                   /* tp_iternext */
+    0,                                   /* tp_methods */
+    0,                                   /* tp_members */
+    0,                                   /* tp_getset */
+    0,                                   /* tp_base */
+    0,                                   /* tp_dict */
+    0,                                   /* tp_descr_get */
+    0,                                   /* tp_descr_set */
+    0,                                   /* tp_dictoffset */
+    0,                                   /* tp_init */
+    0,                                   /* tp_alloc */
+    _new_blocked_counting_hash,          /* tp_new */
+};
+
+//
+// _new_blocked_counting_hash
+//
+
+static PyObject* _new_blocked_counting_hash(PyTypeObject * type,
+        PyObject * args, PyObject * kwds)
+{
+    khmer_KCountingHash_Object * self;
+
+    self = (khmer_KCountingHash_Object *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        WordLength k = 0;
+        unsigned long long tablesize = 0;
+        unsigned int n_tables = 0;
+
+        if (!PyArg_ParseTuple(args, "bKI", &k, &tablesize, &n_tables)) {
+            Py_DECREF(self);
+            return NULL;
+        }
+
+        try {
+            self->counting = new BlockedCountingHash(k, tablesize, n_tables);
+        } catch (khmer_value_exception &e) {
+            Py_DECREF(self);
+            PyErr_SetString(PyExc_ValueError, e.what());
+            return NULL;
+        } catch (std::bad_alloc &e) {
+            Py_DECREF(self);
+            return PyErr_NoMemory();
+        }
+        self->khashtable.hashtable = dynamic_cast<Hashtable*>(self->counting);
+    }
+
+    return (PyObject *) self;
+}
+
+static PyObject* _new_packed_counting_hash(PyTypeObject * type,
+        PyObject * args, PyObject * kwds);
+
+static PyTypeObject khmer_KPackedCountgraph_Type
+CPYCHECKER_TYPE_OBJECT_FOR_TYPEDEF("khmer_KCountingHash_Object")
+= {
+    PyVarObject_HEAD_INIT(NULL, 0)       /* init & ob_size */
+    "_khmer.PackedCountgraph",           /*tp_name*/
+    sizeof(khmer_KCountingHash_Object),  /*tp_basicsize*/
+    0,                                   /*tp_itemsize*/
+    (destructor)khmer_counting_dealloc,  /*tp_dealloc*/
+    0,                                   /*tp_print*/
+    0,                                   /*tp_getattr*/
+    0,                                   /*tp_setattr*/
+    0,                                   /*tp_compare*/
+    0,                                   /*tp_repr*/
+    0,                                   /*tp_as_number*/
+    0,                                   /*tp_as_sequence*/
+    0,                                   /*tp_as_mapping*/
+    0,                                   /*tp_hash */
+    0,                                   /*tp_call*/
+    0,                                   /*tp_str*/
+    0,                                   /*tp_getattro*/
+    0,                                   /*tp_setattro*/
+    0,                                   /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,                  /*tp_flags*/
+    "counting hash object with 4-bit or 2-bit counters", /* tp_doc */
+    0,                                   /* tp_traverse */
+    0,                                   /* tp_clear */
+    0,                                   /* tp_richcompare */
+    0,                                   /* tp_weaklistoffset */
+    0,                                   /* tp_iter */
+    0,                                   /* tp_iternext */
+    0,                                   /* tp_methods */
+    0,                                   /* tp_members */
+    0,                                   /* tp_getset */
+    0,                                   /* tp_base */
+    0,                                   /* tp_dict */
+    0,                                   /* tp_descr_get */
+    0,                                   /* tp_descr_set */
+    0,                                   /* tp_dictoffset */
+    0,                                   /* tp_init */
+    0,                                   /* tp_alloc */
+    _new_packed_counting_hash,           /* tp_new */
+};
+
+//
+// _new_packed_counting_hash: k, the table sizes, the counter width and
+// optionally fastrange.
+//
+
+static PyObject* _new_packed_counting_hash(PyTypeObject * type,
+        PyObject * args, PyObject * kwds)
+{
+    khmer_KCountingHash_Object * self;
+
+    self = (khmer_KCountingHash_Object *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        WordLength k = 0;
+        PyListObject * sizes_list_o = NULL;
+        unsigned int counter_bits = 0;
+        PyObject * fastrange_o = NULL;
 
-        if (!PyArg_ParseTuple(args, "bO!", &k, &PyList_Type, &sizes_list_o)) {
+        if (!PyArg_ParseTuple(args, "bO!I|O", &k, &PyList_Type, &sizes_list_o,
+                              &counter_bits, &fastrange_o)) {
             Py_DECREF(self);
             return NULL;
         }
+        bool fastrange = fastrange_o != NULL && PyObject_IsTrue(fastrange_o);
 
         std::vector<HashIntoType> sizes;
-        Py_ssize_t sizes_list_o_length = PyList_GET_SIZE(sizes_list_o);
-        if (sizes_list_o_length == -1) {
+        if (!convert_counting_sizes(sizes_list_o, sizes)) {
             Py_DECREF(self);
-            PyErr_SetString(PyExc_ValueError, "error with hashtable primes!");
             return NULL;
         }
-        for (Py_ssize_t i = 0; i < sizes_list_o_length; i++) {
-            PyObject * size_o = PyList_GET_ITEM(sizes_list_o, i);
-            if (PyLong_Check(size_o)) {
-                sizes.push_back((HashIntoType) PyLong_AsUnsignedLongLong(size_o));
-            } else if (PyInt_Check(size_o)) {
-                sizes.push_back((HashIntoType) PyInt_AsLong(size_o));
-            } else if (PyFloat_Check(size_o)) {
-                sizes.push_back((HashIntoType) PyFloat_AS_DOUBLE(size_o));
-            } else {
-                Py_DECREF(self);
-                PyErr_SetString(PyExc_TypeError,
-                                "2nd argument must be a list of ints, longs, or floats");
-                return NULL;
-            }
-        }
 
         try {
-            self->counting = new CountingHash(k, sizes);
+            self->counting = new PackedCountingHash(k, sizes, counter_bits,
+                                                    fastrange);
+        } catch (khmer_value_exception &e) {
+            Py_DECREF(self);
+            PyErr_SetString(PyExc_ValueError, e.what());
+            return NULL;
         } catch (std::bad_alloc &e) {
             Py_DECREF(self);
             return PyErr_NoMemory();
@@ -3307,8 +4014,8 @@ hashbits_get_raw_tables(khmer_KHashbits_Object * self, PyObject * args)
     PyObject * raw_tables = PyList_New(sizes.size());
     for (unsigned int i=0; i<sizes.size(); ++i) {
         Py_buffer buffer;
-        int res = PyBuffer_FillInfo(&buffer, NULL, table_ptrs[i], sizes[i], 0,
-                                    PyBUF_FULL_RO);
+        int res = PyBuffer_FillInfo(&buffer, NULL, table_ptrs[i], sizes[i],
+                                    counting->is_read_only(), PyBUF_FULL_RO);
         if (res == -1) {
             return NULL;
         }
@@ -3349,11 +4056,14 @@ static PyObject* khmer_hashbits_new(PyTypeObject * type, PyObject * args,
     if (self != NULL) {
         WordLength k = 0;
         PyListObject* sizes_list_o = NULL;
+        PyObject * fastrange_o = NULL;
 
-        if (!PyArg_ParseTuple(args, "bO!", &k, &PyList_Type, &sizes_list_o)) {
+        if (!PyArg_ParseTuple(args, "bO!|O", &k, &PyList_Type, &sizes_list_o,
+                              &fastrange_o)) {
             Py_DECREF(self);
             return NULL;
         }
+        bool fastrange = fastrange_o != NULL && PyObject_IsTrue(fastrange_o);
 
         std::vector<HashIntoType> sizes;
         Py_ssize_t sizes_list_o_length = PyList_GET_SIZE(sizes_list_o);
@@ -3374,7 +4084,7 @@ static PyObject* khmer_hashbits_new(PyTypeObject * type, PyObject * args,
         }
 
         try {
-            self->hashbits = new Hashbits(k, sizes);
+            self->hashbits = new Hashbits(k, sizes, fastrange);
         } catch (std::bad_alloc &e) {
             Py_DECREF(self);
             return PyErr_NoMemory();
@@ -3386,6 +4096,85 @@ static PyObject* khmer_hashbits_new(PyTypeObject * type, PyObject * args,
 
 #define is_hashbits_obj(v)  (Py_TYPE(v) == &khmer_KNodegraph_Type)
 
+static PyObject* khmer_blocked_hashbits_new(PyTypeObject * type,
+        PyObject * args, PyObject * kwds);
+
+static PyTypeObject khmer_KBlockedNodegraph_Type
+CPYCHECKER_TYPE_OBJECT_FOR_TYPEDEF("khmer_KHashbits_Object")
+= {
+    PyVarObject_HEAD_INIT(NULL, 0) /* init & ob_size */
+    "_khmer.BlockedNodegraph",      /* tp_name */
+    sizeof(khmer_KHashbits_Object), /* tp_basicsize */
+    0,                             /* tp_itemsize */
+    (destructor)khmer_hashbits_dealloc, /*tp_dealloc*/
+    0,              /*tp_print*/
+    0,              /*tp_getattr*/
+    0,              /*tp_setattr*/
+    0,              /*tp_compare*/
+    0,              /*tp_repr*/
+    0,              /*tp_as_number*/
+    0,              /*tp_as_sequence*/
+    0,              /*tp_as_mapping*/
+    0,              /*tp_hash */
+    0,              /*tp_call*/
+    0,              /*tp_str*/
+    0,              /*tp_getattro*/
+    0,              /*tp_setattro*/
+    0,              /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,       /*tp_flags*/
+    "hashbits object with cache-line blocked bits", /* tp_doc */
+    0,                       /* tp_traverse */
+    0,                       /* tp_clear */
+    0,                       /* tp_richcompare */
+    0,                       /* tp_weaklistoffset */
+    0,                       /* tp_iter */
+    0,                       /* tp_iternext */
+    0,                       /* tp_methods */
+    0,                       /* tp_members */
+    0,                       /* tp_getset */
+    0,                       /* tp_base */
+    0,                       /* tp_dict */
+    0,                       /* tp_descr_get */
+    0,                       /* tp_descr_set */
+    0,                       /* tp_dictoffset */
+    0,                       /* tp_init */
+    0,                       /* tp_alloc */
+    khmer_blocked_hashbits_new,          /* tp_new */
+};
+
+// __new__ for blocked hashbits: k, the table size in bits, and the number
+// of bits per k-mer.
+static PyObject* khmer_blocked_hashbits_new(PyTypeObject * type,
+        PyObject * args, PyObject * kwds)
+{
+    khmer_KHashbits_Object * self;
+    self = (khmer_KHashbits_Object *)type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        WordLength k = 0;
+        unsigned long long tablesize = 0;
+        unsigned int n_tables = 0;
+
+        if (!PyArg_ParseTuple(args, "bKI", &k, &tablesize, &n_tables)) {
+            Py_DECREF(self);
+            return NULL;
+        }
+
+        try {
+            self->hashbits = new BlockedHashbits(k, tablesize, n_tables);
+        } catch (khmer_value_exception &e) {
+            Py_DECREF(self);
+            PyErr_SetString(PyExc_ValueError, e.what());
+            return NULL;
+        } catch (std::bad_alloc &e) {
+            Py_DECREF(self);
+            return PyErr_NoMemory();
+        }
+        self->khashtable.hashtable = self->hashbits;
+    }
+    return (PyObject *) self;
+}
+
 ////////////////////////////////////////////////////////////////////////////
 
 static
@@ -4057,8 +4846,13 @@ hashtable_traverse_from_tags(khmer_KHashtable_Object * me, PyObject * args)
         return NULL;
     }
 
-    hashtable->traverse_from_tags(distance, threshold, frequency,
-                                  * counting_o->counting);
+    try {
+        hashtable->traverse_from_tags(distance, threshold, frequency,
+                                      * counting_o->counting);
+    } catch (khmer_value_exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
 
     Py_RETURN_NONE;
 }
@@ -4873,6 +5667,324 @@ get_version_cpp( PyObject * self, PyObject * args )
 }
 
 
+static
+PyObject *
+read_chunked_table(PyObject * self, PyObject * args)
+{
+    const char * filename = NULL;
+    unsigned int index = 0;
+    unsigned int n_threads = 1;
+
+    if (!PyArg_ParseTuple(args, "sI|I", &filename, &index, &n_threads)) {
+        return NULL;
+    }
+    if (n_threads == 0) {
+        PyErr_SetString(PyExc_ValueError, "threads must be at least 1");
+        return NULL;
+    }
+
+    PyObject * table = NULL;
+    try {
+        ChunkedFileReader chunks(filename);
+        if (index >= chunks.n_sections()) {
+            PyErr_SetString(PyExc_ValueError, "no such table in the file");
+            return NULL;
+        }
+        table = PyBytes_FromStringAndSize(NULL, chunks.section_bytes(index));
+        if (table == NULL) {
+            return NULL;
+        }
+        chunks.read_section(index, (Byte *) PyBytes_AS_STRING(table),
+                            n_threads);
+    } catch (khmer_file_exception &e) {
+        Py_XDECREF(table);
+        PyErr_SetString(PyExc_OSError, e.what());
+        return NULL;
+    } catch (khmer_value_exception &e) {
+        Py_XDECREF(table);
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
+
+    return table;
+}
+
+static
+PyObject *
+merge_graph_files(PyObject * self, PyObject * args)
+{
+    const char * outfilename = NULL;
+    PyListObject * infilenames_o = NULL;
+    unsigned long long block_size = DEFAULT_MERGE_BLOCK_SIZE;
+
+    if (!PyArg_ParseTuple(args, "sO!|K", &outfilename, &PyList_Type,
+                          &infilenames_o, &block_size)) {
+        return NULL;
+    }
+
+    std::vector<std::string> infilenames;
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(infilenames_o); i++) {
+        PyObject * name_o = PyList_GET_ITEM(infilenames_o, i);
+        if (PyUnicode_Check(name_o)) {
+            PyObject * encoded = PyUnicode_AsEncodedString(name_o, "utf-8",
+                                 "strict");
+            if (encoded == NULL) {
+                return NULL;
+            }
+            infilenames.push_back(PyBytes_AsString(encoded));
+            Py_DECREF(encoded);
+        } else if (PyBytes_Check(name_o)) {
+            infilenames.push_back(PyBytes_AsString(name_o));
+        } else {
+            PyErr_SetString(PyExc_TypeError,
+                            "2nd argument must be a list of file names");
+            return NULL;
+        }
+    }
+
+    PyObject * exc_type = NULL;
+    std::string exc_message;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        GraphFileMerger::merge(infilenames, outfilename, block_size);
+    } catch (khmer_file_exception &e) {
+        exc_type = PyExc_OSError;
+        exc_message = e.what();
+    } catch (khmer_value_exception &e) {
+        exc_type = PyExc_ValueError;
+        exc_message = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (exc_type != NULL) {
+        PyErr_SetString(exc_type, exc_message.c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// A Python file object that a FastxWriter writes to. write() is called with
+// bytes, or with str if it will not take bytes (as sys.stdout would not),
+// holding the GIL, which the caller has released. An exception it raises
+// is kept for the caller to restore once it holds the GIL again.
+struct PythonFileSink {
+    PyObject *  file;
+    bool        text;
+    PyObject *  error_type;
+    PyObject *  error_value;
+    PyObject *  error_traceback;
+
+    explicit PythonFileSink(PyObject * file)
+        : file(file), text(false), error_type(NULL), error_value(NULL),
+          error_traceback(NULL) {}
+
+    // restore a kept exception, returning whether there was one.
+    bool restore_error()
+    {
+        if (error_type == NULL) {
+            return false;
+        }
+        PyErr_Restore(error_type, error_value, error_traceback);
+        error_type = error_value = error_traceback = NULL;
+        return true;
+    }
+};
+
+static
+void
+_write_to_python_file(const char * data, size_t length, void * write_data)
+{
+    PythonFileSink * sink = (PythonFileSink *)write_data;
+    PyGILState_STATE gil = PyGILState_Ensure();
+
+    PyObject * result = NULL;
+    if (!sink->text) {
+        PyObject * bytes = PyBytes_FromStringAndSize(data, length);
+        if (bytes != NULL) {
+            result = PyObject_CallMethod(sink->file, "write", "O", bytes);
+            Py_DECREF(bytes);
+        }
+        if (result == NULL && PyErr_ExceptionMatches(PyExc_TypeError)) {
+            PyErr_Clear();
+            sink->text = true;
+        }
+    }
+    if (sink->text) {
+        PyObject * text = PyUnicode_DecodeUTF8(data, length, "strict");
+        if (text != NULL) {
+            result = PyObject_CallMethod(sink->file, "write", "O", text);
+            Py_DECREF(text);
+        }
+    }
+
+    bool failed = result == NULL;
+    if (failed) {
+        PyErr_Fetch(&sink->error_type, &sink->error_value,
+                    &sink->error_traceback);
+    }
+    Py_XDECREF(result);
+    PyGILState_Release(gil);
+
+    if (failed) {
+        throw khmer_file_exception("Could not write reads to a Python file");
+    }
+}
+
+// Run write_paired_reads over 'pairs', from parsers opened in the caller;
+// a NULL second sink means the pairs are interleaved in the first.
+static
+PyObject *
+_write_paired_reads(PairedReadStream &pairs, PythonFileSink &first_sink,
+                    PythonFileSink * second_sink, PythonFileSink * orphan_sink)
+{
+    FastxWriter first(_write_to_python_file, &first_sink);
+    FastxWriter * second = NULL;
+    FastxWriter * orphans = NULL;
+    if (second_sink != NULL) {
+        second = new FastxWriter(_write_to_python_file, second_sink);
+    }
+    if (orphan_sink != NULL) {
+        orphans = new FastxWriter(_write_to_python_file, orphan_sink);
+    }
+
+    uint64_t n_pairs = 0, n_orphans = 0;
+    PyObject * exc_type = NULL;
+    std::string exc_message;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        write_paired_reads(pairs, first, second ? *second : first, orphans,
+                           n_pairs, n_orphans);
+    } catch (khmer_file_exception &e) {
+        exc_type = PyExc_OSError;
+        exc_message = e.what();
+    } catch (khmer_value_exception &e) {
+        exc_type = PyExc_ValueError;
+        exc_message = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    delete second;
+    delete orphans;
+
+    // an exception raised by a file comes first; the rest stem from it.
+    if (first_sink.restore_error()
+            || (second_sink && second_sink->restore_error())
+            || (orphan_sink && orphan_sink->restore_error())) {
+        return NULL;
+    }
+    if (exc_type != NULL) {
+        PyErr_SetString(exc_type, exc_message.c_str());
+        return NULL;
+    }
+    return Py_BuildValue("KK", (unsigned long long) n_pairs,
+                         (unsigned long long) n_orphans);
+}
+
+static
+PyObject *
+interleave_reads(PyObject * self, PyObject * args)
+{
+    const char * left_filename = NULL;
+    const char * right_filename = NULL;
+    PyObject * outfile = NULL;
+    PyObject * reformat_o = Py_True;
+
+    if (!PyArg_ParseTuple(args, "ssO|O", &left_filename, &right_filename,
+                          &outfile, &reformat_o)) {
+        return NULL;
+    }
+    int reformat = PyObject_IsTrue(reformat_o);
+    if (reformat < 0) {
+        return NULL;
+    }
+
+    IParser * left = NULL;
+    IParser * right = NULL;
+    PyObject * exc_type = NULL;
+    std::string exc_message;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        left = IParser::get_parser(left_filename);
+        right = IParser::get_parser(right_filename);
+    } catch (khmer_file_exception &e) {
+        exc_type = PyExc_OSError;
+        exc_message = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (exc_type != NULL) {
+        delete left;
+        PyErr_SetString(exc_type, exc_message.c_str());
+        return NULL;
+    }
+
+    PairedReadStream pairs(left, right, reformat);
+    PythonFileSink sink(outfile);
+    PyObject * counts = _write_paired_reads(pairs, sink, NULL, NULL);
+    delete left;
+    delete right;
+
+    if (counts == NULL) {
+        return NULL;
+    }
+    PyObject * n_pairs = PyTuple_GetItem(counts, 0);
+    Py_INCREF(n_pairs);
+    Py_DECREF(counts);
+    return n_pairs;
+}
+
+static
+PyObject *
+paired_reads_to_files(PyObject * self, PyObject * args)
+{
+    const char * filename = NULL;
+    PyObject * first_file = NULL;
+    PyObject * second_file = Py_None;
+    PyObject * orphan_file = Py_None;
+    int pair_mode = IParser::PAIR_MODE_ALLOW_UNPAIRED;
+
+    if (!PyArg_ParseTuple(args, "sO|OOi", &filename, &first_file,
+                          &second_file, &orphan_file, &pair_mode)) {
+        return NULL;
+    }
+    if (pair_mode == IParser::PAIR_MODE_ALLOW_UNPAIRED
+            && orphan_file == Py_None) {
+        PyErr_SetString(PyExc_ValueError,
+                        "PAIR_MODE_ALLOW_UNPAIRED needs a file for orphans");
+        return NULL;
+    }
+
+    IParser * parser = NULL;
+    PyObject * exc_type = NULL;
+    std::string exc_message;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        parser = IParser::get_parser(filename);
+    } catch (khmer_file_exception &e) {
+        exc_type = PyExc_OSError;
+        exc_message = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (exc_type != NULL) {
+        PyErr_SetString(exc_type, exc_message.c_str());
+        return NULL;
+    }
+
+    PyObject * counts = NULL;
+    try {
+        PairedReadStream pairs(parser, pair_mode);
+        PythonFileSink first_sink(first_file);
+        PythonFileSink second_sink(second_file);
+        PythonFileSink orphan_sink(orphan_file);
+        bool interleaved = second_file == Py_None || second_file == first_file;
+        counts = _write_paired_reads(
+                     pairs, first_sink, interleaved ? NULL : &second_sink,
+                     orphan_file == Py_None ? NULL : &orphan_sink);
+    } catch (UnknownPairReadingMode &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+    }
+    delete parser;
+    return counts;
+}
+
 //
 // Module machinery.
 //
@@ -4908,6 +6020,33 @@ static PyMethodDef KhmerMethods[] = {
         "get_version_cpp", get_version_cpp,
         METH_VARARGS, "return the VERSION c++ compiler option"
     },
+    {
+        "read_chunked_table", read_chunked_table,
+        METH_VARARGS,
+        "Read one table of a chunked graph file, decompressing only its "
+        "blocks; the bigcounts of a countgraph follow its tables.",
+    },
+    {
+        "merge_graph_files", merge_graph_files,
+        METH_VARARGS,
+        "Merge saved countgraphs or nodegraphs of the same type and shape "
+        "into a new file, a block of each table at a time.",
+    },
+    {
+        "interleave_reads", interleave_reads,
+        METH_VARARGS,
+        "Write each read of one file and the read of another in the same "
+        "place to a file object as a pair, optionally adding /1 and /2 to "
+        "their names and checking that they pair; returns the number of "
+        "pairs.",
+    },
+    {
+        "paired_reads_to_files", paired_reads_to_files,
+        METH_VARARGS,
+        "Write the pairs of reads of an interleaved file to one or two file "
+        "objects and its orphans to another, in a ReadParser pair mode; "
+        "returns the numbers of pairs and of orphans.",
+    },
     { NULL, NULL, 0, NULL } // sentinel
 };
 
@@ -4924,6 +6063,16 @@ MOD_INIT(_khmer)
         return MOD_ERROR_VAL;
     }
 
+    khmer_KBlockedCountgraph_Type.tp_base = &khmer_KCountgraph_Type;
+    if (PyType_Ready(&khmer_KBlockedCountgraph_Type) < 0) {
+        return MOD_ERROR_VAL;
+    }
+
+    khmer_KPackedCountgraph_Type.tp_base = &khmer_KCountgraph_Type;
+    if (PyType_Ready(&khmer_KPackedCountgraph_Type) < 0) {
+        return MOD_ERROR_VAL;
+    }
+
     if (PyType_Ready(&khmer_PrePartitionInfo_Type) < 0) {
         return MOD_ERROR_VAL;
     }
@@ -4939,6 +6088,11 @@ MOD_INIT(_khmer)
         return MOD_ERROR_VAL;
     }
 
+    khmer_KBlockedNodegraph_Type.tp_base = &khmer_KNodegraph_Type;
+    if (PyType_Ready(&khmer_KBlockedNodegraph_Type) < 0) {
+        return MOD_ERROR_VAL;
+    }
+
     khmer_KGraphLabels_Type.tp_base = &khmer_KNodegraph_Type;
     khmer_KGraphLabels_Type.tp_methods = khmer_graphlabels_methods;
     khmer_KGraphLabels_Type.tp_new = khmer_graphlabels_new;
@@ -4966,6 +6120,10 @@ MOD_INIT(_khmer)
         return MOD_ERROR_VAL;
     }
 
+    if (PyType_Ready(&khmer_ReadBatchIterator_Type ) < 0) {
+        return MOD_ERROR_VAL;
+    }
+
     PyObject * m;
 
     MOD_DEF(m, "_khmer", "interface for the khmer module low-level extensions",
@@ -4987,12 +6145,30 @@ MOD_INIT(_khmer)
         return MOD_ERROR_VAL;
     }
 
+    Py_INCREF(&khmer_KBlockedCountgraph_Type);
+    if (PyModule_AddObject( m, "BlockedCountgraph",
+                            (PyObject *)&khmer_KBlockedCountgraph_Type ) < 0) {
+        return MOD_ERROR_VAL;
+    }
+
+    Py_INCREF(&khmer_KPackedCountgraph_Type);
+    if (PyModule_AddObject( m, "PackedCountgraph",
+                            (PyObject *)&khmer_KPackedCountgraph_Type ) < 0) {
+        return MOD_ERROR_VAL;
+    }
+
     Py_INCREF(&khmer_KNodegraph_Type);
     if (PyModule_AddObject(m, "Nodegraph",
                            (PyObject *)&khmer_KNodegraph_Type) < 0) {
         return MOD_ERROR_VAL;
     }
 
+    Py_INCREF(&khmer_KBlockedNodegraph_Type);
+    if (PyModule_AddObject(m, "BlockedNodegraph",
+                           (PyObject *)&khmer_KBlockedNodegraph_Type) < 0) {
+        return MOD_ERROR_VAL;
+    }
+
     Py_INCREF(&khmer_KGraphLabels_Type);
     if (PyModule_AddObject(m, "GraphLabels",
                            (PyObject *)&khmer_KGraphLabels_Type) < 0) {
@@ -297,6 +297,16 @@ def build_graph_args(descr=None, epilog=None, parser=None):
     parser.add_argument('--fp-rate', type=float, default=None,
                         help="Override the automatic FP rate setting for the"
                         " current script")
+    parser.add_argument('--blocked-tables', default=False,
+                        action='store_true',
+                        help='keep all of the entries for a k-mer in one '
+                        'cache line; faster, at the cost of a slightly '
+                        'higher false positive rate')
+    parser.add_argument('--fastrange-tables', default=False,
+                        action='store_true',
+                        help='pick table entries with a multiply rather than '
+                        'a division by a prime table size; faster, with the '
+                        'same false positive rate')
 
     group = parser.add_mutually_exclusive_group()
     group.add_argument('--max-tablesize', '-x', type=float,
@@ -313,6 +323,11 @@ def build_graph_args(descr=None, epilog=None, parser=None):
 def build_counting_args(descr=None, epilog=None):
     """Build an ArgumentParser with args for countgraph based scripts."""
     parser = build_graph_args(descr=descr, epilog=epilog)
+    parser.add_argument('--counter-bits', type=int, default=8,
+                        choices=[8, 4, 2],
+                        help='width of the k-mer counters; 4-bit counters '
+                        'stop at 15 and 2-bit ones at 3, but fit two or four '
+                        'times as many counters into the same memory')
 
     return parser
 
@@ -338,7 +353,7 @@ def calculate_graphsize(args, graphtype, multiplier=1.0):
     if args.max_memory_usage:
         if graphtype == 'countgraph':
             tablesize = args.max_memory_usage / args.n_tables / \
-                float(multiplier)
+                float(multiplier) * 8 / getattr(args, 'counter_bits', 8)
         elif graphtype == 'nodegraph':
             tablesize = 8. * args.max_memory_usage / args.n_tables / \
                 float(multiplier)
@@ -358,7 +373,14 @@ def create_nodegraph(args, ksize=None, multiplier=1.0, fp_rate=0.01):
         sys.exit(1)
 
     tablesize = calculate_graphsize(args, 'nodegraph', multiplier)
-    return khmer.Nodegraph(ksize, tablesize, args.n_tables)
+    if getattr(args, 'blocked_tables', False):
+        if getattr(args, 'fastrange_tables', False):
+            print_error("\n** ERROR: blocked tables pick their blocks by a "
+                        "hash of their own; drop --fastrange-tables.\n")
+            sys.exit(1)
+        return khmer.BlockedNodegraph(ksize, tablesize, args.n_tables)
+    return khmer.Nodegraph(ksize, tablesize, args.n_tables,
+                           getattr(args, 'fastrange_tables', False))
 
 
 def create_countgraph(args, ksize=None, multiplier=1.0, fp_rate=0.1):
@@ -371,7 +393,23 @@ def create_countgraph(args, ksize=None, multiplier=1.0, fp_rate=0.1):
         sys.exit(1)
 
     tablesize = calculate_graphsize(args, 'countgraph', multiplier=multiplier)
-    return khmer.Countgraph(ksize, tablesize, args.n_tables)
+    counter_bits = getattr(args, 'counter_bits', 8)
+    if getattr(args, 'blocked_tables', False):
+        if getattr(args, 'fastrange_tables', False):
+            print_error("\n** ERROR: blocked tables pick their blocks by a "
+                        "hash of their own; drop --fastrange-tables.\n")
+            sys.exit(1)
+        if counter_bits != 8:
+            print_error("\n** ERROR: blocked tables only have 8-bit "
+                        "counters.\n")
+            sys.exit(1)
+        return khmer.BlockedCountgraph(ksize, tablesize, args.n_tables)
+    if counter_bits != 8:
+        return khmer.PackedCountgraph(ksize, tablesize, args.n_tables,
+                                      counter_bits,
+                                      getattr(args, 'fastrange_tables', False))
+    return khmer.Countgraph(ksize, tablesize, args.n_tables,
+                            getattr(args, 'fastrange_tables', False))
 
 
 def report_on_config(args, graphtype='countgraph'):
@@ -394,8 +432,9 @@ def report_on_config(args, graphtype='countgraph'):
     if graphtype == 'countgraph':
         log_info(
             "Estimated memory usage is {0:.2g} bytes "
-            "(n_tables x max_tablesize)".format(
-                args.n_tables * tablesize))
+            "(n_tables x max_tablesize x counter_bits / 8)".format(
+                args.n_tables * tablesize *
+                getattr(args, 'counter_bits', 8) / 8))
     elif graphtype == 'nodegraph':
         log_info(
             "Estimated memory usage is {0:.2g} bytes "
@@ -0,0 +1,175 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Contention on the bigcounts: T threads each add n_ops counts to k-mers
+// drawn from a small hot set, as when many threads consume reads from a
+// few very abundant sequences. Compares the old single spin lock around a
+// std::map with BigCountMap, then runs threaded consume_string on a
+// CountingHash with bigcount on.
+//
+// Usage: bench-bigcount [n_hot [n_ops]]
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bigcount.hh"
+#include "counting.hh"
+#include "khmer.hh"
+
+using namespace khmer;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// the bigcount store as it was: one spin lock around a std::map.
+class LockedMap
+{
+    std::map<HashIntoType, BoundedCounterType> _map;
+    uint32_t _lock;
+public:
+    LockedMap() : _lock(0) {}
+
+    void increment(HashIntoType khash, BoundedCounterType start_count,
+                   BoundedCounterType max_count)
+    {
+        while (!__sync_bool_compare_and_swap(&_lock, 0, 1));
+        if (_map[khash] == 0) {
+            _map[khash] = start_count;
+        } else if (_map[khash] < max_count) {
+            _map[khash] += 1;
+        }
+        __sync_bool_compare_and_swap(&_lock, 1, 0);
+    }
+};
+
+template <typename Map>
+static double run_threads(Map &map, unsigned int n_threads, size_t n_ops,
+                          const std::vector<HashIntoType> &hot)
+{
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (unsigned int t = 0; t < n_threads; t++) {
+        threads.push_back(std::thread([&map, &hot, n_ops, t]() {
+            size_t j = t * 7919;
+            for (size_t i = 0; i < n_ops; i++) {
+                j = (j * 1103515245 + 12345) % hot.size();
+                map.increment(hot[j], MAX_KCOUNT + 1, MAX_BIGCOUNT);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    return seconds_since(start);
+}
+
+int main(int argc, char ** argv)
+{
+    size_t n_hot = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t n_ops = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    const unsigned int thread_counts[] = { 1, 16, 32, 64 };
+    const size_t n_runs = sizeof(thread_counts) / sizeof(thread_counts[0]);
+
+    srand(1);
+    std::vector<HashIntoType> hot(n_hot);
+    for (size_t i = 0; i < n_hot; i++) {
+        hot[i] = ((HashIntoType) rand() << 32) ^ rand();
+    }
+
+    std::cout << n_hot << " hot k-mers, " << n_ops << " counts per thread"
+              << std::endl;
+    for (size_t r = 0; r < n_runs; r++) {
+        unsigned int n_threads = thread_counts[r];
+
+        LockedMap locked;
+        double locked_time = run_threads(locked, n_threads, n_ops, hot);
+        BigCountMap sharded;
+        double sharded_time = run_threads(sharded, n_threads, n_ops, hot);
+
+        double total = (double) n_threads * n_ops / 1e6;
+        std::cout << n_threads << " threads: spin-locked map "
+                  << total / locked_time << " M/s, BigCountMap "
+                  << total / sharded_time << " M/s" << std::endl;
+    }
+
+    // a few hundred abundant reads, counted over and over.
+    std::vector<std::string> reads(500);
+    for (size_t i = 0; i < reads.size(); i++) {
+        for (size_t j = 0; j < 150; j++) {
+            reads[i] += "ACGT"[rand() % 4];
+        }
+    }
+    for (size_t r = 0; r < n_runs; r++) {
+        unsigned int n_threads = thread_counts[r];
+        CountingHash ht(31, 1000003);
+        ht.set_use_bigcount(true);
+
+        std::vector<std::thread> threads;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (unsigned int t = 0; t < n_threads; t++) {
+            threads.push_back(std::thread([&ht, &reads]() {
+                for (size_t pass = 0; pass < 20; pass++) {
+                    for (size_t i = 0; i < reads.size(); i++) {
+                        ht.consume_string(reads[i]);
+                    }
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+        double elapsed = seconds_since(start);
+
+        double n_kmers = (double) n_threads * 20 * reads.size() * 120;
+        std::cout << n_threads << " threads: consume_string with bigcount "
+                  << n_kmers / elapsed / 1e6 << " M k-mers/s" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Threaded consume_fasta throughput for 1, 2, 4, ... up to max_threads
+// worker threads, each run on a fresh countgraph.
+//
+// Usage: bench-consume reads.fq [max_threads [tablesize [n_tables]]]
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "counting.hh"
+#include "khmer.hh"
+
+using namespace khmer;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0]
+                  << " reads.fq [max_threads [tablesize [n_tables]]]"
+                  << std::endl;
+        return 1;
+    }
+    unsigned int max_threads = argc > 2 ? atoi(argv[2]) : 32;
+    HashIntoType tablesize = argc > 3 ? strtoull(argv[3], NULL, 10) :
+                             64000000;
+    unsigned int n_tables = argc > 4 ? atoi(argv[4]) : 4;
+
+    std::vector<HashIntoType> sizes(n_tables, tablesize);
+    double base_rate = 0;
+    for (unsigned int n_threads = 1; n_threads <= max_threads;
+            n_threads *= 2) {
+        CountingHash ht(25, sizes);
+        unsigned int total_reads = 0;
+        unsigned long long n_consumed = 0;
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        ht.consume_fasta(argv[1], total_reads, n_consumed, n_threads);
+        double rate = n_consumed / seconds_since(start) / 1e6;
+        if (n_threads == 1) {
+            base_rate = rate;
+        }
+
+        std::cout << n_threads << " threads: " << total_reads << " reads, "
+                  << rate << " M k-mers/s (" << rate / base_rate << "x)"
+                  << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2010-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Compare the table-driven / vectorized 2-bit encoding used by KmerIterator
+// against the per-base comparison chains it replaced, and KmerIterator
+// against hashing a whole read at once into a KmerHashBlock.
+//
+// Usage: bench-kmer-hash [n_reads [read_length [k]]]
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "khmer.hh"
+#include "kmer_hash.hh"
+
+using namespace khmer;
+
+#define legacy_twobit_repr(ch) ((ch) == 'A' ? 0LL : \
+                                (ch) == 'T' ? 1LL : \
+                                (ch) == 'C' ? 2LL : 3LL)
+#define legacy_twobit_comp(ch) ((ch) == 'A' ? 1LL : \
+                                (ch) == 'T' ? 0LL : \
+                                (ch) == 'C' ? 3LL : 2LL)
+
+static HashIntoType legacy_consume(const std::string &s, WordLength k)
+{
+    HashIntoType bitmask = 0;
+    for (WordLength i = 0; i < k; i++) {
+        bitmask = (bitmask << 2) | 3;
+    }
+    const unsigned int nbits_sub_1 = k * 2 - 2;
+
+    HashIntoType f = 0, r = 0, sum = 0;
+    for (size_t i = 0; i < s.length(); i++) {
+        const char ch = s[i];
+        f = ((f << 2) | legacy_twobit_repr(ch)) & bitmask;
+        r = (r >> 2) | (legacy_twobit_comp(ch) << nbits_sub_1);
+        if (i + 1 >= k) {
+            sum += uniqify_rc(f, r);
+        }
+    }
+    return sum;
+}
+
+static HashIntoType iterator_consume(const std::string &s, WordLength k)
+{
+    HashIntoType sum = 0;
+    KmerIterator kmers(s.c_str(), k);
+    while (!kmers.done()) {
+        sum += kmers.next();
+    }
+    return sum;
+}
+
+static HashIntoType block_consume(const std::string &s, WordLength k)
+{
+    HashIntoType sum = 0;
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(s, k);
+    for (size_t i = 0; i < kmers.size(); i++) {
+        sum += kmers[i];
+    }
+    return sum;
+}
+
+// normalize-by-median walks each read once for the median check and once
+// more to consume it; with a block, it hashes the read once and uses the
+// block for both.
+static HashIntoType iterator_consume_twice(const std::string &s, WordLength k)
+{
+    return iterator_consume(s, k) + iterator_consume(s, k);
+}
+
+static HashIntoType block_consume_twice(const std::string &s, WordLength k)
+{
+    HashIntoType sum = 0;
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(s, k);
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < kmers.size(); i++) {
+            sum += kmers[i];
+        }
+    }
+    return sum;
+}
+
+template <typename Fn>
+static void run(const char * label, Fn fn,
+                const std::vector<std::string> &reads, WordLength k,
+                size_t n_bases)
+{
+    HashIntoType check = 0;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads.size(); i++) {
+        check += fn(reads[i], k);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << label << ": " << elapsed.count() << " s, "
+              << (n_bases / elapsed.count() / 1e6) << " Mbp/s"
+              << " (checksum " << check << ")" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    size_t n_reads = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t read_length = argc > 2 ? strtoul(argv[2], NULL, 10) : 150;
+    WordLength k = argc > 3 ? atoi(argv[3]) : 31;
+
+    const char bases[] = "ACGT";
+    std::vector<std::string> reads(n_reads);
+    srand(1);
+    for (size_t i = 0; i < n_reads; i++) {
+        reads[i].resize(read_length);
+        for (size_t j = 0; j < read_length; j++) {
+            reads[i][j] = bases[rand() & 3];
+        }
+    }
+    const size_t n_bases = n_reads * read_length;
+
+    std::cout << n_reads << " reads of " << read_length << " bp, k = "
+              << (unsigned int) k << std::endl;
+    run("comparison chains", legacy_consume, reads, k, n_bases);
+    run("KmerIterator     ", iterator_consume, reads, k, n_bases);
+    run("KmerHashBlock    ", block_consume, reads, k, n_bases);
+    run("KmerIterator x2  ", iterator_consume_twice, reads, k, n_bases);
+    run("KmerHashBlock x2 ", block_consume_twice, reads, k, n_bases);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2010-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Compare read_pair_name_end, which IParser uses to tell whether two reads
+// make a pair, against the POSIX regexes it replaced: first that they agree
+// on a set of awkward names, then how long each takes over many names.
+//
+// Usage: bench-pair-names [n_names]
+
+#include <regex.h>
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "read_parsers.hh"
+
+using namespace khmer::read_parsers;
+
+static const char * const awkward_names[] = {
+    "", "/1", "a/1", "a/2", "a/1/2", "a/2/1", "read/1 extra", "read/10",
+    "read /1", "read 1:N:0:ACGT", "read 2:Y:18:ACGT", "read 1:N:0:",
+    "read 1:N::ACGT", "read 1:X:0:ACGT", "read 1:N:0:1", "read 1:N:0:AC1",
+    " 1:N:0:ACGT", "x 1:N:0:ACGT", "read 1:N:0:ACGT/1", "read/1 1:N:0:ACGT",
+    "read 1:N:0:ACGT 1:N:0:TG", "read 1:N:0:AC 1:Y:123:ACGTACGT",
+    "read 1:N:0:ACGT/2", "read  1:N:0:ACGT", "read 1:N:007:acgtNN",
+    "895:1:1:1246:14654 1:N:0:NNNNN", "895:1:1:1246:14654 2:N:0:NNNNN",
+    "SRR/1 1:N:0", "r/1/1", "r//1", "r 1 1:N:0:A", "r\t1:N:0:A",
+};
+
+static size_t regex_end(regex_t &re, const std::string &name)
+{
+    regmatch_t match;
+    if (regexec(&re, name.c_str(), 1, &match, 0)) {
+        return 0;
+    }
+    return match.rm_eo;
+}
+
+template <typename Fn>
+static void run(const char * label, Fn fn,
+                const std::vector<std::string> &names)
+{
+    size_t check = 0;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (size_t i = 0; i < names.size(); i++) {
+        check += fn(names[i], i & 1 ? '2' : '1');
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << label << ": " << elapsed.count() << " s, "
+              << (names.size() / elapsed.count() / 1e6) << " M names/s"
+              << " (checksum " << check << ")" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    size_t n_names = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    regex_t re_read_1, re_read_2;
+    if (regcomp(&re_read_1,
+                "^.+(/1| 1:[YN]:[[:digit:]]+:[[:alpha:]]+).{0}",
+                REG_EXTENDED)
+            || regcomp(&re_read_2,
+                       "^.+(/2| 2:[YN]:[[:digit:]]+:[[:alpha:]]+).{0}",
+                       REG_EXTENDED)) {
+        std::cerr << "could not compile the regexes" << std::endl;
+        return 1;
+    }
+
+    int mismatches = 0;
+    for (size_t i = 0; i < sizeof(awkward_names) / sizeof(*awkward_names);
+            i++) {
+        const std::string name = awkward_names[i];
+        size_t expected[2] = {
+            regex_end(re_read_1, name), regex_end(re_read_2, name)
+        };
+        size_t got[2] = {
+            read_pair_name_end(name, '1'), read_pair_name_end(name, '2')
+        };
+        for (int mate = 0; mate < 2; mate++) {
+            if (expected[mate] != got[mate]) {
+                std::cerr << "mismatch for '" << name << "', mate "
+                          << (mate + 1) << ": regex " << expected[mate]
+                          << ", read_pair_name_end " << got[mate] << std::endl;
+                mismatches++;
+            }
+        }
+    }
+    if (mismatches) {
+        return 1;
+    }
+
+    // Alternate Casava 1.8 and old Illumina names, as in interleaved files.
+    std::vector<std::string> names(n_names);
+    for (size_t i = 0; i < n_names; i++) {
+        std::string id = "HWI-ST1234:112:C0A4RACXX:1:1101:"
+                         + std::to_string(1000 + i % 20000) + ":"
+                         + std::to_string(2000 + i);
+        char mate = i & 1 ? '2' : '1';
+        if ((i >> 1) & 1) {
+            names[i] = id + " " + mate + ":N:0:ATCACG";
+        } else {
+            names[i] = id + "/" + mate;
+        }
+    }
+
+    std::cout << n_names << " names" << std::endl;
+    run("regexec           ", [&](const std::string &name, char mate) {
+        return regex_end(mate == '1' ? re_read_1 : re_read_2, name);
+    }, names);
+    run("read_pair_name_end", [](const std::string &name, char mate) {
+        return read_pair_name_end(name, mate);
+    }, names);
+
+    regfree(&re_read_1);
+    regfree(&re_read_2);
+    return 0;
+}
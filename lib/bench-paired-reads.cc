@@ -0,0 +1,144 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Throughput of the paired-read engine behind split-paired-reads.py and
+// extract-paired-reads.py: pairing the reads of an interleaved file with
+// PairedReadStream and writing them out with FastxWriters, in GB/s of the
+// file and in M reads/s, the best of n_runs passes run after one to warm
+// the page cache. The output goes to out_file, or is only counted if none
+// is given.
+//
+// Usage: bench-paired-reads reads.fq [n_runs [out_file]]
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+
+#include "khmer.hh"
+#include "read_parsers.hh"
+
+using namespace khmer;
+using namespace khmer::read_parsers;
+
+static void write_fd(const char * data, size_t length, void * fd)
+{
+    while (length) {
+        ssize_t n = write(*(int *)fd, data, length);
+        if (n < 0) {
+            throw khmer_file_exception("write failed");
+        }
+        data += n;
+        length -= n;
+    }
+}
+
+static void count_bytes(const char * data, size_t length, void * n_bytes)
+{
+    *(uint64_t *)n_bytes += length;
+}
+
+static double split_file(const char * filename, const char * out_filename,
+                         uint64_t &n_pairs, uint64_t &n_orphans)
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    int fd = -1;
+    uint64_t n_bytes = 0;
+    FastxWriter::WriteFn write_fn = count_bytes;
+    void * write_data = &n_bytes;
+    if (out_filename) {
+        fd = open(out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw khmer_file_exception("cannot open output file");
+        }
+        write_fn = write_fd;
+        write_data = &fd;
+    }
+
+    IParser * parser = IParser::get_parser(filename);
+    PairedReadStream pairs(parser);
+    FastxWriter left(write_fn, write_data);
+    FastxWriter right(write_fn, write_data);
+    FastxWriter orphans(write_fn, write_data);
+    write_paired_reads(pairs, left, right, &orphans, n_pairs, n_orphans);
+    delete parser;
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " reads.fq [n_runs [out_file]]"
+                  << std::endl;
+        return 1;
+    }
+    const char * filename = argv[1];
+    unsigned int n_runs = argc > 2 ? atoi(argv[2]) : 3;
+    const char * out_filename = argc > 3 ? argv[3] : NULL;
+
+    struct stat info;
+    if (stat(filename, &info)) {
+        std::cerr << "cannot stat " << filename << std::endl;
+        return 1;
+    }
+    double file_gb = info.st_size / 1e9;
+
+    uint64_t n_pairs, n_orphans;
+    double best = split_file(filename, out_filename, n_pairs, n_orphans);
+    for (unsigned int run = 0; run < n_runs; run++) {
+        double seconds = split_file(filename, out_filename, n_pairs,
+                                    n_orphans);
+        best = seconds < best ? seconds : best;
+    }
+
+    uint64_t n_reads = 2 * n_pairs + n_orphans;
+    std::cout << n_pairs << " pairs, " << n_orphans << " orphans, "
+              << file_gb / best << " GB/s, " << n_reads / best / 1e6
+              << " M reads/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Parsing throughput of FastxParser and SeqAnParser, in GB/s of the file as
+// it is on disk and in M reads/s, each the best of n_runs passes over the
+// file, run once first to warm the page cache. FastxParser inflates BGZF
+// files on n_threads threads, or one per CPU if it is 0.
+//
+// Usage: bench-parse reads.fq [n_runs [batch_size [n_threads]]]
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "khmer.hh"
+#include "read_parsers.hh"
+
+using namespace khmer;
+using namespace khmer::read_parsers;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// read every read of the file a batch at a time, returning the seconds
+// taken and adding up the bases read.
+static double parse_file(std::function<IParser * ()> open_parser,
+                         size_t batch_size, size_t &n_reads,
+                         unsigned long long &n_bases)
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    IParser * parser = open_parser();
+    std::vector<Read> reads;
+    size_t n;
+    n_reads = 0;
+    n_bases = 0;
+    while ((n = parser->imprint_next_read_batch(reads, batch_size))) {
+        for (size_t i = 0; i < n; i++) {
+            n_bases += reads[i].sequence.length();
+        }
+        n_reads += n;
+    }
+    delete parser;
+    return seconds_since(start);
+}
+
+static void bench(const char * name, std::function<IParser * ()> open_parser,
+                  double file_gb, unsigned int n_runs, size_t batch_size)
+{
+    size_t n_reads;
+    unsigned long long n_bases;
+    double best = parse_file(open_parser, batch_size, n_reads, n_bases);
+    for (unsigned int run = 0; run < n_runs; run++) {
+        double seconds = parse_file(open_parser, batch_size, n_reads,
+                                    n_bases);
+        best = seconds < best ? seconds : best;
+    }
+
+    std::cout << name << ": " << n_reads << " reads, " << n_bases
+              << " bases, " << file_gb / best << " GB/s, "
+              << n_reads / best / 1e6 << " M reads/s" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0]
+                  << " reads.fq [n_runs [batch_size [n_threads]]]"
+                  << std::endl;
+        return 1;
+    }
+    const char * filename = argv[1];
+    unsigned int n_runs = argc > 2 ? atoi(argv[2]) : 3;
+    size_t batch_size = argc > 3 ? strtoull(argv[3], NULL, 10) :
+                        DEFAULT_READ_BATCH_SIZE;
+    unsigned int n_threads = argc > 4 ? atoi(argv[4]) : 0;
+
+    struct stat info;
+    if (stat(filename, &info)) {
+        std::cerr << "cannot stat " << filename << std::endl;
+        return 1;
+    }
+    double file_gb = info.st_size / 1e9;
+
+    bench("FastxParser", [=]() -> IParser * {
+        return new FastxParser(filename, DEFAULT_PARSER_BUFFER_SIZE,
+                               n_threads);
+    }, file_gb, n_runs, batch_size);
+    bench("SeqAnParser", [=]() -> IParser * {
+        return new SeqAnParser(filename);
+    }, file_gb, n_runs, batch_size);
+
+    return 0;
+}
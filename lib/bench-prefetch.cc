@@ -0,0 +1,141 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2010-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Compare consume_string and get_median_count with and without the
+// prefetching batch engine, for each table type, on tables much larger
+// than the cache.
+//
+// Usage: bench-prefetch [tablesize [n_tables [n_reads]]]
+//
+// tablesize is per table, as for the Countgraph constructor; the blocked
+// tables get tablesize * n_tables entries, and the nodegraphs eight times as
+// many entries, i.e. the same memory as the countgraphs.
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "counting.hh"
+#include "hashbits.hh"
+#include "khmer.hh"
+
+using namespace khmer;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// each distance gets a fresh table from make_table.
+template <typename MakeTable>
+static void run(const char * label, MakeTable make_table,
+                const std::vector<std::string> &reads)
+{
+    const unsigned int distances[] = { 0, 4, 8, 16, 32 };
+
+    for (size_t d = 0; d < sizeof(distances) / sizeof(distances[0]); d++) {
+        auto * ht = make_table();
+        ht->set_prefetch_distance(distances[d]);
+
+        size_t n_kmers = 0;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (size_t i = 0; i < reads.size(); i++) {
+            n_kmers += ht->consume_string(reads[i]);
+        }
+        double consume_time = seconds_since(start);
+
+        BoundedCounterType median;
+        float average, stddev, total = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < reads.size(); i++) {
+            ht->get_median_count(reads[i], median, average, stddev);
+            total += average;
+        }
+        double median_time = seconds_since(start);
+
+        std::cout << label << " distance " << distances[d] << ": consume "
+                  << (n_kmers / consume_time / 1e6) << " M/s, median "
+                  << (n_kmers / median_time / 1e6) << " M/s (average "
+                  << total / reads.size() << ")" << std::endl;
+        delete ht;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    HashIntoType tablesize = argc > 1 ? strtoull(argv[1], NULL, 10) :
+                             64000000;
+    unsigned int n_tables = argc > 2 ? atoi(argv[2]) : 4;
+    size_t n_reads = argc > 3 ? strtoul(argv[3], NULL, 10) : 200000;
+
+    srand(1);
+    std::vector<std::string> reads(n_reads);
+    for (size_t i = 0; i < n_reads; i++) {
+        for (size_t j = 0; j < 150; j++) {
+            reads[i] += "ACGT"[rand() % 4];
+        }
+    }
+
+    std::cout << n_reads << " reads, " << n_tables << " x " << tablesize
+              << " bytes" << std::endl;
+    std::vector<HashIntoType> sizes(n_tables, tablesize);
+    std::vector<HashIntoType> bit_sizes(n_tables, tablesize * 8);
+
+    run("CountingHash       ", [&]() {
+        return new CountingHash(31, sizes);
+    }, reads);
+    run("CountingHash, fr   ", [&]() {
+        return new CountingHash(31, sizes, true);
+    }, reads);
+    run("BlockedCountingHash", [&]() {
+        return new BlockedCountingHash(31, tablesize * n_tables, n_tables);
+    }, reads);
+    run("Hashbits           ", [&]() {
+        return new Hashbits(31, bit_sizes);
+    }, reads);
+    run("BlockedHashbits    ", [&]() {
+        return new BlockedHashbits(31, tablesize * 8 * n_tables, n_tables);
+    }, reads);
+
+    return 0;
+}
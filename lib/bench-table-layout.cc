@@ -0,0 +1,202 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2010-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Compare the classic layouts of CountingHash and Hashbits (one prime-sized
+// table per hash function, indexed modulo-prime or with fastrange) against
+// BlockedCountingHash and BlockedHashbits (all of a k-mer's entries in one
+// cache line) and 4-bit PackedCountingHash at the same memory: update
+// and lookup throughput on tables much larger than the cache, and how often
+// each layout overcounts k-mers that were seen or reports k-mers that were
+// not.
+//
+// Usage: bench-table-layout [tablesize [n_tables [n_kmers]]]
+//
+// tablesize is per table, as for the Countgraph constructor; the blocked
+// tables get tablesize * n_tables entries and the 4-bit tables twice
+// tablesize. The nodegraphs get eight times as many entries, i.e. the same
+// memory as the countgraphs.
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "counting.hh"
+#include "hashbits.hh"
+#include "khmer.hh"
+
+using namespace khmer;
+
+static bool is_prime(HashIntoType n)
+{
+    if (n < 2) {
+        return false;
+    }
+    for (HashIntoType d = 2; d * d <= n; d++) {
+        if (n % d == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<HashIntoType> primes_below(HashIntoType target,
+        unsigned int n)
+{
+    std::vector<HashIntoType> primes;
+    for (HashIntoType i = target - 1; primes.size() < n && i > 1; i--) {
+        if (is_prime(i)) {
+            primes.push_back(i);
+        }
+    }
+    return primes;
+}
+
+// a 31-mer hash; the low bits of a random number are as good as any.
+static HashIntoType random_kmer()
+{
+    HashIntoType x = ((HashIntoType) rand() << 31) ^ rand();
+    return ((x << 31) ^ rand()) & ((1ULL << 62) - 1);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// k-mer i is counted (i % 4) + 1 times; absent holds k-mers never counted.
+static void run(const char * label, Hashtable &ht,
+                const std::vector<HashIntoType> &kmers,
+                const std::vector<HashIntoType> &absent)
+{
+    size_t n_updates = 0;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (unsigned int round = 0; round < 4; round++) {
+        for (size_t i = 0; i < kmers.size(); i++) {
+            if (i % 4 >= round) {
+                ht.count(kmers[i]);
+                n_updates++;
+            }
+        }
+    }
+    double count_time = seconds_since(start);
+
+    // a nodegraph only records presence.
+    const bool presence = dynamic_cast<Hashbits *>(&ht) != NULL;
+    size_t n_over = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kmers.size(); i++) {
+        BoundedCounterType expected = presence ? 1 : (i % 4) + 1;
+        if (ht.get_count(kmers[i]) > expected) {
+            n_over++;
+        }
+    }
+    double get_time = seconds_since(start);
+
+    size_t n_false = 0;
+    for (size_t i = 0; i < absent.size(); i++) {
+        if (ht.get_count(absent[i])) {
+            n_false++;
+        }
+    }
+
+    std::cout << label << ": count " << (n_updates / count_time / 1e6)
+              << " M/s, get " << (kmers.size() / get_time / 1e6)
+              << " M/s, overcounted " << ((double) n_over / kmers.size())
+              << ", false positives " << ((double) n_false / absent.size())
+              << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    HashIntoType tablesize = argc > 1 ? strtoull(argv[1], NULL, 10) :
+                             64000000;
+    unsigned int n_tables = argc > 2 ? atoi(argv[2]) : 4;
+    size_t n_kmers = argc > 3 ? strtoul(argv[3], NULL, 10) : tablesize / 4;
+
+    srand(1);
+    std::vector<HashIntoType> kmers(n_kmers), absent(n_kmers);
+    for (size_t i = 0; i < n_kmers; i++) {
+        kmers[i] = random_kmer();
+        absent[i] = random_kmer();
+    }
+
+    std::cout << n_kmers << " k-mers, " << n_tables << " x " << tablesize
+              << " bytes" << std::endl;
+    {
+        std::vector<HashIntoType> sizes = primes_below(tablesize, n_tables);
+        CountingHash ht(31, sizes);
+        run("CountingHash       ", ht, kmers, absent);
+    }
+    {
+        std::vector<HashIntoType> sizes(n_tables, tablesize);
+        CountingHash ht(31, sizes, true);
+        run("CountingHash, fr   ", ht, kmers, absent);
+    }
+    {
+        BlockedCountingHash ht(31, tablesize * n_tables, n_tables);
+        run("BlockedCountingHash", ht, kmers, absent);
+    }
+    {
+        std::vector<HashIntoType> sizes = primes_below(tablesize * 2,
+                                          n_tables);
+        PackedCountingHash ht(31, sizes, 4);
+        run("CountingHash, 4-bit", ht, kmers, absent);
+    }
+    {
+        std::vector<HashIntoType> sizes = primes_below(tablesize * 8,
+                                          n_tables);
+        Hashbits ht(31, sizes);
+        run("Hashbits           ", ht, kmers, absent);
+    }
+    {
+        std::vector<HashIntoType> sizes(n_tables, tablesize * 8);
+        Hashbits ht(31, sizes, true);
+        run("Hashbits, fr       ", ht, kmers, absent);
+    }
+    {
+        BlockedHashbits ht(31, tablesize * 8 * n_tables, n_tables);
+        run("BlockedHashbits    ", ht, kmers, absent);
+    }
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2010-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Compare tagging reads and looking up their counts with a virtual call
+// for each k-mer against consume_sequence_and_tag and get_kmer_counts,
+// which make one call to the table for a batch of k-mers, for each table
+// type.
+//
+// Usage: bench-tagging [tablesize [n_tables [n_reads]]]
+//
+// tablesize is per table, as for the Countgraph constructor; the blocked
+// tables get tablesize * n_tables entries, and the nodegraphs eight times as
+// many entries, i.e. the same memory as the countgraphs.
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "counting.hh"
+#include "hashbits.hh"
+#include "khmer.hh"
+
+using namespace khmer;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// the loop of consume_sequence_and_tag, one k-mer at a time. Not inlined,
+// so that the calls go through the vtable as they used to.
+__attribute__((noinline))
+static void tag_one_at_a_time(Hashtable * ht, const std::string &seq,
+                              unsigned long long &n_consumed)
+{
+    KmerIterator kmers(seq.c_str(), ht->ksize());
+    const unsigned int density = ht->_get_tag_density();
+    unsigned int since = density / 2 + 1;
+    HashIntoType kmer = 0;
+
+    while (!kmers.done()) {
+        kmer = kmers.next();
+        if (ht->test_and_set_bits(kmer)) {
+            ++n_consumed;
+            ++since;
+        } else if (set_contains(ht->all_tags, kmer)) {
+            since = 1;
+        } else {
+            ++since;
+        }
+        if (since >= density) {
+            ht->add_tag(kmer);
+            since = 1;
+        }
+    }
+    if (since >= density / 2 - 1) {
+        ht->add_tag(kmer);
+    }
+}
+
+__attribute__((noinline))
+static unsigned long long count_one_at_a_time(const Hashtable * ht,
+        const std::string &seq)
+{
+    unsigned long long total = 0;
+    KmerIterator kmers(seq.c_str(), ht->ksize());
+    while (!kmers.done()) {
+        total += ht->get_count(kmers.next());
+    }
+    return total;
+}
+
+// each run gets two fresh tables from make_table.
+template <typename MakeTable>
+static void run(const char * label, MakeTable make_table,
+                const std::vector<std::string> &reads)
+{
+    size_t n_kmers = 0;
+    for (size_t i = 0; i < reads.size(); i++) {
+        n_kmers += reads[i].length() - 31 + 1;
+    }
+
+    auto * ht = make_table();
+    unsigned long long n_consumed = 0;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads.size(); i++) {
+        tag_one_at_a_time(ht, reads[i], n_consumed);
+    }
+    double single_tag_time = seconds_since(start);
+
+    unsigned long long total = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads.size(); i++) {
+        total += count_one_at_a_time(ht, reads[i]);
+    }
+    double single_count_time = seconds_since(start);
+    delete ht;
+
+    ht = make_table();
+    n_consumed = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads.size(); i++) {
+        ht->consume_sequence_and_tag(reads[i], n_consumed);
+    }
+    double batch_tag_time = seconds_since(start);
+
+    unsigned long long batch_total = 0;
+    std::vector<BoundedCounterType> counts;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads.size(); i++) {
+        counts.clear();
+        ht->get_kmer_counts(reads[i], counts);
+        for (size_t j = 0; j < counts.size(); j++) {
+            batch_total += counts[j];
+        }
+    }
+    double batch_count_time = seconds_since(start);
+
+    std::cout << label << ": tag " << (n_kmers / single_tag_time / 1e6)
+              << " -> " << (n_kmers / batch_tag_time / 1e6)
+              << " M/s, get_count " << (n_kmers / single_count_time / 1e6)
+              << " -> " << (n_kmers / batch_count_time / 1e6) << " M/s ("
+              << ht->n_tags() << " tags, " << total << " = " << batch_total
+              << ")" << std::endl;
+    delete ht;
+}
+
+int main(int argc, char ** argv)
+{
+    HashIntoType tablesize = argc > 1 ? strtoull(argv[1], NULL, 10) :
+                             64000000;
+    unsigned int n_tables = argc > 2 ? atoi(argv[2]) : 4;
+    size_t n_reads = argc > 3 ? strtoul(argv[3], NULL, 10) : 200000;
+
+    srand(1);
+    std::vector<std::string> reads(n_reads);
+    for (size_t i = 0; i < n_reads; i++) {
+        for (size_t j = 0; j < 150; j++) {
+            reads[i] += "ACGT"[rand() % 4];
+        }
+    }
+
+    std::cout << n_reads << " reads, " << n_tables << " x " << tablesize
+              << " bytes; one k-mer at a time -> batched" << std::endl;
+    std::vector<HashIntoType> sizes(n_tables, tablesize);
+    std::vector<HashIntoType> bit_sizes(n_tables, tablesize * 8);
+
+    run("CountingHash       ", [&]() {
+        return new CountingHash(31, sizes);
+    }, reads);
+    run("BlockedCountingHash", [&]() {
+        return new BlockedCountingHash(31, tablesize * n_tables, n_tables);
+    }, reads);
+    run("Hashbits           ", [&]() {
+        return new Hashbits(31, bit_sizes);
+    }, reads);
+    run("BlockedHashbits    ", [&]() {
+        return new BlockedHashbits(31, tablesize * 8 * n_tables, n_tables);
+    }, reads);
+
+    return 0;
+}
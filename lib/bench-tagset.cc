@@ -0,0 +1,184 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+// Contention on the tags: T threads each test n_ops k-mers against the tag
+// set, adding one in every DEFAULT_TAG_DENSITY of them, as
+// consume_sequence_and_tag does. Compares the old spin lock around a
+// std::set with ConcurrentTagSet, then runs threaded consume_sequence_and_tag on a
+// Hashbits.
+//
+// Usage: bench-tagset [n_kmers [n_ops]]
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hashbits.hh"
+#include "khmer.hh"
+#include "tagset.hh"
+
+using namespace khmer;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// the tags as they were: one spin lock around a std::set.
+class LockedSet
+{
+    std::set<HashIntoType> _set;
+    uint32_t _lock;
+public:
+    LockedSet() : _lock(0) {}
+
+    bool contains(HashIntoType tag)
+    {
+        while (!__sync_bool_compare_and_swap(&_lock, 0, 1));
+        bool found = _set.find(tag) != _set.end();
+        __sync_bool_compare_and_swap(&_lock, 1, 0);
+        return found;
+    }
+
+    void insert(HashIntoType tag)
+    {
+        while (!__sync_bool_compare_and_swap(&_lock, 0, 1));
+        _set.insert(tag);
+        __sync_bool_compare_and_swap(&_lock, 1, 0);
+    }
+};
+
+template <typename Set>
+static double run_threads(Set &set, unsigned int n_threads, size_t n_ops,
+                          const std::vector<HashIntoType> &kmers)
+{
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (unsigned int t = 0; t < n_threads; t++) {
+        threads.push_back(std::thread([&set, &kmers, n_ops, t]() {
+            size_t j = t * 7919;
+            for (size_t i = 0; i < n_ops; i++) {
+                j = (j * 1103515245 + 12345) % kmers.size();
+                if (!set.contains(kmers[j]) &&
+                        i % DEFAULT_TAG_DENSITY == 0) {
+                    set.insert(kmers[j]);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    return seconds_since(start);
+}
+
+int main(int argc, char ** argv)
+{
+    size_t n_kmers = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t n_ops = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    const unsigned int thread_counts[] = { 1, 4, 16, 64 };
+    const size_t n_runs = sizeof(thread_counts) / sizeof(thread_counts[0]);
+
+    srand(1);
+    std::vector<HashIntoType> kmers(n_kmers);
+    for (size_t i = 0; i < n_kmers; i++) {
+        kmers[i] = ((HashIntoType) rand() << 32) ^ rand();
+    }
+
+    std::cout << n_kmers << " k-mers, " << n_ops << " lookups per thread"
+              << std::endl;
+    for (size_t r = 0; r < n_runs; r++) {
+        unsigned int n_threads = thread_counts[r];
+
+        LockedSet locked;
+        double locked_time = run_threads(locked, n_threads, n_ops, kmers);
+        ConcurrentTagSet tags;
+        double tagset_time = run_threads(tags, n_threads, n_ops, kmers);
+
+        double total = (double) n_threads * n_ops / 1e6;
+        std::cout << n_threads << " threads: spin-locked set "
+                  << total / locked_time << " M/s, ConcurrentTagSet "
+                  << total / tagset_time << " M/s" << std::endl;
+    }
+
+    // reads sharing most of their k-mers, so that most lookups are made.
+    std::vector<std::string> reads(2000);
+    std::string genome;
+    for (size_t i = 0; i < 20000; i++) {
+        genome += "ACGT"[rand() % 4];
+    }
+    for (size_t i = 0; i < reads.size(); i++) {
+        reads[i] = genome.substr(rand() % (genome.size() - 150), 150);
+    }
+    for (size_t r = 0; r < n_runs; r++) {
+        unsigned int n_threads = thread_counts[r];
+        std::vector<HashIntoType> sizes(4, 1000003);
+        Hashbits ht(31, sizes);
+
+        std::vector<std::thread> threads;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (unsigned int t = 0; t < n_threads; t++) {
+            threads.push_back(std::thread([&ht, &reads]() {
+                unsigned long long n_consumed = 0;
+                for (size_t pass = 0; pass < 5; pass++) {
+                    for (size_t i = 0; i < reads.size(); i++) {
+                        ht.consume_sequence_and_tag(reads[i], n_consumed);
+                    }
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+        double elapsed = seconds_since(start);
+
+        double n_done = (double) n_threads * 5 * reads.size() * 120;
+        std::cout << n_threads << " threads: consume_sequence_and_tag "
+                  << n_done / elapsed / 1e6 << " M k-mers/s, "
+                  << ht.n_tags() << " tags" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2010-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// Compare looking the neighbors of a k-mer up one at a time, as the
+// traversals used to, with Traverser::neighbors, which looks all eight up
+// in one batch, on a nodegraph of reads from a random genome. Then time
+// calc_connected_graph_size, which is built on it.
+//
+// Usage: bench-traverse [tablesize [n_tables [genome_size]]]
+//
+// tablesize is the number of bits in each table.
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "hashbits.hh"
+#include "khmer.hh"
+#include "traversal.hh"
+
+using namespace khmer;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// the degree of node, with a separate lookup for each neighbor.
+static unsigned int degree_one_at_a_time(const Traverser &traverser,
+        const Kmer &node)
+{
+    const Hashtable * graph = traverser.graph;
+    const char bases[] = "ACGT";
+    unsigned int degree = 0;
+    for (unsigned int i = 0; i < 4; i++) {
+        if (graph->get_count(traverser.get_right(node, bases[i]))) {
+            ++degree;
+        }
+        if (graph->get_count(traverser.get_left(node, bases[i]))) {
+            ++degree;
+        }
+    }
+    return degree;
+}
+
+int main(int argc, char ** argv)
+{
+    HashIntoType tablesize = argc > 1 ? strtoull(argv[1], NULL, 10) :
+                             1000000000;
+    unsigned int n_tables = argc > 2 ? atoi(argv[2]) : 4;
+    size_t genome_size = argc > 3 ? strtoul(argv[3], NULL, 10) : 5000000;
+    const unsigned int ksize = 31;
+
+    // reads of 150 bases at 10x coverage, with one error in fifty reads,
+    // which leaves a graph of long paths with short tips.
+    srand(1);
+    std::string genome;
+    for (size_t i = 0; i < genome_size; i++) {
+        genome += "ACGT"[rand() % 4];
+    }
+    std::vector<HashIntoType> sizes(n_tables, tablesize);
+    Hashbits graph(ksize, sizes);
+    Traverser traverser(&graph);
+
+    size_t n_reads = genome_size * 10 / 150;
+    for (size_t i = 0; i < n_reads; i++) {
+        std::string read = genome.substr(rand() % (genome_size - 150), 150);
+        if (rand() % 50 == 0) {
+            read[rand() % 150] = "ACGT"[rand() % 4];
+        }
+        graph.consume_string(read);
+    }
+
+    // k-mers of the genome, in random order.
+    std::vector<Kmer> nodes;
+    for (size_t i = 0; i < 2000000; i++) {
+        nodes.push_back(graph.build_kmer(
+                            genome.substr(rand() % (genome_size - ksize),
+                                          ksize)));
+    }
+
+    std::cout << n_reads << " reads, " << n_tables << " x " << tablesize
+              << " bits, " << nodes.size() << " k-mers" << std::endl;
+
+    unsigned long long total = 0;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        total += degree_one_at_a_time(traverser, nodes[i]);
+    }
+    std::cout << "degree, one at a time: "
+              << (nodes.size() / seconds_since(start) / 1e6) << " M/s ("
+              << total << ")" << std::endl;
+
+    total = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        total += traverser.degree(nodes[i]);
+    }
+    std::cout << "degree, batched:       "
+              << (nodes.size() / seconds_since(start) / 1e6) << " M/s ("
+              << total << ")" << std::endl;
+
+    TraversalContext context;
+    unsigned long long count = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < 200; i++) {
+        graph.calc_connected_graph_size(nodes[i], count, context, 20000);
+    }
+    std::cout << "calc_connected_graph_size: "
+              << (count / seconds_since(start) / 1e6) << " M k-mers/s"
+              << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2014-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <string.h>
+#include <algorithm>
+
+#include "bigcount.hh"
+
+using namespace khmer;
+
+// keep each shard at most half full.
+static size_t _slots_for(size_t n_entries)
+{
+    size_t n_slots = 16;
+    while (n_slots < 2 * n_entries) {
+        n_slots *= 2;
+    }
+    return n_slots;
+}
+
+BigCountMap::Slot * BigCountMap::_insert(Shard &shard, HashIntoType khash)
+{
+    if (2 * (shard.n_slots_used + 1) > shard.slots.size()) {
+        _resize(shard, _slots_for(shard.n_slots_used + 1));
+    }
+
+    Slot * slot = (Slot *) _find(shard, khash);
+    if (!slot->count) {
+        slot->kmer = khash;
+        shard.n_slots_used++;
+    }
+    return slot;
+}
+
+void BigCountMap::_resize(Shard &shard, size_t n_slots)
+{
+    if (n_slots <= shard.slots.size()) {
+        return;
+    }
+
+    std::vector<Slot> old_slots(n_slots);	// zeroed, so all empty
+    old_slots.swap(shard.slots);
+
+    for (size_t j = 0; j < old_slots.size(); j++) {
+        if (old_slots[j].count) {
+            Slot * slot = (Slot *) _find(shard, old_slots[j].kmer);
+            *slot = old_slots[j];
+        }
+    }
+}
+
+void BigCountMap::increment(HashIntoType khash,
+                            BoundedCounterType start_count,
+                            BoundedCounterType max_count)
+{
+    Shard &shard = _shard(khash);
+    _lock(shard);
+
+    Slot * slot = _insert(shard, khash);
+    if (slot->count == 0) {
+        slot->count = start_count;
+    } else if (slot->count < max_count) {
+        slot->count++;
+    }
+
+    _unlock(shard);
+}
+
+void BigCountMap::set(HashIntoType khash, BoundedCounterType count)
+{
+    if (!count) {
+        return;
+    }
+
+    Shard &shard = _shard(khash);
+    _lock(shard);
+
+    Slot * slot = _insert(shard, khash);
+    slot->count = count;
+
+    _unlock(shard);
+}
+
+void BigCountMap::clear()
+{
+    for (size_t i = 0; i < BIGCOUNT_SHARDS; i++) {
+        Shard &shard = _shards[i];
+        _lock(shard);
+        std::vector<Slot>().swap(shard.slots);
+        shard.n_slots_used = 0;
+        _unlock(shard);
+    }
+}
+
+size_t BigCountMap::size() const
+{
+    size_t n = 0;
+    for (size_t i = 0; i < BIGCOUNT_SHARDS; i++) {
+        n += _shards[i].n_slots_used;
+    }
+    return n;
+}
+
+void BigCountMap::reserve(size_t n)
+{
+    // the shards fill evenly; leave some room for the unlucky ones.
+    const size_t per_shard = (size() + n) / BIGCOUNT_SHARDS;
+    const size_t n_slots = _slots_for(per_shard + per_shard / 4 + 1);
+
+    for (size_t i = 0; i < BIGCOUNT_SHARDS; i++) {
+        Shard &shard = _shards[i];
+        _lock(shard);
+        _resize(shard, n_slots);
+        _unlock(shard);
+    }
+}
+
+void BigCountMap::get_entries(std::vector<Entry> &entries) const
+{
+    entries.clear();
+    entries.reserve(size());
+
+    for (size_t i = 0; i < BIGCOUNT_SHARDS; i++) {
+        Shard &shard = _shards[i];
+        _lock(shard);
+        for (size_t j = 0; j < shard.slots.size(); j++) {
+            if (shard.slots[j].count) {
+                entries.push_back(Entry(shard.slots[j].kmer,
+                                        shard.slots[j].count));
+            }
+        }
+        _unlock(shard);
+    }
+
+    std::sort(entries.begin(), entries.end());
+}
+
+void BigCountMap::serialize(std::vector<char> &buffer) const
+{
+    std::vector<Entry> entries;
+    get_entries(entries);
+
+    buffer.resize(entries.size() * entry_bytes);
+    char * p = buffer.data();
+    for (size_t i = 0; i < entries.size(); i++) {
+        memcpy(p, &entries[i].first, sizeof(HashIntoType));
+        p += sizeof(HashIntoType);
+        memcpy(p, &entries[i].second, sizeof(BoundedCounterType));
+        p += sizeof(BoundedCounterType);
+    }
+}
+
+void BigCountMap::deserialize(const char * buffer, size_t n_entries)
+{
+    reserve(n_entries);
+
+    for (size_t i = 0; i < n_entries; i++) {
+        HashIntoType kmer;
+        BoundedCounterType count;
+        memcpy(&kmer, buffer, sizeof(HashIntoType));
+        buffer += sizeof(HashIntoType);
+        memcpy(&count, buffer, sizeof(BoundedCounterType));
+        buffer += sizeof(BoundedCounterType);
+
+        set(kmer, count);
+    }
+}
+
+/* vim: set ft=cpp ts=8 sts=4 sw=4 et tw=79 */
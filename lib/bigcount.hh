@@ -0,0 +1,177 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2014-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef BIGCOUNT_HH
+#define BIGCOUNT_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "khmer.hh"
+#include "kmer_hash.hh"
+
+namespace khmer
+{
+
+/**
+ * \class BigCountMap
+ *
+ * \brief The counts above MAX_KCOUNT of a CountingHash with bigcount on.
+ *
+ * The k-mers are spread over BIGCOUNT_SHARDS shards by a hash of the
+ * k-mer, each an open-addressing table with linear probing under its own
+ * spin lock, so threads counting different high-abundance k-mers rarely
+ * meet on a lock, and lookups in an empty shard take no lock at all.
+ * Entries are never removed, except by clear(); a count of zero marks an
+ * empty slot.
+ */
+class BigCountMap
+{
+public:
+    typedef std::pair<HashIntoType, BoundedCounterType> Entry;
+
+    /// Add one to the count of khash, up to max_count; a k-mer that is not
+    /// in the map yet gets start_count.
+    void increment(HashIntoType khash, BoundedCounterType start_count,
+                   BoundedCounterType max_count);
+
+    /// Set the count of khash; a count of zero is ignored.
+    void set(HashIntoType khash, BoundedCounterType count);
+
+    /// @return true, with the count of khash in count, if khash is present.
+    bool get(HashIntoType khash, BoundedCounterType &count) const
+    {
+        // most k-mers never reach bigcount; a stale count of zero just
+        // misses one being added as we look.
+        Shard &shard = _shard(khash);
+        if (!shard.n_slots_used) {
+            return false;
+        }
+
+        _lock(shard);
+        const Slot * slot = _find(shard, khash);
+        bool found = slot != NULL && slot->count;
+        if (found) {
+            count = slot->count;
+        }
+        _unlock(shard);
+
+        return found;
+    }
+
+    size_t size() const;
+
+    void clear();
+
+    /// Make room for n more k-mers without growing the shards again.
+    void reserve(size_t n);
+
+    /// Copy out all of the entries, ordered by k-mer.
+    void get_entries(std::vector<Entry> &entries) const;
+
+    /// Pack the entries, ordered by k-mer, as the k-mer count file stores
+    /// them: each k-mer followed by its count, in native byte order.
+    void serialize(std::vector<char> &buffer) const;
+    /// Add n_entries entries in the format written by serialize().
+    void deserialize(const char * buffer, size_t n_entries);
+
+    /// The size in bytes of one serialized entry.
+    static const size_t entry_bytes = sizeof(HashIntoType) +
+                                      sizeof(BoundedCounterType);
+
+protected:
+    struct Slot {
+        HashIntoType        kmer;
+        BoundedCounterType  count;
+    };
+
+    // padded, so that threads spinning on the locks of neighboring shards
+    // don't share a cache line.
+    struct Shard {
+        uint32_t            lock;
+        size_t              n_slots_used;
+        std::vector<Slot>   slots;	// empty, or a power of two long
+        char                _pad[CACHE_LINE_SIZE];
+
+        Shard() : lock(0), n_slots_used(0) {}
+    };
+
+    mutable Shard _shards[BIGCOUNT_SHARDS];
+
+    Shard& _shard(HashIntoType khash) const
+    {
+        return _shards[_mix_hash(khash) % BIGCOUNT_SHARDS];
+    }
+
+    static void _lock(Shard &shard)
+    {
+        while (!__sync_bool_compare_and_swap(&shard.lock, 0, 1));
+    }
+    static void _unlock(Shard &shard)
+    {
+        __sync_lock_release(&shard.lock);
+    }
+
+    // the slot holding khash, or the empty slot where it would go; NULL if
+    // the shard has no slots. The shard must be locked.
+    static const Slot * _find(const Shard &shard, HashIntoType khash)
+    {
+        if (shard.slots.empty()) {
+            return NULL;
+        }
+
+        const size_t mask = shard.slots.size() - 1;
+        // the low bits of the mixed hash picked the shard; use the high ones.
+        size_t i = (_mix_hash(khash) >> 32) & mask;
+        while (shard.slots[i].count && shard.slots[i].kmer != khash) {
+            i = (i + 1) & mask;
+        }
+        return &shard.slots[i];
+    }
+
+    // find or add the slot for khash; the shard must be locked.
+    Slot * _insert(Shard &shard, HashIntoType khash);
+
+    // rehash the shard into n_slots slots; the shard must be locked.
+    static void _resize(Shard &shard, size_t n_slots);
+};
+
+}
+
+#endif // BIGCOUNT_HH
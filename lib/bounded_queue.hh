@@ -0,0 +1,164 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef BOUNDED_QUEUE_HH
+#define BOUNDED_QUEUE_HH
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "khmer.hh"
+
+namespace khmer
+{
+
+/**
+ * \class BoundedQueue
+ *
+ * \brief A fixed-size, lock-free queue for any number of producer and
+ * consumer threads.
+ *
+ * A ring of cells, each stamped with the position it may next be written
+ * (or read) at, after D. Vyukov's bounded MPMC queue: producers and
+ * consumers each claim a position with one compare-and-swap and never wait
+ * on each other except when the queue is full or empty. The capacity is
+ * rounded up to a power of two. T should be cheap to copy, e.g. a pointer.
+ */
+template <typename T>
+class BoundedQueue
+{
+protected:
+    struct Cell {
+        size_t  seq;
+        T       value;
+    };
+
+    std::vector<Cell>   _cells;
+    size_t              _mask;
+    // producers and consumers each get their own cache line.
+    char                _pad0[CACHE_LINE_SIZE];
+    size_t              _tail;
+    char                _pad1[CACHE_LINE_SIZE];
+    size_t              _head;
+    char                _pad2[CACHE_LINE_SIZE];
+
+    static size_t _load(const size_t &x)
+    {
+        return *(volatile const size_t *) &x;
+    }
+public:
+    explicit BoundedQueue(size_t capacity) : _tail(0), _head(0)
+    {
+        size_t n_cells = 2;
+        while (n_cells < capacity) {
+            n_cells *= 2;
+        }
+        _cells.resize(n_cells);
+        for (size_t i = 0; i < n_cells; i++) {
+            _cells[i].seq = i;
+        }
+        _mask = n_cells - 1;
+    }
+
+    /// @return false, without waiting, if the queue is full.
+    bool try_push(const T &value)
+    {
+        Cell * cell;
+        size_t pos = _load(_tail);
+        while (true) {
+            cell = &_cells[pos & _mask];
+            intptr_t dif = (intptr_t) _load(cell->seq) - (intptr_t) pos;
+            if (dif == 0) {
+                if (__sync_bool_compare_and_swap(&_tail, pos, pos + 1)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            }
+            pos = _load(_tail);
+        }
+
+        cell->value = value;
+        __sync_synchronize();
+        cell->seq = pos + 1;
+        return true;
+    }
+
+    /// @return false, without waiting, if the queue is empty.
+    bool try_pop(T &value)
+    {
+        Cell * cell;
+        size_t pos = _load(_head);
+        while (true) {
+            cell = &_cells[pos & _mask];
+            intptr_t dif = (intptr_t) _load(cell->seq) - (intptr_t) (pos + 1);
+            if (dif == 0) {
+                if (__sync_bool_compare_and_swap(&_head, pos, pos + 1)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            }
+            pos = _load(_head);
+        }
+
+        value = cell->value;
+        __sync_synchronize();
+        cell->seq = pos + _mask + 1;
+        return true;
+    }
+
+    // the waiting versions yield the CPU while the queue is full or empty.
+    void push(const T &value)
+    {
+        while (!try_push(value)) {
+            sched_yield();
+        }
+    }
+    void pop(T &value)
+    {
+        while (!try_pop(value)) {
+            sched_yield();
+        }
+    }
+};
+
+}
+
+#endif // BOUNDED_QUEUE_HH
@@ -0,0 +1,348 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+#include "chunked_file.hh"
+#include "khmer_exception.hh"
+#include "zlib.h"
+
+using namespace std;
+using namespace khmer;
+
+// Run work(0) to work(n_threads - 1), each on a thread of its own unless
+// there is only one.
+template<typename F>
+static void _run_threads(unsigned int n_threads, F work)
+{
+    if (n_threads <= 1) {
+        work(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < n_threads; t++) {
+        threads.push_back(std::thread(work, t));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+}
+
+// how many blocks each thread takes on between reads or writes.
+#define CHUNKED_BLOCKS_PER_THREAD 4
+
+// each block is a gzip member: its CRC-32 checks a block in about half the
+// time of the Adler-32 of the zlib wrapper.
+#define CHUNKED_WINDOW_BITS (15 + 16)
+
+static bool _pack_block(ChunkCodec codec, const Byte * data, size_t bytes,
+                        std::vector<Byte> &packed)
+{
+    if (codec == CHUNK_CODEC_NONE) {
+        packed.assign(data, data + bytes);
+        return true;
+    }
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    // the count tables are mostly zeros; the fastest level does nearly as
+    // well on them as the default.
+    if (deflateInit2(&strm, Z_BEST_SPEED, Z_DEFLATED, CHUNKED_WINDOW_BITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    packed.resize(deflateBound(&strm, bytes));
+    strm.next_in = (Bytef *) data;
+    strm.avail_in = bytes;
+    strm.next_out = packed.data();
+    strm.avail_out = packed.size();
+    const bool ok = deflate(&strm, Z_FINISH) == Z_STREAM_END;
+    packed.resize(strm.total_out);
+    deflateEnd(&strm);
+    return ok;
+}
+
+static bool _unpack_block(ChunkCodec codec, const Byte * packed,
+                          size_t packed_bytes, Byte * data, size_t bytes)
+{
+    if (codec == CHUNK_CODEC_NONE) {
+        if (packed_bytes != bytes) {
+            return false;
+        }
+        memcpy(data, packed, bytes);
+        return true;
+    }
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, CHUNKED_WINDOW_BITS) != Z_OK) {
+        return false;
+    }
+    strm.next_in = (Bytef *) packed;
+    strm.avail_in = packed_bytes;
+    strm.next_out = data;
+    strm.avail_out = bytes;
+    const bool ok = inflate(&strm, Z_FINISH) == Z_STREAM_END
+                    && strm.avail_out == 0 && strm.avail_in == 0;
+    inflateEnd(&strm);
+    return ok;
+}
+
+void ChunkedFileWriter::write(std::ofstream &outfile,
+                              const std::vector<const Byte *> &sections,
+                              const std::vector<HashIntoType> &section_bytes,
+                              ChunkCodec codec, unsigned int n_threads)
+{
+    if (codec != CHUNK_CODEC_NONE && codec != CHUNK_CODEC_ZLIB) {
+        throw khmer_value_exception("Unknown codec for a chunked file");
+    }
+    n_threads = std::max(n_threads, 1U);
+
+    // the blocks of all of the sections, in order.
+    std::vector<const Byte *> blocks;
+    std::vector<size_t> block_bytes;
+    for (size_t i = 0; i < sections.size(); i++) {
+        for (HashIntoType pos = 0; pos < section_bytes[i];
+                pos += CHUNKED_BLOCK_SIZE) {
+            blocks.push_back(sections[i] + pos);
+            block_bytes.push_back(std::min(section_bytes[i] - pos,
+                                           (HashIntoType) CHUNKED_BLOCK_SIZE));
+        }
+    }
+
+    std::vector<uint64_t> offsets;
+    const size_t round = n_threads * CHUNKED_BLOCKS_PER_THREAD;
+    std::vector< std::vector<Byte> > packed(round);
+    std::vector<char> packed_ok(round);
+
+    for (size_t start = 0; start < blocks.size(); start += round) {
+        const size_t n = std::min(round, blocks.size() - start);
+        _run_threads(n_threads, [&](unsigned int t) {
+            for (size_t j = t; j < n; j += n_threads) {
+                packed_ok[j] = _pack_block(codec, blocks[start + j],
+                                           block_bytes[start + j], packed[j]);
+            }
+        });
+        for (size_t j = 0; j < n; j++) {
+            if (!packed_ok[j]) {
+                throw khmer_file_exception("Error compressing a block of a "
+                                           "chunked file");
+            }
+            offsets.push_back(outfile.tellp());
+            outfile.write((const char *) packed[j].data(), packed[j].size());
+        }
+    }
+    offsets.push_back(outfile.tellp());
+
+    uint64_t index_offset = outfile.tellp();
+    unsigned char save_codec = codec;
+    uint32_t block_size = CHUNKED_BLOCK_SIZE;
+    uint32_t n_sections = sections.size();
+    outfile.write((const char *) &save_codec, sizeof(save_codec));
+    outfile.write((const char *) &block_size, sizeof(block_size));
+    outfile.write((const char *) &n_sections, sizeof(n_sections));
+    for (size_t i = 0; i < sections.size(); i++) {
+        uint64_t bytes = section_bytes[i];
+        outfile.write((const char *) &bytes, sizeof(bytes));
+    }
+    outfile.write((const char *) offsets.data(),
+                  offsets.size() * sizeof(uint64_t));
+    outfile.write((const char *) &index_offset, sizeof(index_offset));
+}
+
+ChunkedFileReader::ChunkedFileReader(const std::string &infilename)
+    : _filename(infilename)
+{
+    _infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                       std::ifstream::eofbit);
+    try {
+        _infile.open(infilename.c_str(), ios::binary);
+    } catch (std::ifstream::failure &e) {
+        throw khmer_file_exception("Cannot open k-mer table file: "
+                                   + infilename + " " + strerror(errno));
+    }
+
+    const std::string bad_index = "Bad block index in k-mer table file: "
+                                  + infilename;
+    try {
+        _infile.seekg(0, ios::end);
+        const uint64_t file_bytes = _infile.tellg();
+        uint64_t index_offset = 0;
+        if (file_bytes < sizeof(index_offset)) {
+            throw khmer_file_exception(bad_index);
+        }
+        _infile.seekg(file_bytes - sizeof(index_offset));
+        _infile.read((char *) &index_offset, sizeof(index_offset));
+
+        unsigned char codec = 0;
+        uint32_t n_sections = 0;
+        const uint64_t index_bytes = file_bytes - sizeof(index_offset)
+                                     - index_offset;
+        if (index_offset > file_bytes - sizeof(index_offset)
+                || index_bytes < sizeof(codec) + sizeof(_block_size)
+                + sizeof(n_sections)) {
+            throw khmer_file_exception(bad_index);
+        }
+        _infile.seekg(index_offset);
+        _infile.read((char *) &codec, sizeof(codec));
+        _infile.read((char *) &_block_size, sizeof(_block_size));
+        _infile.read((char *) &n_sections, sizeof(n_sections));
+        if (!(codec == CHUNK_CODEC_NONE || codec == CHUNK_CODEC_ZLIB)) {
+            throw khmer_file_exception("Unknown codec in k-mer table file: "
+                                       + infilename);
+        }
+        _codec = (ChunkCodec) codec;
+
+        uint64_t n_blocks = 0;
+        if (!_block_size || n_sections > index_bytes / sizeof(uint64_t)) {
+            throw khmer_file_exception(bad_index);
+        }
+        for (uint32_t i = 0; i < n_sections; i++) {
+            uint64_t bytes;
+            _infile.read((char *) &bytes, sizeof(bytes));
+            _section_bytes.push_back(bytes);
+            _first_block.push_back(n_blocks);
+            n_blocks += (bytes + _block_size - 1) / _block_size;
+        }
+        _first_block.push_back(n_blocks);
+
+        if (n_blocks + 1 > index_bytes / sizeof(uint64_t)) {
+            throw khmer_file_exception(bad_index);
+        }
+        _block_offsets.resize(n_blocks + 1);
+        _infile.read((char *) _block_offsets.data(),
+                     _block_offsets.size() * sizeof(uint64_t));
+        for (size_t b = 0; b < n_blocks; b++) {
+            if (_block_offsets[b] > _block_offsets[b + 1]) {
+                throw khmer_file_exception(bad_index);
+            }
+        }
+        if (_block_offsets[n_blocks] > index_offset) {
+            throw khmer_file_exception(bad_index);
+        }
+    } catch (std::ifstream::failure &e) {
+        throw khmer_file_exception(bad_index);
+    }
+}
+
+void ChunkedFileReader::_read_blocks(size_t first, size_t last, Byte * dest,
+                                     HashIntoType dest_bytes,
+                                     unsigned int n_threads)
+{
+    n_threads = std::max(n_threads, 1U);
+    const size_t round = n_threads * CHUNKED_BLOCKS_PER_THREAD;
+    std::vector<Byte> packed;
+    std::vector<char> unpacked_ok(round);
+
+    for (size_t start = first; start < last; start += round) {
+        const size_t n = std::min(round, last - start);
+        const uint64_t base = _block_offsets[start];
+        packed.resize(_block_offsets[start + n] - base);
+        try {
+            _infile.seekg(base);
+            _infile.read((char *) packed.data(), packed.size());
+        } catch (std::ifstream::failure &e) {
+            throw khmer_file_exception("Unexpected end of k-mer table file: "
+                                       + _filename);
+        }
+
+        _run_threads(n_threads, [&](unsigned int t) {
+            for (size_t j = t; j < n; j += n_threads) {
+                const size_t b = start + j;
+                const HashIntoType pos = (b - first) * _block_size;
+                unpacked_ok[j] = _unpack_block(
+                                     _codec,
+                                     packed.data() + _block_offsets[b] - base,
+                                     _block_offsets[b + 1] - _block_offsets[b],
+                                     dest + pos,
+                                     std::min(dest_bytes - pos,
+                                              (HashIntoType) _block_size));
+            }
+        });
+        for (size_t j = 0; j < n; j++) {
+            if (!unpacked_ok[j]) {
+                throw khmer_file_exception("Corrupt block in k-mer table "
+                                           "file: " + _filename);
+            }
+        }
+    }
+}
+
+void ChunkedFileReader::read_section(size_t i, Byte * dest,
+                                     unsigned int n_threads)
+{
+    if (i >= n_sections()) {
+        throw khmer_value_exception("No such table in k-mer table file: "
+                                    + _filename);
+    }
+    _read_blocks(_first_block[i], _first_block[i + 1], dest,
+                 _section_bytes[i], n_threads);
+}
+
+void ChunkedFileReader::read_section_range(size_t i, HashIntoType offset,
+        HashIntoType bytes, Byte * dest,
+        unsigned int n_threads)
+{
+    if (i >= n_sections() || offset > _section_bytes[i]
+            || bytes > _section_bytes[i] - offset) {
+        throw khmer_value_exception("No such table range in k-mer table "
+                                    "file: " + _filename);
+    }
+    if (!bytes) {
+        return;
+    }
+    const HashIntoType end = offset + bytes;
+    const size_t first = offset / _block_size;
+    const size_t last = (end + _block_size - 1) / _block_size;
+    if (offset % _block_size == 0
+            && (end % _block_size == 0 || end == _section_bytes[i])) {
+        _read_blocks(_first_block[i] + first, _first_block[i] + last, dest,
+                     bytes, n_threads);
+        return;
+    }
+
+    // decompress every block that the range touches, and copy it out.
+    const HashIntoType start = (HashIntoType) first * _block_size;
+    const HashIntoType span = std::min((HashIntoType) last * _block_size,
+                                       _section_bytes[i]) - start;
+    std::vector<Byte> blocks(span);
+    _read_blocks(_first_block[i] + first, _first_block[i] + last,
+                 blocks.data(), span, n_threads);
+    memcpy(dest, blocks.data() + (offset - start), bytes);
+}
+
+// vim: set ft=cpp sts=4 sw=4 tw=80:
@@ -0,0 +1,127 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef CHUNKED_FILE_HH
+#define CHUNKED_FILE_HH
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "khmer.hh"
+
+namespace khmer
+{
+
+// The codecs that the blocks of a chunked file can be compressed with.
+// zstd and lz4 would go here, were they in third-party/.
+enum ChunkCodec {
+    CHUNK_CODEC_NONE = 0,
+    CHUNK_CODEC_ZLIB = 1
+};
+
+// the uncompressed size of the blocks of a chunked file.
+#define CHUNKED_BLOCK_SIZE (1 << 20)
+
+// A chunked file keeps a graph's tables (its "sections") as a run of
+// independently compressed blocks of CHUNKED_BLOCK_SIZE bytes, after the
+// header of the graph, and then an index of the blocks:
+//
+//     codec                     1 byte
+//     block size                4 bytes
+//     number of sections        4 bytes
+//     section sizes             8 bytes each, uncompressed
+//     block offsets             8 bytes each, one per block and one for
+//                               the end of the last block
+//     offset of the index       8 bytes, the last in the file
+//
+// So several threads can compress and decompress the blocks, and one
+// section can be read without the others.
+class ChunkedFileWriter
+{
+public:
+    // write sections to outfile from its current position on, and then
+    // the index.
+    static void write(std::ofstream &outfile,
+                      const std::vector<const Byte *> &sections,
+                      const std::vector<HashIntoType> &section_bytes,
+                      ChunkCodec codec, unsigned int n_threads);
+};
+
+class ChunkedFileReader
+{
+protected:
+    std::ifstream _infile;
+    std::string _filename;
+    ChunkCodec _codec;
+    uint32_t _block_size;
+    std::vector<HashIntoType> _section_bytes;
+    // the first block of each section, and one past the last.
+    std::vector<size_t> _first_block;
+    std::vector<uint64_t> _block_offsets;
+
+    void _read_blocks(size_t first, size_t last, Byte * dest,
+                      HashIntoType dest_bytes, unsigned int n_threads);
+
+public:
+    // read the index of the chunked file infilename.
+    explicit ChunkedFileReader(const std::string &infilename);
+
+    size_t n_sections() const
+    {
+        return _section_bytes.size();
+    }
+    HashIntoType section_bytes(size_t i) const
+    {
+        return _section_bytes[i];
+    }
+
+    // decompress section i into dest, which holds section_bytes(i) bytes.
+    void read_section(size_t i, Byte * dest, unsigned int n_threads = 1);
+    // decompress bytes bytes of section i from offset on into dest. Only
+    // the blocks that overlap the range are read, so a section can be
+    // streamed; ranges that start and end on block boundaries are cheapest.
+    void read_section_range(size_t i, HashIntoType offset,
+                            HashIntoType bytes, Byte * dest,
+                            unsigned int n_threads = 1);
+};
+
+}
+
+#endif // CHUNKED_FILE_HH
+
+// vim: set ft=cpp sts=4 sw=4 tw=80:
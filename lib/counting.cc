@@ -39,6 +39,7 @@ Contact: khmer-project@idyll.org
 #include <errno.h>
 #include <algorithm>
 #include <iostream>
+#include <mutex>
 #include <sstream> // IWYU pragma: keep
 
 #include "counting.hh"
@@ -65,14 +66,11 @@ void CountingHash::output_fasta_kmer_pos_freq(
     ofstream outfile;
     outfile.open(outputfile.c_str());
     string seq;
-    Read read;
 
-    while(!parser->is_complete()) {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         seq = read.sequence;
 
         long numPos = seq.length() - _ksize + 1;
@@ -140,27 +138,20 @@ CountingHash::abundance_distribution(
         dist[i] = 0;
     }
 
-    Read read;
-
-    string name;
-    string seq;
-
     // if not, could lead to overflow.
     if (sizeof(BoundedCounterType) != 2) {
         delete[] dist;
         throw khmer_exception();
     }
 
-    while(!parser->is_complete()) {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
-        seq = read.sequence;
+    // the reads of a batch are ours to normalize in place.
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
 
-        if (check_and_normalize_read(seq)) {
-            KmerIterator kmers(seq.c_str(), _ksize);
+        if (check_and_normalize_read(read.sequence)) {
+            KmerIterator kmers(read.sequence.c_str(), _ksize);
 
             while(!kmers.done()) {
                 HashIntoType kmer = kmers.next();
@@ -172,9 +163,6 @@ CountingHash::abundance_distribution(
                     dist[n]++;
                 }
             }
-
-            name.clear();
-            seq.clear();
         }
     }
     return dist;
@@ -183,13 +171,59 @@ CountingHash::abundance_distribution(
 
 HashIntoType * CountingHash::abundance_distribution(
     std::string filename,
-    Hashbits *  tracking)
+    Hashbits *  tracking,
+    unsigned int n_threads)
 {
-    IParser* parser = IParser::get_parser(filename.c_str());
+    std::vector< std::unique_ptr<IParser> > parsers =
+        IParser::get_split_parsers(filename, n_threads);
+
+    // each thread tallies the k-mers it is first to see in a distribution
+    // of its own; test_and_set_bits decides which thread that is. The
+    // parsers are our own, so their reads are hashed where they are.
+    const size_t n_bins = MAX_BIGCOUNT + 1;
+    std::vector<HashIntoType> dists(parsers.size() * n_bins, 0);
+
+    // test_and_set_bits sets a k-mer's bit in each table with its own
+    // atomic OR, so two threads adding the same new k-mer at once could
+    // each set a bit the other found clear, and both call it new. A k-mer
+    // the tracking table doesn't have yet is added under a lock picked by
+    // the k-mer, so only the first of them does.
+    std::vector<std::mutex> locks(ABUNDANCE_DIST_LOCK_STRIPES);
+    for_each_read_split(parsers, [&](const ReadView &read, size_t i) {
+        const char * seq = _check_read_view(read.sequence,
+                                            read.sequence_length);
+        if (seq == NULL) {
+            return;
+        }
 
-    HashIntoType * distribution = abundance_distribution(parser, tracking);
-    delete parser;
-    return distribution;
+        HashIntoType * dist = &dists[i * n_bins];
+        KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+        size_t n_kmers = kmers.hash(seq, read.sequence_length, _ksize);
+        for (size_t j = 0; j < n_kmers; j++) {
+            if (tracking->get_count(kmers[j])) {
+                continue;
+            }
+
+            bool is_new_kmer;
+            {
+                std::lock_guard<std::mutex> lock(
+                    locks[_mix_hash(kmers[j]) % ABUNDANCE_DIST_LOCK_STRIPES]);
+                is_new_kmer = tracking->test_and_set_bits(kmers[j]);
+            }
+            if (is_new_kmer) {
+                dist[get_count(kmers[j])]++;
+            }
+        }
+    });
+
+    HashIntoType * dist = new HashIntoType[n_bins];
+    for (size_t bin = 0; bin < n_bins; bin++) {
+        dist[bin] = 0;
+        for (size_t i = 0; i < parsers.size(); i++) {
+            dist[bin] += dists[i * n_bins + bin];
+        }
+    }
+    return dist;
 }
 
 HashIntoType * CountingHash::fasta_count_kmers_by_position(
@@ -205,18 +239,15 @@ HashIntoType * CountingHash::fasta_count_kmers_by_position(
         counts[i] = 0;
     }
 
-    Read read;
     IParser* parser = IParser::get_parser(inputfile.c_str());
     string name;
     string seq;
     unsigned long long read_num = 0;
 
-    while(!parser->is_complete()) {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
 
         seq = read.sequence;
         bool valid_read = check_and_normalize_read(seq);
@@ -261,18 +292,15 @@ void CountingHash::fasta_dump_kmers_by_abundance(
     CallbackFn      callback,
     void *      callback_data)
 {
-    Read read;
     IParser* parser = IParser::get_parser(inputfile.c_str());
     string name;
     string seq;
     unsigned long long read_num = 0;
 
-    while(!parser->is_complete()) {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         bool valid_read = check_and_normalize_read(seq);
         seq = read.sequence;
 
@@ -310,14 +338,21 @@ void CountingHash::fasta_dump_kmers_by_abundance(
     delete parser;
 }
 
-void CountingHash::save(std::string outfilename)
+void CountingHash::save(std::string outfilename, bool page_aligned)
+{
+    CountingHashFile::save(outfilename, *this, page_aligned);
+}
+
+void CountingHash::save_chunked(std::string outfilename, ChunkCodec codec,
+                                unsigned int n_threads)
 {
-    CountingHashFile::save(outfilename, *this);
+    CountingHashFile::save_chunked(outfilename, *this, codec, n_threads);
 }
 
-void CountingHash::load(std::string infilename)
+void CountingHash::load(std::string infilename, TableLoadMode mode,
+                        unsigned int n_threads)
 {
-    CountingHashFile::load(infilename, *this);
+    CountingHashFile::load(infilename, *this, mode, n_threads);
 }
 
 unsigned long CountingHash::trim_on_abundance(
@@ -329,30 +364,32 @@ const
         return 0;
     }
 
-    KmerIterator kmers(seq.c_str(), _ksize);
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(seq, _ksize);
 
-    HashIntoType kmer;
+    return trim_on_abundance(kmers, min_abund);
+}
 
-    if (kmers.done()) {
-        return 0;
-    }
-    kmer = kmers.next();
+unsigned long CountingHash::trim_on_abundance(
+    const KmerHashBlock &kmers,
+    BoundedCounterType  min_abund)
+const
+{
+    _check_kmer_block(kmers);
 
-    if (kmers.done() || get_count(kmer) < min_abund) {
+    const size_t n_kmers = kmers.size();
+
+    if (n_kmers < 2 || get_count(kmers[0]) < min_abund) {
         return 0;
     }
 
-    unsigned long i = _ksize;
-    while (!kmers.done()) {
-        kmer = kmers.next();
-
-        if (get_count(kmer) < min_abund) {
-            return i;
+    for (size_t i = 1; i < n_kmers; i++) {
+        if (get_count(kmers[i]) < min_abund) {
+            return i + _ksize - 1;
         }
-        i++;
     }
 
-    return seq.length();
+    return n_kmers + _ksize - 1;
 }
 
 unsigned long CountingHash::trim_below_abundance(
@@ -364,30 +401,32 @@ const
         return 0;
     }
 
-    KmerIterator kmers(seq.c_str(), _ksize);
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(seq, _ksize);
 
-    HashIntoType kmer;
+    return trim_below_abundance(kmers, max_abund);
+}
 
-    if (kmers.done()) {
-        return 0;
-    }
-    kmer = kmers.next();
+unsigned long CountingHash::trim_below_abundance(
+    const KmerHashBlock &kmers,
+    BoundedCounterType  max_abund)
+const
+{
+    _check_kmer_block(kmers);
+
+    const size_t n_kmers = kmers.size();
 
-    if (kmers.done() || get_count(kmer) > max_abund) {
+    if (n_kmers < 2 || get_count(kmers[0]) > max_abund) {
         return 0;
     }
 
-    unsigned long i = _ksize;
-    while (!kmers.done()) {
-        kmer = kmers.next();
-
-        if (get_count(kmer) > max_abund) {
-            return i;
+    for (size_t i = 1; i < n_kmers; i++) {
+        if (get_count(kmers[i]) > max_abund) {
+            return i + _ksize - 1;
         }
-        i++;
     }
 
-    return seq.length();
+    return n_kmers + _ksize - 1;
 }
 
 std::vector<unsigned int> CountingHash::find_spectral_error_positions(
@@ -395,48 +434,52 @@ std::vector<unsigned int> CountingHash::find_spectral_error_positions(
     BoundedCounterType max_abund)
 const
 {
-    std::vector<unsigned int> posns;
     if (!check_and_normalize_read(seq)) {
         throw khmer_exception("invalid read");
     }
 
-    KmerIterator kmers(seq.c_str(), _ksize);
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(seq, _ksize);
+
+    return find_spectral_error_positions(kmers, max_abund);
+}
+
+std::vector<unsigned int> CountingHash::find_spectral_error_positions(
+    const KmerHashBlock &kmers,
+    BoundedCounterType max_abund)
+const
+{
+    _check_kmer_block(kmers);
+
+    std::vector<unsigned int> posns;
+    const size_t n_kmers = kmers.size();
 
-    HashIntoType kmer = kmers.next();
-    if (kmers.done()) {
+    if (n_kmers < 2) {
         return posns;
     }
 
-    // find the first trusted k-mer
-    while (!kmers.done()) {
-        if (get_count(kmer) > max_abund) {
-            break;
-        }
-        kmer = kmers.next();
+    // find the first trusted k-mer; the last k-mer is never considered.
+    size_t i = 0;
+    while (i < n_kmers - 1 && get_count(kmers[i]) <= max_abund) {
+        i++;
     }
 
-    if (kmers.done()) {
+    if (i == n_kmers - 1) {
         return posns;
     }
 
     // did we bypass some erroneous k-mers? call the last one.
-    if (kmers.get_start_pos() > 0) {
-        // if we are well past the first k, forget the whole thing (!? @CTB)
-        if (kmers.get_start_pos() >= _ksize && 0) {
-            return posns;
-        }
-        posns.push_back(kmers.get_start_pos() - 1);
+    if (i > 0) {
+        posns.push_back(i - 1);
     }
 
-    while (!kmers.done()) {
-        kmer = kmers.next();
-        if (get_count(kmer) <= max_abund) { // error!
-            posns.push_back(kmers.get_end_pos() - 1);
+    for (i++; i < n_kmers; i++) {
+        if (get_count(kmers[i]) <= max_abund) { // error!
+            posns.push_back(i + _ksize - 1);
 
             // find next good
-            while (!kmers.done()) {
-                kmer = kmers.next();
-                if (get_count(kmer) > max_abund) { // a good stretch again.
+            for (i++; i < n_kmers; i++) {
+                if (get_count(kmers[i]) > max_abund) { // a good stretch again.
                     break;
                 }
             }
@@ -447,41 +490,120 @@ const
 }
 
 
+// round tablesize up to a whole number of blocks.
+static HashIntoType _blocked_tablesize(HashIntoType tablesize)
+{
+    if (tablesize < CACHE_LINE_SIZE) {
+        return CACHE_LINE_SIZE;
+    }
+    return (tablesize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE
+           * CACHE_LINE_SIZE;
+}
+
+BlockedCountingHash::BlockedCountingHash(
+    WordLength      ksize,
+    HashIntoType    tablesize,
+    unsigned int    n_tables)
+    : CountingHash(ksize, _blocked_tablesize(tablesize))
+{
+    if (n_tables < 1 || n_tables > CACHE_LINE_SIZE) {
+        std::ostringstream err;
+        err << "number of tables for a blocked countgraph must be between "
+            << "1 and " << CACHE_LINE_SIZE << ", not " << n_tables;
+        throw khmer_value_exception(err.str());
+    }
+    _n_tables = n_tables;
+    _n_blocks = _tablesizes[0] / CACHE_LINE_SIZE;
+}
+
+void BlockedCountingHash::load(std::string infilename, TableLoadMode mode,
+                               unsigned int n_threads)
+{
+    CountingHash::load(infilename, mode, n_threads);
+
+    if (_n_tables < 1 || _n_tables > CACHE_LINE_SIZE
+            || _tablesizes[0] == 0 || _tablesizes[0] % CACHE_LINE_SIZE) {
+        throw khmer_file_exception("Bad table layout in blocked k-mer count "
+                                   "file: " + infilename);
+    }
+    _n_blocks = _tablesizes[0] / CACHE_LINE_SIZE;
+}
+
+PackedCountingHash::PackedCountingHash(
+    WordLength                  ksize,
+    std::vector<HashIntoType>&  tablesizes,
+    unsigned int                counter_bits,
+    bool                        fastrange)
+    : CountingHash(ksize, tablesizes, fastrange,
+                   counter_bits == 2 || counter_bits == 4 ? counter_bits : 8)
+{
+    if (!(counter_bits == 2 || counter_bits == 4)) {
+        std::ostringstream err;
+        err << "counters of a packed countgraph must be 2 or 4 bits wide, "
+            << "not " << counter_bits;
+        throw khmer_value_exception(err.str());
+    }
+    _per_byte_shift = counter_bits == 4 ? 1 : 2;
+}
+
 void CountingHashFile::load(
     const std::string   &infilename,
-    CountingHash    &ht)
+    CountingHash    &ht,
+    TableLoadMode   mode,
+    unsigned int    n_threads)
 {
     std::string filename(infilename);
     size_t found = filename.find_last_of(".");
     std::string type = filename.substr(found + 1);
 
+    // gzipped tables can only be read.
     if (type == "gz") {
         CountingHashGzFileReader(filename, ht);
     } else {
-        CountingHashFileReader(filename, ht);
+        CountingHashFileReader(filename, ht, mode, n_threads);
     }
 }
 
 
 void CountingHashFile::save(
     const std::string   &outfilename,
-    const CountingHash  &ht)
+    const CountingHash  &ht,
+    bool                page_aligned)
 {
     std::string filename(outfilename);
     size_t found = filename.find_last_of(".");
     std::string type = filename.substr(found + 1);
 
+    ht._check_not_mapped_from(filename);
     if (type == "gz") {
+        if (page_aligned) {
+            throw khmer_value_exception("a page-aligned k-mer count file "
+                                        "cannot be gzipped: " + filename);
+        }
         CountingHashGzFileWriter(filename, ht);
     } else {
-        CountingHashFileWriter(filename, ht);
+        CountingHashFileWriter(filename, ht,
+                               page_aligned ? SAVED_FLAG_PAGE_ALIGNED : 0);
     }
 }
 
+void CountingHashFile::save_chunked(
+    const std::string   &outfilename,
+    const CountingHash  &ht,
+    ChunkCodec          codec,
+    unsigned int        n_threads)
+{
+    ht._check_not_mapped_from(outfilename);
+    CountingHashFileWriter(outfilename, ht, SAVED_FLAG_CHUNKED, codec,
+                           n_threads);
+}
+
 
 CountingHashFileReader::CountingHashFileReader(
     const std::string   &infilename,
-    CountingHash    &ht)
+    CountingHash    &ht,
+    TableLoadMode   mode,
+    unsigned int    n_threads)
 {
     ifstream infile;
     // configure ifstream to raise exceptions for everything.
@@ -500,14 +622,7 @@ CountingHashFileReader::CountingHashFileReader(
         throw khmer_file_exception(err + " " + strerror(errno));
     }
 
-    if (ht._counts) {
-        for (unsigned int i = 0; i < ht._n_tables; i++) {
-            delete[] ht._counts[i];
-            ht._counts[i] = NULL;
-        }
-        delete[] ht._counts;
-        ht._counts = NULL;
-    }
+    ht._free_counters();
     ht._tablesizes.clear();
 
     try {
@@ -535,7 +650,11 @@ CountingHashFileReader::CountingHashFileReader(
                 << " while reading k-mer count file from " << infilename
                 << "; should be " << (int) SAVED_FORMAT_VERSION;
             throw khmer_file_exception(err.str());
-        } else if (!(ht_type == SAVED_COUNTING_HT)) {
+        } else if (!((ht_type & ~(SAVED_FLAG_FASTRANGE |
+                                  SAVED_FLAG_PAGE_ALIGNED |
+                                  SAVED_FLAG_CHUNKED |
+                                  SAVED_FLAG_SPARSE))
+                     == ht._saved_type())) {
             std::ostringstream err;
             err << "Incorrect file format type " << (int) ht_type
                 << " while reading k-mer count file from " << infilename;
@@ -553,42 +672,86 @@ CountingHashFileReader::CountingHashFileReader(
         ht._init_bitstuff();
 
         ht._use_bigcount = use_bigcount;
+        ht._use_fastrange = (ht_type & SAVED_FLAG_FASTRANGE) != 0;
 
-        ht._counts = new Byte*[ht._n_tables];
-        for (unsigned int i = 0; i < ht._n_tables; i++) {
+        const size_t n_stored = ht._n_stored_tables();
+        ht._counts = new Byte*[n_stored];
+        for (unsigned int i = 0; i < n_stored; i++) {
             ht._counts[i] = NULL;
         }
 
-        for (unsigned int i = 0; i < ht._n_tables; i++) {
-            HashIntoType tablesize;
+        if (ht_type & (SAVED_FLAG_PAGE_ALIGNED | SAVED_FLAG_CHUNKED)) {
+            std::vector<HashIntoType> table_bytes;
+            for (unsigned int i = 0; i < n_stored; i++) {
+                infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+                ht._tablesizes.push_back((HashIntoType) save_tablesize);
+                table_bytes.push_back(ht._table_bytes(save_tablesize));
+            }
+            if (ht_type & SAVED_FLAG_CHUNKED) {
+                ChunkedFileReader chunks(infilename);
+                ht._load_chunked_tables(chunks, infilename, table_bytes,
+                                        ht._counts, n_threads);
+
+                // the bigcounts are the section after the tables.
+                if (chunks.n_sections() != n_stored + 1
+                        || chunks.section_bytes(n_stored)
+                        % BigCountMap::entry_bytes) {
+                    throw khmer_file_exception("Bad table layout in k-mer "
+                                               "count file: " + infilename);
+                }
+                HashIntoType n_counts = chunks.section_bytes(n_stored)
+                                        / BigCountMap::entry_bytes;
+                if (n_counts) {
+                    ht._bigcounts.clear();
+
+                    std::vector<char> buffer(chunks.section_bytes(n_stored));
+                    chunks.read_section(n_stored, (Byte *) buffer.data(),
+                                        n_threads);
+                    ht._bigcounts.deserialize(buffer.data(), n_counts);
+                }
+            } else {
+                ht._load_page_aligned_tables(infile, infilename, table_bytes,
+                                             ht._counts, mode);
+            }
+        } else {
+            for (unsigned int i = 0; i < n_stored; i++) {
+                HashIntoType tablesize;
 
-            infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+                infile.read((char *) &save_tablesize, sizeof(save_tablesize));
 
-            tablesize = (HashIntoType) save_tablesize;
-            ht._tablesizes.push_back(tablesize);
+                tablesize = (HashIntoType) save_tablesize;
+                ht._tablesizes.push_back(tablesize);
 
-            ht._counts[i] = new Byte[tablesize];
+                HashIntoType tablebytes = ht._table_bytes(tablesize);
+                if (ht_type & SAVED_FLAG_SPARSE) {
+                    ht._counts[i] = ht._read_encoded_table(tablebytes,
+                                                           infilename,
+                    [&](Byte * data, size_t bytes) {
+                        infile.read((char *) data, bytes);
+                    });
+                } else {
+                    ht._counts[i] = ht._allocate_table(tablebytes, false);
 
-            unsigned long long loaded = 0;
-            while (loaded != tablesize) {
-                infile.read((char *) ht._counts[i], tablesize - loaded);
-                loaded += infile.gcount();
+                    unsigned long long loaded = 0;
+                    while (loaded != tablebytes) {
+                        infile.read((char *) ht._counts[i],
+                                    tablebytes - loaded);
+                        loaded += infile.gcount();
+                    }
+                }
             }
         }
 
-        HashIntoType n_counts = 0;
-        infile.read((char *) &n_counts, sizeof(n_counts));
+        if (!(ht_type & SAVED_FLAG_CHUNKED)) {
+            HashIntoType n_counts = 0;
+            infile.read((char *) &n_counts, sizeof(n_counts));
 
-        if (n_counts) {
-            ht._bigcounts.clear();
+            if (n_counts) {
+                ht._bigcounts.clear();
 
-            HashIntoType kmer;
-            BoundedCounterType count;
-
-            for (HashIntoType n = 0; n < n_counts; n++) {
-                infile.read((char *) &kmer, sizeof(kmer));
-                infile.read((char *) &count, sizeof(count));
-                ht._bigcounts[kmer] = count;
+                std::vector<char> buffer(n_counts * BigCountMap::entry_bytes);
+                infile.read(buffer.data(), buffer.size());
+                ht._bigcounts.deserialize(buffer.data(), n_counts);
             }
         }
 
@@ -605,6 +768,32 @@ CountingHashFileReader::CountingHashFileReader(
     }
 }
 
+// read exactly bytes bytes from infile, throwing if that fails; the caller
+// closes infile.
+static void _gzread_fully(gzFile infile, Byte * data, size_t bytes,
+                          const std::string &infilename)
+{
+    while (bytes) {
+        // Zlib can only read chunks of at most INT_MAX bytes.
+        const unsigned int to_read = std::min(bytes, (size_t) INT_MAX);
+        int read_b = gzread(infile, (char *) data, to_read);
+
+        if (read_b <= 0) {
+            std::string gzerr = gzerror(infile, &read_b);
+            std::string err = "K-mer count file read error: " + infilename;
+            if (read_b == Z_ERRNO) {
+                err = err + " " + strerror(errno);
+            } else {
+                err = err + " " + gzerr;
+            }
+            throw khmer_file_exception(err);
+        }
+
+        data += read_b;
+        bytes -= read_b;
+    }
+}
+
 CountingHashGzFileReader::CountingHashGzFileReader(
     const std::string   &infilename,
     CountingHash    &ht)
@@ -615,14 +804,7 @@ CountingHashGzFileReader::CountingHashGzFileReader(
         throw khmer_file_exception(err);
     }
 
-    if (ht._counts) {
-        for (unsigned int i = 0; i < ht._n_tables; i++) {
-            delete[] ht._counts[i];
-            ht._counts[i] = NULL;
-        }
-        delete[] ht._counts;
-        ht._counts = NULL;
-    }
+    ht._free_counters();
     ht._tablesizes.clear();
 
     unsigned int save_ksize = 0;
@@ -647,7 +829,8 @@ CountingHashGzFileReader::CountingHashGzFileReader(
             SAVED_SIGNATURE;
         throw khmer_file_exception(err.str());
     } else if (!(version == SAVED_FORMAT_VERSION)
-               || !(ht_type == SAVED_COUNTING_HT)) {
+               || !((ht_type & ~(SAVED_FLAG_FASTRANGE | SAVED_FLAG_SPARSE))
+                    == ht._saved_type())) {
         if (!(version == SAVED_FORMAT_VERSION)) {
             std::ostringstream err;
             err << "Incorrect file format version " << (int) version
@@ -655,7 +838,9 @@ CountingHashGzFileReader::CountingHashGzFileReader(
                 << "; should be " << (int) SAVED_FORMAT_VERSION;
             gzclose(infile);
             throw khmer_file_exception(err.str());
-        } else if (!(ht_type == SAVED_COUNTING_HT)) {
+        } else if (!((ht_type & ~(SAVED_FLAG_FASTRANGE |
+                                  SAVED_FLAG_SPARSE))
+                     == ht._saved_type())) {
             std::ostringstream err;
             err << "Incorrect file format type " << (int) ht_type
                 << " while reading k-mer count file from " << infilename;
@@ -684,9 +869,15 @@ CountingHashGzFileReader::CountingHashGzFileReader(
     ht._init_bitstuff();
 
     ht._use_bigcount = use_bigcount;
+    ht._use_fastrange = (ht_type & SAVED_FLAG_FASTRANGE) != 0;
+
+    const size_t n_stored = ht._n_stored_tables();
+    ht._counts = new Byte*[n_stored];
+    for (unsigned int i = 0; i < n_stored; i++) {
+        ht._counts[i] = NULL;
+    }
 
-    ht._counts = new Byte*[ht._n_tables];
-    for (unsigned int i = 0; i < ht._n_tables; i++) {
+    for (unsigned int i = 0; i < n_stored; i++) {
         HashIntoType tablesize;
 
         read_b = gzread(infile, (char *) &save_tablesize,
@@ -708,11 +899,24 @@ CountingHashGzFileReader::CountingHashGzFileReader(
         tablesize = (HashIntoType) save_tablesize;
         ht._tablesizes.push_back(tablesize);
 
-        ht._counts[i] = new Byte[tablesize];
+        HashIntoType tablebytes = ht._table_bytes(tablesize);
+        if (ht_type & SAVED_FLAG_SPARSE) {
+            try {
+                ht._counts[i] = ht._read_encoded_table(tablebytes, infilename,
+                [&](Byte * data, size_t bytes) {
+                    _gzread_fully(infile, data, bytes, infilename);
+                });
+            } catch (khmer_file_exception &) {
+                gzclose(infile);
+                throw;
+            }
+            continue;
+        }
+        ht._counts[i] = ht._allocate_table(tablebytes, false);
 
         HashIntoType loaded = 0;
-        while (loaded != tablesize) {
-            unsigned long long  to_read_ll = tablesize - loaded;
+        while (loaded != tablebytes) {
+            unsigned long long  to_read_ll = tablebytes - loaded;
             unsigned int        to_read_int;
             // Zlib can only read chunks of at most INT_MAX bytes.
             if (to_read_ll > INT_MAX) {
@@ -755,14 +959,20 @@ CountingHashGzFileReader::CountingHashGzFileReader(
     if (n_counts) {
         ht._bigcounts.clear();
 
-        HashIntoType kmer;
-        BoundedCounterType count;
-
-        for (HashIntoType n = 0; n < n_counts; n++) {
-            int read_k = gzread(infile, (char *) &kmer, sizeof(kmer));
-            int read_c = gzread(infile, (char *) &count, sizeof(count));
+        std::vector<char> buffer(n_counts * BigCountMap::entry_bytes);
+        HashIntoType loaded = 0;
+        while (loaded != buffer.size()) {
+            unsigned long long  to_read_ll = buffer.size() - loaded;
+            unsigned int        to_read_int;
+            // Zlib can only read chunks of at most INT_MAX bytes.
+            if (to_read_ll > INT_MAX) {
+                to_read_int = INT_MAX;
+            } else {
+                to_read_int = (unsigned int) to_read_ll;
+            }
+            read_b = gzread(infile, buffer.data() + loaded, to_read_int);
 
-            if (read_k <= 0 || read_c <= 0) {
+            if (read_b <= 0) {
                 std::string gzerr = gzerror(infile, &read_b);
                 std::string err = "K-mer count read error: " + infilename;
                 if (read_b == Z_ERRNO) {
@@ -774,8 +984,10 @@ CountingHashGzFileReader::CountingHashGzFileReader(
                 throw khmer_file_exception(err);
             }
 
-            ht._bigcounts[kmer] = count;
+            loaded += read_b;
         }
+
+        ht._bigcounts.deserialize(buffer.data(), n_counts);
     }
 
     gzclose(infile);
@@ -783,7 +995,10 @@ CountingHashGzFileReader::CountingHashGzFileReader(
 
 CountingHashFileWriter::CountingHashFileWriter(
     const std::string   &outfilename,
-    const CountingHash  &ht)
+    const CountingHash  &ht,
+    unsigned char       layout,
+    ChunkCodec          codec,
+    unsigned int        n_threads)
 {
     if (!ht._counts[0]) {
         throw khmer_exception();
@@ -794,13 +1009,30 @@ CountingHashFileWriter::CountingHashFileWriter(
     unsigned long long save_tablesize;
     unsigned long long save_occupied_bins = ht._occupied_bins;
 
+    std::vector<HashIntoType> table_bytes;
+    for (unsigned int i = 0; i < ht._n_stored_tables(); i++) {
+        table_bytes.push_back(ht._table_bytes(ht._tablesizes[i]));
+    }
+    // the tables of plain files go sparse where that pays.
+    std::vector<TableEncoding> encodings;
+    std::vector<HashIntoType> encoded_bytes;
+    if (!layout && Hashtable::_choose_table_encodings(ht._counts, table_bytes,
+            ht._occupied_bins, ht._tablesizes[0], false, encodings,
+            encoded_bytes)) {
+        layout = SAVED_FLAG_SPARSE;
+    }
+
     ofstream outfile(outfilename.c_str(), ios::binary);
 
     outfile.write(SAVED_SIGNATURE, 4);
     unsigned char version = SAVED_FORMAT_VERSION;
     outfile.write((const char *) &version, 1);
 
-    unsigned char ht_type = SAVED_COUNTING_HT;
+    unsigned char ht_type = ht._saved_type();
+    if (ht._use_fastrange) {
+        ht_type |= SAVED_FLAG_FASTRANGE;
+    }
+    ht_type |= layout;
     outfile.write((const char *) &ht_type, 1);
 
     unsigned char use_bigcount = 0;
@@ -814,23 +1046,53 @@ CountingHashFileWriter::CountingHashFileWriter(
     outfile.write((const char *) &save_occupied_bins,
                   sizeof(save_occupied_bins));
 
-    for (unsigned int i = 0; i < save_n_tables; i++) {
-        save_tablesize = ht._tablesizes[i];
+    std::vector<char> buffer;
+    ht._bigcounts.serialize(buffer);
+
+    if (layout & SAVED_FLAG_SPARSE) {
+        for (unsigned int i = 0; i < ht._n_stored_tables(); i++) {
+            save_tablesize = ht._tablesizes[i];
+            outfile.write((const char *) &save_tablesize,
+                          sizeof(save_tablesize));
+            Hashtable::_write_encoded_table(ht._counts[i], table_bytes[i],
+                                            encodings[i], encoded_bytes[i],
+            [&](const Byte * data, size_t bytes) {
+                outfile.write((const char *) data, bytes);
+            });
+        }
+    } else if (layout) {
+        for (unsigned int i = 0; i < ht._n_stored_tables(); i++) {
+            save_tablesize = ht._tablesizes[i];
+            outfile.write((const char *) &save_tablesize,
+                          sizeof(save_tablesize));
+        }
+        if (layout & SAVED_FLAG_CHUNKED) {
+            // the bigcounts go in the container too, as its last section.
+            std::vector<const Byte *> sections(ht._counts,
+                                               ht._counts + table_bytes.size());
+            sections.push_back((const Byte *) buffer.data());
+            table_bytes.push_back(buffer.size());
+            ChunkedFileWriter::write(outfile, sections, table_bytes, codec,
+                                     n_threads);
+        } else {
+            Hashtable::_write_page_aligned_tables(outfile, ht._counts,
+                                                  table_bytes);
+        }
+    } else {
+        for (unsigned int i = 0; i < ht._n_stored_tables(); i++) {
+            save_tablesize = ht._tablesizes[i];
 
-        outfile.write((const char *) &save_tablesize, sizeof(save_tablesize));
-        outfile.write((const char *) ht._counts[i], save_tablesize);
+            outfile.write((const char *) &save_tablesize,
+                          sizeof(save_tablesize));
+            outfile.write((const char *) ht._counts[i],
+                          ht._table_bytes(save_tablesize));
+        }
     }
 
-    HashIntoType n_counts = ht._bigcounts.size();
-    outfile.write((const char *) &n_counts, sizeof(n_counts));
-
-    if (n_counts) {
-        KmerCountMap::const_iterator it = ht._bigcounts.begin();
-
-        for (; it != ht._bigcounts.end(); ++it) {
-            outfile.write((const char *) &it->first, sizeof(it->first));
-            outfile.write((const char *) &it->second, sizeof(it->second));
-        }
+    if (!(layout & SAVED_FLAG_CHUNKED)) {
+        HashIntoType n_counts = buffer.size() / BigCountMap::entry_bytes;
+        outfile.write((const char *) &n_counts, sizeof(n_counts));
+        outfile.write(buffer.data(), buffer.size());
     }
     if (outfile.fail()) {
         throw khmer_file_exception(strerror(errno));
@@ -838,6 +1100,38 @@ CountingHashFileWriter::CountingHashFileWriter(
     outfile.close();
 }
 
+// write all of data to outfile, closing it and throwing if that fails.
+static void _gzwrite_fully(gzFile outfile, const Byte * data, size_t bytes)
+{
+    while (bytes) {
+        // Zlib can only write chunks of at most INT_MAX bytes.
+        const unsigned int to_write = std::min(bytes, (size_t) INT_MAX);
+        int gz_result = gzwrite(outfile, (const char *) data, to_write);
+        // Zlib returns 0 on error
+        if (gz_result == 0) {
+            int errcode = 0;
+            const char *err_msg;
+            std::ostringstream msg;
+
+            msg << "gzwrite failed while writing counting hash: ";
+            // Get zlib error
+            err_msg = gzerror(outfile, &errcode);
+            if (errcode != Z_ERRNO) {
+                // Zlib error, not stdlib
+                msg << err_msg;
+                gzclearerr(outfile);
+            } else {
+                // stdlib error
+                msg << strerror(errno);
+            }
+            gzclose(outfile);
+            throw khmer_file_exception(msg.str());
+        }
+        data += gz_result;
+        bytes -= gz_result;
+    }
+}
+
 CountingHashGzFileWriter::CountingHashGzFileWriter(
     const std::string   &outfilename,
     const CountingHash  &ht)
@@ -852,6 +1146,21 @@ CountingHashGzFileWriter::CountingHashGzFileWriter(
     unsigned long long save_tablesize;
     unsigned long long save_occupied_bins = ht._occupied_bins;
 
+    std::vector<HashIntoType> table_bytes;
+    for (unsigned int i = 0; i < ht._n_stored_tables(); i++) {
+        table_bytes.push_back(ht._table_bytes(ht._tablesizes[i]));
+    }
+    // going sparse saves deflating the runs of zeros too.
+    unsigned char layout = 0;
+    std::vector<TableEncoding> encodings;
+    std::vector<HashIntoType> encoded_bytes;
+    if (Hashtable::_choose_table_encodings(ht._counts, table_bytes,
+                                           ht._occupied_bins,
+                                           ht._tablesizes[0], false,
+                                           encodings, encoded_bytes)) {
+        layout = SAVED_FLAG_SPARSE;
+    }
+
     gzFile outfile = gzopen(outfilename.c_str(), "wb");
     if (outfile == NULL) {
         const char * error = gzerror(outfile, &errnum);
@@ -866,7 +1175,11 @@ CountingHashGzFileWriter::CountingHashGzFileWriter(
     unsigned char version = SAVED_FORMAT_VERSION;
     gzwrite(outfile, (const char *) &version, 1);
 
-    unsigned char ht_type = SAVED_COUNTING_HT;
+    unsigned char ht_type = ht._saved_type();
+    if (ht._use_fastrange) {
+        ht_type |= SAVED_FLAG_FASTRANGE;
+    }
+    ht_type |= layout;
     gzwrite(outfile, (const char *) &ht_type, 1);
 
     unsigned char use_bigcount = 0;
@@ -880,58 +1193,45 @@ CountingHashGzFileWriter::CountingHashGzFileWriter(
     gzwrite(outfile, (const char *) &save_occupied_bins,
             sizeof(save_occupied_bins));
 
-    for (unsigned int i = 0; i < save_n_tables; i++) {
+    for (unsigned int i = 0; i < ht._n_stored_tables(); i++) {
         save_tablesize = ht._tablesizes[i];
 
         gzwrite(outfile, (const char *) &save_tablesize,
                 sizeof(save_tablesize));
-        unsigned long long written = 0;
-        while (written != save_tablesize) {
-            unsigned long long  to_write_ll = save_tablesize - written;
-            unsigned int        to_write_int;
-            int                 gz_result;
-            // Zlib can only write chunks of at most INT_MAX bytes.
-            if (to_write_ll > INT_MAX) {
-                to_write_int = INT_MAX;
-            } else {
-                to_write_int = (unsigned int) to_write_ll;
-            }
-            gz_result = gzwrite(outfile, (const char *) ht._counts[i],
-                                to_write_int);
-            // Zlib returns 0 on error
-            if (gz_result == 0) {
-                int errcode = 0;
-                const char *err_msg;
-                std::ostringstream msg;
-
-                msg << "gzwrite failed while writing counting hash: ";
-                // Get zlib error
-                err_msg = gzerror(outfile, &errcode);
-                if (errcode != Z_ERRNO) {
-                    // Zlib error, not stdlib
-                    msg << err_msg;
-                    gzclearerr(outfile);
-                } else {
-                    // stdlib error
-                    msg << strerror(errno);
-                }
-                gzclose(outfile);
-                throw khmer_file_exception(msg.str());
-            }
-            written += gz_result;
+        if (layout & SAVED_FLAG_SPARSE) {
+            Hashtable::_write_encoded_table(ht._counts[i], table_bytes[i],
+                                            encodings[i], encoded_bytes[i],
+            [&](const Byte * data, size_t bytes) {
+                _gzwrite_fully(outfile, data, bytes);
+            });
+        } else {
+            _gzwrite_fully(outfile, ht._counts[i], table_bytes[i]);
         }
     }
 
-    HashIntoType n_counts = ht._bigcounts.size();
-    gzwrite(outfile, (const char *) &n_counts, sizeof(n_counts));
+    std::vector<char> buffer;
+    ht._bigcounts.serialize(buffer);
 
-    if (n_counts) {
-        KmerCountMap::const_iterator it = ht._bigcounts.begin();
+    HashIntoType n_counts = buffer.size() / BigCountMap::entry_bytes;
+    gzwrite(outfile, (const char *) &n_counts, sizeof(n_counts));
 
-        for (; it != ht._bigcounts.end(); ++it) {
-            gzwrite(outfile, (const char *) &it->first, sizeof(it->first));
-            gzwrite(outfile, (const char *) &it->second, sizeof(it->second));
+    unsigned long long written = 0;
+    while (written != buffer.size()) {
+        unsigned long long  to_write_ll = buffer.size() - written;
+        unsigned int        to_write_int;
+        // Zlib can only write chunks of at most INT_MAX bytes.
+        if (to_write_ll > INT_MAX) {
+            to_write_int = INT_MAX;
+        } else {
+            to_write_int = (unsigned int) to_write_ll;
         }
+        int gz_result = gzwrite(outfile, buffer.data() + written,
+                                to_write_int);
+        // Zlib returns 0 on error; reported below.
+        if (gz_result == 0) {
+            break;
+        }
+        written += gz_result;
     }
     const char * error = gzerror(outfile, &errnum);
     if (errnum == Z_ERRNO) {
@@ -951,7 +1251,6 @@ void CountingHash::collect_high_abundance_kmers(
     unsigned long long total_reads = 0;
 
     IParser* parser = IParser::get_parser(filename.c_str());
-    Read read;
 
     string currSeq = "";
 
@@ -961,12 +1260,10 @@ void CountingHash::collect_high_abundance_kmers(
     //
 
     bool done = false;
-    while(!parser->is_complete() && !done)  {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while (!done && (next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         currSeq = read.sequence;
 
         // do we want to process it?
@@ -1004,12 +1301,10 @@ void CountingHash::collect_high_abundance_kmers(
     parser = IParser::get_parser(filename.c_str());
 
     total_reads = 0;
-    while(!parser->is_complete() && total_reads != stop_at_read)  {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads second_pass(parser);
+    while (total_reads != stop_at_read
+            && (next_read = second_pass.next()) != NULL) {
+        Read &read = *next_read;
         currSeq = read.sequence;
 
         // do we want to process it?
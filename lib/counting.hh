@@ -41,11 +41,11 @@ Contact: khmer-project@idyll.org
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
-#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "bigcount.hh"
 #include "hashtable.hh"
 #include "khmer.hh"
 #include "kmer_hash.hh"
@@ -62,7 +62,6 @@ struct IParser;
 
 namespace khmer
 {
-typedef std::map<HashIntoType, BoundedCounterType> KmerCountMap;
 
 class CountingHashFile;
 class CountingHashFileReader;
@@ -70,6 +69,8 @@ class CountingHashFileWriter;
 class CountingHashGzFileReader;
 class CountingHashGzFileWriter;
 class CountingHashIntersect;
+class BlockedCountingHash;
+class PackedCountingHash;
 
 class CountingHash : public khmer::Hashtable
 {
@@ -82,11 +83,11 @@ class CountingHash : public khmer::Hashtable
 
 protected:
     bool _use_bigcount;		// keep track of counts > Bloom filter hash count threshold?
-    uint32_t _bigcount_spin_lock;
     std::vector<HashIntoType> _tablesizes;
     size_t _n_tables;
     HashIntoType _n_unique_kmers;
     HashIntoType _occupied_bins;
+    unsigned int _counter_bits;	// 8, or less for PackedCountingHash
 
     Byte ** _counts;
 
@@ -96,46 +97,106 @@ protected:
 
         _counts = new Byte*[_n_tables];
         for (size_t i = 0; i < _n_tables; i++) {
-            _counts[i] = new Byte[_tablesizes[i]];
-            memset(_counts[i], 0, _tablesizes[i]);
+            _counts[i] = _allocate_table(_table_bytes(_tablesizes[i]));
         }
     }
+
+    // the number of bytes that hold tablesize counters.
+    HashIntoType _table_bytes(HashIntoType tablesize) const
+    {
+        return (tablesize * _counter_bits + 7) / 8;
+    }
+
+    // release the tables in _counts; there is one per entry in _tablesizes.
+    void _free_counters()
+    {
+        if (_counts) {
+            for (size_t i = 0; i < _tablesizes.size(); i++) {
+                if (_counts[i]) {
+                    if (!_mapped_file) {
+                        _free_table(_counts[i]);
+                    }
+                    _counts[i] = NULL;
+                }
+            }
+
+            delete[] _counts;
+            _counts = NULL;
+        }
+        _unmap_tables();
+    }
+
+    // The type byte written to saved files, and the number of tables in
+    // _counts. Usually there is one table per hash function, but the
+    // blocked layout keeps all of its counters in a single table.
+    virtual unsigned char _saved_type() const
+    {
+        return SAVED_COUNTING_HT;
+    }
+    virtual size_t _n_stored_tables() const
+    {
+        return _n_tables;
+    }
+
+    // count a k-mer whose counters are all at _max_count.
+    void _count_big(HashIntoType khash)
+    {
+        _bigcounts.increment(khash, _max_count + 1, _max_bigcount);
+    }
+
+    virtual void _count_hashes(const HashIntoType * hashes, size_t n)
+    {
+        _pipeline_count(this, hashes, n);
+    }
+    virtual void _get_counts(const HashIntoType * hashes, size_t n,
+                             BoundedCounterType * counts) const
+    {
+        _pipeline_get_counts(this, hashes, n, counts);
+    }
+    virtual void _test_and_set_hashes(const HashIntoType * hashes, size_t n,
+                                      Byte * is_new)
+    {
+        _pipeline_test_and_set(this, hashes, n, is_new);
+    }
+
+    // for PackedCountingHash, whose counters are counter_bits wide.
+    CountingHash( WordLength ksize, std::vector<HashIntoType>& tablesizes,
+                  bool fastrange, unsigned int counter_bits ) :
+        khmer::Hashtable(ksize), _use_bigcount(false), _tablesizes(tablesizes),
+        _n_unique_kmers(0), _occupied_bins(0), _counter_bits(counter_bits)
+    {
+        _use_fastrange = fastrange;
+        _max_count = (1 << counter_bits) - 1;
+
+        _allocate_counters();
+    }
 public:
-    KmerCountMap _bigcounts;
+    BigCountMap _bigcounts;
 
     CountingHash( WordLength ksize, HashIntoType single_tablesize ) :
-        khmer::Hashtable(ksize), _use_bigcount(false),
-        _bigcount_spin_lock(false), _n_unique_kmers(0), _occupied_bins(0)
+        khmer::Hashtable(ksize), _use_bigcount(false), _n_unique_kmers(0),
+        _occupied_bins(0), _counter_bits(8)
     {
         _tablesizes.push_back(single_tablesize);
 
         _allocate_counters();
     }
 
-    CountingHash( WordLength ksize, std::vector<HashIntoType>& tablesizes ) :
-        khmer::Hashtable(ksize), _use_bigcount(false),
-        _bigcount_spin_lock(false), _tablesizes(tablesizes),
-        _n_unique_kmers(0), _occupied_bins(0)
+    // with fastrange, the table sizes need not be prime.
+    CountingHash( WordLength ksize, std::vector<HashIntoType>& tablesizes,
+                  bool fastrange = false ) :
+        khmer::Hashtable(ksize), _use_bigcount(false), _tablesizes(tablesizes),
+        _n_unique_kmers(0), _occupied_bins(0), _counter_bits(8)
     {
+        _use_fastrange = fastrange;
 
         _allocate_counters();
     }
 
     virtual ~CountingHash()
     {
-        if (_counts) {
-            for (size_t i = 0; i < _n_tables; i++) {
-                if (_counts[i]) {
-                    delete[] _counts[i];
-                    _counts[i] = NULL;
-                }
-            }
-
-            delete[] _counts;
-            _counts = NULL;
-
-            _n_tables = 0;
-        }
+        _free_counters();
+        _n_tables = 0;
     }
 
     // Writing to the tables outside of defined methods has undefined behavior!
@@ -145,6 +206,23 @@ public:
         return _counts;
     }
 
+    // the size in bytes of each of the raw tables.
+    std::vector<HashIntoType> get_raw_table_sizes() const
+    {
+        std::vector<HashIntoType> sizes;
+        for (size_t i = 0; i < _n_stored_tables(); i++) {
+            sizes.push_back(_table_bytes(_tablesizes[i]));
+        }
+        return sizes;
+    }
+
+    // the width of the counters in bits; counts saturate at
+    // 2**counter_bits - 1, or go on into the bigcounts when that is 255.
+    unsigned int get_counter_bits() const
+    {
+        return _counter_bits;
+    }
+
     virtual BoundedCounterType test_and_set_bits(const char * kmer)
     {
         BoundedCounterType x = get_count(kmer); // @CTB just hash it, yo.
@@ -152,10 +230,12 @@ public:
         return !x;
     }
 
+    // qualified, so that _pipeline_test_and_set can inline it; the
+    // subclasses have their own.
     virtual BoundedCounterType test_and_set_bits(HashIntoType khash)
     {
-        BoundedCounterType x = get_count(khash);
-        count(khash);
+        BoundedCounterType x = CountingHash::get_count(khash);
+        CountingHash::count(khash);
         return !x;
     }
 
@@ -169,7 +249,7 @@ public:
         return _n_unique_kmers;
     }
 
-    void set_use_bigcount(bool b)
+    virtual void set_use_bigcount(bool b)
     {
         _use_bigcount = b;
     }
@@ -178,8 +258,11 @@ public:
         return _use_bigcount;
     }
 
-    virtual void save(std::string);
-    virtual void load(std::string);
+    virtual void save(std::string, bool page_aligned = false);
+    virtual void save_chunked(std::string, ChunkCodec codec,
+                              unsigned int n_threads = 1);
+    virtual void load(std::string, TableLoadMode mode = LOAD_TABLES_READ,
+                      unsigned int n_threads = 1);
 
     const size_t n_tables() const
     {
@@ -192,6 +275,21 @@ public:
         return _occupied_bins;
     }
 
+    virtual void prefetch(HashIntoType khash) const
+    {
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
+
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            const HashIntoType bin = _use_fastrange ?
+                                     _fastrange(h1 + i * h2, _tablesizes[i]) :
+                                     khash % _tablesizes[i];
+            __builtin_prefetch(_counts[i] + bin);
+        }
+    }
+
     virtual void count(const char * kmer)
     {
         HashIntoType hash = _hash(kmer, _ksize);
@@ -200,11 +298,19 @@ public:
 
     virtual void count(HashIntoType khash)
     {
+        _check_writable();
+
         bool is_new_kmer = false;
         unsigned int  n_full	  = 0;
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
 
         for (unsigned int i = 0; i < _n_tables; i++) {
-            const HashIntoType bin = khash % _tablesizes[i];
+            const HashIntoType bin = _use_fastrange ?
+                                     _fastrange(h1 + i * h2, _tablesizes[i]) :
+                                     khash % _tablesizes[i];
             Byte current_count = _counts[ i ][ bin ];
             if (!is_new_kmer) {
                 if (current_count == 0) {
@@ -228,15 +334,7 @@ public:
         } // for each table
 
         if (n_full == _n_tables && _use_bigcount) {
-            while (!__sync_bool_compare_and_swap( &_bigcount_spin_lock, 0, 1 ));
-            if (_bigcounts[khash] == 0) {
-                _bigcounts[khash] = _max_count + 1;
-            } else {
-                if (_bigcounts[khash] < _max_bigcount) {
-                    _bigcounts[khash] += 1;
-                }
-            }
-            __sync_bool_compare_and_swap( &_bigcount_spin_lock, 1, 0 );
+            _count_big(khash);
         }
 
         if (is_new_kmer) {
@@ -257,17 +355,22 @@ public:
     {
         unsigned int	  max_count	= _max_count;
         BoundedCounterType  min_count	= max_count;
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
+
         for (unsigned int i = 0; i < _n_tables; i++) {
-            BoundedCounterType the_count = _counts[i][khash % _tablesizes[i]];
+            const HashIntoType bin = _use_fastrange ?
+                                     _fastrange(h1 + i * h2, _tablesizes[i]) :
+                                     khash % _tablesizes[i];
+            BoundedCounterType the_count = _counts[i][bin];
             if (the_count < min_count) {
                 min_count = the_count;
             }
         }
         if (min_count == max_count && _use_bigcount) {
-            KmerCountMap::const_iterator it = _bigcounts.find(khash);
-            if (it != _bigcounts.end()) {
-                min_count = it->second;
-            }
+            _bigcounts.get(khash, min_count);
         }
         return min_count;
     }
@@ -281,8 +384,11 @@ public:
 
     HashIntoType * abundance_distribution(read_parsers::IParser * parser,
                                           Hashbits * tracking);
+    // n_threads > 1 splits a plain file into byte ranges, each parsed and
+    // tallied on a thread of its own.
     HashIntoType * abundance_distribution(std::string filename,
-                                          Hashbits * tracking);
+                                          Hashbits * tracking,
+                                          unsigned int n_threads = 1);
 
     HashIntoType * fasta_count_kmers_by_position(const std::string &inputfile,
             const unsigned int max_read_len,
@@ -297,10 +403,17 @@ public:
 
     unsigned long trim_on_abundance(std::string seq,
                                     BoundedCounterType min_abund) const;
+    unsigned long trim_on_abundance(const KmerHashBlock &kmers,
+                                    BoundedCounterType min_abund) const;
     unsigned long trim_below_abundance(std::string seq,
                                        BoundedCounterType max_abund) const;
+    unsigned long trim_below_abundance(const KmerHashBlock &kmers,
+                                       BoundedCounterType max_abund) const;
     std::vector<unsigned int> find_spectral_error_positions(std::string seq,
             BoundedCounterType min_abund) const;
+    std::vector<unsigned int> find_spectral_error_positions(
+        const KmerHashBlock &kmers,
+        BoundedCounterType min_abund) const;
 
     void collect_high_abundance_kmers(const std::string &infilename,
                                       unsigned int lower_count,
@@ -309,17 +422,337 @@ public:
 };
 
 
+/**
+ * \class BlockedCountingHash
+ *
+ * \brief A CountingHash with all of a k-mer's counters in one cache line.
+ *
+ * Instead of one prime-sized table per hash function, the counters live
+ * in a single table of CACHE_LINE_SIZE-byte blocks. One hash of the k-mer
+ * picks a block, and n_tables distinct counters within that block play
+ * the part of the separate tables, so counting or looking up a k-mer
+ * touches one cache line (and one page) rather than n_tables of them.
+ * The price is a somewhat higher false positive rate than independent
+ * tables of the same total size, since busy blocks fill up together.
+ *
+ * n_tables() is the number of counters per k-mer (at most
+ * CACHE_LINE_SIZE); get_tablesizes() returns the size of the one table.
+ * n_occupied() counts every occupied counter, so n_occupied() over the
+ * table size still estimates the chance that a single counter collides.
+ */
+class BlockedCountingHash : public CountingHash
+{
+protected:
+    HashIntoType _n_blocks;
+
+    virtual unsigned char _saved_type() const
+    {
+        return SAVED_BLOCKED_COUNTING_HT;
+    }
+    virtual size_t _n_stored_tables() const
+    {
+        return 1;
+    }
+
+    // find the block for this k-mer, and the position of and stride
+    // between its counters. The stride is odd, so the n_tables positions
+    // (pos + i * step) % CACHE_LINE_SIZE are all different.
+    const Byte * _get_block(HashIntoType khash, unsigned int &pos,
+                            unsigned int &step) const
+    {
+        HashIntoType h = _mix_hash(khash);
+
+        pos = h % CACHE_LINE_SIZE;
+        step = ((h >> 6) % CACHE_LINE_SIZE) | 1;
+        return _counts[0] + _fastrange(h, _n_blocks) * CACHE_LINE_SIZE;
+    }
+
+    virtual void _count_hashes(const HashIntoType * hashes, size_t n)
+    {
+        _pipeline_count(this, hashes, n);
+    }
+    virtual void _get_counts(const HashIntoType * hashes, size_t n,
+                             BoundedCounterType * counts) const
+    {
+        _pipeline_get_counts(this, hashes, n, counts);
+    }
+    virtual void _test_and_set_hashes(const HashIntoType * hashes, size_t n,
+                                      Byte * is_new)
+    {
+        _pipeline_test_and_set(this, hashes, n, is_new);
+    }
+public:
+    /** @param[in]  ksize The k-mer size.
+     *  @param[in]  tablesize The table size in bytes, rounded up to a
+     *              whole number of blocks.
+     *  @param[in]  n_tables The number of counters per k-mer.
+     */
+    BlockedCountingHash( WordLength ksize, HashIntoType tablesize,
+                         unsigned int n_tables );
+
+    virtual void load(std::string, TableLoadMode mode = LOAD_TABLES_READ,
+                      unsigned int n_threads = 1);
+
+    using CountingHash::count;
+    using CountingHash::get_count;
+    using CountingHash::test_and_set_bits;
+
+    virtual BoundedCounterType test_and_set_bits(HashIntoType khash)
+    {
+        BoundedCounterType x = BlockedCountingHash::get_count(khash);
+        BlockedCountingHash::count(khash);
+        return !x;
+    }
+
+    virtual void prefetch(HashIntoType khash) const
+    {
+        HashIntoType block = _fastrange(_mix_hash(khash), _n_blocks);
+        __builtin_prefetch(_counts[0] + block * CACHE_LINE_SIZE);
+    }
+
+    virtual void count(HashIntoType khash)
+    {
+        _check_writable();
+
+        bool is_new_kmer = false;
+        unsigned int n_full = 0;
+        unsigned int pos, step;
+        Byte * block = (Byte *) _get_block(khash, pos, step);
+
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            Byte current_count = block[pos];
+            if (current_count == 0) {
+                is_new_kmer = true;
+                __sync_add_and_fetch(&_occupied_bins, 1);
+            }
+            // NOTE: as in CountingHash::count, concurrent updates may push
+            //	 a counter a little past max_count.
+            if ( _max_count > current_count ) {
+                __sync_add_and_fetch( block + pos, 1 );
+            } else {
+                n_full++;
+            }
+            pos = (pos + step) % CACHE_LINE_SIZE;
+        }
+
+        if (n_full == _n_tables && _use_bigcount) {
+            _count_big(khash);
+        }
+
+        if (is_new_kmer) {
+            __sync_add_and_fetch(&_n_unique_kmers, 1);
+        }
+    }
+
+    virtual const BoundedCounterType get_count(HashIntoType khash) const
+    {
+        unsigned int	  max_count	= _max_count;
+        BoundedCounterType  min_count	= max_count;
+        unsigned int pos, step;
+        const Byte * block = _get_block(khash, pos, step);
+
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            BoundedCounterType the_count = block[pos];
+            if (the_count < min_count) {
+                min_count = the_count;
+            }
+            pos = (pos + step) % CACHE_LINE_SIZE;
+        }
+        if (min_count == max_count && _use_bigcount) {
+            _bigcounts.get(khash, min_count);
+        }
+        return min_count;
+    }
+};
+
+
+
+/**
+ * \class PackedCountingHash
+ *
+ * \brief A CountingHash with 4-bit or 2-bit counters.
+ *
+ * Two or four counters share each byte of a table, so the same memory
+ * holds two or four times as many counters, and the false positive rate
+ * at a fixed memory size drops accordingly. The counters saturate at 15
+ * or 3 instead of 255, and bigcounts are never kept, which is fine
+ * wherever only counts up to a small cutoff matter: trimming at
+ * cutoff 2, or normalizing to a coverage of at most 15.
+ *
+ * A counter is updated with a compare-and-swap on its byte, so that
+ * concurrent updates neither lose counts nor carry into the neighboring
+ * counter, and a full counter stays full.
+ */
+class PackedCountingHash : public CountingHash
+{
+protected:
+    unsigned int _per_byte_shift;	// log2 of the counters per byte
+
+    virtual unsigned char _saved_type() const
+    {
+        return _counter_bits == 4 ? SAVED_COUNTING_HT_4BIT :
+               SAVED_COUNTING_HT_2BIT;
+    }
+
+    // find the byte holding the counter in bin, and the counter's offset
+    // within that byte.
+    HashIntoType _byte(HashIntoType bin, unsigned int &shift) const
+    {
+        shift = (bin & ((1 << _per_byte_shift) - 1)) * _counter_bits;
+        return bin >> _per_byte_shift;
+    }
+
+    HashIntoType _bin(HashIntoType khash, HashIntoType h1, HashIntoType h2,
+                      unsigned int i) const
+    {
+        return _use_fastrange ? _fastrange(h1 + i * h2, _tablesizes[i]) :
+               khash % _tablesizes[i];
+    }
+
+    // add one to the counter in bin of table i unless it is full, and
+    // return its old value.
+    Byte _increment(unsigned int i, HashIntoType bin)
+    {
+        unsigned int shift;
+        Byte * byte = _counts[i] + _byte(bin, shift);
+
+        Byte old = *byte;
+        while (true) {
+            const Byte current = (old >> shift) & _max_count;
+            if (current == _max_count) {
+                return current;
+            }
+            const Byte seen = __sync_val_compare_and_swap(byte, old,
+                              (Byte) (old + (1 << shift)));
+            if (seen == old) {
+                return current;
+            }
+            old = seen;
+        }
+    }
+
+    virtual void _count_hashes(const HashIntoType * hashes, size_t n)
+    {
+        _pipeline_count(this, hashes, n);
+    }
+    virtual void _get_counts(const HashIntoType * hashes, size_t n,
+                             BoundedCounterType * counts) const
+    {
+        _pipeline_get_counts(this, hashes, n, counts);
+    }
+    virtual void _test_and_set_hashes(const HashIntoType * hashes, size_t n,
+                                      Byte * is_new)
+    {
+        _pipeline_test_and_set(this, hashes, n, is_new);
+    }
+public:
+    /** @param[in]  ksize The k-mer size.
+     *  @param[in]  tablesizes The number of counters in each table.
+     *  @param[in]  counter_bits The width of the counters, 4 or 2.
+     *  @param[in]  fastrange Use fastrange rather than modulo indexing.
+     */
+    PackedCountingHash( WordLength ksize,
+                        std::vector<HashIntoType>& tablesizes,
+                        unsigned int counter_bits, bool fastrange = false );
+
+    using CountingHash::count;
+    using CountingHash::get_count;
+    using CountingHash::test_and_set_bits;
+
+    // counters that stop at 15 or 3 never reach the bigcounts.
+    virtual void set_use_bigcount(bool b)
+    {
+        if (b) {
+            throw khmer_value_exception("bigcount needs 8-bit counters");
+        }
+        _use_bigcount = b;
+    }
+
+    virtual BoundedCounterType test_and_set_bits(HashIntoType khash)
+    {
+        BoundedCounterType x = PackedCountingHash::get_count(khash);
+        PackedCountingHash::count(khash);
+        return !x;
+    }
+
+    virtual void prefetch(HashIntoType khash) const
+    {
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
+
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            __builtin_prefetch(_counts[i] +
+                               (_bin(khash, h1, h2, i) >> _per_byte_shift));
+        }
+    }
+
+    virtual void count(HashIntoType khash)
+    {
+        _check_writable();
+
+        bool is_new_kmer = false;
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
+
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            if (_increment(i, _bin(khash, h1, h2, i)) == 0
+                    && !is_new_kmer) {
+                is_new_kmer = true;
+                if (i == 0) {
+                    __sync_add_and_fetch(&_occupied_bins, 1);
+                }
+            }
+        }
+
+        if (is_new_kmer) {
+            __sync_add_and_fetch(&_n_unique_kmers, 1);
+        }
+    }
+
+    virtual const BoundedCounterType get_count(HashIntoType khash) const
+    {
+        BoundedCounterType min_count = _max_count;
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
+
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            unsigned int shift;
+            HashIntoType byte = _byte(_bin(khash, h1, h2, i), shift);
+            BoundedCounterType the_count =
+                (_counts[i][byte] >> shift) & _max_count;
+            if (the_count < min_count) {
+                min_count = the_count;
+            }
+        }
+        return min_count;
+    }
+};
+
 class CountingHashFile
 {
 public:
-    static void load(const std::string &infilename, CountingHash &ht);
-    static void save(const std::string &outfilename, const CountingHash &ht);
+    static void load(const std::string &infilename, CountingHash &ht,
+                     TableLoadMode mode = LOAD_TABLES_READ,
+                     unsigned int n_threads = 1);
+    static void save(const std::string &outfilename, const CountingHash &ht,
+                     bool page_aligned = false);
+    static void save_chunked(const std::string &outfilename,
+                             const CountingHash &ht, ChunkCodec codec,
+                             unsigned int n_threads = 1);
 };
 
 class CountingHashFileReader : public CountingHashFile
 {
 public:
-    CountingHashFileReader(const std::string &infilename, CountingHash &ht);
+    CountingHashFileReader(const std::string &infilename, CountingHash &ht,
+                           TableLoadMode mode = LOAD_TABLES_READ,
+                           unsigned int n_threads = 1);
 };
 
 class CountingHashGzFileReader : public CountingHashFile
@@ -332,7 +765,13 @@ public:
 class CountingHashFileWriter : public CountingHashFile
 {
 public:
-    CountingHashFileWriter(const std::string &outfilename, const CountingHash &ht);
+    // layout is 0, SAVED_FLAG_PAGE_ALIGNED or SAVED_FLAG_CHUNKED; codec and
+    // n_threads only matter for the last. The tables of a plain file (0)
+    // are saved sparse where that pays.
+    CountingHashFileWriter(const std::string &outfilename,
+                           const CountingHash &ht, unsigned char layout = 0,
+                           ChunkCodec codec = CHUNK_CODEC_NONE,
+                           unsigned int n_threads = 1);
 };
 
 class CountingHashGzFileWriter : public CountingHashFile
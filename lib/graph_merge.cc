@@ -0,0 +1,602 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream> // IWYU pragma: keep
+
+#include "chunked_file.hh"
+#include "graph_merge.hh"
+#include "khmer_exception.hh"
+
+using namespace std;
+using namespace khmer;
+
+// the flags that may be set in the type byte of a saved graph.
+#define SAVED_FLAGS (SAVED_FLAG_FASTRANGE | SAVED_FLAG_PAGE_ALIGNED | \
+                     SAVED_FLAG_CHUNKED | SAVED_FLAG_SPARSE)
+
+SavedTableReader::SavedTableReader(const std::string &infilename)
+    : _filename(infilename), _infile(NULL), _chunks(NULL), _encoded(NULL),
+      _use_bigcount(false), _n_started(0), _table_read(0), _table_offset(0)
+{
+    // gzread reads files that aren't gzipped as they are.
+    _infile = gzopen(infilename.c_str(), "rb");
+    if (_infile == Z_NULL) {
+        throw khmer_file_exception("Cannot open k-mer graph file: "
+                                   + infilename);
+    }
+    gzbuffer(_infile, 1 << 17);
+
+    try {
+        char signature[4];
+        unsigned char version = 0, ht_type = 0, use_bigcount = 0;
+        uint32_t save_ksize = 0;
+        unsigned char save_n_tables = 0;
+        uint64_t save_occupied_bins = 0;
+
+        _read_fully((Byte *) signature, 4);
+        _read_fully(&version, 1);
+        _read_fully(&ht_type, 1);
+        if (!(std::string(signature, 4) == SAVED_SIGNATURE)) {
+            throw khmer_file_exception("Does not start with signature for a "
+                                       "khmer file: " + infilename);
+        } else if (!(version == SAVED_FORMAT_VERSION)) {
+            std::ostringstream err;
+            err << "Incorrect file format version " << (int) version
+                << " while reading k-mer graph from " << infilename
+                << "; should be " << (int) SAVED_FORMAT_VERSION;
+            throw khmer_file_exception(err.str());
+        }
+
+        _type = ht_type & ~SAVED_FLAGS;
+        _flags = ht_type & SAVED_FLAGS;
+        switch (_type) {
+        case SAVED_COUNTING_HT:
+        case SAVED_BLOCKED_COUNTING_HT:
+            _counter_bits = 8;
+            break;
+        case SAVED_COUNTING_HT_4BIT:
+            _counter_bits = 4;
+            break;
+        case SAVED_COUNTING_HT_2BIT:
+            _counter_bits = 2;
+            break;
+        case SAVED_HASHBITS:
+        case SAVED_BLOCKED_HASHBITS:
+            _counter_bits = 1;
+            break;
+        default:
+            std::ostringstream err;
+            err << "Incorrect file format type " << (int) ht_type
+                << " while reading k-mer graph from " << infilename;
+            throw khmer_file_exception(err.str());
+        }
+
+        if (is_countgraph()) {
+            _read_fully(&use_bigcount, 1);
+        }
+        _read_fully((Byte *) &save_ksize, sizeof(save_ksize));
+        _read_fully(&save_n_tables, sizeof(save_n_tables));
+        _read_fully((Byte *) &save_occupied_bins, sizeof(save_occupied_bins));
+
+        _use_bigcount = use_bigcount;
+        _ksize = save_ksize;
+        _n_tables = save_n_tables;
+        _occupied_bins = save_occupied_bins;
+        _n_stored = _type == SAVED_BLOCKED_COUNTING_HT
+                    || _type == SAVED_BLOCKED_HASHBITS ? 1 : _n_tables;
+        if (!_n_stored) {
+            throw khmer_file_exception("Bad table layout in k-mer graph "
+                                       "file: " + infilename);
+        }
+
+        // these two list the table sizes before any of the tables.
+        if (_flags & (SAVED_FLAG_PAGE_ALIGNED | SAVED_FLAG_CHUNKED)) {
+            for (size_t i = 0; i < _n_stored; i++) {
+                uint64_t save_tablesize = 0;
+                _read_fully((Byte *) &save_tablesize, sizeof(save_tablesize));
+                _tablesizes.push_back(save_tablesize);
+            }
+        }
+        if (_flags & SAVED_FLAG_CHUNKED) {
+            _chunks = new ChunkedFileReader(infilename);
+            if (_chunks->n_sections() != _n_stored + is_countgraph()) {
+                throw khmer_file_exception("Bad table layout in k-mer graph "
+                                           "file: " + infilename);
+            }
+            for (size_t i = 0; i < _n_stored; i++) {
+                if (_chunks->section_bytes(i) != table_bytes(_tablesizes[i])) {
+                    throw khmer_file_exception("Bad table layout in k-mer "
+                                               "graph file: " + infilename);
+                }
+            }
+        } else if (_flags & SAVED_FLAG_PAGE_ALIGNED) {
+            _table_offset = Hashtable::_page_align(gztell(_infile));
+        }
+    } catch (...) {
+        delete _chunks;
+        gzclose(_infile);
+        throw;
+    }
+}
+
+SavedTableReader::~SavedTableReader()
+{
+    delete _encoded;
+    delete _chunks;
+    gzclose(_infile);
+}
+
+void SavedTableReader::_read_fully(Byte * dest, size_t bytes)
+{
+    while (bytes) {
+        // Zlib can only read chunks of at most INT_MAX bytes.
+        const unsigned int to_read = std::min(bytes, (size_t) INT_MAX);
+        int read_b = gzread(_infile, (char *) dest, to_read);
+
+        if (read_b <= 0) {
+            std::string err = "Unexpected end of k-mer graph file: "
+                              + _filename;
+            if (read_b < 0) {
+                std::string gzerr = gzerror(_infile, &read_b);
+                err = "Error reading from k-mer graph file: " + _filename
+                      + " " + (read_b == Z_ERRNO ? strerror(errno) : gzerr);
+            }
+            throw khmer_file_exception(err);
+        }
+
+        dest += read_b;
+        bytes -= read_b;
+    }
+}
+
+void SavedTableReader::_skip(HashIntoType bytes)
+{
+    if (bytes && gzseek(_infile, bytes, SEEK_CUR) < 0) {
+        throw khmer_file_exception("Error reading from k-mer graph file: "
+                                   + _filename);
+    }
+}
+
+void SavedTableReader::_finish_table()
+{
+    const HashIntoType bytes = table_bytes(_tablesizes[_n_started - 1]);
+    if (_encoded) {
+        _skip(_encoded->unread_bytes());
+        delete _encoded;
+        _encoded = NULL;
+    } else if (!(_flags & (SAVED_FLAG_PAGE_ALIGNED | SAVED_FLAG_CHUNKED))) {
+        _skip(bytes - _table_read);
+    }
+    _table_read = bytes;
+}
+
+HashIntoType SavedTableReader::next_table()
+{
+    if (_n_started == _n_stored) {
+        throw khmer_exception("no more tables in " + _filename);
+    }
+    if (_n_started) {
+        _finish_table();
+    }
+
+    if (_flags & SAVED_FLAG_PAGE_ALIGNED) {
+        if (_n_started) {
+            _table_offset = Hashtable::_page_align(_table_offset +
+                                                   _table_read);
+        }
+        if (gzseek(_infile, _table_offset, SEEK_SET) < 0) {
+            throw khmer_file_exception("Unexpected end of k-mer graph file: "
+                                       + _filename);
+        }
+    } else if (!(_flags & SAVED_FLAG_CHUNKED)) {
+        uint64_t save_tablesize = 0;
+        _read_fully((Byte *) &save_tablesize, sizeof(save_tablesize));
+        _tablesizes.push_back(save_tablesize);
+        if (_flags & SAVED_FLAG_SPARSE) {
+            _encoded = new EncodedTableReader(table_bytes(save_tablesize),
+                                              _filename,
+            [this](Byte * data, size_t bytes) {
+                _read_fully(data, bytes);
+            });
+        }
+    }
+    _table_read = 0;
+    return _tablesizes[_n_started++];
+}
+
+void SavedTableReader::read(Byte * dest, HashIntoType bytes)
+{
+    if (!_n_started
+            || bytes > table_bytes(_tablesizes[_n_started - 1]) - _table_read) {
+        throw khmer_exception("read past the end of a table of "
+                              + _filename);
+    }
+    if (_encoded) {
+        _encoded->read(dest, bytes);
+        if (_table_read + bytes == table_bytes(_tablesizes[_n_started - 1])) {
+            _encoded->finish();
+        }
+    } else if (_chunks) {
+        _chunks->read_section_range(_n_started - 1, _table_read, bytes, dest);
+    } else {
+        _read_fully(dest, bytes);
+    }
+    _table_read += bytes;
+}
+
+void SavedTableReader::read_bigcounts(BigCountMap &bigcounts)
+{
+    if (!is_countgraph()) {
+        throw khmer_exception("nodegraphs have no bigcounts");
+    }
+    while (_n_started < _n_stored) {
+        next_table();
+    }
+    _finish_table();
+
+    std::vector<char> buffer;
+    HashIntoType n_counts = 0;
+    if (_chunks) {
+        // the bigcounts are the section after the tables.
+        const HashIntoType bytes = _chunks->section_bytes(_n_stored);
+        if (bytes % BigCountMap::entry_bytes) {
+            throw khmer_file_exception("Bad table layout in k-mer graph "
+                                       "file: " + _filename);
+        }
+        n_counts = bytes / BigCountMap::entry_bytes;
+        buffer.resize(bytes);
+        _chunks->read_section(_n_stored, (Byte *) buffer.data());
+    } else {
+        if (_flags & SAVED_FLAG_PAGE_ALIGNED) {
+            const HashIntoType offset = Hashtable::_page_align(_table_offset +
+                                        _table_read);
+            if (gzseek(_infile, offset, SEEK_SET) < 0) {
+                throw khmer_file_exception("Unexpected end of k-mer graph "
+                                           "file: " + _filename);
+            }
+        }
+        _read_fully((Byte *) &n_counts, sizeof(n_counts));
+        buffer.resize(n_counts * BigCountMap::entry_bytes);
+        _read_fully((Byte *) buffer.data(), buffer.size());
+    }
+    if (n_counts) {
+        bigcounts.deserialize(buffer.data(), n_counts);
+    }
+}
+
+void GraphFileMerger::_counter_offsets(const SavedTableReader &reader,
+                                       const std::vector<HashIntoType> &
+                                       tablesizes,
+                                       HashIntoType khash,
+                                       std::vector< std::pair<size_t,
+                                       HashIntoType> > &offsets)
+{
+    offsets.clear();
+    // as CountingHash::count and BlockedCountingHash::_get_block pick them.
+    if (reader.table_type() == SAVED_BLOCKED_COUNTING_HT) {
+        const HashIntoType h = _mix_hash(khash);
+        unsigned int pos = h % CACHE_LINE_SIZE;
+        const unsigned int step = ((h >> 6) % CACHE_LINE_SIZE) | 1;
+        const HashIntoType block = Hashtable::_fastrange(h, tablesizes[0] /
+                                   CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
+        for (unsigned int i = 0; i < reader.n_tables(); i++) {
+            offsets.push_back(std::make_pair(0, block + pos));
+            pos = (pos + step) % CACHE_LINE_SIZE;
+        }
+    } else {
+        HashIntoType h1 = 0, h2 = 0;
+        if (reader.use_fastrange()) {
+            Hashtable::_mix_hashes(khash, h1, h2);
+        }
+        for (unsigned int i = 0; i < reader.n_tables(); i++) {
+            const HashIntoType bin = reader.use_fastrange() ?
+                                     Hashtable::_fastrange(h1 + i * h2,
+                                             tablesizes[i]) :
+                                     khash % tablesizes[i];
+            offsets.push_back(std::make_pair(i, bin));
+        }
+    }
+}
+
+// add the counters of in to those of out, stopping at the largest count
+// that counter_bits bits hold; the bits of nodegraphs are ORed.
+static void _combine_block(Byte * out, const Byte * in, size_t bytes,
+                           bool counters, unsigned int counter_bits)
+{
+    if (!counters) {
+        for (size_t i = 0; i < bytes; i++) {
+            out[i] |= in[i];
+        }
+    } else if (counter_bits == 8) {
+        for (size_t i = 0; i < bytes; i++) {
+            const unsigned int sum = out[i] + in[i];
+            out[i] = sum > MAX_KCOUNT ? MAX_KCOUNT : sum;
+        }
+    } else {
+        const unsigned int max_count = (1 << counter_bits) - 1;
+        for (size_t i = 0; i < bytes; i++) {
+            Byte combined = 0;
+            for (unsigned int shift = 0; shift < 8; shift += counter_bits) {
+                const unsigned int sum = ((out[i] >> shift) & max_count) +
+                                         ((in[i] >> shift) & max_count);
+                combined |= (sum > max_count ? max_count : sum) << shift;
+            }
+            out[i] = combined;
+        }
+    }
+}
+
+// the number of nonzero counters, or set bits, in block.
+static HashIntoType _count_occupied(const Byte * block, size_t bytes,
+                                    bool counters, unsigned int counter_bits)
+{
+    HashIntoType occupied = 0;
+    if (!counters) {
+        for (size_t i = 0; i < bytes; i++) {
+            occupied += __builtin_popcount(block[i]);
+        }
+    } else {
+        const unsigned int max_count = (1 << counter_bits) - 1;
+        for (size_t i = 0; i < bytes; i++) {
+            for (unsigned int shift = 0; shift < 8; shift += counter_bits) {
+                occupied += ((block[i] >> shift) & max_count) != 0;
+            }
+        }
+    }
+    return occupied;
+}
+
+void GraphFileMerger::merge(const std::vector<std::string> &infilenames,
+                            const std::string &outfilename,
+                            HashIntoType block_size)
+{
+    if (infilenames.empty()) {
+        throw khmer_value_exception("no graphs to merge");
+    } else if (!block_size) {
+        throw khmer_value_exception("the merge block size must be positive");
+    }
+    for (size_t r = 0; r < infilenames.size(); r++) {
+        if (infilenames[r] == outfilename) {
+            throw khmer_value_exception("cannot merge a graph into itself: "
+                                        + outfilename);
+        }
+    }
+
+    std::vector<SavedTableReader *> readers;
+    try {
+        for (size_t r = 0; r < infilenames.size(); r++) {
+            readers.push_back(new SavedTableReader(infilenames[r]));
+            const SavedTableReader &first = *readers[0];
+            const SavedTableReader &reader = *readers[r];
+            if (reader.table_type() != first.table_type()
+                    || reader.ksize() != first.ksize()
+                    || reader.n_tables() != first.n_tables()
+                    || reader.use_fastrange() != first.use_fastrange()) {
+                throw khmer_value_exception("graphs to merge must be of the "
+                                            "same type, k-mer size and number "
+                                            "of tables: " + infilenames[r]);
+            }
+        }
+        const SavedTableReader &first = *readers[0];
+        const bool counters = first.is_countgraph();
+        const size_t n_inputs = readers.size();
+        const size_t n_stored = first.n_stored_tables();
+
+        // Gather the k-mers with a bigcount in any input, from a second
+        // pass over those inputs, and the counter bytes of each, so that
+        // the counts of the inputs without a bigcount for a k-mer can be
+        // picked up as the blocks go by.
+        bool use_bigcount = false;
+        std::vector<BigCountMap> bigcounts(n_inputs);
+        std::vector<HashIntoType> kmers, tablesizes;
+        for (size_t r = 0; r < n_inputs; r++) {
+            use_bigcount = use_bigcount || readers[r]->use_bigcount();
+            if (readers[r]->use_bigcount() && first.counter_bits() == 8) {
+                SavedTableReader reader(infilenames[r]);
+                reader.read_bigcounts(bigcounts[r]);
+                tablesizes = reader.tablesizes();
+
+                std::vector<BigCountMap::Entry> entries;
+                bigcounts[r].get_entries(entries);
+                for (size_t j = 0; j < entries.size(); j++) {
+                    kmers.push_back(entries[j].first);
+                }
+            }
+        }
+        std::sort(kmers.begin(), kmers.end());
+        kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+
+        // for each stored table, the counter bytes to watch, in order, and
+        // the k-mer each belongs to.
+        std::vector< std::vector< std::pair<HashIntoType, size_t> > >
+        watches(n_stored);
+        std::vector< std::pair<size_t, HashIntoType> > offsets;
+        for (size_t j = 0; j < kmers.size(); j++) {
+            _counter_offsets(first, tablesizes, kmers[j], offsets);
+            for (size_t i = 0; i < offsets.size(); i++) {
+                watches[offsets[i].first].push_back(
+                    std::make_pair(offsets[i].second, j));
+            }
+        }
+        for (size_t t = 0; t < n_stored; t++) {
+            std::sort(watches[t].begin(), watches[t].end());
+        }
+        // the smallest counter of each k-mer in each input.
+        std::vector<BoundedCounterType> min_counts(n_inputs * kmers.size(),
+                MAX_KCOUNT);
+
+        ofstream outfile(outfilename.c_str(), ios::binary);
+        if (!outfile.is_open()) {
+            throw khmer_file_exception("Cannot open k-mer graph file for "
+                                       "writing: " + outfilename + " "
+                                       + strerror(errno));
+        }
+
+        outfile.write(SAVED_SIGNATURE, 4);
+        unsigned char version = SAVED_FORMAT_VERSION;
+        outfile.write((const char *) &version, 1);
+        unsigned char ht_type = first.table_type();
+        if (first.use_fastrange()) {
+            ht_type |= SAVED_FLAG_FASTRANGE;
+        }
+        outfile.write((const char *) &ht_type, 1);
+        if (counters) {
+            unsigned char save_use_bigcount = use_bigcount;
+            outfile.write((const char *) &save_use_bigcount, 1);
+        }
+        uint32_t save_ksize = first.ksize();
+        unsigned char save_n_tables = first.n_tables();
+        outfile.write((const char *) &save_ksize, sizeof(save_ksize));
+        outfile.write((const char *) &save_n_tables, sizeof(save_n_tables));
+        // the occupied bins are filled in once they have been counted.
+        const std::streampos occupied_pos = outfile.tellp();
+        uint64_t save_occupied_bins = 0;
+        outfile.write((const char *) &save_occupied_bins,
+                      sizeof(save_occupied_bins));
+
+        std::vector<Byte> block(block_size), input(block_size);
+        for (size_t t = 0; t < n_stored; t++) {
+            uint64_t save_tablesize = first.tablesizes().size() > t ?
+                                      first.tablesizes()[t] : 0;
+            for (size_t r = 0; r < n_inputs; r++) {
+                const HashIntoType tablesize = readers[r]->next_table();
+                if (r && tablesize != save_tablesize) {
+                    throw khmer_value_exception("graphs to merge must have "
+                                                "the same table sizes: "
+                                                + infilenames[r]);
+                }
+                save_tablesize = tablesize;
+            }
+            outfile.write((const char *) &save_tablesize,
+                          sizeof(save_tablesize));
+
+            const std::vector< std::pair<HashIntoType, size_t> > &watch =
+                watches[t];
+            size_t next_watch = 0;
+            const HashIntoType bytes = first.table_bytes(save_tablesize);
+            for (HashIntoType start = 0; start < bytes; start += block_size) {
+                const size_t n = std::min(bytes - start, block_size);
+                size_t end_watch = next_watch;
+                for (size_t r = 0; r < n_inputs; r++) {
+                    Byte * data = r ? input.data() : block.data();
+                    readers[r]->read(data, n);
+
+                    BoundedCounterType * mins = min_counts.data() +
+                                                r * kmers.size();
+                    for (end_watch = next_watch; end_watch < watch.size()
+                            && watch[end_watch].first < start + n;
+                            end_watch++) {
+                        const Byte count = data[watch[end_watch].first -
+                                                start];
+                        BoundedCounterType &min_count =
+                            mins[watch[end_watch].second];
+                        min_count = std::min(min_count,
+                                             (BoundedCounterType) count);
+                    }
+                    if (r) {
+                        _combine_block(block.data(), data, n, counters,
+                                       first.counter_bits());
+                    }
+                }
+                next_watch = end_watch;
+
+                if (t == 0) {
+                    save_occupied_bins += _count_occupied(block.data(), n,
+                                                          counters,
+                                                          first.counter_bits());
+                }
+                outfile.write((const char *) block.data(), n);
+            }
+        }
+
+        if (counters) {
+            // read through the rest of every input, so a file cut short in
+            // its bigcounts is caught even when they were not needed.
+            for (size_t r = 0; r < n_inputs; r++) {
+                BigCountMap unused;
+                readers[r]->read_bigcounts(unused);
+            }
+
+            // a k-mer keeps a bigcount if its counts add up past what the
+            // counters hold, which are then all full.
+            BigCountMap merged;
+            for (size_t j = 0; j < kmers.size(); j++) {
+                unsigned long total = 0;
+                for (size_t r = 0; r < n_inputs; r++) {
+                    BoundedCounterType count;
+                    if (!bigcounts[r].get(kmers[j], count)) {
+                        count = min_counts[r * kmers.size() + j];
+                    }
+                    total += count;
+                }
+                if (total > MAX_KCOUNT) {
+                    merged.set(kmers[j], std::min(total,
+                                                  (unsigned long) MAX_BIGCOUNT));
+                }
+            }
+
+            std::vector<char> buffer;
+            merged.serialize(buffer);
+            HashIntoType n_counts = buffer.size() / BigCountMap::entry_bytes;
+            outfile.write((const char *) &n_counts, sizeof(n_counts));
+            outfile.write(buffer.data(), buffer.size());
+        }
+
+        outfile.seekp(occupied_pos);
+        outfile.write((const char *) &save_occupied_bins,
+                      sizeof(save_occupied_bins));
+        if (outfile.fail()) {
+            throw khmer_file_exception(strerror(errno));
+        }
+        outfile.close();
+    } catch (...) {
+        for (size_t r = 0; r < readers.size(); r++) {
+            delete readers[r];
+        }
+        throw;
+    }
+
+    for (size_t r = 0; r < readers.size(); r++) {
+        delete readers[r];
+    }
+}
+
+// vim: set ft=cpp sts=4 sw=4 tw=80:
@@ -0,0 +1,208 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef GRAPH_MERGE_HH
+#define GRAPH_MERGE_HH
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "bigcount.hh"
+#include "hashtable.hh"
+#include "khmer.hh"
+#include "zlib.h"
+
+namespace khmer
+{
+class ChunkedFileReader;
+
+// the bytes of each table that GraphFileMerger reads from each input at a
+// time.
+#define DEFAULT_MERGE_BLOCK_SIZE (4 << 20)
+
+/**
+ * \class SavedTableReader
+ *
+ * \brief Reads the tables of a saved countgraph or nodegraph in order, a
+ * range at a time.
+ *
+ * Any layout that save() writes can be read: plain, sparse, gzipped,
+ * page-aligned or chunked. Only a buffer's worth of the file is held in
+ * memory at a time, so graphs much bigger than memory can be streamed.
+ * Each table is started with next_table() and then read from start to end
+ * with read(); the bigcounts of a countgraph come after the tables.
+ */
+class SavedTableReader
+{
+protected:
+    std::string _filename;
+    gzFile _infile;                 // the file, unless it is chunked
+    ChunkedFileReader * _chunks;    // the blocks of a chunked file
+    EncodedTableReader * _encoded;  // the current table of a sparse file
+
+    unsigned char _type;            // the type byte, without the flags
+    unsigned char _flags;
+    bool _use_bigcount;
+    WordLength _ksize;
+    unsigned int _n_tables;
+    HashIntoType _occupied_bins;
+    unsigned int _counter_bits;     // 1 for nodegraphs
+    size_t _n_stored;
+
+    // the sizes of the tables started so far; page-aligned and chunked
+    // files list them all up front.
+    std::vector<HashIntoType> _tablesizes;
+    size_t _n_started;
+    HashIntoType _table_read;       // bytes read of the current table
+    HashIntoType _table_offset;     // where it starts, if page-aligned
+
+    void _read_fully(Byte * dest, size_t bytes);
+    void _skip(HashIntoType bytes);
+    void _finish_table();
+
+public:
+    explicit SavedTableReader(const std::string &infilename);
+    ~SavedTableReader();
+
+    const std::string &filename() const
+    {
+        return _filename;
+    }
+    // SAVED_COUNTING_HT and so on.
+    unsigned char table_type() const
+    {
+        return _type;
+    }
+    bool is_countgraph() const
+    {
+        return _type != SAVED_HASHBITS && _type != SAVED_BLOCKED_HASHBITS;
+    }
+    bool use_fastrange() const
+    {
+        return (_flags & SAVED_FLAG_FASTRANGE) != 0;
+    }
+    bool use_bigcount() const
+    {
+        return _use_bigcount;
+    }
+    WordLength ksize() const
+    {
+        return _ksize;
+    }
+    unsigned int n_tables() const
+    {
+        return _n_tables;
+    }
+    HashIntoType n_occupied() const
+    {
+        return _occupied_bins;
+    }
+    unsigned int counter_bits() const
+    {
+        return _counter_bits;
+    }
+    // the number of tables in the file; the blocked types keep all of
+    // their counters in one.
+    size_t n_stored_tables() const
+    {
+        return _n_stored;
+    }
+    HashIntoType table_bytes(HashIntoType tablesize) const
+    {
+        if (!is_countgraph()) {
+            return tablesize / 8 + 1;
+        }
+        return (tablesize * _counter_bits + 7) / 8;
+    }
+
+    // start the next table, skipping what is left of the current one, and
+    // return its size.
+    HashIntoType next_table();
+    // read the next bytes bytes of the current table into dest.
+    void read(Byte * dest, HashIntoType bytes);
+    // add the bigcounts of a countgraph to bigcounts, skipping any tables
+    // that are left. The sizes of all of the tables are known after this.
+    void read_bigcounts(BigCountMap &bigcounts);
+
+    const std::vector<HashIntoType> &tablesizes() const
+    {
+        return _tablesizes;
+    }
+};
+
+/**
+ * \class GraphFileMerger
+ *
+ * \brief Merges saved graphs of the same type and shape without loading
+ * them.
+ *
+ * The tables of all of the inputs are read a block at a time and combined:
+ * counts are added, stopping at the largest count the counters hold, and
+ * the bits of nodegraphs are ORed. Each combined block goes straight to
+ * the output, so memory use is a couple of blocks per input however big
+ * the tables are, plus the bigcounts.
+ *
+ * The bigcount of a k-mer in the merged countgraph is the sum of its
+ * counts in the inputs, each input's count being its bigcount if it has
+ * one and otherwise the smallest of the k-mer's counters there, which are
+ * picked up as the blocks go by. A k-mer with no bigcount in any input
+ * stops at 255, as if the inputs had been counted without bigcount.
+ */
+class GraphFileMerger
+{
+protected:
+    // find the bytes of the stored tables that hold the counters of khash,
+    // for a countgraph of reader's type with tables of tablesizes.
+    static void _counter_offsets(const SavedTableReader &reader,
+                                 const std::vector<HashIntoType> &tablesizes,
+                                 HashIntoType khash,
+                                 std::vector< std::pair<size_t, HashIntoType> >
+                                 &offsets);
+
+public:
+    // merge the graphs in infilenames into a plain graph file outfilename,
+    // reading block_size bytes of each table of each input at a time.
+    static void merge(const std::vector<std::string> &infilenames,
+                      const std::string &outfilename,
+                      HashIntoType block_size = DEFAULT_MERGE_BLOCK_SIZE);
+};
+
+}
+
+#endif // GRAPH_MERGE_HH
+
+// vim: set ft=cpp sts=4 sw=4 tw=80:
@@ -47,24 +47,55 @@ using namespace std;
 using namespace khmer;
 using namespace khmer:: read_parsers;
 
-void Hashbits::save(std::string outfilename)
+void Hashbits::save(std::string outfilename, bool page_aligned)
+{
+    _save(outfilename, page_aligned ? SAVED_FLAG_PAGE_ALIGNED : 0,
+          CHUNK_CODEC_NONE, 1);
+}
+
+void Hashbits::save_chunked(std::string outfilename, ChunkCodec codec,
+                            unsigned int n_threads)
+{
+    _save(outfilename, SAVED_FLAG_CHUNKED, codec, n_threads);
+}
+
+void Hashbits::_save(std::string outfilename, unsigned char layout,
+                     ChunkCodec codec, unsigned int n_threads)
 {
     if (!_counts[0]) {
         throw khmer_exception();
     }
+    _check_not_mapped_from(outfilename);
 
     unsigned int save_ksize = _ksize;
     unsigned char save_n_tables = _n_tables;
     unsigned long long save_tablesize;
     unsigned long long save_occupied_bins = _occupied_bins;
 
+    std::vector<HashIntoType> table_bytes;
+    for (unsigned int i = 0; i < _n_stored_tables(); i++) {
+        table_bytes.push_back(_tablesizes[i] / 8 + 1);
+    }
+    // the tables of plain files go sparse where that pays.
+    std::vector<TableEncoding> encodings;
+    std::vector<HashIntoType> encoded_bytes;
+    if (!layout && _choose_table_encodings(_counts, table_bytes,
+                                           _occupied_bins, _tablesizes[0],
+                                           true, encodings, encoded_bytes)) {
+        layout = SAVED_FLAG_SPARSE;
+    }
+
     ofstream outfile(outfilename.c_str(), ios::binary);
 
     outfile.write(SAVED_SIGNATURE, 4);
     unsigned char version = SAVED_FORMAT_VERSION;
     outfile.write((const char *) &version, 1);
 
-    unsigned char ht_type = SAVED_HASHBITS;
+    unsigned char ht_type = _saved_type();
+    if (_use_fastrange) {
+        ht_type |= SAVED_FLAG_FASTRANGE;
+    }
+    ht_type |= layout;
     outfile.write((const char *) &ht_type, 1);
 
     outfile.write((const char *) &save_ksize, sizeof(save_ksize));
@@ -72,13 +103,41 @@ void Hashbits::save(std::string outfilename)
     outfile.write((const char *) &save_occupied_bins,
                   sizeof(save_occupied_bins));
 
-    for (unsigned int i = 0; i < _n_tables; i++) {
-        save_tablesize = _tablesizes[i];
-        unsigned long long tablebytes = save_tablesize / 8 + 1;
+    if (layout & SAVED_FLAG_SPARSE) {
+        for (unsigned int i = 0; i < _n_stored_tables(); i++) {
+            save_tablesize = _tablesizes[i];
+            outfile.write((const char *) &save_tablesize,
+                          sizeof(save_tablesize));
+            _write_encoded_table(_counts[i], table_bytes[i], encodings[i],
+                                 encoded_bytes[i],
+            [&](const Byte * data, size_t bytes) {
+                outfile.write((const char *) data, bytes);
+            });
+        }
+    } else if (layout) {
+        for (unsigned int i = 0; i < _n_stored_tables(); i++) {
+            save_tablesize = _tablesizes[i];
+            outfile.write((const char *) &save_tablesize,
+                          sizeof(save_tablesize));
+        }
+        if (layout & SAVED_FLAG_CHUNKED) {
+            std::vector<const Byte *> tables(_counts,
+                                             _counts + _n_stored_tables());
+            ChunkedFileWriter::write(outfile, tables, table_bytes, codec,
+                                     n_threads);
+        } else {
+            _write_page_aligned_tables(outfile, _counts, table_bytes);
+        }
+    } else {
+        for (unsigned int i = 0; i < _n_stored_tables(); i++) {
+            save_tablesize = _tablesizes[i];
+            unsigned long long tablebytes = save_tablesize / 8 + 1;
 
-        outfile.write((const char *) &save_tablesize, sizeof(save_tablesize));
+            outfile.write((const char *) &save_tablesize,
+                          sizeof(save_tablesize));
 
-        outfile.write((const char *) _counts[i], tablebytes);
+            outfile.write((const char *) _counts[i], tablebytes);
+        }
     }
     if (outfile.fail()) {
         throw khmer_file_exception(strerror(errno));
@@ -88,9 +147,11 @@ void Hashbits::save(std::string outfilename)
 
 /**
  * Loads @param infilename into Hashbits, with error checking on
- * file type and file version.  Populates _counts internally.
+ * file type and file version.  Populates _counts internally, mapping
+ * the tables of a page-aligned file if @param mode says to.
  */
-void Hashbits::load(std::string infilename)
+void Hashbits::load(std::string infilename, TableLoadMode mode,
+                    unsigned int n_threads)
 {
     ifstream infile;
 
@@ -110,14 +171,7 @@ void Hashbits::load(std::string infilename)
         throw khmer_file_exception(err);
     }
 
-    if (_counts) {
-        for (unsigned int i = 0; i < _n_tables; i++) {
-            delete[] _counts[i];
-            _counts[i] = NULL;
-        }
-        delete[] _counts;
-        _counts = NULL;
-    }
+    _free_counters();
     _tablesizes.clear();
 
     try {
@@ -145,7 +199,11 @@ void Hashbits::load(std::string infilename)
                 << " while reading k-mer graph from " << infilename
                 << "; should be " << (int) SAVED_FORMAT_VERSION;
             throw khmer_file_exception(err.str());
-        } else if (!(ht_type == SAVED_HASHBITS)) {
+        } else if (!((ht_type & ~(SAVED_FLAG_FASTRANGE |
+                                  SAVED_FLAG_PAGE_ALIGNED |
+                                  SAVED_FLAG_CHUNKED |
+                                  SAVED_FLAG_SPARSE))
+                     == _saved_type())) {
             std::ostringstream err;
             err << "Incorrect file format type " << (int) ht_type
                 << " while reading k-mer graph from " << infilename;
@@ -159,25 +217,55 @@ void Hashbits::load(std::string infilename)
         _ksize = (WordLength) save_ksize;
         _n_tables = (unsigned int) save_n_tables;
         _occupied_bins = save_occupied_bins;
+        _use_fastrange = (ht_type & SAVED_FLAG_FASTRANGE) != 0;
         _init_bitstuff();
 
-        _counts = new Byte*[_n_tables];
-        for (unsigned int i = 0; i < _n_tables; i++) {
-            HashIntoType tablesize;
-            unsigned long long tablebytes;
-
-            infile.read((char *) &save_tablesize, sizeof(save_tablesize));
-
-            tablesize = (HashIntoType) save_tablesize;
-            _tablesizes.push_back(tablesize);
-
-            tablebytes = tablesize / 8 + 1;
-            _counts[i] = new Byte[tablebytes];
+        const size_t n_stored = _n_stored_tables();
+        _counts = new Byte*[n_stored];
+        for (unsigned int i = 0; i < n_stored; i++) {
+            _counts[i] = NULL;
+        }
 
-            unsigned long long loaded = 0;
-            while (loaded != tablebytes) {
-                infile.read((char *) _counts[i], tablebytes - loaded);
-                loaded += infile.gcount();
+        if (ht_type & (SAVED_FLAG_PAGE_ALIGNED | SAVED_FLAG_CHUNKED)) {
+            std::vector<HashIntoType> table_bytes;
+            for (unsigned int i = 0; i < n_stored; i++) {
+                infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+                _tablesizes.push_back((HashIntoType) save_tablesize);
+                table_bytes.push_back(save_tablesize / 8 + 1);
+            }
+            if (ht_type & SAVED_FLAG_CHUNKED) {
+                ChunkedFileReader chunks(infilename);
+                _load_chunked_tables(chunks, infilename, table_bytes, _counts,
+                                     n_threads);
+            } else {
+                _load_page_aligned_tables(infile, infilename, table_bytes,
+                                          _counts, mode);
+            }
+        } else {
+            for (unsigned int i = 0; i < n_stored; i++) {
+                HashIntoType tablesize;
+                unsigned long long tablebytes;
+
+                infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+
+                tablesize = (HashIntoType) save_tablesize;
+                _tablesizes.push_back(tablesize);
+
+                tablebytes = tablesize / 8 + 1;
+                if (ht_type & SAVED_FLAG_SPARSE) {
+                    _counts[i] = _read_encoded_table(tablebytes, infilename,
+                    [&](Byte * data, size_t bytes) {
+                        infile.read((char *) data, bytes);
+                    });
+                } else {
+                    _counts[i] = _allocate_table(tablebytes, false);
+
+                    unsigned long long loaded = 0;
+                    while (loaded != tablebytes) {
+                        infile.read((char *) _counts[i], tablebytes - loaded);
+                        loaded += infile.gcount();
+                    }
+                }
             }
         }
         infile.close();
@@ -192,16 +280,56 @@ void Hashbits::load(std::string infilename)
     }
 }
 
+// Prefetch the bins in the first table of every hash before reading any,
+// then finish the hashes one at a time: most neighbors of a k-mer are
+// absent from the graph and drop out at the first table, as in get_count,
+// so batching the later tables, too, costs more than it saves.
+unsigned int Hashbits::_get_present(const HashIntoType * hashes,
+                                    unsigned int n) const
+{
+    HashIntoType h1[32], h2[32], bins[32];
+    for (unsigned int j = 0; j < n; j++) {
+        if (_use_fastrange) {
+            _mix_hashes(hashes[j], h1[j], h2[j]);
+            bins[j] = _fastrange(h1[j], _tablesizes[0]);
+        } else {
+            bins[j] = hashes[j] % _tablesizes[0];
+        }
+        __builtin_prefetch(_counts[0] + bins[j] / 8);
+    }
+
+    unsigned int present = 0;
+    for (unsigned int j = 0; j < n; j++) {
+        HashIntoType bin = bins[j];
+        size_t i = 0;
+        while (_counts[i][bin / 8] & (1 << (bin % 8))) {
+            if (++i == _n_tables) {
+                present |= 1U << j;
+                break;
+            }
+            bin = _use_fastrange ?
+                  _fastrange(h1[j] + i * h2[j], _tablesizes[i]) :
+                  hashes[j] % _tablesizes[i];
+        }
+    }
+    return present;
+}
+
 void Hashbits::update_from(const Hashbits &other)
 {
     if (_ksize != other._ksize) {
         throw khmer_exception("both nodegraphs must have same k size");
     }
-    if (_tablesizes != other._tablesizes) {
+    if (_tablesizes != other._tablesizes || _n_tables != other._n_tables
+            || _saved_type() != other._saved_type()
+            || _use_fastrange != other._use_fastrange) {
         throw khmer_exception("both nodegraphs must have same table sizes");
     }
+    _check_writable();
+
     Byte tmp = 0;
-    for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
+    for (unsigned int table_num = 0; table_num < _n_stored_tables();
+            table_num++) {
         Byte * me = _counts[table_num];
         Byte * ot = other._counts[table_num];
         HashIntoType tablesize = _tablesizes[table_num];
@@ -226,4 +354,63 @@ void Hashbits::update_from(const Hashbits &other)
     }
 }
 
+// round tablesize up to a whole number of 64-bit words.
+static HashIntoType _blocked_tablesize(HashIntoType tablesize)
+{
+    if (tablesize < 64) {
+        return 64;
+    }
+    return (tablesize + 63) / 64 * 64;
+}
+
+BlockedHashbits::BlockedHashbits(
+    WordLength      ksize,
+    HashIntoType    tablesize,
+    unsigned int    n_tables)
+    : Hashbits(ksize, _blocked_tablesize(tablesize))
+{
+    if (n_tables < 1 || n_tables > 64) {
+        std::ostringstream err;
+        err << "number of tables for a blocked nodegraph must be between "
+            << "1 and 64, not " << n_tables;
+        throw khmer_value_exception(err.str());
+    }
+    _n_tables = n_tables;
+    _n_blocks = _tablesizes[0] / 64;
+}
+
+void BlockedHashbits::load(std::string infilename, TableLoadMode mode,
+                           unsigned int n_threads)
+{
+    Hashbits::load(infilename, mode, n_threads);
+
+    if (_n_tables < 1 || _n_tables > 64
+            || _tablesizes[0] == 0 || _tablesizes[0] % 64) {
+        throw khmer_file_exception("Bad table layout in blocked k-mer graph "
+                                   "file: " + infilename);
+    }
+    _n_blocks = _tablesizes[0] / 64;
+}
+
+// The bits of a k-mer share one word, so each k-mer is one load: prefetch
+// the words of every hash, then test each against its mask.
+unsigned int BlockedHashbits::_get_present(const HashIntoType * hashes,
+        unsigned int n) const
+{
+    const uint64_t * blocks[32];
+    uint64_t masks[32];
+    for (unsigned int j = 0; j < n; j++) {
+        blocks[j] = _get_block(hashes[j], masks[j]);
+        __builtin_prefetch(blocks[j]);
+    }
+
+    unsigned int present = 0;
+    for (unsigned int j = 0; j < n; j++) {
+        if ((*blocks[j] & masks[j]) == masks[j]) {
+            present |= 1U << j;
+        }
+    }
+    return present;
+}
+
 // vim: set sts=2 sw=2:
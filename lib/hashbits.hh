@@ -39,6 +39,7 @@ Contact: khmer-project@idyll.org
 #define HASHBITS_HH
 
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <string>
 #include <vector>
@@ -71,35 +72,87 @@ protected:
             HashIntoType tablesize = _tablesizes[i];
             HashIntoType tablebytes = tablesize / 8 + 1;
 
-            _counts[i] = new Byte[tablebytes];
-            memset(_counts[i], 0, tablebytes);
+            _counts[i] = _allocate_table(tablebytes);
         }
     }
 
+    // release the tables in _counts; there is one per entry in _tablesizes.
+    void _free_counters()
+    {
+        if (_counts) {
+            for (size_t i = 0; i < _tablesizes.size(); i++) {
+                if (!_mapped_file) {
+                    _free_table(_counts[i]);
+                }
+                _counts[i] = NULL;
+            }
+            delete[] _counts;
+            _counts = NULL;
+        }
+        _unmap_tables();
+    }
+
+    // The type byte written to saved files, and the number of tables in
+    // _counts; see CountingHash.
+    virtual unsigned char _saved_type() const
+    {
+        return SAVED_HASHBITS;
+    }
+    virtual size_t _n_stored_tables() const
+    {
+        return _n_tables;
+    }
+
+    // save with layout 0, SAVED_FLAG_PAGE_ALIGNED or SAVED_FLAG_CHUNKED; the
+    // tables of a plain file (0) are saved sparse where that pays.
+    void _save(std::string outfilename, unsigned char layout,
+               ChunkCodec codec, unsigned int n_threads);
+
+    virtual void _count_hashes(const HashIntoType * hashes, size_t n)
+    {
+        _pipeline_count(this, hashes, n);
+    }
+    virtual void _get_counts(const HashIntoType * hashes, size_t n,
+                             BoundedCounterType * counts) const
+    {
+        _pipeline_get_counts(this, hashes, n, counts);
+    }
+    virtual void _test_and_set_hashes(const HashIntoType * hashes, size_t n,
+                                      Byte * is_new)
+    {
+        _pipeline_test_and_set(this, hashes, n, is_new);
+    }
+    virtual unsigned int _get_present(const HashIntoType * hashes,
+                                      unsigned int n) const;
+
 public:
-    Hashbits(WordLength ksize, std::vector<HashIntoType>& tablesizes)
+    // with fastrange, the table sizes need not be prime.
+    Hashbits(WordLength ksize, std::vector<HashIntoType>& tablesizes,
+             bool fastrange = false)
         : khmer::Hashtable(ksize),
           _tablesizes(tablesizes)
     {
+        _use_fastrange = fastrange;
         _occupied_bins = 0;
         _n_unique_kmers = 0;
 
         _allocate_counters();
     }
 
-    ~Hashbits()
+    Hashbits(WordLength ksize, HashIntoType single_tablesize)
+        : khmer::Hashtable(ksize)
     {
-        if (_counts) {
-            for (size_t i = 0; i < _n_tables; i++) {
-                delete[] _counts[i];
-                _counts[i] = NULL;
-            }
-            delete[] _counts;
-            _counts = NULL;
+        _tablesizes.push_back(single_tablesize);
+        _occupied_bins = 0;
+        _n_unique_kmers = 0;
 
-            _n_tables = 0;
-        }
+        _allocate_counters();
+    }
 
+    virtual ~Hashbits()
+    {
+        _free_counters();
+        _n_tables = 0;
     }
 
     // Accessors for protected/private table info members
@@ -113,8 +166,11 @@ public:
         return _n_tables;
     }
 
-    virtual void save(std::string);
-    virtual void load(std::string);
+    virtual void save(std::string, bool page_aligned = false);
+    virtual void save_chunked(std::string, ChunkCodec codec,
+                              unsigned int n_threads = 1);
+    virtual void load(std::string, TableLoadMode mode = LOAD_TABLES_READ,
+                      unsigned int n_threads = 1);
 
     // count number of occupied bins
     virtual const HashIntoType n_occupied() const
@@ -147,10 +203,18 @@ public:
     BoundedCounterType
     test_and_set_bits( HashIntoType khash )
     {
+        _check_writable();
+
         bool is_new_kmer = false;
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
 
         for (size_t i = 0; i < _n_tables; i++) {
-            HashIntoType bin = khash % _tablesizes[i];
+            HashIntoType bin = _use_fastrange ?
+                               _fastrange(h1 + i * h2, _tablesizes[i]) :
+                               khash % _tablesizes[i];
             HashIntoType byte = bin / 8;
             unsigned char bit = (unsigned char)(1 << (bin % 8));
 
@@ -171,6 +235,21 @@ public:
         return 0; // kmer already seen
     } // test_and_set_bits
 
+    virtual void prefetch(HashIntoType khash) const
+    {
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
+
+        for (size_t i = 0; i < _n_tables; i++) {
+            HashIntoType bin = _use_fastrange ?
+                               _fastrange(h1 + i * h2, _tablesizes[i]) :
+                               khash % _tablesizes[i];
+            __builtin_prefetch(_counts[i] + bin / 8);
+        }
+    }
+
     virtual void count(const char * kmer)
     {
         HashIntoType hash = _hash(kmer, _ksize);
@@ -192,8 +271,15 @@ public:
     // get the count for the given k-mer hash.
     virtual const BoundedCounterType get_count(HashIntoType khash) const
     {
+        HashIntoType h1 = 0, h2 = 0;
+        if (_use_fastrange) {
+            _mix_hashes(khash, h1, h2);
+        }
+
         for (size_t i = 0; i < _n_tables; i++) {
-            HashIntoType bin = khash % _tablesizes[i];
+            HashIntoType bin = _use_fastrange ?
+                               _fastrange(h1 + i * h2, _tablesizes[i]) :
+                               khash % _tablesizes[i];
             HashIntoType byte = bin / 8;
             unsigned char bit = bin % 8;
 
@@ -213,6 +299,133 @@ public:
 
     void update_from(const Hashbits &other);
 };
+
+/**
+ * \class BlockedHashbits
+ *
+ * \brief A Hashbits with all of a k-mer's bits in one 64-bit word.
+ *
+ * The bits live in a single table of 64-bit words. One hash of the k-mer
+ * picks a word and n_tables distinct bits within it, so testing a k-mer is
+ * one memory access and setting it is a single 64-bit atomic OR, always
+ * within one cache line. Spreading the bits over a whole cache line would
+ * give a slightly lower false positive rate, but needs an atomic OR per
+ * word touched and data-dependent branches that stall out-of-order
+ * execution on memory-bound workloads. The false positive rate is higher
+ * than for independent tables of the same total size, noticeably so for
+ * large n_tables.
+ *
+ * As with BlockedCountingHash, n_tables() is the number of bits per k-mer,
+ * get_tablesizes() returns the size in bits of the one table, and
+ * n_occupied() counts all of the set bits.
+ */
+class BlockedHashbits : public Hashbits
+{
+protected:
+    HashIntoType _n_blocks;
+
+    virtual unsigned char _saved_type() const
+    {
+        return SAVED_BLOCKED_HASHBITS;
+    }
+    virtual size_t _n_stored_tables() const
+    {
+        return 1;
+    }
+
+    virtual void _count_hashes(const HashIntoType * hashes, size_t n)
+    {
+        _pipeline_count(this, hashes, n);
+    }
+    virtual void _get_counts(const HashIntoType * hashes, size_t n,
+                             BoundedCounterType * counts) const
+    {
+        _pipeline_get_counts(this, hashes, n, counts);
+    }
+    virtual void _test_and_set_hashes(const HashIntoType * hashes, size_t n,
+                                      Byte * is_new)
+    {
+        _pipeline_test_and_set(this, hashes, n, is_new);
+    }
+    virtual unsigned int _get_present(const HashIntoType * hashes,
+                                      unsigned int n) const;
+
+    // find the word for this k-mer and the mask of its bits in it.
+    uint64_t * _get_block(HashIntoType khash, uint64_t &mask) const
+    {
+        HashIntoType h = _mix_hash(khash);
+
+        // an odd stride gives n_tables different bits of the word.
+        unsigned int pos = h % 64;
+        const unsigned int step = ((h >> 6) % 64) | 1;
+
+        mask = 0;
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            mask |= 1ULL << pos;
+            pos = (pos + step) % 64;
+        }
+
+        return (uint64_t *) _counts[0] + _fastrange(h, _n_blocks);
+    }
+public:
+    /** @param[in]  ksize The k-mer size.
+     *  @param[in]  tablesize The table size in bits, rounded up to a
+     *              whole number of 64-bit words.
+     *  @param[in]  n_tables The number of bits per k-mer.
+     */
+    BlockedHashbits(WordLength ksize, HashIntoType tablesize,
+                    unsigned int n_tables);
+
+    virtual void load(std::string, TableLoadMode mode = LOAD_TABLES_READ,
+                      unsigned int n_threads = 1);
+
+    using Hashbits::count;
+    using Hashbits::test_and_set_bits;
+    using Hashbits::get_count;
+
+    virtual void prefetch(HashIntoType khash) const
+    {
+        __builtin_prefetch((uint64_t *) _counts[0] +
+                           _fastrange(_mix_hash(khash), _n_blocks));
+    }
+
+    virtual void count(HashIntoType khash)
+    {
+        BlockedHashbits::test_and_set_bits(khash);
+    }
+
+    virtual BoundedCounterType test_and_set_bits(HashIntoType khash)
+    {
+        _check_writable();
+
+        uint64_t mask;
+        uint64_t * block = _get_block(khash, mask);
+
+        // most k-mers have been seen before; skip the atomic when all of
+        // the bits are already set.
+        if (!(mask & ~*block)) {
+            return 0; // kmer already seen
+        }
+
+        uint64_t bits_orig = __sync_fetch_and_or(block, mask);
+        unsigned int n_new_bits = __builtin_popcountll(mask & ~bits_orig);
+        if (n_new_bits) {
+            __sync_add_and_fetch( &_occupied_bins, n_new_bits );
+            __sync_add_and_fetch( &_n_unique_kmers, 1 );
+            return 1; // kmer not seen before
+        }
+
+        return 0; // kmer already seen
+    }
+
+    virtual const BoundedCounterType get_count(HashIntoType khash) const
+    {
+        uint64_t mask;
+        const uint64_t * block = _get_block(khash, mask);
+
+        return (*block & mask) == mask;
+    }
+};
 }
 
 #include "counting.hh"
@@ -36,19 +36,30 @@ LICENSE (END)
 Contact: khmer-project@idyll.org
 */
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
 #include <deque>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <new>
 #include <sstream> // IWYU pragma: keep
 #include <queue>
 #include <set>
+#include <thread>
 
+#include "bounded_queue.hh"
 #include "counting.hh"
 #include "hashtable.hh"
 #include "khmer.hh"
 #include "read_parsers.hh"
+#include "traversal.hh"
 
 using namespace std;
 using namespace khmer;
@@ -70,6 +81,463 @@ unsigned int Hashtable::check_and_process_read(std::string &read,
     return consume_string(read);
 }
 
+unsigned int Hashtable::check_and_process_read(const char * read,
+        size_t length, bool &is_valid)
+{
+    read = _check_read_view(read, length);
+    is_valid = read != NULL;
+    if (!is_valid) {
+        return 0;
+    }
+
+    return consume_string(read, length);
+}
+
+const char * Hashtable::_check_read_view(const char * read,
+        size_t length) const
+{
+    if (length < _ksize) {
+        return NULL;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (!is_valid_dna(read[i])) {
+            static thread_local std::string normalized;
+            normalized.assign(read, length);
+            return check_and_normalize_read(normalized) ?
+                   normalized.data() : NULL;
+        }
+    }
+    return read;
+}
+
+Byte * Hashtable::_allocate_table(HashIntoType tablesize, bool zero)
+{
+    void * table = NULL;
+    if (posix_memalign(&table, CACHE_LINE_SIZE, tablesize ? tablesize : 1)) {
+        throw std::bad_alloc();
+    }
+    if (zero) {
+        memset(table, 0, tablesize);
+    }
+    return (Byte *) table;
+}
+
+void Hashtable::_free_table(Byte * table)
+{
+    free(table);
+}
+
+MappedFile::MappedFile(const std::string &filename, bool read_only)
+    : _filename(filename), _data(NULL), _size(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw khmer_file_exception("Cannot open k-mer table file: "
+                                   + filename + " " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        int err = errno;
+        close(fd);
+        throw khmer_file_exception("Cannot read k-mer table file: "
+                                   + filename + " " + strerror(err));
+    }
+    _size = st.st_size;
+
+    void * data = mmap(NULL, _size ? _size : 1, PROT_READ |
+                       (read_only ? 0 : PROT_WRITE),
+                       read_only ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    int err = errno;
+    // the mapping keeps the file open.
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw khmer_file_exception("Cannot map k-mer table file: "
+                                   + filename + " " + strerror(err));
+    }
+    _data = (Byte *) data;
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(_data, _size ? _size : 1);
+}
+
+bool MappedFile::is_file(const std::string &filename) const
+{
+    struct stat mine, theirs;
+    if (stat(_filename.c_str(), &mine) || stat(filename.c_str(), &theirs)) {
+        return false;
+    }
+    return mine.st_dev == theirs.st_dev && mine.st_ino == theirs.st_ino;
+}
+
+void Hashtable::_write_page_aligned_tables(std::ofstream &outfile,
+        Byte * const * tables,
+        const std::vector<HashIntoType> &table_bytes)
+{
+    static const char zeros[SAVED_PAGE_SIZE] = { 0 };
+    auto pad_to_page = [&]() {
+        HashIntoType offset = outfile.tellp();
+        outfile.write(zeros, _page_align(offset) - offset);
+    };
+
+    pad_to_page();
+    for (size_t i = 0; i < table_bytes.size(); i++) {
+        outfile.write((const char *) tables[i], table_bytes[i]);
+        pad_to_page();
+    }
+}
+
+void Hashtable::_load_page_aligned_tables(std::ifstream &infile,
+        const std::string &infilename,
+        const std::vector<HashIntoType> &table_bytes,
+        Byte ** tables, TableLoadMode mode)
+{
+    HashIntoType offset = _page_align(infile.tellg());
+
+    if (mode == LOAD_TABLES_READ) {
+        for (size_t i = 0; i < table_bytes.size(); i++) {
+            infile.seekg(offset);
+            tables[i] = _allocate_table(table_bytes[i], false);
+            infile.read((char *) tables[i], table_bytes[i]);
+            offset = _page_align(offset + table_bytes[i]);
+        }
+    } else {
+        _mapped_file = new MappedFile(infilename,
+                                      mode == LOAD_TABLES_MAP_READ_ONLY);
+        _read_only = mode == LOAD_TABLES_MAP_READ_ONLY;
+        for (size_t i = 0; i < table_bytes.size(); i++) {
+            if (offset + table_bytes[i] > _mapped_file->size()) {
+                throw khmer_file_exception("Unexpected end of k-mer table "
+                                           "file: " + infilename);
+            }
+            tables[i] = _mapped_file->data() + offset;
+            offset = _page_align(offset + table_bytes[i]);
+        }
+    }
+    infile.seekg(offset);
+}
+
+void Hashtable::_load_chunked_tables(ChunkedFileReader &chunks,
+                                     const std::string &infilename,
+                                     const std::vector<HashIntoType> &
+                                     table_bytes,
+                                     Byte ** tables, unsigned int n_threads)
+{
+    if (chunks.n_sections() < table_bytes.size()) {
+        throw khmer_file_exception("Bad table layout in k-mer table file: "
+                                   + infilename);
+    }
+    for (size_t i = 0; i < table_bytes.size(); i++) {
+        if (chunks.section_bytes(i) != table_bytes[i]) {
+            throw khmer_file_exception("Bad table layout in k-mer table "
+                                       "file: " + infilename);
+        }
+        tables[i] = _allocate_table(table_bytes[i], false);
+        chunks.read_section(i, tables[i], n_threads);
+    }
+}
+
+// how many bytes of an encoded table are buffered at a time.
+#define ENCODED_TABLE_BUFFER (1 << 16)
+// the longest LEB128 varint of a HashIntoType.
+#define MAX_VARINT_BYTES 10
+// tables smaller than this are always saved dense; there is little to save.
+#define MIN_SPARSE_TABLE_BYTES (1 << 16)
+
+static inline size_t _varint_bytes(HashIntoType n)
+{
+    size_t bytes = 1;
+    while (n >= 0x80) {
+        n >>= 7;
+        bytes++;
+    }
+    return bytes;
+}
+
+static inline Byte * _put_varint(Byte * out, HashIntoType n)
+{
+    while (n >= 0x80) {
+        *out++ = (Byte) (n | 0x80);
+        n >>= 7;
+    }
+    *out++ = (Byte) n;
+    return out;
+}
+
+// decode the varint at in into n; NULL if it doesn't end before end.
+static inline const Byte * _get_varint(const Byte * in, const Byte * end,
+                                       HashIntoType &n)
+{
+    n = 0;
+    for (unsigned int shift = 0; in < end && shift < 64; shift += 7) {
+        const Byte b = *in++;
+        n |= (HashIntoType) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+// call visit(pos) for each nonzero byte of table in order, skipping over
+// zero words, until it returns false.
+template<typename F>
+static void _for_each_nonzero_byte(const Byte * table, HashIntoType bytes,
+                                   F visit)
+{
+    HashIntoType pos = 0;
+    for (; pos + sizeof(uint64_t) <= bytes; pos += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, table + pos, sizeof(word));
+        if (!word) {
+            continue;
+        }
+        for (unsigned int j = 0; j < sizeof(uint64_t); j++) {
+            if (table[pos + j] && !visit(pos + j)) {
+                return;
+            }
+        }
+    }
+    for (; pos < bytes; pos++) {
+        if (table[pos] && !visit(pos)) {
+            return;
+        }
+    }
+}
+
+bool Hashtable::_choose_table_encodings(Byte * const * tables,
+                                        const std::vector<HashIntoType> &
+                                        table_bytes,
+                                        HashIntoType n_occupied,
+                                        HashIntoType n_bins, bool bit_tables,
+                                        std::vector<TableEncoding> &encodings,
+                                        std::vector<HashIntoType> &
+                                        encoded_bytes)
+{
+    encodings.assign(table_bytes.size(), TABLE_DENSE);
+    encoded_bytes = table_bytes;
+
+    // a sparse table takes at least two bytes per nonzero byte or one per
+    // set bit, so can only halve a table with at most a quarter of its bins
+    // occupied.
+    if (n_occupied > n_bins / 4) {
+        return false;
+    }
+
+    bool any_sparse = false;
+    for (size_t i = 0; i < table_bytes.size(); i++) {
+        const Byte * table = tables[i];
+        const HashIntoType limit = table_bytes[i] / 2;
+        if (table_bytes[i] < MIN_SPARSE_TABLE_BYTES) {
+            continue;
+        }
+        HashIntoType sparse_bytes = 0, next_byte = 0;
+        HashIntoType sparse_bits = bit_tables ? 0 : limit + 1, next_bit = 0;
+
+        _for_each_nonzero_byte(table, table_bytes[i], [&](HashIntoType pos) {
+            sparse_bytes += _varint_bytes(pos - next_byte) + 1;
+            next_byte = pos + 1;
+            if (bit_tables) {
+                for (unsigned int b = 0; b < 8; b++) {
+                    if (table[pos] & (1 << b)) {
+                        sparse_bits += _varint_bytes(pos * 8 + b - next_bit);
+                        next_bit = pos * 8 + b + 1;
+                    }
+                }
+            }
+            return sparse_bytes <= limit || sparse_bits <= limit;
+        });
+
+        if (sparse_bits <= limit && sparse_bits < sparse_bytes) {
+            encodings[i] = TABLE_SPARSE_BITS;
+            encoded_bytes[i] = sparse_bits;
+        } else if (sparse_bytes <= limit) {
+            encodings[i] = TABLE_SPARSE_BYTES;
+            encoded_bytes[i] = sparse_bytes;
+        } else {
+            continue;
+        }
+        any_sparse = true;
+    }
+    return any_sparse;
+}
+
+void Hashtable::_write_encoded_table(const Byte * table,
+                                     HashIntoType table_bytes,
+                                     TableEncoding encoding,
+                                     HashIntoType encoded_bytes,
+                                     const std::function<void(const Byte *,
+                                             size_t)> &write)
+{
+    unsigned char save_encoding = encoding;
+    write(&save_encoding, sizeof(save_encoding));
+    write((const Byte *) &encoded_bytes, sizeof(encoded_bytes));
+
+    if (encoding == TABLE_DENSE) {
+        write(table, table_bytes);
+        return;
+    }
+
+    // room for the varints of all of the set bits of one more byte.
+    std::vector<Byte> buffer(ENCODED_TABLE_BUFFER + 8 * MAX_VARINT_BYTES);
+    Byte * const start = buffer.data();
+    Byte * out = start;
+    HashIntoType next = 0;
+    _for_each_nonzero_byte(table, table_bytes, [&](HashIntoType pos) {
+        if (encoding == TABLE_SPARSE_BYTES) {
+            out = _put_varint(out, pos - next);
+            *out++ = table[pos];
+            next = pos + 1;
+        } else {
+            for (unsigned int b = 0; b < 8; b++) {
+                if (table[pos] & (1 << b)) {
+                    out = _put_varint(out, pos * 8 + b - next);
+                    next = pos * 8 + b + 1;
+                }
+            }
+        }
+        if (out - start >= ENCODED_TABLE_BUFFER) {
+            write(start, out - start);
+            out = start;
+        }
+        return true;
+    });
+    write(start, out - start);
+}
+
+EncodedTableReader::EncodedTableReader(HashIntoType table_bytes,
+                                       const std::string &infilename,
+                                       const std::function<void(Byte *,
+                                               size_t)> &read)
+    : _read(read), _corrupt("Corrupt table in k-mer table file: "
+                            + infilename),
+      _table_bytes(table_bytes), _unread(0), _at(0), _have(0), _next(0),
+      _done(0), _pending(false), _pending_pos(0), _pending_value(0)
+{
+    unsigned char encoding = 0;
+    _read(&encoding, sizeof(encoding));
+    _read((Byte *) &_unread, sizeof(_unread));
+
+    if (encoding == TABLE_DENSE) {
+        if (_unread != table_bytes) {
+            throw khmer_file_exception(_corrupt);
+        }
+    } else if (encoding == TABLE_SPARSE_BYTES
+               || encoding == TABLE_SPARSE_BITS) {
+        _buffer.resize(ENCODED_TABLE_BUFFER + MAX_VARINT_BYTES + 1);
+    } else {
+        throw khmer_file_exception(_corrupt);
+    }
+    _encoding = (TableEncoding) encoding;
+}
+
+bool EncodedTableReader::_decode(HashIntoType &pos, Byte &value)
+{
+    Byte * const start = _buffer.data();
+    if (_have - _at <= MAX_VARINT_BYTES && _unread) {
+        memmove(start, start + _at, _have - _at);
+        _have -= _at;
+        _at = 0;
+        const size_t n = std::min(_unread,
+                                  (HashIntoType) ENCODED_TABLE_BUFFER);
+        _read(start + _have, n);
+        _have += n;
+        _unread -= n;
+    }
+    if (_at == _have) {
+        return false;
+    }
+
+    const HashIntoType positions = _encoding == TABLE_SPARSE_BYTES ?
+                                   _table_bytes : _table_bytes * 8;
+    HashIntoType gap;
+    const Byte * in = _get_varint(start + _at, start + _have, gap);
+    if (!in || gap >= positions - _next) {
+        throw khmer_file_exception(_corrupt);
+    }
+    _at = in - start;
+    pos = _next + gap;
+    if (_encoding == TABLE_SPARSE_BYTES) {
+        if (_at == _have) {
+            throw khmer_file_exception(_corrupt);
+        }
+        value = start[_at++];
+    }
+    _next = pos + 1;
+    return true;
+}
+
+void EncodedTableReader::read(Byte * dest, HashIntoType bytes)
+{
+    if (bytes > _table_bytes - _done) {
+        throw khmer_exception("read past the end of an encoded table");
+    }
+    if (_encoding == TABLE_DENSE) {
+        _read(dest, bytes);
+        _unread -= bytes;
+        _done += bytes;
+        return;
+    }
+
+    memset(dest, 0, bytes);
+    const HashIntoType end = _done + bytes;
+    while (_pending || _decode(_pending_pos, _pending_value)) {
+        _pending = true;
+        const HashIntoType byte = _encoding == TABLE_SPARSE_BYTES ?
+                                  _pending_pos : _pending_pos / 8;
+        if (byte >= end) {
+            break;
+        }
+        if (_encoding == TABLE_SPARSE_BYTES) {
+            dest[byte - _done] = _pending_value;
+        } else {
+            dest[byte - _done] |= 1 << (_pending_pos % 8);
+        }
+        _pending = false;
+    }
+    _done = end;
+}
+
+void EncodedTableReader::finish()
+{
+    if (_done != _table_bytes || _pending || _unread || _at != _have) {
+        throw khmer_file_exception(_corrupt);
+    }
+}
+
+Byte * Hashtable::_read_encoded_table(HashIntoType table_bytes,
+                                      const std::string &infilename,
+                                      const std::function<void(Byte *,
+                                              size_t)> &read)
+{
+    EncodedTableReader decoder(table_bytes, infilename, read);
+    Byte * table = _allocate_table(table_bytes, false);
+    try {
+        decoder.read(table, table_bytes);
+        decoder.finish();
+    } catch (...) {
+        _free_table(table);
+        throw;
+    }
+    return table;
+}
+
+void Hashtable::_unmap_tables()
+{
+    delete _mapped_file;
+    _mapped_file = NULL;
+    _read_only = false;
+}
+
+void Hashtable::_check_not_mapped_from(const std::string &outfilename) const
+{
+    if (_mapped_file && _mapped_file->is_file(outfilename)) {
+        throw khmer_file_exception("Cannot save over the file the k-mer "
+                                   "tables were loaded from: " + outfilename);
+    }
+}
+
 //
 // check_and_normalize_read: checks for non-ACGT characters
 //			     converts lowercase characters to uppercase one
@@ -108,37 +576,47 @@ void
 Hashtable::
 consume_fasta(
     std:: string const  &filename,
-    unsigned int	      &total_reads, unsigned long long	&n_consumed
+    unsigned int	      &total_reads, unsigned long long	&n_consumed,
+    unsigned int	      n_threads
 )
 {
-    IParser *	  parser =
-        IParser::get_parser( filename );
-
-    consume_fasta(
-        parser,
-        total_reads, n_consumed
-    );
-
-    delete parser;
+    // a file that can be split is parsed on n_threads threads, each
+    // counting what it parses; any other is parsed on this thread, or goes
+    // through the pipeline for n_threads > 1. Our parsers are our own, so
+    // their reads are counted where they are in their buffers.
+    std:: vector< std:: unique_ptr< IParser > >	parsers =
+        IParser::get_split_parsers( filename, n_threads );
+
+    if (parsers.size() > 1 || n_threads <= 1) {
+        _consume_fasta_split( parsers, total_reads, n_consumed );
+    } else {
+        consume_fasta(
+            parsers[0].get(),
+            total_reads, n_consumed,
+            n_threads
+        );
+    }
 }
 
 void
 Hashtable::
 consume_fasta(
     read_parsers:: IParser *  parser,
-    unsigned int		    &total_reads, unsigned long long  &n_consumed
+    unsigned int		    &total_reads, unsigned long long  &n_consumed,
+    unsigned int		    n_threads
 )
 {
-    Read			  read;
+    if (n_threads > 1) {
+        _consume_fasta_threaded(parser, n_threads, total_reads, n_consumed);
+        return;
+    }
 
     // Iterate through the reads and consume their k-mers.
-    while (!parser->is_complete( )) {
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         bool is_valid;
-        try {
-            read = parser->get_next_read( );
-        } catch (NoMoreReadsAvailable) {
-            break;
-        }
 
         unsigned int this_n_consumed =
             check_and_process_read(read.sequence, is_valid);
@@ -150,25 +628,180 @@ consume_fasta(
 
 } // consume_fasta
 
+//
+// _consume_fasta_threaded: the calling thread parses reads into batches and
+// passes them through a bounded queue to n_threads workers, which count
+// them and pass the emptied batches back for reuse. Nothing but the parser
+// is shared between threads, so this scales until parsing is the
+// bottleneck.
+//
+
+namespace
+{
+
+const size_t CONSUME_BATCH_SIZE = 256;
+
+struct ReadBatch {
+    std::vector<Read>	reads;
+    size_t		n_reads;
+};
+
+// one thread's counts in _consume_fasta_split, padded so that no two
+// threads write to the same cache line.
+struct SplitTally {
+    unsigned long long	n_consumed;
+    unsigned int	n_reads;
+    char		_pad[CACHE_LINE_SIZE];
+
+    SplitTally() : n_consumed(0), n_reads(0) {}
+};
+
+}
+
+void
+Hashtable::
+_consume_fasta_threaded(
+    read_parsers:: IParser *  parser,
+    unsigned int		    n_threads,
+    unsigned int		    &total_reads, unsigned long long  &n_consumed
+)
+{
+    // enough batches in flight that neither side waits on the other often.
+    const size_t n_batches = 4 * n_threads;
+    std::vector<ReadBatch> batches(n_batches);
+    BoundedQueue<ReadBatch *> empty(n_batches), full(n_batches + n_threads);
+    for (size_t i = 0; i < n_batches; i++) {
+        empty.push(&batches[i]);
+    }
+
+    // the first exception in any thread stops the parsing, and is rethrown
+    // here once the workers are done.
+    std::exception_ptr error;
+    uint32_t error_spin_lock = 0;
+    volatile bool failed = false;
+    auto record_error = [&]() {
+        while (!__sync_bool_compare_and_swap(&error_spin_lock, 0, 1));
+        if (!error) {
+            error = std::current_exception();
+        }
+        failed = true;
+        __sync_lock_release(&error_spin_lock);
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < n_threads; t++) {
+        workers.push_back(std::thread([&]() {
+            unsigned int my_reads = 0;
+            unsigned long long my_consumed = 0;
+            ReadBatch * batch;
+
+            // a NULL batch means the parser is done.
+            while (full.pop(batch), batch != NULL) {
+                try {
+                    for (size_t i = 0; i < batch->n_reads; i++) {
+                        bool is_valid;
+                        my_consumed += check_and_process_read(
+                                           batch->reads[i].sequence, is_valid);
+                        my_reads++;
+                    }
+                } catch (...) {
+                    record_error();
+                }
+                empty.push(batch);
+            }
+
+            __sync_add_and_fetch(&n_consumed, my_consumed);
+            __sync_add_and_fetch(&total_reads, my_reads);
+        }));
+    }
+
+    try {
+        bool done = false;
+        while (!done && !failed) {
+            ReadBatch * batch;
+            empty.pop(batch);
+
+            // the reads before a bad one come in one batch, and the error
+            // with the next.
+            batch->n_reads = 0;
+            try {
+                batch->n_reads = parser->imprint_next_read_batch(
+                                     batch->reads, CONSUME_BATCH_SIZE);
+                done = batch->n_reads == 0;
+            } catch (...) {
+                record_error();
+            }
+            full.push(batch);
+        }
+    } catch (...) {
+        record_error();
+    }
+
+    for (unsigned int t = 0; t < n_threads; t++) {
+        full.push(NULL);
+    }
+    for (unsigned int t = 0; t < n_threads; t++) {
+        workers[t].join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+} // _consume_fasta_threaded
+
+//
+// _consume_fasta_split: each parser of a split file counts its own reads,
+// as ReadViews, on a thread of its own.
+//
+
+void
+Hashtable::
+_consume_fasta_split(
+    std:: vector< std:: unique_ptr< IParser > > const &parsers,
+    unsigned int		    &total_reads, unsigned long long  &n_consumed
+)
+{
+    std::vector<SplitTally> tallies(parsers.size());
+
+    for_each_read_split(parsers, [&](const ReadView &read, size_t i) {
+        bool is_valid;
+        tallies[i].n_consumed += check_and_process_read(
+                                     read.sequence, read.sequence_length,
+                                     is_valid);
+        tallies[i].n_reads++;
+    });
+
+    for (size_t i = 0; i < parsers.size(); i++) {
+        n_consumed += tallies[i].n_consumed;
+        total_reads += tallies[i].n_reads;
+    }
+} // _consume_fasta_split
+
 //
 // consume_string: run through every k-mer in the given string, & hash it.
 //
 
 unsigned int Hashtable::consume_string(const std::string &s)
 {
-    const char * sp = s.c_str();
-    unsigned int n_consumed = 0;
+    return consume_string(s.data(), s.length());
+}
 
-    KmerIterator kmers(sp, _ksize);
+unsigned int Hashtable::consume_string(const char * s, size_t length)
+{
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(s, length, _ksize);
 
-    while(!kmers.done()) {
-        HashIntoType kmer = kmers.next();
+    return consume_kmers(kmers);
+}
 
-        count(kmer);
-        n_consumed++;
-    }
+unsigned int Hashtable::consume_kmers(const KmerHashBlock &kmers)
+{
+    _check_kmer_block(kmers);
 
-    return n_consumed;
+    const size_t n_kmers = kmers.size();
+    _count_hashes(kmers.uniqified(), n_kmers);
+
+    return n_kmers;
 }
 
 // technically, get medioid count... our "median" is always a member of the
@@ -178,9 +811,20 @@ void Hashtable::get_median_count(const std::string &s,
                                  BoundedCounterType &median,
                                  float &average,
                                  float &stddev)
+{
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(s, _ksize);
+
+    get_median_count(kmers, median, average, stddev);
+}
+
+void Hashtable::get_median_count(const KmerHashBlock &kmers,
+                                 BoundedCounterType &median,
+                                 float &average,
+                                 float &stddev)
 {
     std::vector<BoundedCounterType> counts;
-    this->get_kmer_counts(s, counts);
+    this->get_kmer_counts(kmers, counts);
 
     if (!counts.size()) {
         throw khmer_exception("no k-mer counts for this string; too short?");
@@ -211,36 +855,61 @@ void Hashtable::get_median_count(const std::string &s,
 bool Hashtable::median_at_least(const std::string &s,
                                 unsigned int cutoff)
 {
-    KmerIterator kmers(s.c_str(), _ksize);
-    unsigned int min_req = 0.5 + float(s.size() - _ksize + 1) / 2;
-    unsigned int num_cutoff_kmers = 0;
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(s, _ksize);
 
-    // first loop:
-    // accumulate at least min_req worth of counts before checking to see
-    // if we have enough high-abundance k-mers to indicate success.
-    for (unsigned int i = 0; i < min_req; ++i) {
-        HashIntoType kmer = kmers.next();
-        if (this->get_count(kmer) >= cutoff) {
-            ++num_cutoff_kmers;
-        }
-    }
+    return median_at_least(kmers, cutoff);
+}
 
-    // second loop: now check to see if we pass the threshold for each k-mer.
-    if (num_cutoff_kmers >= min_req) {
-        return true;
+bool Hashtable::median_at_least(const KmerHashBlock &kmers,
+                                unsigned int cutoff)
+{
+    _check_kmer_block(kmers);
+
+    const size_t n_kmers = kmers.size();
+    if (!n_kmers) {
+        throw khmer_exception("no k-mer counts for this string; too short?");
     }
-    while(!kmers.done()) {
-        HashIntoType kmer = kmers.next();
-        if (this->get_count(kmer) >= cutoff) {
-            ++num_cutoff_kmers;
-            if (num_cutoff_kmers >= min_req) {
-                return true;
+
+    const HashIntoType * hashes = kmers.uniqified();
+    unsigned int min_req = 0.5 + float(n_kmers) / 2;
+    unsigned int num_cutoff_kmers = 0;
+
+    // look the counts up a batch at a time, so that they can be prefetched,
+    // and stop as soon as we have enough high-abundance k-mers to indicate
+    // success.
+    const size_t batch_size = 64;
+    BoundedCounterType counts[batch_size];
+
+    for (size_t i = 0; i < n_kmers; i += batch_size) {
+        const size_t n = std::min(batch_size, n_kmers - i);
+        _get_counts(hashes + i, n, counts);
+
+        for (size_t j = 0; j < n; ++j) {
+            if (counts[j] >= cutoff) {
+                ++num_cutoff_kmers;
             }
         }
+        if (num_cutoff_kmers >= min_req) {
+            return true;
+        }
     }
     return false;
 }
 
+bool Hashtable::consume_if_median_below(const std::string &s,
+                                        unsigned int cutoff)
+{
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(s, _ksize);
+
+    if (median_at_least(kmers, cutoff)) {
+        return false;
+    }
+    consume_kmers(kmers);
+    return true;
+}
+
 void Hashtable::save_tagset(std::string outfilename)
 {
     ofstream outfile(outfilename.c_str(), ios::binary);
@@ -261,8 +930,8 @@ void Hashtable::save_tagset(std::string outfilename)
     outfile.write((const char *) &_tag_density, sizeof(_tag_density));
 
     unsigned int i = 0;
-    for (SeenSet::iterator pi = all_tags.begin(); pi != all_tags.end();
-            ++pi, i++) {
+    for (ConcurrentTagSet::const_iterator pi = all_tags.begin();
+            pi != all_tags.end(); ++pi, i++) {
         buf[i] = *pi;
     }
 
@@ -348,6 +1017,7 @@ void Hashtable::load_tagset(std::string infilename, bool clear_tags)
 
         infile.read((char *) buf, sizeof(HashIntoType) * tagset_size);
 
+        all_tags.reserve(tagset_size);
         for (unsigned int i = 0; i < tagset_size; i++) {
             all_tags.insert(buf[i]);
         }
@@ -366,34 +1036,34 @@ void Hashtable::consume_sequence_and_tag(const std::string& seq,
         unsigned long long& n_consumed,
         SeenSet * found_tags)
 {
-    bool kmer_tagged;
-
-    KmerIterator kmers(seq.c_str(), _ksize);
-    HashIntoType kmer;
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    const size_t n_kmers = kmers.hash(seq, _ksize);
+    if (!n_kmers) {
+        return;
+    }
+    const HashIntoType * hashes = kmers.uniqified();
 
     unsigned int since = _tag_density / 2 + 1;
 
-    while(!kmers.done()) {
-        kmer = kmers.next();
-        bool is_new_kmer;
-
-        // Set the bits for the kmer in the various hashtables,
-        // and report on whether or not they had already been set.
-        // This is probably better than first testing and then setting the bits,
-        // as a failed test essentially results in doing the same amount of work
-        // twice.
-        if ((is_new_kmer = test_and_set_bits( kmer ))) {
-            ++n_consumed;
-        }
+    // Set the bits for the k-mers in the various hashtables a batch at a
+    // time, in one call to the table, and report on whether or not they
+    // had already been set. This is probably better than first testing and
+    // then setting the bits, as a failed test essentially results in doing
+    // the same amount of work twice.
+    const size_t batch_size = 64;
+    Byte is_new[batch_size];
 
-#if (1)
-        if (is_new_kmer) {
-            ++since;
-        } else {
-            ACQUIRE_ALL_TAGS_SPIN_LOCK
-            kmer_tagged = set_contains(all_tags, kmer);
-            RELEASE_ALL_TAGS_SPIN_LOCK
-            if (kmer_tagged) {
+    for (size_t i = 0; i < n_kmers; i += batch_size) {
+        const size_t n = std::min(batch_size, n_kmers - i);
+        _test_and_set_hashes(hashes + i, n, is_new);
+
+        for (size_t j = 0; j < n; j++) {
+            const HashIntoType kmer = hashes[i + j];
+
+            if (is_new[j]) {
+                ++n_consumed;
+                ++since;
+            } else if (set_contains(all_tags, kmer)) {
                 since = 1;
                 if (found_tags) {
                     found_tags->insert(kmer);
@@ -401,34 +1071,20 @@ void Hashtable::consume_sequence_and_tag(const std::string& seq,
             } else {
                 ++since;
             }
-        }
-#else
-        if (!is_new_kmer && set_contains(all_tags, kmer)) {
-            since = 1;
-            if (found_tags) {
-                found_tags->insert(kmer);
-            }
-        } else {
-            since++;
-        }
-#endif
 
-        if (since >= _tag_density) {
-            ACQUIRE_ALL_TAGS_SPIN_LOCK
-            all_tags.insert(kmer);
-            RELEASE_ALL_TAGS_SPIN_LOCK
-            if (found_tags) {
-                found_tags->insert(kmer);
+            if (since >= _tag_density) {
+                all_tags.insert(kmer);
+                if (found_tags) {
+                    found_tags->insert(kmer);
+                }
+                since = 1;
             }
-            since = 1;
         }
-
-    } // iteration over kmers
+    }
 
     if (since >= _tag_density/2 - 1) {
-        ACQUIRE_ALL_TAGS_SPIN_LOCK
+        const HashIntoType kmer = hashes[n_kmers - 1];
         all_tags.insert(kmer);	// insert the last k-mer, too.
-        RELEASE_ALL_TAGS_SPIN_LOCK
         if (found_tags) {
             found_tags->insert(kmer);
         }
@@ -466,21 +1122,16 @@ consume_fasta_and_tag(
     unsigned int		    &total_reads,   unsigned long long	&n_consumed
 )
 {
-    Read			  read;
 
     // TODO? Delete the following assignments.
     total_reads = 0;
     n_consumed = 0;
 
     // Iterate through the reads and consume their k-mers.
-    while (!parser->is_complete( )) {
-
-        try {
-            read = parser->get_next_read( );
-        } catch (NoMoreReadsAvailable &e) {
-            // Bail out if this error is raised
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
 
         if (check_and_normalize_read( read.sequence )) {
             unsigned long long this_n_consumed = 0;
@@ -507,7 +1158,6 @@ void Hashtable::consume_fasta_and_tag_with_stoptags(const std::string &filename,
     n_consumed = 0;
 
     IParser* parser = IParser::get_parser(filename.c_str());
-    Read read;
 
     string seq = "";
 
@@ -517,12 +1167,10 @@ void Hashtable::consume_fasta_and_tag_with_stoptags(const std::string &filename,
     // iterate through the FASTA file & consume the reads.
     //
 
-    while(!parser->is_complete())  {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         seq = read.sequence;
 
         read_tags.clear();
@@ -608,8 +1256,8 @@ void Hashtable::divide_tags_into_subsets(unsigned int subset_size,
 {
     unsigned int i = 0;
 
-    for (SeenSet::const_iterator si = all_tags.begin(); si != all_tags.end();
-            ++si) {
+    for (ConcurrentTagSet::const_iterator si = all_tags.begin();
+            si != all_tags.end(); ++si) {
         if (i % subset_size == 0) {
             divvy.insert(*si);
             i = 0;
@@ -630,7 +1278,6 @@ void Hashtable::consume_partitioned_fasta(const std::string &filename,
     n_consumed = 0;
 
     IParser* parser = IParser::get_parser(filename.c_str());
-    Read read;
 
     string seq = "";
 
@@ -642,12 +1289,10 @@ void Hashtable::consume_partitioned_fasta(const std::string &filename,
     // iterate through the FASTA file & consume the reads.
     //
 
-    while(!parser->is_complete())  {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         seq = read.sequence;
 
         if (check_and_normalize_read(seq)) {
@@ -685,7 +1330,6 @@ void Hashtable::consume_fasta_and_traverse(const std::string &filename,
     unsigned long long total_reads = 0;
 
     IParser* parser = IParser::get_parser(filename.c_str());
-    Read read;
 
     string seq = "";
 
@@ -693,12 +1337,10 @@ void Hashtable::consume_fasta_and_traverse(const std::string &filename,
     // iterate through the FASTA file & consume the reads.
     //
 
-    while(!parser->is_complete())  {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         seq = read.sequence;
 
         if (check_and_normalize_read(seq)) {	// process?
@@ -744,7 +1386,7 @@ void Hashtable::consume_fasta_and_traverse(const std::string &filename,
 
 void Hashtable::calc_connected_graph_size(Kmer start,
         unsigned long long& count,
-        KmerSet& keeper,
+        TraversalContext& context,
         const unsigned long long threshold,
         bool break_on_circum)
 const
@@ -756,8 +1398,8 @@ const
     }
 
     Traverser traverser(this);
-    KmerQueue node_q;
-    node_q.push(start);
+    context.reset();
+    context.push(start, 0);
 
     // Avoid high-circumference k-mers
     auto filter = [&] (Kmer& n) {
@@ -765,12 +1407,11 @@ const
                  traverser.degree(n) > 4);
     };
 
-    while(!node_q.empty()) {
-        Kmer node = node_q.front();
-        node_q.pop();
+    while(!context.frontier_empty()) {
+        Kmer node = context.pop().kmer;
 
         // have we already seen me? don't count; exit.
-        if (set_contains(keeper, node)) {
+        if (context.visited(node)) {
             continue;
         }
 
@@ -780,7 +1421,7 @@ const
         }
 
         // keep track of both seen kmers, and counts.
-        keeper.insert(node);
+        context.visit(node);
 
         count += 1;
 
@@ -790,8 +1431,7 @@ const
         }
 
         // otherwise, explore in all directions.
-        traverser.traverse_right(node, node_q, filter);
-        traverser.traverse_left(node, node_q, filter);
+        traverser.traverse(node, context, 0, filter);
     }
 }
 
@@ -818,17 +1458,14 @@ void Hashtable::filter_if_present(const std::string &infilename,
     unsigned int total_reads = 0;
     unsigned int reads_kept = 0;
 
-    Read read;
     string seq;
 
     HashIntoType kmer;
 
-    while(!parser->is_complete()) {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         seq = read.sequence;
 
         if (check_and_normalize_read(seq)) {
@@ -893,8 +1530,8 @@ void Hashtable::traverse_from_tags(unsigned int distance,
     std::cout << all_tags.size() << " tags...\n";
 #endif // 0
 
-    for (SeenSet::const_iterator si = all_tags.begin(); si != all_tags.end();
-            ++si, i++) {
+    for (ConcurrentTagSet::const_iterator si = all_tags.begin();
+            si != all_tags.end(); ++si, i++) {
 
         n++;
         Kmer tag = build_kmer(*si);
@@ -1124,8 +1761,8 @@ void Hashtable::print_tagset(std::string infilename)
     ofstream printfile(infilename.c_str());
 
     unsigned int i = 0;
-    for (SeenSet::iterator pi = all_tags.begin(); pi != all_tags.end();
-            ++pi, i++) {
+    for (ConcurrentTagSet::const_iterator pi = all_tags.begin();
+            pi != all_tags.end(); ++pi, i++) {
         std::string kmer = _revhash(*pi, _ksize);
         printfile << kmer << "\n";
     }
@@ -1288,25 +1925,36 @@ void Hashtable::get_kmers(const std::string &s,
 void Hashtable::get_kmer_hashes(const std::string &s,
                                 std::vector<HashIntoType> &kmers_vec) const
 {
-    KmerIterator kmers(s.c_str(), _ksize);
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(s, _ksize);
 
-    while(!kmers.done()) {
-        HashIntoType kmer = kmers.next();
-        kmers_vec.push_back(kmer);
-    }
+    kmers_vec.insert(kmers_vec.end(), kmers.uniqified(),
+                     kmers.uniqified() + kmers.size());
 }
 
 
 void Hashtable::get_kmer_counts(const std::string &s,
                                 std::vector<BoundedCounterType> &counts) const
 {
-    KmerIterator kmers(s.c_str(), _ksize);
+    KmerHashBlock &kmers = KmerHashBlock::thread_local_block();
+    kmers.hash(s, _ksize);
 
-    while(!kmers.done()) {
-        HashIntoType kmer = kmers.next();
-        BoundedCounterType c = this->get_count(kmer);
-        counts.push_back(c);
+    get_kmer_counts(kmers, counts);
+}
+
+void Hashtable::get_kmer_counts(const KmerHashBlock &kmers,
+                                std::vector<BoundedCounterType> &counts) const
+{
+    _check_kmer_block(kmers);
+
+    const size_t n_kmers = kmers.size();
+    const size_t start = counts.size();
+    if (!n_kmers) {
+        return;
     }
+
+    counts.resize(start + n_kmers);
+    _get_counts(kmers.uniqified(), n_kmers, &counts[start]);
 }
 
 // vim: set sts=2 sw=2:
@@ -43,6 +43,7 @@ Contact: khmer-project@idyll.org
 #include <stdint.h>
 #include <string.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <map>
@@ -52,17 +53,19 @@ Contact: khmer-project@idyll.org
 #include <string>
 #include <vector>
 
+#include "chunked_file.hh"
 #include "khmer.hh"
 #include "khmer_exception.hh"
 #include "kmer_hash.hh"
 #include "read_parsers.hh"
-#include "traversal.hh"
 #include "subset.hh"
+#include "tagset.hh"
 
 namespace khmer
 {
 class CountingHash;
 class Hashtable;
+class TraversalContext;
 
 namespace read_parsers
 {
@@ -78,12 +81,112 @@ struct IParser;
 #define prev_f(kmer_f, ch) ((kmer_f) >> 2 | twobit_repr(ch) << rc_left_shift)
 #define prev_r(kmer_r, ch) ((((kmer_r) << 2) & bitmask) | (twobit_comp(ch)))
 
-#define set_contains(s, e) ((s).find(e) != (s).end())
-
 #define CALLBACK_PERIOD 100000
 
 namespace khmer
 {
+// ConcurrentTagSet has an overload of its own, in tagset.hh.
+template<typename S, typename E>
+inline bool set_contains(const S& s, const E& e)
+{
+    return s.find(e) != s.end();
+}
+
+
+// How load brings the tables of a saved graph into memory. The tables of a
+// file saved page-aligned can be mapped from the file instead of read:
+// read-only, so that every process which loads the file shares its pages
+// in the page cache, or copy-on-write, so that updates go to private copies
+// of just the pages they touch. The tables of other files are always read.
+enum TableLoadMode {
+    LOAD_TABLES_READ,
+    LOAD_TABLES_MAP_READ_ONLY,
+    LOAD_TABLES_MAP_COPY_ON_WRITE
+};
+
+// How each table of a file saved with SAVED_FLAG_SPARSE is stored, after its
+// size: a byte for the encoding, the number of bytes that follow, and then
+// the table in that encoding. Gaps count the zero bytes or clear bits
+// skipped since the last one stored, as LEB128 varints.
+enum TableEncoding {
+    TABLE_DENSE = 0,            // every byte of the table
+    TABLE_SPARSE_BYTES = 1,     // the gap and value of each nonzero byte
+    TABLE_SPARSE_BITS = 2       // the gap before each set bit
+};
+
+// Decodes a table saved by Hashtable::_write_encoded_table a range at a
+// time, from read, which fills the whole buffer given to it or throws, so
+// that a table can be streamed as well as loaded whole.
+class EncodedTableReader
+{
+protected:
+    std::function<void(Byte *, size_t)> _read;
+    std::string _corrupt;       // the message for a corrupt table
+    HashIntoType _table_bytes;
+    TableEncoding _encoding;
+    HashIntoType _unread;       // encoded bytes not read yet
+
+    // room for one more entry's worth left over from the last read.
+    std::vector<Byte> _buffer;
+    size_t _at, _have;
+    HashIntoType _next;         // the position after the last one decoded
+    HashIntoType _done;         // the bytes of the table returned so far
+
+    // the entry decoded but not yet returned, if it lies past the range.
+    bool _pending;
+    HashIntoType _pending_pos;
+    Byte _pending_value;
+
+    // decode the next entry; false once there are none left.
+    bool _decode(HashIntoType &pos, Byte &value);
+
+public:
+    // read the encoding and encoded size of a table of table_bytes bytes.
+    EncodedTableReader(HashIntoType table_bytes, const std::string &infilename,
+                       const std::function<void(Byte *, size_t)> &read);
+
+    TableEncoding encoding() const
+    {
+        return _encoding;
+    }
+    // the encoded bytes that are still to be read; skip these to skip the
+    // rest of the table.
+    HashIntoType unread_bytes() const
+    {
+        return _unread;
+    }
+
+    // fill dest with the next bytes bytes of the table.
+    void read(Byte * dest, HashIntoType bytes);
+    // check that the whole table has been read, and nothing more is left.
+    void finish();
+};
+
+// A whole file mapped into memory, shared with the page cache if read_only
+// and private copy-on-write otherwise.
+class MappedFile
+{
+protected:
+    std::string _filename;
+    Byte *	_data;
+    size_t	_size;
+
+public:
+    MappedFile(const std::string &filename, bool read_only);
+    ~MappedFile();
+
+    Byte * data() const
+    {
+        return _data;
+    }
+    size_t size() const
+    {
+        return _size;
+    }
+
+    // is filename this file, under any name?
+    bool is_file(const std::string &filename) const;
+};
 
 class Hashtable: public
     KmerFactory  		// Base class implementation of a Bloom ht.
@@ -91,12 +194,21 @@ class Hashtable: public
     friend class SubsetPartition;
     friend class LabelHash;
     friend class Traverser;
+    friend class GraphFileMerger;
+    friend class SavedTableReader;
 
 protected:
     unsigned int _tag_density;
 
     unsigned int    _max_count;
     unsigned int    _max_bigcount;
+    bool            _use_fastrange;
+    unsigned int    _prefetch_distance;
+
+    // the file that load mapped the tables from, or NULL if they were
+    // allocated; the tables of a read-only mapping must not be changed.
+    MappedFile *    _mapped_file;
+    bool            _read_only;
 
     //WordLength	    _ksize;
     HashIntoType    bitmask;
@@ -105,7 +217,11 @@ protected:
     explicit Hashtable( WordLength ksize )
         : KmerFactory( ksize ),
           _max_count( MAX_KCOUNT ),
-          _max_bigcount( MAX_BIGCOUNT )
+          _max_bigcount( MAX_BIGCOUNT ),
+          _use_fastrange( false ),
+          _prefetch_distance( DEFAULT_PREFETCH_DISTANCE ),
+          _mapped_file( NULL ),
+          _read_only( false )
     {
         _tag_density = DEFAULT_TAG_DENSITY;
         if (!(_tag_density % 2 == 0)) {
@@ -113,12 +229,114 @@ protected:
         }
         _init_bitstuff();
         partition = new SubsetPartition(this);
-        _all_tags_spin_lock = 0;
     }
 
     virtual ~Hashtable( )
     {
         delete partition;
+        _unmap_tables();
+    }
+
+    // allocate a table starting on a cache line boundary, so that any
+    // CACHE_LINE_SIZE-aligned block within it is a single cache line.
+    // Release with _free_table.
+    static Byte * _allocate_table(HashIntoType tablesize, bool zero = true);
+    static void _free_table(Byte * table);
+
+    // the offset of the next SAVED_PAGE_SIZE boundary at or after offset.
+    static HashIntoType _page_align(HashIntoType offset)
+    {
+        return (offset + SAVED_PAGE_SIZE - 1) / SAVED_PAGE_SIZE
+               * SAVED_PAGE_SIZE;
+    }
+
+    // The tables of a page-aligned file follow its header and table sizes,
+    // each starting on the next SAVED_PAGE_SIZE boundary; whatever follows
+    // the tables does too.
+    static void _write_page_aligned_tables(std::ofstream &outfile,
+                                           Byte * const * tables,
+                                           const std::vector<HashIntoType> &
+                                           table_bytes);
+    // read or map the tables of a page-aligned file into tables, leaving
+    // infile at the end of them. The subclasses' _free_counters must not
+    // free mapped tables, and call _unmap_tables once they are done with
+    // them.
+    void _load_page_aligned_tables(std::ifstream &infile,
+                                   const std::string &infilename,
+                                   const std::vector<HashIntoType> &
+                                   table_bytes,
+                                   Byte ** tables, TableLoadMode mode);
+    void _unmap_tables();
+
+    // read the first table_bytes.size() sections of a chunked file, which
+    // must be that big, into newly allocated tables.
+    static void _load_chunked_tables(ChunkedFileReader &chunks,
+                                     const std::string &infilename,
+                                     const std::vector<HashIntoType> &
+                                     table_bytes,
+                                     Byte ** tables, unsigned int n_threads);
+
+    // pick an encoding for each table, and the number of bytes it comes to.
+    // A sparse encoding is only picked if it at least halves the table, and
+    // the tables are only scanned if n_occupied of the n_bins bins of a
+    // table says one might; TABLE_SPARSE_BITS needs bit_tables. Returns
+    // whether any table is to be saved sparse.
+    static bool _choose_table_encodings(Byte * const * tables,
+                                        const std::vector<HashIntoType> &
+                                        table_bytes,
+                                        HashIntoType n_occupied,
+                                        HashIntoType n_bins, bool bit_tables,
+                                        std::vector<TableEncoding> &encodings,
+                                        std::vector<HashIntoType> &
+                                        encoded_bytes);
+    // write table with its encoding and size, a buffer at a time, to write.
+    static void _write_encoded_table(const Byte * table,
+                                     HashIntoType table_bytes,
+                                     TableEncoding encoding,
+                                     HashIntoType encoded_bytes,
+                                     const std::function<void(const Byte *,
+                                             size_t)> &write);
+    // read a table saved by _write_encoded_table from read, which fills
+    // the whole buffer given to it or throws, into a newly allocated table.
+    static Byte * _read_encoded_table(HashIntoType table_bytes,
+                                      const std::string &infilename,
+                                      const std::function<void(Byte *,
+                                              size_t)> &read);
+
+    // saving over the file that the tables are mapped from would pull the
+    // pages out from under them.
+    void _check_not_mapped_from(const std::string &outfilename) const;
+
+    void _check_writable() const
+    {
+        if (_read_only) {
+            throw khmer_value_exception("cannot change a k-mer table that "
+                                        "was loaded read-only");
+        }
+    }
+
+    // By default table i puts a k-mer in bin khash % tablesize, and the
+    // table sizes are distinct primes. In the fastrange mode table i
+    // multiplies the k-mer hash by its own odd constant, h1 + i * h2 from
+    // _mix_hashes, and picks the bin from the high bits of that with a
+    // multiply-high (_fastrange) instead of a 64-bit division, so the table
+    // sizes can be anything. The blocked layouts pick a k-mer's block by
+    // _mix_hash, in kmer_hash.hh.
+
+    // h1 is odd and h2 even multiples of khash, so each table's multiplier
+    // is odd.
+    static void _mix_hashes(HashIntoType khash, HashIntoType &h1,
+                            HashIntoType &h2)
+    {
+        h1 = khash * 0x9e3779b97f4a7c15ULL;
+        h2 = khash * 0xc2b2ae3d27d4eb4eULL;
+    }
+
+    // map a uniform 64-bit hash onto [0, n).
+    static HashIntoType _fastrange(HashIntoType h, HashIntoType n)
+    {
+        __extension__ typedef unsigned __int128 uint128_t;
+        return (HashIntoType) (((uint128_t) h * n) >> 64);
     }
 
     void _init_bitstuff()
@@ -148,6 +366,139 @@ protected:
         return uniqify_rc(h, r);
     }
 
+    // count, or get the counts of, n k-mer hashes. Each table class
+    // overrides these with _pipeline_count and _pipeline_get_counts, which
+    // call its own count, get_count and prefetch directly.
+    virtual void _count_hashes(const HashIntoType * hashes, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            count(hashes[i]);
+        }
+    }
+    virtual void _get_counts(const HashIntoType * hashes, size_t n,
+                             BoundedCounterType * counts) const
+    {
+        for (size_t i = 0; i < n; i++) {
+            counts[i] = get_count(hashes[i]);
+        }
+    }
+
+    // test_and_set_bits for n k-mer hashes in order, setting is_new[i] for
+    // each; overridden with _pipeline_test_and_set, like _count_hashes.
+    virtual void _test_and_set_hashes(const HashIntoType * hashes, size_t n,
+                                      Byte * is_new)
+    {
+        for (size_t i = 0; i < n; i++) {
+            is_new[i] = test_and_set_bits(hashes[i]) ? 1 : 0;
+        }
+    }
+
+    // bit i of the result is set if hashes[i] has a nonzero count, for n
+    // of at most 32. Tables whose get_count stops at the first empty bin
+    // override this to stop early for the whole batch, too.
+    virtual unsigned int _get_present(const HashIntoType * hashes,
+                                      unsigned int n) const
+    {
+        BoundedCounterType counts[32];
+        _get_counts(hashes, n, counts);
+
+        unsigned int present = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            if (counts[i]) {
+                present |= 1U << i;
+            }
+        }
+        return present;
+    }
+
+    // The batched engine: while k-mer i is counted, the bins of k-mer
+    // i + _prefetch_distance are already on their way from memory, so on
+    // tables much larger than the cache the lookups overlap instead of
+    // stalling one after another.
+    template <typename T>
+    static void _pipeline_count(T * table, const HashIntoType * hashes,
+                                size_t n)
+    {
+        const size_t distance = table->_prefetch_distance;
+
+        for (size_t i = 0; i < distance && i < n; i++) {
+            table->T::prefetch(hashes[i]);
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (distance && i + distance < n) {
+                table->T::prefetch(hashes[i + distance]);
+            }
+            table->T::count(hashes[i]);
+        }
+    }
+
+    template <typename T>
+    static void _pipeline_get_counts(const T * table,
+                                     const HashIntoType * hashes, size_t n,
+                                     BoundedCounterType * counts)
+    {
+        const size_t distance = table->_prefetch_distance;
+
+        for (size_t i = 0; i < distance && i < n; i++) {
+            table->T::prefetch(hashes[i]);
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (distance && i + distance < n) {
+                table->T::prefetch(hashes[i + distance]);
+            }
+            counts[i] = table->T::get_count(hashes[i]);
+        }
+    }
+
+    template <typename T>
+    static void _pipeline_test_and_set(T * table,
+                                       const HashIntoType * hashes, size_t n,
+                                       Byte * is_new)
+    {
+        const size_t distance = table->_prefetch_distance;
+
+        for (size_t i = 0; i < distance && i < n; i++) {
+            table->T::prefetch(hashes[i]);
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (distance && i + distance < n) {
+                table->T::prefetch(hashes[i + distance]);
+            }
+            is_new[i] = table->T::test_and_set_bits(hashes[i]) ? 1 : 0;
+        }
+    }
+
+    // as check_and_normalize_read for a read that is not to be modified:
+    // the read itself if it is valid and uppercase, an uppercased copy of
+    // it, valid until the next call on this thread, if it is valid, or
+    // else NULL.
+    const char * _check_read_view(const char * read, size_t length) const;
+
+    // make sure a block of hashes was computed with our k-mer size.
+    void _check_kmer_block(const KmerHashBlock &kmers) const
+    {
+        if (kmers.size() && kmers.ksize() != _ksize) {
+            throw khmer_exception("k-mer size of hash block doesn't match");
+        }
+    }
+
+    // consume_fasta with a thread for each of the parsers of a split file,
+    // or just this one for a single parser, counting ReadViews.
+    void _consume_fasta_split(
+        std:: vector< std:: unique_ptr< read_parsers:: IParser > > const
+        &parsers,
+        unsigned int	    &total_reads,
+        unsigned long long  &n_consumed
+    );
+
+    // consume_fasta with n_threads worker threads; see hashtable.cc.
+    void _consume_fasta_threaded(
+        read_parsers:: IParser *	    parser,
+        unsigned int	    n_threads,
+        unsigned int	    &total_reads,
+        unsigned long long  &n_consumed
+    );
+
     void _clear_all_partitions()
     {
         if (partition != NULL) {
@@ -155,14 +506,12 @@ protected:
         }
     }
 
-    uint32_t _all_tags_spin_lock;
-
     explicit Hashtable(const Hashtable&);
     Hashtable& operator=(const Hashtable&);
 
 public:
     SubsetPartition * partition;
-    SeenSet all_tags;
+    ConcurrentTagSet all_tags;
     SeenSet stop_tags;
     SeenSet repart_small_tags;
 
@@ -179,11 +528,43 @@ public:
     virtual const BoundedCounterType get_count(const char * kmer) const = 0;
     virtual const BoundedCounterType get_count(HashIntoType khash) const = 0;
 
-    virtual void save(std::string) = 0;
-    virtual void load(std::string) = 0;
+    // start fetching the table bins of the given k-mer hash into cache.
+    virtual void prefetch(HashIntoType khash) const { }
+
+    // k-mers ahead that consume_string, get_median_count and friends
+    // prefetch; 0 looks them up one at a time.
+    void set_prefetch_distance(unsigned int distance)
+    {
+        _prefetch_distance = distance;
+    }
+    unsigned int get_prefetch_distance() const
+    {
+        return _prefetch_distance;
+    }
+
+    // page_aligned saves the tables so that load can map them; see
+    // TableLoadMode. save_chunked saves them as blocks compressed on
+    // n_threads threads, and load decompresses those on n_threads threads.
+    virtual void save(std::string, bool page_aligned = false) = 0;
+    virtual void save_chunked(std::string, ChunkCodec codec,
+                              unsigned int n_threads = 1) = 0;
+    virtual void load(std::string,
+                      TableLoadMode mode = LOAD_TABLES_READ,
+                      unsigned int n_threads = 1) = 0;
+
+    // are the tables mapped read-only from a file?
+    bool is_read_only() const
+    {
+        return _read_only;
+    }
 
     // count every k-mer in the string.
     unsigned int consume_string(const std::string &s);
+    // count every k-mer in the length bases at s, which are uppercase.
+    unsigned int consume_string(const char * s, size_t length);
+
+    // count every k-mer in a block of precomputed hashes.
+    unsigned int consume_kmers(const KmerHashBlock &kmers);
 
     // checks each read for non-ACGT characters
     bool check_and_normalize_read(std::string &read) const;
@@ -191,31 +572,49 @@ public:
     // check each read for non-ACGT characters, and then consume it.
     unsigned int check_and_process_read(std::string &read,
                                         bool &is_valid);
+    // the same for a read that is not to be modified, such as a ReadView;
+    // one with lowercase bases is consumed from an uppercased copy.
+    unsigned int check_and_process_read(const char * read, size_t length,
+                                        bool &is_valid);
 
-    // Count every k-mer in a FASTA or FASTQ file.
+    // Count every k-mer in a FASTA or FASTQ file. With n_threads > 1, a
+    // plain file is split into byte ranges parsed on n_threads threads.
     // Note: Yes, the name 'consume_fasta' is a bit misleading,
     //	     but the FASTA format is effectively a subset of the FASTQ format
     //	     and the FASTA portion is what we care about in this case.
     void consume_fasta(
         std::string const   &filename,
         unsigned int	    &total_reads,
-        unsigned long long  &n_consumed
+        unsigned long long  &n_consumed,
+        unsigned int	    n_threads = 1
     );
     // Count every k-mer from a stream of FASTA or FASTQ reads,
-    // using the supplied parser.
+    // using the supplied parser. With n_threads > 1, the calling thread
+    // parses batches of reads and hands them to n_threads worker threads.
     void consume_fasta(
         read_parsers:: IParser *	    parser,
         unsigned int	    &total_reads,
-        unsigned long long  &n_consumed
+        unsigned long long  &n_consumed,
+        unsigned int	    n_threads = 1
     );
 
     bool median_at_least(const std::string &s,
                          unsigned int cutoff);
+    bool median_at_least(const KmerHashBlock &kmers,
+                         unsigned int cutoff);
+    // count every k-mer in the string if its median count is below cutoff,
+    // hashing it once for both; returns whether it did.
+    bool consume_if_median_below(const std::string &s,
+                                 unsigned int cutoff);
 
     void get_median_count(const std::string &s,
                           BoundedCounterType &median,
                           float &average,
                           float &stddev);
+    void get_median_count(const KmerHashBlock &kmers,
+                          BoundedCounterType &median,
+                          float &average,
+                          float &stddev);
 
     // number of unique k-mers
     virtual const HashIntoType n_unique_kmers() const = 0;
@@ -317,6 +716,12 @@ public:
     virtual std::vector<HashIntoType> get_tablesizes() const = 0;
     virtual const size_t n_tables() const = 0;
 
+    // true if the tables use fastrange indexing rather than modulo-prime.
+    bool get_use_fastrange() const
+    {
+        return _use_fastrange;
+    }
+
     void filter_if_present(const std::string &infilename,
                            const std::string &outputfilename);
 
@@ -353,7 +758,7 @@ public:
 
     void calc_connected_graph_size(Kmer node,
                                    unsigned long long& count,
-                                   KmerSet& keeper,
+                                   TraversalContext& context,
                                    const unsigned long long threshold=0,
                                    bool break_on_circum=false) const;
 
@@ -374,15 +779,11 @@ public:
     // return counts of all k-mers in this string.
     void get_kmer_counts(const std::string &s,
                          std::vector<BoundedCounterType> &counts) const;
+    void get_kmer_counts(const KmerHashBlock &kmers,
+                         std::vector<BoundedCounterType> &counts) const;
 };
 }
 
 
 
-#define ACQUIRE_ALL_TAGS_SPIN_LOCK \
-  while (!__sync_bool_compare_and_swap( &_all_tags_spin_lock, 0, 1 ));
-
-#define RELEASE_ALL_TAGS_SPIN_LOCK \
-  __sync_bool_compare_and_swap( &_all_tags_spin_lock, 1, 0 );
-
 #endif // HASHTABLE_HH
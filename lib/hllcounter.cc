@@ -53,6 +53,7 @@ Contact: khmer-project@idyll.org
 #else
 #define omp_get_thread_num() 0
 #define omp_get_num_threads() 1
+#define omp_get_max_threads() 1
 #endif
 
 #define arr_len(a) (a + sizeof a / sizeof a[0])
@@ -347,29 +348,41 @@ HashIntoType HLLCounter::estimate_cardinality()
 
 void HLLCounter::add(const std::string &value)
 {
-    HashIntoType x = khmer::_hash_murmur(value);
+    _add_hash(khmer::_hash_murmur(value));
+}
+
+void HLLCounter::_add_hash(HashIntoType x)
+{
     HashIntoType j = x & (this->m - 1);
     this->M[j] = std::max(this->M[j], get_rho(x >> this->p, 64 - this->p));
 }
 
 unsigned int HLLCounter::consume_string(const std::string &inp)
 {
-    unsigned int n_consumed = 0;
-    std::string kmer = "";
     std::string s = inp;
 
     for (unsigned int i = 0; i < s.length(); i++)  {
         s[i] &= 0xdf; // toupper - knock out the "lowercase bit"
     }
 
-    for(std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
-        kmer.push_back(*it);
-        if (kmer.size() < _ksize) {
-            continue;
-        }
-        this->add(kmer);
+    return consume_string(s.data(), s.length());
+}
 
-        kmer.erase(0, 1);
+unsigned int HLLCounter::consume_string(const char * s, size_t length)
+{
+    if (length < _ksize) {
+        return 0;
+    }
+
+    // the reverse complement of the read holds those of all its k-mers.
+    static thread_local std::string rc;
+    rc.resize(length);
+    khmer::_revcomp(s, length, &rc[0]);
+
+    unsigned int n_consumed = 0;
+    for (size_t i = 0; i + _ksize <= length; i++) {
+        _add_hash(khmer::_hash_murmur(s + i, rc.data() + length - i - _ksize,
+                                      _ksize));
         n_consumed++;
     }
     return n_consumed;
@@ -381,11 +394,42 @@ void HLLCounter::consume_fasta(
     unsigned int &total_reads,
     unsigned long long &n_consumed)
 {
-    read_parsers::IParser * parser = read_parsers::IParser::get_parser(filename);
+    // records are streamed out in order, so only a file read without
+    // streaming is split among the OpenMP threads. The parsers are our
+    // own, so their reads are consumed where they are; one that cannot be
+    // split still goes to all the threads, through consume_fasta.
+    std::vector< std::unique_ptr<read_parsers::IParser> > parsers =
+        read_parsers::IParser::get_split_parsers(
+            filename, stream_records ? 1 : omp_get_max_threads());
+    if (parsers.size() == 1 &&
+            (stream_records || omp_get_max_threads() > 1)) {
+        consume_fasta(parsers[0].get(), stream_records, total_reads,
+                      n_consumed);
+        return;
+    }
 
-    consume_fasta(parser, stream_records, total_reads, n_consumed);
+    // a counter for each parser, merged once all are done.
+    std::vector<HLLCounter> counters(parsers.size(),
+                                     HLLCounter(this->p, this->_ksize));
+    std::vector<unsigned long long> n_consumed_partial(parsers.size(), 0);
+    std::vector<unsigned int> total_reads_partial(parsers.size(), 0);
+    read_parsers::for_each_read_split(parsers,
+    [&](const read_parsers::ReadView &read, size_t i) {
+        bool is_valid;
+        n_consumed_partial[i] += counters[i].check_and_process_read(
+                                     read.sequence, read.sequence_length,
+                                     is_valid);
+        if (is_valid) {
+            total_reads_partial[i] += 1;
+        }
+    });
 
-    delete parser;
+    n_consumed = 0;
+    for (size_t i = 0; i < parsers.size(); i++) {
+        this->merge(counters[i]);
+        n_consumed += n_consumed_partial[i];
+        total_reads += total_reads_partial[i];
+    }
 }
 
 void HLLCounter::consume_fasta(
@@ -395,7 +439,6 @@ void HLLCounter::consume_fasta(
     unsigned long long &    n_consumed)
 {
 
-    read_parsers::Read read;
     HLLCounter** counters;
     unsigned int *n_consumed_partial;
     unsigned int *total_reads_partial;
@@ -419,30 +462,39 @@ void HLLCounter::consume_fasta(
                 counters[i] = newc;
             }
 
-            while (!parser->is_complete())
+            // each task takes a batch of reads, which it deletes, rather
+            // than a copy of each read.
+            while (true)
             {
-                // Iterate through the reads and consume their k-mers.
-                try {
-                    read = parser->get_next_read();
-                } catch (read_parsers::NoMoreReadsAvailable) {
+                std::vector<read_parsers::Read> * batch =
+                    new std::vector<read_parsers::Read>;
+                size_t n_reads = parser->imprint_next_read_batch(
+                                     *batch, DEFAULT_READ_BATCH_SIZE);
+                if (!n_reads) {
+                    delete batch;
                     break;
                 }
 
                 if (stream_records) {
-                    read.write_to(std::cout);
+                    for (size_t i = 0; i < n_reads; i++) {
+                        (*batch)[i].write_to(std::cout);
+                    }
                 }
 
-                #pragma omp task default(none) firstprivate(read) \
+                #pragma omp task default(none) firstprivate(batch, n_reads) \
                 shared(counters, n_consumed_partial, total_reads_partial)
                 {
-                    bool is_valid;
-                    int n, t = omp_get_thread_num();
-                    n = counters[t]->check_and_process_read(read.sequence,
-                                                            is_valid);
-                    n_consumed_partial[t] += n;
-                    if (is_valid) {
-                        total_reads_partial[t] += 1;
+                    int t = omp_get_thread_num();
+                    for (size_t i = 0; i < n_reads; i++) {
+                        bool is_valid;
+                        n_consumed_partial[t] +=
+                            counters[t]->check_and_process_read(
+                                (*batch)[i].sequence, is_valid);
+                        if (is_valid) {
+                            total_reads_partial[t] += 1;
+                        }
                     }
+                    delete batch;
                 }
 
             } // while reads left for parser
@@ -477,6 +529,24 @@ unsigned int HLLCounter::check_and_process_read(std::string &read,
     return consume_string(read);
 }
 
+unsigned int HLLCounter::check_and_process_read(const char * read,
+        size_t length, bool &is_valid)
+{
+    is_valid = length >= this->_ksize;
+    for (size_t i = 0; is_valid && i < length; i++) {
+        if (!is_valid_dna(read[i])) {
+            static thread_local std::string normalized;
+            normalized.assign(read, length);
+            return check_and_process_read(normalized, is_valid);
+        }
+    }
+
+    if (!is_valid) {
+        return 0;
+    }
+    return consume_string(read, length);
+}
+
 bool HLLCounter::check_and_normalize_read(std::string &read) const
 {
     bool is_valid = true;
@@ -64,6 +64,8 @@ public:
 
     void add(const std::string &);
     unsigned int consume_string(const std::string &);
+    // the k-mers of the given number of uppercase bases.
+    unsigned int consume_string(const char *, size_t);
     void consume_fasta(std::string const &,
                        bool,
                        unsigned int &,
@@ -74,6 +76,9 @@ public:
                        unsigned long long &);
     unsigned int check_and_process_read(std::string &,
                                         bool &);
+    // the same for a read that is not to be modified, such as a ReadView;
+    // one that needs normalizing is consumed from a normalized copy.
+    unsigned int check_and_process_read(const char *, size_t, bool &);
     bool check_and_normalize_read(std::string &) const;
     HashIntoType estimate_cardinality();
     void merge(HLLCounter &);
@@ -111,6 +116,7 @@ private:
     std::vector<int> M;
 
     void init(int p, WordLength ksize);
+    void _add_hash(HashIntoType x);
 };
 
 }
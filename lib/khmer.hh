@@ -72,11 +72,15 @@ private:\
 #include <set>
 #include <map>
 #include <queue>
+#include <unordered_map>
 
 #include "khmer_exception.hh"
 
 #   define MAX_KCOUNT 255
 #   define MAX_BIGCOUNT 65535
+#   define BIGCOUNT_SHARDS 64
+#   define TAGSET_SHARDS 64
+#   define ABUNDANCE_DIST_LOCK_STRIPES 256
 #   define DEFAULT_TAG_DENSITY 40   // must be even
 
 #   define MAX_CIRCUM 3		// @CTB remove
@@ -91,6 +95,42 @@ private:\
 #   define SAVED_STOPTAGS 4
 #   define SAVED_SUBSET 5
 #   define SAVED_LABELSET 6
+#   define SAVED_BLOCKED_COUNTING_HT 7
+#   define SAVED_BLOCKED_HASHBITS 8
+#   define SAVED_COUNTING_HT_4BIT 9
+#   define SAVED_COUNTING_HT_2BIT 10
+// set in the type byte of saved tables that use fastrange indexing.
+#   define SAVED_FLAG_FASTRANGE 0x80
+// set in the type byte of saved tables that start on SAVED_PAGE_SIZE
+// boundaries in the file, so that load can map them instead of reading them.
+#   define SAVED_FLAG_PAGE_ALIGNED 0x40
+#   define SAVED_PAGE_SIZE 4096
+// set in the type byte of saved tables kept in compressed blocks; see
+// chunked_file.hh.
+#   define SAVED_FLAG_CHUNKED 0x20
+// set in the type byte of saved tables each stored in an encoding of its
+// own, which may be sparse; see TableEncoding in hashtable.hh.
+#   define SAVED_FLAG_SPARSE 0x10
+
+// size of the blocks used by the blocked table layouts.
+#   define CACHE_LINE_SIZE 64
+
+// how many k-mers ahead the batched engine prefetches table bins; 0 turns
+// it off.
+#   define DEFAULT_PREFETCH_DISTANCE 16
+
+// how many reads BatchedReads takes from a parser at a time.
+#   define DEFAULT_READ_BATCH_SIZE 64
+
+// how many bytes of a sequence file FastxParser reads at a time.
+#   define DEFAULT_PARSER_BUFFER_SIZE (4 << 20)
+
+// how many bytes of records FastxWriter collects before writing them.
+#   define DEFAULT_WRITER_BUFFER_SIZE (4 << 20)
+
+// the fewest bytes of a file that get_split_parsers gives a parser of its
+// own.
+#   define MIN_SPLIT_RANGE_SIZE (64 << 10)
 
 #   define VERBOSE_REPARTITION 0
 
@@ -121,11 +161,11 @@ typedef void (*CallbackFn)(const char * info, void * callback_data,
 typedef unsigned int PartitionID;
 typedef std::set<HashIntoType> SeenSet;
 typedef std::set<PartitionID> PartitionSet;
-typedef std::map<HashIntoType, PartitionID*> PartitionMap;
-typedef std::map<PartitionID, PartitionID*> PartitionPtrMap;
+// a node of the PartitionForest of a SubsetPartition.
+typedef unsigned int PartitionNode;
+typedef std::unordered_map<PartitionID, PartitionNode> PartitionNodeMap;
 typedef std::map<PartitionID, SeenSet*> PartitionsToTagsMap;
-typedef std::set<PartitionID *> PartitionPtrSet;
-typedef std::map<PartitionID, PartitionPtrSet*> ReversePartitionMap;
+typedef PartitionNodeMap ReversePartitionMap;
 typedef std::queue<HashIntoType> NodeQueue;
 typedef std::map<PartitionID, PartitionID*> PartitionToPartitionPMap;
 typedef std::map<HashIntoType, unsigned int> TagCountMap;
@@ -41,6 +41,12 @@ Contact: khmer-project@idyll.org
 #include <algorithm>
 #include <string>
 
+#if defined(__AVX2__) && !defined(KHMER_EXTRA_SANITY_CHECKS)
+#include <immintrin.h>
+#elif defined(__SSE2__) && !defined(KHMER_EXTRA_SANITY_CHECKS)
+#include <emmintrin.h>
+#endif
+
 #include "MurmurHash3.h"
 #include "khmer.hh"
 #include "khmer_exception.hh"
@@ -48,12 +54,92 @@ Contact: khmer-project@idyll.org
 
 using namespace std;
 
+namespace khmer
+{
+
+#define _TB_ROW(x)  x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x
+#define _TB_ROW_AC  3, 0, 3, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3
+#define _TB_ROW_T   3, 3, 3, 3, 1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3
+
+// twobit_repr for every byte value, 16 per row: 0x40 holds 'A' and 'C',
+// 0x50 holds 'T', 0x60 and 0x70 hold their lowercase forms.
+const Byte _twobit_table[256] = {
+    _TB_ROW(3), _TB_ROW(3), _TB_ROW(3), _TB_ROW(3),
+    _TB_ROW_AC, _TB_ROW_T,
+#ifdef KHMER_EXTRA_SANITY_CHECKS
+    _TB_ROW_AC, _TB_ROW_T,
+#else
+    _TB_ROW(3), _TB_ROW(3),
+#endif
+    _TB_ROW(3), _TB_ROW(3), _TB_ROW(3), _TB_ROW(3),
+    _TB_ROW(3), _TB_ROW(3), _TB_ROW(3), _TB_ROW(3)
+};
+
+#undef _TB_ROW
+#undef _TB_ROW_AC
+#undef _TB_ROW_T
+
 //
-// _hash: hash a k-length DNA sequence into a 64-bit number.
+// _twobit_encode: compute twobit_repr for a run of bases at once.
+//
+// A vector of bytes is compared against 'A', 'T' and 'C'; since the
+// comparison masks are all-ones bytes, 3 - (A & 3) - (T & 2) - (C & 1) gives
+// 0/1/2 for A/T/C and 3 for everything else, exactly as the table does.
 //
 
-namespace khmer
+void _twobit_encode(const char * seq, size_t length, Byte * codes)
 {
+    size_t i = 0;
+
+#if defined(__AVX2__) && !defined(KHMER_EXTRA_SANITY_CHECKS)
+    const __m256i a32 = _mm256_set1_epi8('A');
+    const __m256i t32 = _mm256_set1_epi8('T');
+    const __m256i c32 = _mm256_set1_epi8('C');
+    const __m256i three32 = _mm256_set1_epi8(3);
+    const __m256i two32 = _mm256_set1_epi8(2);
+    const __m256i one32 = _mm256_set1_epi8(1);
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(seq + i));
+        __m256i code = _mm256_sub_epi8(three32,
+                                       _mm256_and_si256(_mm256_cmpeq_epi8(v, a32), three32));
+        code = _mm256_sub_epi8(code,
+                               _mm256_and_si256(_mm256_cmpeq_epi8(v, t32), two32));
+        code = _mm256_sub_epi8(code,
+                               _mm256_and_si256(_mm256_cmpeq_epi8(v, c32), one32));
+        _mm256_storeu_si256((__m256i *)(codes + i), code);
+    }
+#endif
+
+#if (defined(__AVX2__) || defined(__SSE2__)) && \
+    !defined(KHMER_EXTRA_SANITY_CHECKS)
+    const __m128i a16 = _mm_set1_epi8('A');
+    const __m128i t16 = _mm_set1_epi8('T');
+    const __m128i c16 = _mm_set1_epi8('C');
+    const __m128i three16 = _mm_set1_epi8(3);
+    const __m128i two16 = _mm_set1_epi8(2);
+    const __m128i one16 = _mm_set1_epi8(1);
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(seq + i));
+        __m128i code = _mm_sub_epi8(three16,
+                                    _mm_and_si128(_mm_cmpeq_epi8(v, a16), three16));
+        code = _mm_sub_epi8(code,
+                            _mm_and_si128(_mm_cmpeq_epi8(v, t16), two16));
+        code = _mm_sub_epi8(code,
+                            _mm_and_si128(_mm_cmpeq_epi8(v, c16), one16));
+        _mm_storeu_si128((__m128i *)(codes + i), code);
+    }
+#endif
+
+    for (; i < length; i++) {
+        codes[i] = _twobit_table[(unsigned char) seq[i]];
+    }
+}
+
+//
+// _hash: hash a k-length DNA sequence into a 64-bit number.
+//
 
 HashIntoType _hash(const char * kmer, const WordLength k,
                    HashIntoType& _h, HashIntoType& _r)
@@ -126,15 +212,12 @@ std::string _revhash(HashIntoType hash, WordLength k)
     return s;
 }
 
-std::string _revcomp(const std::string& kmer)
+void _revcomp(const char * seq, size_t length, char * dest)
 {
-    std::string out = kmer;
-    size_t ksize = out.size();
-
-    for (size_t i=0; i < ksize; ++i) {
+    for (size_t i=0; i < length; ++i) {
         char complement;
 
-        switch(kmer[i]) {
+        switch(seq[i]) {
         case 'A':
             complement = 'T';
             break;
@@ -151,8 +234,14 @@ std::string _revcomp(const std::string& kmer)
             throw khmer::khmer_exception("Invalid base in read");
             break;
         }
-        out[ksize - i - 1] = complement;
+        dest[length - i - 1] = complement;
     }
+}
+
+std::string _revcomp(const std::string& kmer)
+{
+    std::string out = kmer;
+    _revcomp(kmer.data(), kmer.size(), &out[0]);
     return out;
 }
 
@@ -179,6 +268,18 @@ HashIntoType _hash_murmur(const std::string& kmer,
     return h ^ r;
 }
 
+HashIntoType _hash_murmur(const char * kmer, const char * rev_kmer,
+                          WordLength k)
+{
+    HashIntoType out[2], h;
+    uint32_t seed = 0;
+    MurmurHash3_x64_128((void *)kmer, k, seed, &out);
+    h = out[0];
+    MurmurHash3_x64_128((void *)rev_kmer, k, seed, &out);
+
+    return h ^ out[0];
+}
+
 HashIntoType _hash_murmur_forward(const std::string& kmer)
 {
     HashIntoType h = 0;
@@ -203,9 +304,18 @@ KmerIterator::KmerIterator(const char * seq,
     _kmer_f = 0;
     _kmer_r = 0;
 
+    _codes_start = _codes_end = 0;
+
     initialized = false;
 }
 
+void KmerIterator::_fill_codes()
+{
+    _codes_start = index;
+    _codes_end = std::min(length, (size_t) index + KMER_ITERATOR_BLOCK_SIZE);
+    _twobit_encode(_seq + _codes_start, _codes_end - _codes_start, _codes);
+}
+
 Kmer KmerIterator::first(HashIntoType& f, HashIntoType& r)
 {
     HashIntoType x;
@@ -230,7 +340,10 @@ Kmer KmerIterator::next(HashIntoType& f, HashIntoType& r)
         return first(f, r);
     }
 
-    unsigned char ch = _seq[index];
+    if (index >= _codes_end) {
+        _fill_codes();
+    }
+    HashIntoType code = _codes[index - _codes_start];
     index++;
     if (!(index <= length)) {
         throw khmer_exception();
@@ -240,14 +353,14 @@ Kmer KmerIterator::next(HashIntoType& f, HashIntoType& r)
     _kmer_f = _kmer_f << 2;
 
     // 'or' in the current nt
-    _kmer_f |= twobit_repr(ch);
+    _kmer_f |= code;
 
     // mask off the 2 bits we shifted over.
     _kmer_f &= bitmask;
 
     // now handle reverse complement
     _kmer_r = _kmer_r >> 2;
-    _kmer_r |= (twobit_comp(ch) << _nbits_sub_1);
+    _kmer_r |= ((code ^ 1) << _nbits_sub_1);
 
     f = _kmer_f;
     r = _kmer_r;
@@ -255,4 +368,60 @@ Kmer KmerIterator::next(HashIntoType& f, HashIntoType& r)
     return build_kmer(_kmer_f, _kmer_r);
 }
 
+size_t KmerHashBlock::hash(const char * seq, size_t length, WordLength k)
+{
+    if (!(k <= sizeof(HashIntoType)*4)) {
+        throw khmer_exception("Supplied k-mer size is too large.");
+    }
+
+    _ksize = k;
+    _n_kmers = (length >= k && k > 0) ? length - k + 1 : 0;
+    if (!_n_kmers) {
+        return 0;
+    }
+
+    if (_codes.size() < length) {
+        _codes.resize(length);
+    }
+    if (_kmers_u.size() < _n_kmers) {
+        _kmers_f.resize(_n_kmers);
+        _kmers_r.resize(_n_kmers);
+        _kmers_u.resize(_n_kmers);
+    }
+    _twobit_encode(seq, length, _codes.data());
+
+    const Byte * codes = _codes.data();
+    HashIntoType * kmers_f = _kmers_f.data();
+    HashIntoType * kmers_r = _kmers_r.data();
+    HashIntoType * kmers_u = _kmers_u.data();
+
+    HashIntoType bitmask = 0;
+    for (WordLength i = 0; i < k; i++) {
+        bitmask = (bitmask << 2) | 3;
+    }
+    const unsigned int nbits_sub_1 = k*2 - 2;
+
+    HashIntoType h = 0, r = 0;
+    for (WordLength i = 0; i < k - 1; i++) {
+        h = (h << 2) | codes[i];
+        r = (r >> 2) | ((HashIntoType)(codes[i] ^ 1) << nbits_sub_1);
+    }
+    for (size_t i = k - 1, j = 0; i < length; i++, j++) {
+        h = ((h << 2) | codes[i]) & bitmask;
+        r = (r >> 2) | ((HashIntoType)(codes[i] ^ 1) << nbits_sub_1);
+
+        kmers_f[j] = h;
+        kmers_r[j] = r;
+        kmers_u[j] = uniqify_rc(h, r);
+    }
+
+    return _n_kmers;
+}
+
+KmerHashBlock& KmerHashBlock::thread_local_block()
+{
+    static thread_local KmerHashBlock block;
+    return block;
+}
+
 }
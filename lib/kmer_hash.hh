@@ -43,6 +43,7 @@ Contact: khmer-project@idyll.org
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <vector>
 
 #include "khmer.hh"
 
@@ -58,33 +59,24 @@ Contact: khmer-project@idyll.org
 #endif
 
 // bit representation of A/T/C/G.
-#ifdef KHMER_EXTRA_SANITY_CHECKS
-#   define twobit_repr(ch) ((toupper(ch)) == 'A' ? 0LL : \
-			    (toupper(ch)) == 'T' ? 1LL : \
-			    (toupper(ch)) == 'C' ? 2LL : 3LL)
-#else
-// NOTE: Assumes data is already sanitized as it should be by parsers.
-//	     This assumption eliminates 4 function calls.
-#   define twobit_repr(ch) ((ch) == 'A' ? 0LL : \
-			    (ch) == 'T' ? 1LL : \
-			    (ch) == 'C' ? 2LL : 3LL)
-#endif
+// NOTE: These are table lookups rather than comparison chains; they run once
+//	 per base in every k-mer iterator and traversal step. Anything which
+//	 is not A/T/C encodes as G, as before. With extra sanity checks on,
+//	 lowercase bases are recognized as well.
+namespace khmer
+{
+extern const Byte _twobit_table[256];
+}
+
+#define twobit_repr(ch) \
+    ((khmer::HashIntoType) khmer::_twobit_table[(unsigned char)(ch)])
 
 #define revtwobit_repr(n) ((n) == 0 ? 'A' : \
                            (n) == 1 ? 'T' : \
                            (n) == 2 ? 'C' : 'G')
 
-#ifdef KHMER_EXTRA_SANITY_CHECKS
-#   define twobit_comp(ch) ((toupper(ch)) == 'A' ? 1LL : \
-			    (toupper(ch)) == 'T' ? 0LL : \
-			    (toupper(ch)) == 'C' ? 3LL : 2LL)
-#else
-// NOTE: Assumes data is already sanitized as it should be by parsers.
-//	     This assumption eliminates 4 function calls.
-#   define twobit_comp(ch) ((ch) == 'A' ? 1LL : \
-			    (ch) == 'T' ? 0LL : \
-			    (ch) == 'C' ? 3LL : 2LL)
-#endif
+// A and T, C and G differ only in the low bit.
+#define twobit_comp(ch) (twobit_repr(ch) ^ 1)
 
 // choose wisely between forward and rev comp.
 #ifndef NO_UNIQUE_RC
@@ -109,6 +101,29 @@ HashIntoType _hash_murmur(const std::string& kmer);
 HashIntoType _hash_murmur(const std::string& kmer,
                           HashIntoType& h, HashIntoType& r);
 HashIntoType _hash_murmur_forward(const std::string& kmer);
+// _hash_murmur of the k bases at kmer, whose reverse complement is at
+// rev_kmer.
+HashIntoType _hash_murmur(const char * kmer, const char * rev_kmer,
+                          WordLength k);
+
+// the reverse complement of the length bases at seq, into dest.
+void _revcomp(const char * seq, size_t length, char * dest);
+
+// bulk 2-bit encoding: codes[i] = twobit_repr(seq[i]) for i < length.
+// Uses SSE2 (or AVX2, if enabled at compile time) where available.
+void _twobit_encode(const char * seq, size_t length, Byte * codes);
+
+// the finalizer of MurmurHash3, which spreads a k-mer hash (far from
+// uniform) over all 64 bits, for picking a bin, block or shard by it.
+inline HashIntoType _mix_hash(HashIntoType h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
 
 /**
  * \class Kmer
@@ -205,7 +220,7 @@ public:
     /** @param[in]  kmer_u Uniqified hash value.
      *  @return A complete Kmer object.
      */
-    Kmer build_kmer(HashIntoType kmer_u)
+    Kmer build_kmer(HashIntoType kmer_u) const
     {
         HashIntoType kmer_f, kmer_r;
         std:: string kmer_s = _revhash(kmer_u, _ksize);
@@ -219,7 +234,7 @@ public:
      *  @param[in]  kmer_r Reverse complement hash value.
      *  @return A complete Kmer object.
      */
-    Kmer build_kmer(HashIntoType kmer_f, HashIntoType kmer_r)
+    Kmer build_kmer(HashIntoType kmer_f, HashIntoType kmer_r) const
     {
         HashIntoType kmer_u = uniqify_rc(kmer_f, kmer_r);
         return Kmer(kmer_f, kmer_r, kmer_u);
@@ -231,7 +246,7 @@ public:
      *  @param[in]  kmer_s String representation of a k-mer.
      *  @return A complete Kmer object hashed from the given string.
      */
-    Kmer build_kmer(std::string kmer_s)
+    Kmer build_kmer(std::string kmer_s) const
     {
         HashIntoType kmer_f, kmer_r, kmer_u;
         kmer_u = _hash(kmer_s.c_str(), _ksize, kmer_f, kmer_r);
@@ -244,7 +259,7 @@ public:
      *  @param[in]  kmer_c The character array representation of a k-mer.
      *  @return A complete Kmer object hashed from the given char array.
      */
-    Kmer build_kmer(const char * kmer_c)
+    Kmer build_kmer(const char * kmer_c) const
     {
         HashIntoType kmer_f, kmer_r, kmer_u;
         kmer_u = _hash(kmer_c, _ksize, kmer_f, kmer_r);
@@ -252,6 +267,9 @@ public:
     }
 };
 
+// number of bases KmerIterator encodes at a time.
+#define KMER_ITERATOR_BLOCK_SIZE 128
+
 /**
  * \class KmerIterator
  *
@@ -283,6 +301,13 @@ protected:
     unsigned int index;
     size_t length;
     bool initialized;
+
+    // 2-bit codes for _seq[_codes_start, _codes_end), filled in blocks by
+    // _twobit_encode so that next() does not re-encode one base at a time.
+    Byte _codes[KMER_ITERATOR_BLOCK_SIZE];
+    size_t _codes_start, _codes_end;
+
+    void _fill_codes();
 public:
     KmerIterator(const char * seq, unsigned char k);
 
@@ -325,6 +350,82 @@ public:
     }
 }; // class KmerIterator
 
+/**
+ * \class KmerHashBlock
+ *
+ * \brief Hold the hash values of every k-mer in a sequence.
+ *
+ * A KmerHashBlock hashes a whole sequence in one pass into parallel
+ * arrays of forward, reverse complement and uniqified hash values,
+ * which the per-read Hashtable and CountingHash operations can then
+ * consume without walking the sequence again.
+ *
+ * The arrays only ever grow, so a block that is reused from read to
+ * read stops allocating once it has seen the longest read. To run several
+ * operations on one read (as normalize-by-median does, with a median check
+ * followed by a consume), hash it once and pass the block to each of the
+ * KmerHashBlock overloads of Hashtable and CountingHash.
+ *
+ * thread_local_block() returns a per-thread scratch block; do not hold
+ * on to it across calls which may hash another sequence into it.
+ */
+class KmerHashBlock
+{
+protected:
+    std::vector<HashIntoType> _kmers_f, _kmers_r, _kmers_u;
+    std::vector<Byte> _codes;
+    WordLength _ksize;
+    size_t _n_kmers;
+public:
+    KmerHashBlock() : _ksize(0), _n_kmers(0) {}
+
+    /** @param[in]  seq The sequence to hash.
+     *  @param[in]  length The length of the sequence.
+     *  @param[in]  k The k-mer size.
+     *  @return The number of k-mers in the sequence.
+     */
+    size_t hash(const char * seq, size_t length, WordLength k);
+
+    size_t hash(const std::string &seq, WordLength k)
+    {
+        return hash(seq.data(), seq.length(), k);
+    }
+
+    /// @return The number of k-mers in the last sequence hashed.
+    size_t size() const
+    {
+        return _n_kmers;
+    }
+
+    WordLength ksize() const
+    {
+        return _ksize;
+    }
+
+    const HashIntoType * forward() const
+    {
+        return _kmers_f.data();
+    }
+
+    const HashIntoType * reverse() const
+    {
+        return _kmers_r.data();
+    }
+
+    const HashIntoType * uniqified() const
+    {
+        return _kmers_u.data();
+    }
+
+    /// @return The uniqified hash of the k-mer starting at position i.
+    HashIntoType operator[](size_t i) const
+    {
+        return _kmers_u[i];
+    }
+
+    static KmerHashBlock& thread_local_block();
+}; // class KmerHashBlock
+
 }
 
 #endif // KMER_HASH_HH
@@ -92,7 +92,6 @@ LabelHash::consume_fasta_and_tag_with_labels(
 #if (0) // Note: Used with callback - currently disabled.
     unsigned long long int  n_consumed_LOCAL	= 0;
 #endif
-    Read			  read;
 
     // TODO? Delete the following assignments.
     total_reads = 0;
@@ -102,12 +101,10 @@ LabelHash::consume_fasta_and_tag_with_labels(
 
     Label * the_label;
     // Iterate through the reads and consume their k-mers.
-    while (!parser->is_complete( )) {
-        try {
-            read = parser->get_next_read( );
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
 
         if (graph->check_and_normalize_read( read.sequence )) {
             // TODO: make threadsafe!
@@ -158,7 +155,6 @@ void LabelHash::consume_partitioned_fasta_and_tag_with_labels(
     n_consumed = 0;
 
     IParser* parser = IParser::get_parser(filename.c_str());
-    Read read;
 
     std::string seq = "";
 
@@ -171,8 +167,10 @@ void LabelHash::consume_partitioned_fasta_and_tag_with_labels(
     //
     Label * c;
     PartitionID p;
-    while(!parser->is_complete())  {
-        read = parser->get_next_read();
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         seq = read.sequence;
 
         if (graph->check_and_normalize_read(seq)) {
@@ -0,0 +1,126 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2014-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <algorithm>
+
+#include "khmer_exception.hh"
+#include "partition_map.hh"
+
+using namespace khmer;
+
+const PartitionNode PartitionTagMap::NO_PARTITION;
+const PartitionNode PartitionTagMap::FREE;
+
+ConcurrentUnionFind::ConcurrentUnionFind(size_t n) : _parent(n)
+{
+    if (n > (uint32_t) -1) {
+        throw khmer_exception("too many elements for a ConcurrentUnionFind");
+    }
+    for (size_t i = 0; i < n; i++) {
+        _parent[i] = i;
+    }
+}
+
+void PartitionTagMap::erase(HashIntoType tag)
+{
+    if (!_size) {
+        return;
+    }
+    size_t i = _find(tag);
+    if (_nodes[i] == FREE) {
+        return;
+    }
+    _size--;
+
+    // move back each following tag which could have gone in the hole.
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & _mask;
+        if (_nodes[j] == FREE) {
+            break;
+        }
+        size_t home = _home(_keys[j]);
+        // is home cyclically outside of (i, j]?
+        bool movable = (i <= j) ? (home <= i || home > j)
+                       : (home <= i && home > j);
+        if (movable) {
+            _keys[i] = _keys[j];
+            _nodes[i] = _nodes[j];
+            i = j;
+        }
+    }
+    _nodes[i] = FREE;
+}
+
+void PartitionTagMap::clear()
+{
+    std::vector<HashIntoType>().swap(_keys);
+    std::vector<PartitionNode>().swap(_nodes);
+    _mask = 0;
+    _size = 0;
+}
+
+void PartitionTagMap::get_sorted_tags(std::vector<HashIntoType> &tags) const
+{
+    tags.clear();
+    tags.reserve(_size);
+    for (size_t i = 0; i < _nodes.size(); i++) {
+        if (_nodes[i] != FREE) {
+            tags.push_back(_keys[i]);
+        }
+    }
+    std::sort(tags.begin(), tags.end());
+}
+
+void PartitionTagMap::_resize(size_t n_slots)
+{
+    std::vector<HashIntoType> old_keys(n_slots);
+    std::vector<PartitionNode> old_nodes(n_slots, FREE);
+    old_keys.swap(_keys);
+    old_nodes.swap(_nodes);
+    _mask = n_slots - 1;
+
+    for (size_t j = 0; j < old_nodes.size(); j++) {
+        if (old_nodes[j] != FREE) {
+            size_t i = _find(old_keys[j]);
+            _keys[i] = old_keys[j];
+            _nodes[i] = old_nodes[j];
+        }
+    }
+}
+
+/* vim: set ft=cpp ts=8 sts=4 sw=4 et tw=79 */
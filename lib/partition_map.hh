@@ -0,0 +1,294 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2014-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef PARTITION_MAP_HH
+#define PARTITION_MAP_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "khmer.hh"
+#include "kmer_hash.hh"
+
+namespace khmer
+{
+
+/**
+ * \class PartitionForest
+ *
+ * \brief The partitions of a SubsetPartition, as a union-find forest.
+ *
+ * Each node is a partition as it was first made, and each tree is a
+ * partition as it is now, known by the ID of its root. Joining two
+ * partitions hangs the root with the lower weight, which is the number of
+ * nodes in its tree, under the other; on a tie the first one stays the
+ * root. find() halves the paths it walks.
+ */
+class PartitionForest
+{
+public:
+    /// Add a partition of its own, and return its node.
+    PartitionNode add(PartitionID id)
+    {
+        PartitionNode node = _parent.size();
+        _parent.push_back(node);
+        _weight.push_back(1);
+        _ids.push_back(id);
+        return node;
+    }
+
+    PartitionNode find(PartitionNode node) const
+    {
+        while (_parent[node] != node) {
+            _parent[node] = _parent[_parent[node]];
+            node = _parent[node];
+        }
+        return node;
+    }
+
+    /// The ID of the partition node is in now.
+    PartitionID id(PartitionNode node) const
+    {
+        return _ids[find(node)];
+    }
+
+    /// Join the partitions of a and b, and return the root of the result.
+    PartitionNode unite(PartitionNode a, PartitionNode b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b) {
+            return a;
+        }
+        if (_weight[a] < _weight[b]) {
+            PartitionNode tmp = a;
+            a = b;
+            b = tmp;
+        }
+        _parent[b] = a;
+        _weight[a] += _weight[b];
+        return a;
+    }
+
+    size_t size() const
+    {
+        return _parent.size();
+    }
+
+    void clear()
+    {
+        std::vector<PartitionNode>().swap(_parent);
+        std::vector<PartitionNode>().swap(_weight);
+        std::vector<PartitionID>().swap(_ids);
+    }
+
+protected:
+    mutable std::vector<PartitionNode> _parent;	// compressed by find()
+    std::vector<PartitionNode> _weight;
+    std::vector<PartitionID> _ids;
+};
+
+/**
+ * \class ConcurrentUnionFind
+ *
+ * \brief A union-find forest over the integers 0..n-1 which many threads
+ * can join at once, without locks.
+ *
+ * A root is linked under another with a compare-and-swap, always the
+ * larger index under the smaller, so no cycle can form; find() halves the
+ * paths it walks with compare-and-swaps which may fail harmlessly.
+ */
+class ConcurrentUnionFind
+{
+public:
+    explicit ConcurrentUnionFind(size_t n);
+
+    size_t find(size_t i)
+    {
+        volatile uint32_t * parent = &_parent[0];
+        while (true) {
+            uint32_t p = parent[i];
+            if (p == i) {
+                return i;
+            }
+            uint32_t gp = parent[p];
+            if (gp != p) {
+                __sync_bool_compare_and_swap(&parent[i], p, gp);
+            }
+            i = gp;
+        }
+    }
+
+    void unite(size_t a, size_t b)
+    {
+        while (true) {
+            a = find(a);
+            b = find(b);
+            if (a == b) {
+                return;
+            }
+            if (a < b) {
+                size_t tmp = a;
+                a = b;
+                b = tmp;
+            }
+            // fails if another thread has linked a meanwhile; start over.
+            if (__sync_bool_compare_and_swap(&_parent[a], (uint32_t) a,
+                                             (uint32_t) b)) {
+                return;
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return _parent.size();
+    }
+
+protected:
+    std::vector<uint32_t> _parent;
+};
+
+/**
+ * \class PartitionTagMap
+ *
+ * \brief A map from tags to nodes of a PartitionForest.
+ *
+ * A single open-addressing table with linear probing, twelve bytes a slot.
+ * A tag can be in the map without a partition, with the node NO_PARTITION;
+ * the node FREE marks an empty slot. Removing a tag shifts the tags after
+ * it back, so there are no tombstones.
+ */
+class PartitionTagMap
+{
+public:
+    static const PartitionNode NO_PARTITION = ~(PartitionNode) 0 - 1;
+
+    PartitionTagMap() : _mask(0), _size(0) {}
+
+    /// @return true, with the node of tag in node, if tag is present.
+    bool find(HashIntoType tag, PartitionNode &node) const
+    {
+        if (!_size) {
+            return false;
+        }
+        size_t i = _find(tag);
+        node = _nodes[i];
+        return node != FREE;
+    }
+
+    bool contains(HashIntoType tag) const
+    {
+        PartitionNode node;
+        return find(tag, node);
+    }
+
+    /// Add tag or change its node.
+    void set(HashIntoType tag, PartitionNode node)
+    {
+        if (2 * (_size + 1) > _nodes.size()) {
+            _resize(_nodes.empty() ? 16 : 2 * _nodes.size());
+        }
+        size_t i = _find(tag);
+        if (_nodes[i] == FREE) {
+            _keys[i] = tag;
+            _size++;
+        }
+        _nodes[i] = node;
+    }
+
+    /// Add tag without a partition, unless it is present already.
+    void insert_unassigned(HashIntoType tag)
+    {
+        if (!contains(tag)) {
+            set(tag, NO_PARTITION);
+        }
+    }
+
+    void erase(HashIntoType tag);
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    void clear();
+
+    /// Call f(tag, node) on each tag, in no particular order.
+    template<typename F>
+    void for_each(F f) const
+    {
+        for (size_t i = 0; i < _nodes.size(); i++) {
+            if (_nodes[i] != FREE) {
+                f(_keys[i], _nodes[i]);
+            }
+        }
+    }
+
+    /// The tags in ascending order.
+    void get_sorted_tags(std::vector<HashIntoType> &tags) const;
+
+protected:
+    static const PartitionNode FREE = ~(PartitionNode) 0;
+
+    std::vector<HashIntoType> _keys;
+    std::vector<PartitionNode> _nodes;	// empty, or a power of two long
+    size_t _mask;
+    size_t _size;
+
+    size_t _home(HashIntoType tag) const
+    {
+        return _mix_hash(tag) & _mask;
+    }
+
+    // the slot holding tag, or the free slot where it would go.
+    size_t _find(HashIntoType tag) const
+    {
+        size_t i = _home(tag);
+        while (_nodes[i] != FREE && _keys[i] != tag) {
+            i = (i + 1) & _mask;
+        }
+        return i;
+    }
+
+    void _resize(size_t n_slots);
+};
+
+}
+
+#endif // PARTITION_MAP_HH
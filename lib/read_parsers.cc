@@ -38,10 +38,24 @@ Contact: khmer-project@idyll.org
 #include <seqan/seq_io.h> // IWYU pragma: keep
 #include <seqan/sequence.h> // IWYU pragma: keep
 #include <seqan/stream.h> // IWYU pragma: keep
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <cctype>
 #include <fstream>
+#include <thread>
 
+#include "bounded_queue.hh"
+#include "bzlib.h"
 #include "khmer_exception.hh"
 #include "read_parsers.hh"
+#include "zlib.h"
 
 namespace khmer
 {
@@ -89,58 +103,1143 @@ SeqAnParser::SeqAnParser( char const * filename ) : IParser( )
 
 bool SeqAnParser::is_complete()
 {
+    if (_pending_error) {
+        return false;
+    }
     return !seqan::isGood(_private->stream) || seqan::atEnd(_private->stream);
 }
 
-void SeqAnParser::imprint_next_read(Read &the_read)
+std::exception_ptr SeqAnParser::_read_record_locked(Read &the_read)
+{
+    the_read.reset();
+    if (_pending_error) {
+        std::exception_ptr error = _pending_error;
+        _pending_error = std::exception_ptr();
+        return error;
+    }
+    if (seqan::atEnd(_private->stream)) {
+        return std::make_exception_ptr(NoMoreReadsAvailable());
+    }
+
+    int ret = seqan::readRecord(the_read.name, the_read.sequence,
+                                the_read.quality, _private->stream);
+    // Catch-all error in readRecord that isn't one of the below
+    if (ret != 0) {
+        return std::make_exception_ptr(StreamReadError());
+    }
+
+    // Detect if we're parsing something w/ qualities on the first read
+    // only
+    if (_num_reads == 0 && the_read.quality.length() != 0) {
+        _have_qualities = true;
+    }
+
+    // Handle error cases, or increment number of reads on success
+    if (the_read.sequence.length() == 0) {
+        return std::make_exception_ptr(InvalidRead("Sequence is empty"));
+    } else if (_have_qualities && (the_read.sequence.length() != \
+                                   the_read.quality.length())) {
+        return std::make_exception_ptr(
+                   InvalidRead("Sequence and quality lengths differ"));
+    }
+    _num_reads++;
+
+    return std::exception_ptr();
+}
+
+void SeqAnParser::imprint_next_read(Read &the_read)
+{
+    while (!__sync_bool_compare_and_swap(& _private->seqan_spin_lock, 0, 1));
+    std::exception_ptr error = _read_record_locked(the_read);
+    __asm__ __volatile__ ("" ::: "memory");
+    _private->seqan_spin_lock = 0;
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+size_t SeqAnParser::imprint_next_read_batch(std::vector< Read > &reads,
+        size_t n_reads)
+{
+    if (reads.size() < n_reads) {
+        reads.resize(n_reads);
+    }
+
+    size_t n = 0;
+    std::exception_ptr error;
+    while (!__sync_bool_compare_and_swap(& _private->seqan_spin_lock, 0, 1));
+    while (n < n_reads && !(error = _read_record_locked(reads[n]))) {
+        n++;
+    }
+    // keep an error for the next call, unless there are no reads to return.
+    if (n && error) {
+        _pending_error = error;
+    }
+    __asm__ __volatile__ ("" ::: "memory");
+    _private->seqan_spin_lock = 0;
+
+    if (n) {
+        return n;
+    }
+    try {
+        std::rethrow_exception(error);
+    } catch (NoMoreReadsAvailable &) {
+        return 0;
+    }
+}
+
+SeqAnParser::~SeqAnParser()
+{
+    seqan::close(_private->stream);
+    delete _private;
+}
+
+// The bytes of a sequence file, read as they are or decompressed with zlib
+// or libbz2 according to its first bytes. "-" is standard input, which zlib
+// decompresses if it is gzipped.
+//
+// A staged Source decompresses on a thread of its own, a block ahead of the
+// parser: the thread fills one block while the parser copies out of the
+// other. BGZF files, whose gzip members each record their size, have a
+// block's worth of members inflated at once on n_threads threads; other
+// gzip files, multi-member or not, can only be inflated in order.
+struct FastxParser::Source {
+    enum { PLAIN, GZIP, BZIP2, BGZF } kind;
+    std::string filename;
+    int fd;
+    gzFile gz;
+    FILE * file;
+    BZFILE * bz;
+    bool bz_done;
+
+    Source(const char * name, bool staged, unsigned int n_threads);
+    ~Source();
+
+    // read up to n bytes into dest, and return how many; 0 at the end.
+    size_t read(char * dest, size_t n);
+
+    // the size of a plain, regular file, which can be read from anywhere
+    // with seek; 0 for any other.
+    uint64_t seekable_size();
+    // carry on reading a plain file at offset.
+    void seek(uint64_t offset);
+
+private:
+    struct Block {
+        std::vector<char>	data;
+        size_t			size;
+        std::exception_ptr	error;
+    };
+    // one BGZF member in _packed, and where it goes in a block.
+    struct Member {
+        size_t	packed_start;
+        size_t	packed_size;
+        size_t	start;
+        size_t	size;
+    };
+
+    unsigned int		_n_threads;
+    std::thread			_stage;
+    volatile bool		_stop;
+    Block			_blocks[2];
+    BoundedQueue< Block * >	_full;
+    BoundedQueue< Block * >	_empty;
+    Block *			_current;
+    size_t			_current_start;
+    bool			_finished;
+    std::exception_ptr		_error;
+    // an error met partway through a block, for the stage to pass on after
+    // the bytes before it.
+    std::exception_ptr		_deferred_error;
+    // BGZF members read but not inflated yet.
+    std::vector<char>		_packed;
+    std::vector<Member>		_members;
+
+    void _throw_read_error(const char * reason)
+    {
+        throw StreamReadError("Error reading from " + filename + ": " +
+                              reason);
+    }
+    void _open_bz2(void * unused, int n_unused);
+    // read up to n bytes of the file itself, as they are, into dest.
+    size_t _read_raw(char * dest, size_t n);
+    // decompress up to n bytes into dest, on the caller's thread.
+    size_t _decode(char * dest, size_t n);
+    // fill a block, returning its size, which is 0 at the end.
+    size_t _decode_block(std::vector<char> &data);
+    size_t _decode_bgzf_block(std::vector<char> &data);
+    bool _read_bgzf_member();
+    void _run_stage();
+};
+
+// the gzip header of a BGZF member: a gzip header with extra fields, the
+// first of which is 'BC', holding the size of the member less one.
+#define BGZF_HEADER_SIZE 18
+#define BGZF_TRAILER_SIZE 8
+
+static bool _is_bgzf_header(const unsigned char * h)
+{
+    return h[0] == 0x1f && h[1] == 0x8b && h[2] == 8 && (h[3] & 4) &&
+           h[10] == 6 && h[11] == 0 && h[12] == 'B' && h[13] == 'C' &&
+           h[14] == 2 && h[15] == 0;
+}
+
+static uint32_t _le32(const char * p)
+{
+    const unsigned char * b = (const unsigned char *) p;
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+}
+
+FastxParser::Source::Source(const char * name, bool staged,
+                            unsigned int n_threads)
+    : kind(PLAIN), filename(name), fd(-1), gz(NULL), file(NULL), bz(NULL),
+      bz_done(false), _n_threads(std::max(n_threads, 1U)), _stop(false),
+      _full(2), _empty(2), _current(NULL), _current_start(0),
+      _finished(false)
+{
+    if (filename == "-") {
+        kind = GZIP;
+        gz = gzdopen(dup(STDIN_FILENO), "rb");
+    } else {
+        fd = open(name, O_RDONLY);
+        if (fd < 0) {
+            throw InvalidStream("Could not open " + filename +
+                                " for reading.");
+        }
+        unsigned char magic[BGZF_HEADER_SIZE] = { 0 };
+        ssize_t n_magic = pread(fd, magic, sizeof(magic), 0);
+        if (staged && n_magic == BGZF_HEADER_SIZE &&
+                _is_bgzf_header(magic)) {
+            // the members are read from fd and inflated by the stage.
+            kind = BGZF;
+        } else if ((n_magic >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) ||
+                   (n_magic < 0 && errno == ESPIPE)) {
+            // zlib also reads a pipe, which cannot be peeked at, as
+            // standard input is read: gzipped or plain.
+            kind = GZIP;
+            gz = gzdopen(fd, "rb");
+            fd = -1;
+        } else if (n_magic >= 3 && magic[0] == 'B' && magic[1] == 'Z' &&
+                   magic[2] == 'h') {
+            kind = BZIP2;
+            file = fdopen(fd, "rb");
+            if (file == NULL) {
+                close(fd);
+                throw InvalidStream("Could not open " + filename +
+                                    " for reading.");
+            }
+            fd = -1;
+            try {
+                _open_bz2(NULL, 0);
+            } catch (...) {
+                fclose(file);
+                throw;
+            }
+        }
+    }
+    if (kind == GZIP) {
+        if (gz == NULL) {
+            throw InvalidStream("Could not open " + filename +
+                                " for reading.");
+        }
+        gzbuffer(gz, 1 << 17);
+    }
+
+    if (staged && kind != PLAIN) {
+        for (size_t i = 0; i < 2; i++) {
+            _blocks[i].data.resize(DEFAULT_PARSER_BUFFER_SIZE);
+            _empty.push(&_blocks[i]);
+        }
+        _stage = std::thread(&Source::_run_stage, this);
+    }
+}
+
+FastxParser::Source::~Source()
+{
+    if (_stage.joinable()) {
+        _stop = true;
+        _stage.join();
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (gz != NULL) {
+        gzclose(gz);
+    }
+    if (bz != NULL) {
+        int bzerror;
+        BZ2_bzReadClose(&bzerror, bz);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+uint64_t FastxParser::Source::seekable_size()
+{
+    struct stat info;
+    if (kind != PLAIN || fstat(fd, &info) || !S_ISREG(info.st_mode)) {
+        return 0;
+    }
+    return info.st_size;
+}
+
+void FastxParser::Source::seek(uint64_t offset)
+{
+    if (lseek(fd, offset, SEEK_SET) == (off_t) -1) {
+        _throw_read_error(strerror(errno));
+    }
+}
+
+void FastxParser::Source::_open_bz2(void * unused, int n_unused)
+{
+    int bzerror;
+    bz = BZ2_bzReadOpen(&bzerror, file, 0, 0, unused, n_unused);
+    if (bzerror != BZ_OK) {
+        bz = NULL;
+        throw InvalidStream("Could not open " + filename + " for reading.");
+    }
+}
+
+size_t FastxParser::Source::_read_raw(char * dest, size_t n)
+{
+    while (true) {
+        ssize_t got = ::read(fd, dest, n);
+        if (got >= 0) {
+            return got;
+        }
+        if (errno != EINTR) {
+            _throw_read_error(strerror(errno));
+        }
+    }
+}
+
+size_t FastxParser::Source::_decode(char * dest, size_t n)
+{
+    n = std::min(n, (size_t) INT_MAX);
+    if (kind == PLAIN) {
+        return _read_raw(dest, n);
+    }
+    if (kind == GZIP) {
+        int got = gzread(gz, dest, n);
+        if (got <= 0) {
+            // a truncated stream ends early, with Z_BUF_ERROR.
+            int errnum;
+            const char * reason = gzerror(gz, &errnum);
+            if (got < 0 || errnum == Z_BUF_ERROR) {
+                _throw_read_error(reason);
+            }
+        }
+        return got;
+    }
+
+    // a .bz2 file may hold several streams, one after the other.
+    while (!bz_done) {
+        int bzerror;
+        int got = BZ2_bzRead(&bzerror, bz, dest, n);
+        if (bzerror == BZ_STREAM_END) {
+            void * unused;
+            int n_unused;
+            BZ2_bzReadGetUnused(&bzerror, bz, &unused, &n_unused);
+            std::string rest((const char *) unused, n_unused);
+            BZ2_bzReadClose(&bzerror, bz);
+            bz = NULL;
+
+            int next = n_unused ? 0 : fgetc(file);
+            if (next == EOF) {
+                bz_done = true;
+            } else {
+                if (!n_unused) {
+                    ungetc(next, file);
+                }
+                _open_bz2(&rest[0], n_unused);
+            }
+        } else if (bzerror != BZ_OK) {
+            _throw_read_error("bzip2 data is corrupt");
+        }
+        if (got > 0) {
+            return got;
+        }
+    }
+    return 0;
+}
+
+size_t FastxParser::Source::_decode_block(std::vector<char> &data)
+{
+    if (kind == BGZF) {
+        return _decode_bgzf_block(data);
+    }
+    if (_deferred_error) {
+        std::rethrow_exception(_deferred_error);
+    }
+    size_t size = 0, got;
+    try {
+        while (size < data.size() &&
+                (got = _decode(&data[size], data.size() - size))) {
+            size += got;
+        }
+    } catch (...) {
+        if (!size) {
+            throw;
+        }
+        _deferred_error = std::current_exception();
+    }
+    return size;
+}
+
+bool FastxParser::Source::_read_bgzf_member()
+{
+    size_t start = _packed.size();
+    _packed.resize(start + BGZF_HEADER_SIZE);
+    size_t got = 0, n;
+    while (got < BGZF_HEADER_SIZE &&
+            (n = _read_raw(&_packed[start + got], BGZF_HEADER_SIZE - got))) {
+        got += n;
+    }
+    if (!got) {
+        _packed.resize(start);
+        return false;
+    }
+    if (got < BGZF_HEADER_SIZE ||
+            !_is_bgzf_header((const unsigned char *) &_packed[start])) {
+        _throw_read_error("invalid BGZF block");
+    }
+
+    size_t size = ((unsigned char) _packed[start + 16] |
+                   ((unsigned char) _packed[start + 17] << 8)) + 1;
+    if (size < BGZF_HEADER_SIZE + BGZF_TRAILER_SIZE) {
+        _throw_read_error("invalid BGZF block");
+    }
+    _packed.resize(start + size);
+    while (got < size && (n = _read_raw(&_packed[start + got], size - got))) {
+        got += n;
+    }
+    if (got < size) {
+        _throw_read_error("unexpected end of file");
+    }
+    return true;
+}
+
+// inflate a BGZF member into dest, which holds exactly its contents.
+static bool _inflate_bgzf_member(const char * member, size_t size,
+                                 char * dest, size_t dest_size)
+{
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, -15) != Z_OK) {
+        return false;
+    }
+    strm.next_in = (Bytef *) member + BGZF_HEADER_SIZE;
+    strm.avail_in = size - BGZF_HEADER_SIZE - BGZF_TRAILER_SIZE;
+    strm.next_out = (Bytef *) dest;
+    strm.avail_out = dest_size;
+    int ret = inflate(&strm, Z_FINISH);
+    bool ok = ret == Z_STREAM_END && strm.total_out == dest_size;
+    inflateEnd(&strm);
+
+    uint32_t crc = _le32(member + size - BGZF_TRAILER_SIZE);
+    return ok && crc32(crc32(0L, Z_NULL, 0), (const Bytef *) dest,
+                       dest_size) == crc;
+}
+
+size_t FastxParser::Source::_decode_bgzf_block(std::vector<char> &data)
+{
+    // gather the members that fit; one that does not is left in _packed
+    // for the next block.
+    if (_deferred_error) {
+        std::rethrow_exception(_deferred_error);
+    }
+    _members.clear();
+    size_t start = 0, size = 0;
+    try {
+        while (start < _packed.size() || _read_bgzf_member()) {
+            size_t packed_size = _packed.size() - start;
+            size_t member_size = _le32(&_packed[_packed.size() - 4]);
+            if (!_members.empty() && size + member_size > data.size()) {
+                break;
+            }
+            Member member = { start, packed_size, size, member_size };
+            _members.push_back(member);
+            size += member_size;
+            start = _packed.size();
+        }
+    } catch (...) {
+        if (_members.empty()) {
+            throw;
+        }
+        _deferred_error = std::current_exception();
+        _packed.resize(start);
+    }
+    if (size > data.size()) {
+        data.resize(size);
+    }
+
+    // thread t inflates members t, t + n_threads, ...
+    unsigned int n_threads = std::min((size_t) _n_threads, _members.size());
+    std::vector<char> failed(n_threads, 0);
+    auto work = [&](unsigned int t) {
+        for (size_t i = t; i < _members.size(); i += n_threads) {
+            const Member &m = _members[i];
+            if (!_inflate_bgzf_member(&_packed[m.packed_start], m.packed_size,
+                                      &data[m.start], m.size)) {
+                failed[t] = 1;
+                return;
+            }
+        }
+    };
+    if (n_threads <= 1) {
+        if (n_threads) {
+            work(0);
+        }
+    } else {
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < n_threads; t++) {
+            threads.push_back(std::thread(work, t));
+        }
+        for (unsigned int t = 0; t < n_threads; t++) {
+            threads[t].join();
+        }
+    }
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) {
+        _throw_read_error("BGZF data is corrupt");
+    }
+
+    _packed.erase(_packed.begin(), _packed.begin() + start);
+    return size;
+}
+
+void FastxParser::Source::_run_stage()
+{
+    while (true) {
+        Block * block;
+        while (!_empty.try_pop(block)) {
+            if (_stop) {
+                return;
+            }
+            sched_yield();
+        }
+
+        block->error = std::exception_ptr();
+        try {
+            block->size = _decode_block(block->data);
+        } catch (...) {
+            block->error = std::current_exception();
+            block->size = 0;
+        }
+
+        bool last = !block->size;
+        while (!_full.try_push(block)) {
+            if (_stop) {
+                return;
+            }
+            sched_yield();
+        }
+        if (last) {
+            return;
+        }
+    }
+}
+
+size_t FastxParser::Source::read(char * dest, size_t n)
+{
+    if (!_stage.joinable()) {
+        return _decode(dest, n);
+    }
+
+    size_t copied = 0;
+    while (copied < n && !_finished) {
+        if (_current == NULL) {
+            // once some bytes are copied, only take a block that is ready.
+            if (copied) {
+                if (!_full.try_pop(_current)) {
+                    break;
+                }
+            } else {
+                _full.pop(_current);
+            }
+            _current_start = 0;
+            if (!_current->size) {
+                _error = _current->error;
+                _finished = true;
+                break;
+            }
+        }
+
+        size_t bytes = std::min(n - copied, _current->size - _current_start);
+        memcpy(dest + copied, &_current->data[_current_start], bytes);
+        copied += bytes;
+        _current_start += bytes;
+        if (_current_start == _current->size) {
+            _empty.push(_current);
+            _current = NULL;
+        }
+    }
+
+    if (!copied && _error) {
+        std::rethrow_exception(_error);
+    }
+    return copied;
+}
+
+FastxParser::FastxParser( const char * filename, size_t buffer_size,
+                          unsigned int n_threads )
+    : IParser( ), _source(NULL), _buffer(NULL),
+      _capacity(std::max(buffer_size, (size_t) 4096)), _start(0), _end(0),
+      _offset(0), _range_end(UINT64_MAX), _at_eof(false), _failed(false),
+      _fastq(false), _lock(0)
+{
+    if (!n_threads) {
+        n_threads = std::thread::hardware_concurrency();
+    }
+    _source = new Source(filename, true, n_threads);
+    try {
+        _buffer = new char[_capacity];
+        int c;
+        try {
+            c = _peek();
+        } catch (StreamReadError &) {
+            // as with SeqAnParser, a file that cannot be decompressed fails
+            // on its first read.
+            _pending_error = std::current_exception();
+            _failed = true;
+            return;
+        }
+        if (c == EOF) {
+            std::string message = "File ";
+            message = message + filename + " does not contain any sequences!";
+            throw InvalidStream(message);
+        } else if (c != '>' && c != '@') {
+            std::string message = "Could not open ";
+            message = message + filename + " for reading.";
+            throw InvalidStream(message);
+        }
+        _fastq = c == '@';
+    } catch (...) {
+        delete _source;
+        delete[] _buffer;
+        throw;
+    }
+}
+
+FastxParser::FastxParser( const FastxParser &first, uint64_t range_start,
+                          uint64_t range_end )
+    : IParser( ), _source(NULL), _buffer(NULL), _capacity(first._capacity),
+      _start(0), _end(0), _offset(range_start - 1), _range_end(range_end),
+      _at_eof(false), _failed(false), _fastq(first._fastq), _lock(0)
+{
+    _source = new Source(first._source->filename.c_str(), false, 1);
+    try {
+        _buffer = new char[_capacity];
+        // a record starting at range_start follows the line break just
+        // before it.
+        _source->seek(_offset);
+        _resync();
+    } catch (...) {
+        delete _source;
+        delete[] _buffer;
+        throw;
+    }
+}
+
+FastxParser::~FastxParser( )
+{
+    delete _source;
+    delete[] _buffer;
+}
+
+bool FastxParser::can_parse( const char * filename )
+{
+    // standard input, a pipe or a FIFO can only be read once, so it is
+    // always ours.
+    struct stat info;
+    if (std::string(filename) == "-" ||
+            (!stat(filename, &info) && !S_ISREG(info.st_mode))) {
+        return true;
+    }
+    try {
+        Source source(filename, false, 1);
+        char c;
+        return !source.read(&c, 1) || c == '>' || c == '@';
+    } catch (khmer_file_exception &) {
+        // FastxParser reports that it cannot be read as SeqAnParser would.
+        return true;
+    }
+}
+
+std::vector< std::unique_ptr< IParser > > FastxParser::open_split(
+    const char * filename, unsigned int n_parsers )
+{
+    std::vector< std::unique_ptr< IParser > > parsers;
+    FastxParser * first = new FastxParser(filename);
+    parsers.push_back(std::unique_ptr< IParser >(first));
+    if (first->_failed) {
+        return parsers;
+    }
+
+    // the records of a FASTQ file are found from anywhere in it by their
+    // four lines, so the file must not wrap them; its first record is taken
+    // as a sample.
+    uint64_t size = first->_source->seekable_size();
+    uint64_t n_ranges = std::min((uint64_t) n_parsers,
+                                 size / MIN_SPLIT_RANGE_SIZE);
+    if (n_ranges < 2 ||
+            (first->_fastq && !first->_at_unwrapped_fastq_record())) {
+        return parsers;
+    }
+
+    first->_range_end = size / n_ranges;
+    for (uint64_t i = 1; i < n_ranges; i++) {
+        parsers.push_back(std::unique_ptr< IParser >(
+                              new FastxParser(*first, size * i / n_ranges,
+                                              size * (i + 1) / n_ranges)));
+    }
+    return parsers;
+}
+
+bool FastxParser::_fill( )
+{
+    if (_at_eof) {
+        return false;
+    }
+    if (_start) {
+        memmove(_buffer, _buffer + _start, _end - _start);
+        _end -= _start;
+        _offset += _start;
+        _start = 0;
+    }
+    if (_end == _capacity) {
+        char * grown = new char[2 * _capacity];
+        memcpy(grown, _buffer, _end);
+        delete[] _buffer;
+        _buffer = grown;
+        _capacity *= 2;
+    }
+
+    size_t n = _source->read(_buffer + _end, _capacity - _end);
+    if (!n) {
+        _at_eof = true;
+        return false;
+    }
+    _end += n;
+    return true;
+}
+
+bool FastxParser::_next_line( const char *&line, size_t &length,
+                              bool &terminated )
+{
+    size_t searched = _start;
+    while (true) {
+        const char * newline = (const char *) memchr(_buffer + searched,
+                               '\n', _end - searched);
+        if (newline) {
+            line = _buffer + _start;
+            length = newline - line;
+            _start += length + 1;
+            terminated = true;
+            break;
+        }
+        // the bytes scanned so far move to the front of the buffer.
+        size_t scanned = _end - _start;
+        if (!_fill()) {
+            if (_start == _end) {
+                return false;
+            }
+            line = _buffer + _start;
+            length = _end - _start;
+            _start = _end;
+            terminated = false;
+            break;
+        }
+        searched = _start + scanned;
+    }
+    if (length && line[length - 1] == '\r') {
+        length--;
+    }
+    return true;
+}
+
+int FastxParser::_peek( )
+{
+    if (_start == _end && !_fill()) {
+        return EOF;
+    }
+    return (unsigned char) _buffer[_start];
+}
+
+void FastxParser::_skip_blank_lines( )
+{
+    int c;
+    while ((c = _peek()) == '\n' || c == '\r') {
+        _start++;
+    }
+}
+
+bool FastxParser::_at_range_end( )
+{
+    _skip_blank_lines();
+    return _peek() == EOF || _offset + _start >= _range_end;
+}
+
+bool FastxParser::_peek_lines( size_t n_lines, size_t * ends )
+{
+    size_t searched = 0;
+    for (size_t i = 0; i < n_lines; i++) {
+        size_t line_start = searched;
+        while (true) {
+            const char * newline = (const char *) memchr(
+                                       _buffer + _start + searched, '\n',
+                                       _end - _start - searched);
+            if (newline) {
+                searched = newline + 1 - (_buffer + _start);
+                break;
+            }
+            // the bytes searched move to the front of the buffer, with
+            // _start.
+            searched = _end - _start;
+            if (!_fill()) {
+                if (searched == line_start) {
+                    return false;
+                }
+                break;
+            }
+        }
+        ends[i] = searched;
+    }
+    return true;
+}
+
+bool FastxParser::_at_unwrapped_fastq_record( )
+{
+    size_t ends[4];
+    if (_peek() != '@' || !_peek_lines(4, ends)) {
+        return false;
+    }
+
+    const char * lines = _buffer + _start;
+    auto length = [&](size_t i) {
+        size_t begin = i ? ends[i - 1] : 0, end = ends[i];
+        if (end > begin && lines[end - 1] == '\n') {
+            end--;
+        }
+        if (end > begin && lines[end - 1] == '\r') {
+            end--;
+        }
+        return end - begin;
+    };
+    // a quality line may start with '@', but then it is followed by a
+    // record, whose sequence does not start with '+'.
+    return lines[ends[1]] == '+' && length(1) && length(1) == length(3);
+}
+
+void FastxParser::_resync( )
+{
+    size_t end;
+    if (!_peek_lines(1, &end)) {
+        return;
+    }
+    _start += end;
+
+    int c;
+    while (_offset + _start < _range_end && (c = _peek()) != EOF) {
+        if (_fastq ? _at_unwrapped_fastq_record() : c == '>') {
+            return;
+        }
+        _peek_lines(1, &end);
+        _start += end;
+    }
+}
+
+// whether the line holds any blanks, which are left out of sequences and
+// qualities.
+static inline bool _has_blanks(const char * line, size_t length)
+{
+    return memchr(line, ' ', length) || memchr(line, '\t', length);
+}
+
+static inline void _append_stripped(std::string &dest, const char * line,
+                                    size_t length)
+{
+    if (!_has_blanks(line, length)) {
+        dest.append(line, length);
+        return;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (!isspace((unsigned char) line[i])) {
+            dest.push_back(line[i]);
+        }
+    }
+}
+
+void FastxParser::_read_record(Read &the_read)
 {
+    const char * line;
+    size_t length;
+    bool terminated;
+
     the_read.reset();
-    int ret = -1;
-    const char *invalid_read_exc = NULL;
-    while (!__sync_bool_compare_and_swap(& _private->seqan_spin_lock, 0, 1));
-    bool atEnd = seqan::atEnd(_private->stream);
-    if (!atEnd) {
-        ret = seqan::readRecord(the_read.name, the_read.sequence,
-                                the_read.quality, _private->stream);
-        if (ret == 0) {
-            // Detect if we're parsing something w/ qualities on the first read
-            // only
-            if (_num_reads == 0 && the_read.quality.length() != 0) {
-                _have_qualities = true;
-            }
+    if (_at_range_end()) {
+        throw NoMoreReadsAvailable();
+    }
+    int c = _peek();
+    if (c != (_fastq ? '@' : '>')) {
+        throw StreamReadError("Invalid FASTA/Q record in " +
+                              _source->filename + ": a line starting with '" +
+                              std::string(1, (char) c) +
+                              "' where a record should start");
+    }
+
+    _next_line(line, length, terminated);
+    the_read.name.assign(line + 1, length - 1);
+
+    // the sequence runs up to the next record in FASTA, or to the line
+    // starting with '+' in FASTQ.
+    const char stop = _fastq ? '+' : '>';
+    while ((c = _peek()) != EOF && c != stop) {
+        _next_line(line, length, terminated);
+        _append_stripped(the_read.sequence, line, length);
+    }
+
+    if (_fastq && c != EOF) {
+        _next_line(line, length, terminated);
+        if (length > 1 && the_read.name.compare(0, std::string::npos,
+                                                line + 1, length - 1)) {
+            throw StreamReadError("Invalid FASTQ record in " +
+                                  _source->filename + ": the '+' line of " +
+                                  the_read.name + " names another read");
+        }
 
-            // Handle error cases, or increment number of reads on success
-            if (the_read.sequence.length() == 0) {
-                invalid_read_exc = "Sequence is empty";
-            } else if (_have_qualities && (the_read.sequence.length() != \
-                                           the_read.quality.length())) {
-                invalid_read_exc = "Sequence and quality lengths differ";
+        // as many qualities as there are bases, which may be wrapped; the
+        // rest of the line holding the last one is skipped.
+        size_t n_bases = the_read.sequence.length();
+        if (terminated && _next_line(line, length, terminated) && n_bases) {
+            if (length == n_bases && !_has_blanks(line, length)) {
+                the_read.quality.assign(line, length);
             } else {
-                _num_reads++;
+                while (true) {
+                    for (size_t i = 0; i < length; i++) {
+                        if (!isspace((unsigned char) line[i])) {
+                            the_read.quality.push_back(line[i]);
+                            if (the_read.quality.length() == n_bases) {
+                                break;
+                            }
+                        }
+                    }
+                    if (the_read.quality.length() == n_bases ||
+                            !_next_line(line, length, terminated)) {
+                        break;
+                    }
+                }
             }
         }
     }
+
+    if (_num_reads == 0 && the_read.quality.length() != 0) {
+        _have_qualities = true;
+    }
+
+    if (the_read.sequence.length() == 0) {
+        throw InvalidRead("Sequence is empty");
+    } else if (_have_qualities && (the_read.sequence.length() != \
+                                   the_read.quality.length())) {
+        throw InvalidRead("Sequence and quality lengths differ");
+    }
+    _num_reads++;
+}
+
+std::exception_ptr FastxParser::_read_record_locked(Read &the_read)
+{
+    if (_pending_error) {
+        std::exception_ptr error = _pending_error;
+        _pending_error = std::exception_ptr();
+        return error;
+    }
+    if (_failed) {
+        return std::make_exception_ptr(NoMoreReadsAvailable());
+    }
+
+    try {
+        _read_record(the_read);
+    } catch (NoMoreReadsAvailable &) {
+        return std::current_exception();
+    } catch (InvalidRead &) {
+        // the bad record was read through, and the next one can follow.
+        return std::current_exception();
+    } catch (...) {
+        _failed = true;
+        return std::current_exception();
+    }
+    return std::exception_ptr();
+}
+
+bool FastxParser::is_complete()
+{
+    bool complete = false;
+    while (!__sync_bool_compare_and_swap(& _lock, 0, 1));
+    try {
+        if (!_pending_error && !_failed) {
+            complete = _at_range_end();
+        }
+    } catch (...) {
+        _pending_error = std::current_exception();
+        _failed = true;
+    }
+    complete = complete || (_failed && !_pending_error);
     __asm__ __volatile__ ("" ::: "memory");
-    _private->seqan_spin_lock = 0;
-    // Throw any error in the read, even if we're at the end
-    if (invalid_read_exc != NULL) {
-        throw InvalidRead(invalid_read_exc);
+    _lock = 0;
+    return complete;
+}
+
+void FastxParser::imprint_next_read(Read &the_read)
+{
+    while (!__sync_bool_compare_and_swap(& _lock, 0, 1));
+    std::exception_ptr error = _read_record_locked(the_read);
+    __asm__ __volatile__ ("" ::: "memory");
+    _lock = 0;
+
+    if (error) {
+        std::rethrow_exception(error);
     }
-    // Throw NoMoreReadsAvailable if none of the above errors were raised, even
-    // if ret == 0
-    if (atEnd) {
-        throw NoMoreReadsAvailable();
+}
+
+size_t FastxParser::imprint_next_read_batch(std::vector< Read > &reads,
+        size_t n_reads)
+{
+    if (reads.size() < n_reads) {
+        reads.resize(n_reads);
     }
-    // Catch-all error in readRecord that isn't one of the above
-    if (ret != 0) {
-        throw StreamReadError();
+
+    size_t n = 0;
+    std::exception_ptr error;
+    while (!__sync_bool_compare_and_swap(& _lock, 0, 1));
+    while (n < n_reads && !(error = _read_record_locked(reads[n]))) {
+        n++;
+    }
+    // keep an error for the next call, unless there are no reads to return.
+    if (n && error) {
+        _pending_error = error;
+    }
+    __asm__ __volatile__ ("" ::: "memory");
+    _lock = 0;
+
+    if (n) {
+        return n;
+    }
+    try {
+        std::rethrow_exception(error);
+    } catch (NoMoreReadsAvailable &) {
+        return 0;
     }
 }
 
-SeqAnParser::~SeqAnParser()
+bool FastxParser::_view_record(ReadView &view)
 {
-    seqan::close(_private->stream);
-    delete _private;
+    // blank lines are skipped as _read_record would, as far as the buffer
+    // goes.
+    while (_start < _end &&
+            (_buffer[_start] == '\n' || _buffer[_start] == '\r')) {
+        _start++;
+    }
+    if (_start == _end || _offset + _start >= _range_end ||
+            _buffer[_start] != (_fastq ? '@' : '>')) {
+        return false;
+    }
+
+    // the lines of the record, without their ends.
+    const char * end = _buffer + _end;
+    const char * lines[4];
+    size_t lengths[4];
+    const char * next = _buffer + _start;
+    const size_t n_lines = _fastq ? 4 : 2;
+    for (size_t i = 0; i < n_lines; i++) {
+        const char * newline = (const char *) memchr(next, '\n', end - next);
+        if (!newline) {
+            return false;
+        }
+        lines[i] = next;
+        lengths[i] = newline - next;
+        if (lengths[i] && next[lengths[i] - 1] == '\r') {
+            lengths[i]--;
+        }
+        next = newline + 1;
+    }
+
+    // an empty sequence is an error for _read_record to report.
+    if (!lengths[1] || lines[1][0] == (_fastq ? '+' : '>') ||
+            _has_blanks(lines[1], lengths[1])) {
+        return false;
+    }
+    if (_fastq) {
+        // the '+' line is bare or names this read, and the qualities are
+        // on one line, as many as there are bases.
+        if (lines[2][0] != '+' || (lengths[2] > 1 &&
+                                   (lengths[2] != lengths[0] ||
+                                    memcmp(lines[2] + 1, lines[0] + 1,
+                                           lengths[0] - 1))) ||
+                lengths[3] != lengths[1] ||
+                _has_blanks(lines[3], lengths[3])) {
+            return false;
+        }
+    } else if (next == end ? !_at_eof : *next != '>') {
+        // the sequence may go on, on the next line.
+        return false;
+    }
+
+    view.name = lines[0] + 1;
+    view.name_length = lengths[0] - 1;
+    view.sequence = lines[1];
+    view.sequence_length = lengths[1];
+    view.quality = _fastq ? lines[3] : NULL;
+    view.quality_length = _fastq ? lengths[3] : 0;
+    if (_num_reads == 0 && _fastq) {
+        _have_qualities = true;
+    }
+    _start = next - _buffer;
+    _num_reads++;
+    return true;
+}
+
+size_t FastxParser::imprint_next_read_view_batch(
+    std::vector< ReadView > &views, size_t n_reads)
+{
+    if (views.size() < n_reads) {
+        views.resize(n_reads);
+    }
+    if (_view_reads.size() < n_reads) {
+        _view_reads.resize(n_reads);
+    }
+
+    // a record read into a Read may refill the buffer, and so only before
+    // any view points into it.
+    size_t n = 0;
+    bool in_buffer = false;
+    std::exception_ptr error;
+    while (!__sync_bool_compare_and_swap(& _lock, 0, 1));
+    while (n < n_reads) {
+        if (!_pending_error && !_failed && _view_record(views[n])) {
+            in_buffer = true;
+        } else if (in_buffer ||
+                   (error = _read_record_locked(_view_reads[n]))) {
+            break;
+        } else {
+            views[n] = ReadView(_view_reads[n]);
+        }
+        n++;
+    }
+    if (n && error) {
+        _pending_error = error;
+    }
+    __asm__ __volatile__ ("" ::: "memory");
+    _lock = 0;
+
+    if (n) {
+        return n;
+    }
+    try {
+        std::rethrow_exception(error);
+    } catch (NoMoreReadsAvailable &) {
+        return 0;
+    }
 }
 
 IParser * const
@@ -149,51 +1248,85 @@ get_parser(
     std:: string const	    &ifile_name
 )
 {
-
+    // SeqAnParser reads the files that FastxParser does not recognize.
+    if (FastxParser::can_parse(ifile_name.c_str())) {
+        return new FastxParser(ifile_name.c_str());
+    }
     return new SeqAnParser(ifile_name.c_str());
 }
 
 
+std:: vector< std:: unique_ptr< IParser > >
 IParser::
-IParser(
+get_split_parsers(
+    std:: string const	    &ifile_name,
+    unsigned int	    n_parsers
 )
 {
-    int regex_rc =
-        regcomp(
-            &_re_read_2_nosub,
-            // ".+(/2| 2:[YN]:[[:digit:]]+:[[:alpha:]]+)$",
-            "^.+(/2| 2:[YN]:[[:digit:]]+:[[:alpha:]]+).{0}",
-            REG_EXTENDED | REG_NOSUB
-        );
-    if (regex_rc) {
-        throw khmer_exception("Could not compile R2 nosub regex");
-    }
-    regex_rc =
-        regcomp(
-            &_re_read_1,
-            "^.+(/1| 1:[YN]:[[:digit:]]+:[[:alpha:]]+).{0}", REG_EXTENDED
-        );
-    if (regex_rc) {
-        throw khmer_exception("Could not compile R1 regex");
-    }
-    regex_rc =
-        regcomp(
-            &_re_read_2,
-            "^.+(/2| 2:[YN]:[[:digit:]]+:[[:alpha:]]+).{0}", REG_EXTENDED
-        );
-    if (regex_rc) {
-        throw khmer_exception("Could not compile R2 regex");
+    if (ifile_name != "-" && n_parsers > 1 &&
+            FastxParser::can_parse(ifile_name.c_str())) {
+        return FastxParser::open_split(ifile_name.c_str(), n_parsers);
     }
+    std:: vector< std:: unique_ptr< IParser > > parsers;
+    parsers.push_back(std:: unique_ptr< IParser >(get_parser(ifile_name)));
+    return parsers;
+}
+
+
+IParser::
+IParser(
+)
+{
     _num_reads = 0;
     _have_qualities = false;
 }
 
+size_t
+IParser::
+imprint_next_read_batch( std::vector< Read > &reads, size_t n_reads )
+{
+    if (reads.size() < n_reads) {
+        reads.resize(n_reads);
+    }
+    if (_pending_error) {
+        std::exception_ptr error = _pending_error;
+        _pending_error = std::exception_ptr();
+        std::rethrow_exception(error);
+    }
+
+    size_t n = 0;
+    try {
+        for (; n < n_reads; n++) {
+            imprint_next_read( reads[n] );
+        }
+    } catch (NoMoreReadsAvailable &) {
+        // a short batch, or none at all.
+    } catch (...) {
+        if (!n) {
+            throw;
+        }
+        _pending_error = std::current_exception();
+    }
+    return n;
+}
+
+size_t
+IParser::
+imprint_next_read_view_batch( std::vector< ReadView > &views, size_t n_reads )
+{
+    size_t n = imprint_next_read_batch( _view_reads, n_reads );
+    if (views.size() < n) {
+        views.resize(n);
+    }
+    for (size_t i = 0; i < n; i++) {
+        views[i] = ReadView( _view_reads[i] );
+    }
+    return n;
+}
+
 IParser::
 ~IParser( )
 {
-    regfree( &_re_read_2_nosub );
-    regfree( &_re_read_1 );
-    regfree( &_re_read_2 );
 }
 
 void
@@ -238,7 +1371,7 @@ _imprint_next_read_pair_in_ignore_mode( ReadPair &the_read_pair )
 {
     Read	    &read_1		= the_read_pair.first;
     Read	    &read_2		= the_read_pair.second;
-    regmatch_t	    match_1, match_2;
+    size_t	    end_1, end_2;
 
     // Hunt for a read pair until one is found or end of reads is reached.
     while (true) {
@@ -248,9 +1381,8 @@ _imprint_next_read_pair_in_ignore_mode( ReadPair &the_read_pair )
         //	 pass through unhandled.
         while (true) {
             imprint_next_read( read_1 );
-            if (!regexec(
-                        &_re_read_1, read_1.name.c_str( ), 1, &match_1, 0
-                    )) {
+            end_1 = read_pair_name_end( read_1.name, '1' );
+            if (end_1) {
                 break;
             }
         }
@@ -260,10 +1392,9 @@ _imprint_next_read_pair_in_ignore_mode( ReadPair &the_read_pair )
         // If found, then validate match.
         // If invalid pair, then restart search for pair.
         imprint_next_read( read_2 );
-        if (!regexec(
-                    &_re_read_2, read_2.name.c_str( ), 1, &match_2, 0
-                )) {
-            if (_is_valid_read_pair( the_read_pair, match_1, match_2 )) {
+        end_2 = read_pair_name_end( read_2.name, '2' );
+        if (end_2) {
+            if (_is_valid_read_pair( the_read_pair, end_1, end_2 )) {
                 break;
             }
         }
@@ -279,7 +1410,7 @@ _imprint_next_read_pair_in_error_mode( ReadPair &the_read_pair )
 {
     Read	    &read_1		= the_read_pair.first;
     Read	    &read_2		= the_read_pair.second;
-    regmatch_t	    match_1, match_2;
+    size_t	    end_1, end_2;
 
     // Note: We let any exception, which flies out of the following,
     //	     pass through unhandled.
@@ -287,38 +1418,446 @@ _imprint_next_read_pair_in_error_mode( ReadPair &the_read_pair )
     imprint_next_read( read_2 );
 
     // Is the first read really the first member of a pair?
-    if (REG_NOMATCH == regexec(
-                &_re_read_1, read_1.name.c_str( ), 1, &match_1, 0
-            )) {
+    end_1 = read_pair_name_end( read_1.name, '1' );
+    if (!end_1) {
         throw InvalidReadPair( );
     }
     // Is the second read really the second member of a pair?
-    if (REG_NOMATCH == regexec(
-                &_re_read_2, read_2.name.c_str( ), 1, &match_2, 0
-            )) {
+    end_2 = read_pair_name_end( read_2.name, '2' );
+    if (!end_2) {
         throw InvalidReadPair( );
     }
 
     // Is the pair valid?
-    if (!_is_valid_read_pair( the_read_pair, match_1, match_2 )) {
+    if (!_is_valid_read_pair( the_read_pair, end_1, end_2 )) {
         throw InvalidReadPair( );
     }
 
 } // _imprint_next_read_pair_in_error_mode
 
 
+// The regexes this replaces matched from the start of the names, so the
+// parts of them before the matches were always empty and only the ends of
+// the matches had to agree.
 bool
 IParser::
 _is_valid_read_pair(
-    ReadPair &the_read_pair, regmatch_t &match_1, regmatch_t &match_2
+    ReadPair &the_read_pair, size_t end_1, size_t end_2
+)
+{
+    return end_1 == end_2;
+}
+
+
+size_t
+read_pair_name_end( const char * name, size_t length, char mate )
+{
+    size_t end = 0;
+    if (length < 3) {
+        return end;
+    }
+
+    // ".+" takes at least one character before the mark, so the mate
+    // number of the first one possible is the third character.
+    for (const char * m = name + 2; m < name + length; m++) {
+        m = (const char *)memchr( m, mate, name + length - m );
+        if (!m) {
+            break;
+        }
+        size_t at = m - name - 1;
+        if (name[ at ] == '/') {
+            end = at + 2;
+            continue;
+        }
+        // " 1:[YN]:[[:digit:]]+:[[:alpha:]]+"
+        if (name[ at ] != ' ' || at + 7 >= length
+                || name[ at + 2 ] != ':'
+                || (name[ at + 3 ] != 'Y' && name[ at + 3 ] != 'N')
+                || name[ at + 4 ] != ':') {
+            continue;
+        }
+        size_t i = at + 5;
+        while (i < length && name[ i ] >= '0' && name[ i ] <= '9') {
+            i++;
+        }
+        if (i == at + 5 || i + 1 >= length || name[ i ] != ':') {
+            continue;
+        }
+        size_t alpha_start = ++i;
+        while (i < length
+                && ((name[ i ] >= 'A' && name[ i ] <= 'Z')
+                    || (name[ i ] >= 'a' && name[ i ] <= 'z'))) {
+            i++;
+        }
+        // A later mark can only end later, so the last one found wins.
+        if (i > alpha_start) {
+            end = i;
+        }
+    }
+    return end;
+}
+
+// A part of a read name, not NUL-terminated.
+struct NamePart {
+    const char *	data;
+    size_t		length;
+};
+
+// whitespace, as str.split() in Python has it for ASCII.
+static inline bool _is_name_space(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r')
+           || (c >= '\x1c' && c <= '\x1f');
+}
+
+// the name up to its first whitespace, and the rest after that whitespace,
+// as _split_left_right in khmer/utils.py splits it.
+static void _split_left_right(const std:: string &name, NamePart &lhs,
+                              NamePart &rhs)
+{
+    const char * at = name.data( );
+    const char * end = at + name.length( );
+
+    while (at < end && _is_name_space( *at )) {
+        at++;
+    }
+    lhs.data = at;
+    while (at < end && !_is_name_space( *at )) {
+        at++;
+    }
+    lhs.length = at - lhs.data;
+    while (at < end && _is_name_space( *at )) {
+        at++;
+    }
+    rhs.data = at;
+    rhs.length = end - at;
+}
+
+static inline bool _starts_with(const NamePart &part, char a, char b)
+{
+    return part.length >= 2 && part.data[ 0 ] == a && part.data[ 1 ] == b;
+}
+
+static inline bool _ends_with(const NamePart &part, char a, char b)
+{
+    return part.length >= 2 && part.data[ part.length - 2 ] == a
+           && part.data[ part.length - 1 ] == b;
+}
+
+static inline bool _equal(const NamePart &a, const NamePart &b)
+{
+    return a.length == b.length && !memcmp( a.data, b.data, a.length );
+}
+
+// whether the parts up to their first '/' are the same, and not empty.
+static bool _same_before_slash(const NamePart &a, const NamePart &b)
+{
+    const char * slash_a = (const char *)memchr( a.data, '/', a.length );
+    const char * slash_b = (const char *)memchr( b.data, '/', b.length );
+    NamePart before_a = { a.data, (size_t)(slash_a - a.data) };
+    NamePart before_b = { b.data, (size_t)(slash_b - b.data) };
+    return before_a.length && _equal( before_a, before_b );
+}
+
+static bool _is_mate_name(const std:: string &name, char mate)
+{
+    NamePart lhs, rhs;
+    _split_left_right( name, lhs, rhs );
+    return _ends_with( lhs, '/', mate ) || _starts_with( rhs, mate, ':' )
+           || _ends_with( rhs, '/', mate );
+}
+
+bool
+is_left_read_name( const std:: string &name )
+{
+    return _is_mate_name( name, '1' );
+}
+
+bool
+is_right_read_name( const std:: string &name )
+{
+    return _is_mate_name( name, '2' );
+}
+
+bool
+is_read_pair( const Read &first, const Read &second )
+{
+    if (first.quality.empty( ) != second.quality.empty( )) {
+        throw InvalidReadPair(
+            "both records must be same type (FASTA or FASTQ)" );
+    }
+
+    NamePart lhs_1, rhs_1, lhs_2, rhs_2;
+    _split_left_right( first.name, lhs_1, rhs_1 );
+    _split_left_right( second.name, lhs_2, rhs_2 );
+
+    // "name/1"
+    if (_ends_with( lhs_1, '/', '1' ) && _ends_with( lhs_2, '/', '2' )) {
+        return _same_before_slash( lhs_1, lhs_2 );
+    }
+    if (!_equal( lhs_1, lhs_2 )) {
+        return false;
+    }
+    // "name 1:..."
+    if (_starts_with( rhs_1, '1', ':' ) && _starts_with( rhs_2, '2', ':' )) {
+        return true;
+    }
+    // "name seq/1"
+    if (_ends_with( rhs_1, '/', '1' ) && _ends_with( rhs_2, '/', '2' )) {
+        return _same_before_slash( rhs_1, rhs_2 );
+    }
+    return false;
+}
+
+
+FastxWriter::
+FastxWriter( WriteFn write, void * write_data, size_t buffer_size )
+    : _write(write), _write_data(write_data),
+      _buffer(buffer_size ? buffer_size : 1), _fill(0)
+{
+}
+
+void
+FastxWriter::
+_append( const char * data, size_t length )
+{
+    while (length) {
+        if (_fill == _buffer.size( )) {
+            flush( );
+        }
+        size_t n = MIN( length, _buffer.size( ) - _fill );
+        memcpy( &_buffer[ _fill ], data, n );
+        _fill += n;
+        data += n;
+        length -= n;
+    }
+}
+
+void
+FastxWriter::
+write( const Read &read )
+{
+    const size_t name_length = read.name.length( );
+    const size_t sequence_length = read.sequence.length( );
+    const size_t quality_length = read.quality.length( );
+    const size_t length = name_length + sequence_length + 3
+                          + (quality_length ? quality_length + 3 : 0);
+
+    // most records fit in what is left of the buffer, and are copied in
+    // without going through _append a piece at a time.
+    if (length <= _buffer.size( ) - _fill) {
+        char * out = &_buffer[ _fill ];
+        *out++ = quality_length ? '@' : '>';
+        memcpy( out, read.name.data( ), name_length );
+        out += name_length;
+        *out++ = '\n';
+        memcpy( out, read.sequence.data( ), sequence_length );
+        out += sequence_length;
+        *out++ = '\n';
+        if (quality_length) {
+            *out++ = '+';
+            *out++ = '\n';
+            memcpy( out, read.quality.data( ), quality_length );
+            out += quality_length;
+            *out++ = '\n';
+        }
+        _fill += length;
+        return;
+    }
+
+    if (read.quality.empty( )) {
+        _append( ">", 1 );
+        _append( read.name.data( ), read.name.length( ) );
+        _append( "\n", 1 );
+        _append( read.sequence.data( ), read.sequence.length( ) );
+        _append( "\n", 1 );
+    } else {
+        _append( "@", 1 );
+        _append( read.name.data( ), read.name.length( ) );
+        _append( "\n", 1 );
+        _append( read.sequence.data( ), read.sequence.length( ) );
+        _append( "\n+\n", 3 );
+        _append( read.quality.data( ), read.quality.length( ) );
+        _append( "\n", 1 );
+    }
+}
+
+void
+FastxWriter::
+flush( )
+{
+    // emptied first, so that a write which throws is not tried again.
+    size_t fill = _fill;
+    _fill = 0;
+    if (fill) {
+        _write( &_buffer[ 0 ], fill, _write_data );
+    }
+}
+
+
+// swapping the strings one by one is cheaper than std::swap, which moves
+// each of them three times.
+static inline void _swap_reads(Read &a, Read &b)
+{
+    a.name.swap( b.name );
+    a.annotations.swap( b.annotations );
+    a.sequence.swap( b.sequence );
+    a.quality.swap( b.quality );
+}
+
+PairedReadStream::
+PairedReadStream( IParser * parser, uint8_t mode )
+    : _reads(parser), _right_reads(NULL), _two_files(false), _mode(mode),
+      _reformat(false), _have_next(false)
+{
+    if (mode != IParser:: PAIR_MODE_ALLOW_UNPAIRED
+            && mode != IParser:: PAIR_MODE_IGNORE_UNPAIRED
+            && mode != IParser:: PAIR_MODE_ERROR_ON_UNPAIRED) {
+        std::ostringstream oss;
+        oss << "Unknown pair reading mode: " << (unsigned int) mode;
+        throw UnknownPairReadingMode(oss.str());
+    }
+}
+
+PairedReadStream::
+PairedReadStream( IParser * left, IParser * right, bool reformat )
+    : _reads(left), _right_reads(right), _two_files(true),
+      _mode(IParser:: PAIR_MODE_ERROR_ON_UNPAIRED), _reformat(reformat),
+      _have_next(false)
+{
+}
+
+bool
+PairedReadStream::
+_imprint_next_read( BatchedReads &reads, Read &the_read )
+{
+    Read * read = reads.next( );
+    if (!read) {
+        return false;
+    }
+    _swap_reads( the_read, *read );
+    return true;
+}
+
+bool
+PairedReadStream::
+_imprint_next_two_file_pair( ReadPair &the_read_pair )
+{
+    Read	    &read_1		= the_read_pair.first;
+    Read	    &read_2		= the_read_pair.second;
+
+    bool have_read_1 = _imprint_next_read( _reads, read_1 );
+    bool have_read_2 = _imprint_next_read( _right_reads, read_2 );
+    if (!have_read_1 && !have_read_2) {
+        throw NoMoreReadsAvailable( );
+    }
+    if (have_read_1 != have_read_2) {
+        throw InvalidReadPair(
+            "Input files contain different number of records." );
+    }
+
+    if (_reformat) {
+        if (!is_left_read_name( read_1.name )) {
+            read_1.name += "/1";
+        }
+        if (!is_right_read_name( read_2.name )) {
+            read_2.name += "/2";
+        }
+        if (!is_read_pair( read_1, read_2 )) {
+            throw InvalidReadPair( "This doesn't look like paired data! " +
+                                   read_1.name + " " + read_2.name );
+        }
+    }
+    return true;
+}
+
+bool
+PairedReadStream::
+imprint_next_read_pair( ReadPair &the_read_pair )
+{
+    if (_two_files) {
+        return _imprint_next_two_file_pair( the_read_pair );
+    }
+
+    Read	    &read_1		= the_read_pair.first;
+    Read	    &read_2		= the_read_pair.second;
+
+    while (true) {
+        if (_have_next) {
+            _swap_reads( read_1, _next );
+            _have_next = false;
+        } else if (!_imprint_next_read( _reads, read_1 )) {
+            throw NoMoreReadsAvailable( );
+        }
+
+        bool have_read_2 = _imprint_next_read( _reads, read_2 );
+        if (have_read_2 && is_read_pair( read_1, read_2 )) {
+            return true;
+        }
+
+        // read_1 is an orphan; read_2 may yet pair with the read after it.
+        if (have_read_2) {
+            _swap_reads( _next, read_2 );
+            _have_next = true;
+        }
+        read_2.reset( );
+        if (_mode == IParser:: PAIR_MODE_ERROR_ON_UNPAIRED) {
+            throw InvalidReadPair( "Unpaired reads found starting at " +
+                                   read_1.name );
+        }
+        if (_mode == IParser:: PAIR_MODE_ALLOW_UNPAIRED) {
+            return false;
+        }
+    }
+}
+
+
+void
+write_paired_reads(
+    PairedReadStream &pairs, FastxWriter &first, FastxWriter &second,
+    FastxWriter * orphans, uint64_t &n_pairs, uint64_t &n_orphans
 )
 {
-    return	(match_1.rm_so == match_2.rm_so)
-            &&	(match_1.rm_eo == match_2.rm_eo)
-            &&	(	the_read_pair.first.name.substr( 0, match_1.rm_so )
-                    ==	the_read_pair.second.name.substr( 0, match_1.rm_so ));
+    ReadPair the_read_pair;
+
+    n_pairs = 0;
+    n_orphans = 0;
+    try {
+        while (true) {
+            bool is_pair;
+            try {
+                is_pair = pairs.imprint_next_read_pair( the_read_pair );
+            } catch (NoMoreReadsAvailable &) {
+                break;
+            }
+            if (is_pair) {
+                first.write( the_read_pair.first );
+                second.write( the_read_pair.second );
+                n_pairs++;
+            } else {
+                if (orphans) {
+                    orphans->write( the_read_pair.first );
+                }
+                n_orphans++;
+            }
+        }
+    } catch (...) {
+        // what was read before the error is written, as in the scripts.
+        first.flush( );
+        second.flush( );
+        if (orphans) {
+            orphans->flush( );
+        }
+        throw;
+    }
+    first.flush( );
+    second.flush( );
+    if (orphans) {
+        orphans->flush( );
+    }
 }
 
+
 } // namespace read_parsers
 
 
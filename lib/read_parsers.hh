@@ -38,13 +38,17 @@ Contact: khmer-project@idyll.org
 #ifndef READ_PARSERS_HH
 #define READ_PARSERS_HH
 
-#include <regex.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <cstdlib>
+#include <atomic>
+#include <exception>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "khmer.hh"
 #include "khmer_exception.hh"
@@ -105,6 +109,42 @@ struct Read {
 
 typedef std:: pair< Read, Read >	ReadPair;
 
+// If 'name' marks read 'mate' ('1' or '2') of a pair, with "/1" or a Casava
+// 1.8 comment like " 1:N:0:ACGT" after at least one other character, the
+// end of the last such mark in it; otherwise 0. This is the end of the match
+// of "^.+(/1| 1:[YN]:[[:digit:]]+:[[:alpha:]]+)" in the C locale, found
+// without a regex or any allocation.
+size_t read_pair_name_end( const char * name, size_t length, char mate );
+
+inline size_t read_pair_name_end( const std:: string &name, char mate )
+{
+    return read_pair_name_end( name.data( ), name.length( ), mate );
+}
+
+// A read as spans of bytes that belong to the parser: its buffer, or a Read
+// of its own for a record that had to be pieced together. The spans are
+// not NUL-terminated. See IParser::imprint_next_read_view_batch for how
+// long they stay valid.
+struct ReadView {
+    const char *	name;
+    size_t		name_length;
+    const char *	sequence;
+    size_t		sequence_length;
+    const char *	quality;
+    size_t		quality_length;
+
+    ReadView( )
+        : name(NULL), name_length(0), sequence(NULL), sequence_length(0),
+          quality(NULL), quality_length(0) {}
+
+    explicit ReadView( const Read &read )
+        : name(read.name.data()), name_length(read.name.length()),
+          sequence(read.sequence.data()),
+          sequence_length(read.sequence.length()),
+          quality(read.quality.data()), quality_length(read.quality.length())
+    {}
+};
+
 struct IParser {
 
     enum {
@@ -117,6 +157,16 @@ struct IParser {
         std:: string const 	&ifile_name
     );
 
+    // Up to n_parsers parsers over disjoint byte ranges of one file, which
+    // between them read each of its records once, so that each can feed a
+    // thread of its own. Only plain FASTA files and FASTQ files with
+    // unwrapped records are split; other files get the one parser that
+    // get_parser would give.
+    static std:: vector< std:: unique_ptr< IParser > >  get_split_parsers(
+        std:: string const	&ifile_name,
+        unsigned int		n_parsers
+    );
+
     IParser( );
     virtual ~IParser( );
 
@@ -136,6 +186,24 @@ struct IParser {
     }
     virtual void	imprint_next_read( Read &the_read ) = 0;
 
+    // Fill the first reads of 'reads' (grown to n_reads if need be) with
+    // up to n_reads reads and return how many, or 0 once the parser is
+    // exhausted. The strings of a reused vector keep their storage.
+    // An error in the middle of a batch is thrown by the next call, so the
+    // reads before the bad one are still returned.
+    virtual size_t	imprint_next_read_batch(
+        std::vector< Read > &reads, size_t n_reads
+    );
+
+    // As imprint_next_read_batch, but the reads are views which stay valid
+    // only until the next call to any of the parser's imprint_ methods, so
+    // only a parser that one thread has to itself should hand them out.
+    // FastxParser points them into its buffer, copying only the records it
+    // cannot view there; the others copy each read once, into _view_reads.
+    virtual size_t	imprint_next_read_view_batch(
+        std::vector< ReadView > &views, size_t n_reads
+    );
+
     virtual void	imprint_next_read_pair(
         ReadPair &the_read_pair,
         uint8_t mode = PAIR_MODE_ERROR_ON_UNPAIRED
@@ -150,9 +218,10 @@ protected:
 
     size_t		_num_reads;
     bool        _have_qualities;
-    regex_t		_re_read_2_nosub;
-    regex_t		_re_read_1;
-    regex_t		_re_read_2;
+    // an error met partway through a batch, for the next call to throw.
+    std::exception_ptr	_pending_error;
+    // the reads that a batch of views points into, when not the buffer.
+    std::vector< Read >	_view_reads;
 
 #if (0)
     void		_imprint_next_read_pair_in_allow_mode(
@@ -167,7 +236,7 @@ protected:
         ReadPair &the_read_pair
     );
     bool		_is_valid_read_pair(
-        ReadPair &the_read_pair, regmatch_t &match_1, regmatch_t &match_2
+        ReadPair &the_read_pair, size_t end_1, size_t end_2
     );
 
 }; // struct IParser
@@ -181,14 +250,273 @@ public:
 
     bool is_complete( );
     void imprint_next_read(Read &the_read);
+    size_t imprint_next_read_batch(std::vector< Read > &reads, size_t n_reads);
 
 private:
     struct Handle;
 
     Handle* _private;
 
+    // read one record; the caller holds the lock. Returns a null pointer if
+    // a read was imprinted, or else the exception to throw once unlocked.
+    std::exception_ptr _read_record_locked(Read &the_read);
+
+};
+
+// Reads FASTA and FASTQ, plain, gzipped or bzip2ed, a large buffer at a
+// time, finding the ends of lines with memchr and filling the strings of the
+// caller's Read in place, so that reused Reads keep their storage. It reads
+// records the way SeqAnParser does: sequences and qualities may be wrapped
+// and lose their whitespace, and the '+' line of a FASTQ record is either
+// bare or repeats the name; blank lines between records are skipped.
+class FastxParser : public IParser
+{
+
+public:
+    // Compressed files are decompressed on a thread of their own, and BGZF
+    // files on n_threads threads, or one per CPU if it is 0.
+    explicit FastxParser( const char * filename,
+                          size_t buffer_size = DEFAULT_PARSER_BUFFER_SIZE,
+                          unsigned int n_threads = 0 );
+    ~FastxParser( );
+
+    // whether the (decompressed) file starts as FASTA or FASTQ does, or is
+    // empty; get_parser leaves other files to SeqAnParser.
+    static bool can_parse( const char * filename );
+
+    // as get_split_parsers, for the files that can_parse accepts.
+    static std::vector< std::unique_ptr< IParser > > open_split(
+        const char * filename, unsigned int n_parsers );
+
+    bool is_complete( );
+    void imprint_next_read(Read &the_read);
+    size_t imprint_next_read_batch(std::vector< Read > &reads, size_t n_reads);
+    size_t imprint_next_read_view_batch(std::vector< ReadView > &views,
+                                        size_t n_reads);
+
+private:
+    struct Source;
+
+    Source *	_source;
+    char *	_buffer;
+    size_t	_capacity;
+    // the unparsed bytes are [_start, _end) of _buffer, which starts at
+    // _offset in the file.
+    size_t	_start;
+    size_t	_end;
+    uint64_t	_offset;
+    // the records that start before _range_end in the file are ours.
+    uint64_t	_range_end;
+    bool	_at_eof;
+    bool	_failed;
+    bool	_fastq;
+    uint32_t	_lock;
+
+    // a parser over the records that start in [range_start, range_end) of
+    // a plain file that first found to be FASTA or FASTQ.
+    FastxParser( const FastxParser &first, uint64_t range_start,
+                 uint64_t range_end );
+
+    // read more of the file into the buffer, moving the unparsed bytes to
+    // its front and growing it if a line does not fit; false at the end.
+    bool _fill( );
+    // the next line, without its end, or false at the end of the file. The
+    // line stays valid until the next call.
+    bool _next_line( const char *&line, size_t &length, bool &terminated );
+    // the first byte of the next line, or EOF.
+    int _peek( );
+    void _skip_blank_lines( );
+    // whether the records left are past the end of our range, or the file.
+    bool _at_range_end( );
+    // the ends of the next n_lines lines, as offsets from _start past
+    // their line breaks, or false if the file ends first. The lines stay in
+    // the buffer.
+    bool _peek_lines( size_t n_lines, size_t * ends );
+    // whether the next lines are a FASTQ record of four lines.
+    bool _at_unwrapped_fastq_record( );
+    // skip to the first record that starts at or after the first line
+    // break from _start.
+    void _resync( );
+
+    // as in SeqAnParser; the caller holds the lock.
+    std::exception_ptr _read_record_locked(Read &the_read);
+    void _read_record(Read &the_read);
+    // view the next record where it is in the buffer, without reading any
+    // more of the file, if it is whole there and unwrapped and needs no
+    // blanks taken out. Otherwise, or at the end of our records, it is left
+    // to _read_record, and this returns false.
+    bool _view_record(ReadView &view);
+
+};
+
+// Hands out the reads of a parser one at a time, fetching them a batch at
+// a time with imprint_next_read_batch, for loops which used to call
+// get_next_read for each read. Several threads may share the parser, each
+// with its own BatchedReads.
+class BatchedReads
+{
+protected:
+    IParser *		_parser;
+    std::vector< Read >	_reads;
+    size_t		_batch_size;
+    size_t		_n_reads;
+    size_t		_next;
+
+public:
+    explicit BatchedReads(IParser * parser,
+                          size_t batch_size = DEFAULT_READ_BATCH_SIZE)
+        : _parser(parser), _batch_size(batch_size), _n_reads(0), _next(0) {}
+
+    // the next read, or NULL once the parser is exhausted. The read may be
+    // modified, and stays valid until the next call.
+    Read * next()
+    {
+        if (_next == _n_reads) {
+            _n_reads = _parser->imprint_next_read_batch(_reads, _batch_size);
+            _next = 0;
+            if (!_n_reads) {
+                return NULL;
+            }
+        }
+        return &_reads[_next++];
+    }
+};
+
+// Whether two reads are the left and right reads of one fragment, by the
+// names check_is_pair in khmer/utils.py pairs: "name/1" and "name/2",
+// "name 1:..." and "name 2:...", or "name seq/1" and "name seq/2". Throws
+// InvalidReadPair if one read is FASTQ and the other FASTA.
+bool is_read_pair( const Read &first, const Read &second );
+
+// Whether a name marks a left (or right) read, as check_is_left (or
+// check_is_right) in khmer/utils.py has it.
+bool is_left_read_name( const std:: string &name );
+bool is_right_read_name( const std:: string &name );
+
+// Collects reads as FASTA records, or FASTQ records if they have qualities,
+// and hands them to write(data, length, write_data) a buffer at a time.
+// Call flush() once done; the destructor does not, as write may throw.
+class FastxWriter
+{
+public:
+    typedef void (*WriteFn)( const char * data, size_t length,
+                             void * write_data );
+
+    FastxWriter( WriteFn write, void * write_data,
+                 size_t buffer_size = DEFAULT_WRITER_BUFFER_SIZE );
+
+    void write( const Read &read );
+    void flush( );
+
+protected:
+    WriteFn		_write;
+    void *		_write_data;
+    std:: vector< char >	_buffer;
+    size_t		_fill;
+
+    void _append( const char * data, size_t length );
 };
 
+// The pairs of reads of an interleaved parser, and the reads left over
+// (orphans), as broken_paired_reader in khmer/utils.py finds them: a read
+// makes a pair with the one after it if is_read_pair says so. In
+// PAIR_MODE_ALLOW_UNPAIRED orphans are handed out alone, in
+// PAIR_MODE_IGNORE_UNPAIRED they are skipped, and in
+// PAIR_MODE_ERROR_ON_UNPAIRED the first one throws InvalidReadPair.
+class PairedReadStream
+{
+public:
+    explicit PairedReadStream(
+        IParser * parser, uint8_t mode = IParser::PAIR_MODE_ALLOW_UNPAIRED
+    );
+
+    // Each read of 'left' paired with the read of 'right' in the same place,
+    // as interleave-reads.py pairs them. If 'reformat', names not marked as
+    // left or right get "/1" or "/2", and names which then do not make a
+    // pair throw InvalidReadPair. So does one parser running out of reads
+    // before the other.
+    PairedReadStream( IParser * left, IParser * right, bool reformat = true );
+
+    // Fill the_read_pair with the next pair and return true, or put the
+    // next orphan in its first read and return false. Throws
+    // NoMoreReadsAvailable once the reads run out.
+    bool imprint_next_read_pair( ReadPair &the_read_pair );
+
+protected:
+    BatchedReads	_reads;
+    BatchedReads	_right_reads;
+    bool		_two_files;
+    uint8_t		_mode;
+    bool		_reformat;
+    // the read after an orphan, still to be paired.
+    Read		_next;
+    bool		_have_next;
+
+    bool _imprint_next_read( BatchedReads &reads, Read &the_read );
+    bool _imprint_next_two_file_pair( ReadPair &the_read_pair );
+};
+
+// Write each pair of 'pairs' to 'first' and 'second', which may be the same
+// writer for interleaved output, and each orphan to 'orphans' unless it is
+// NULL, counting them in n_pairs and n_orphans. The writers are flushed
+// even when reading the pairs throws.
+void write_paired_reads(
+    PairedReadStream &pairs, FastxWriter &first, FastxWriter &second,
+    FastxWriter * orphans, uint64_t &n_pairs, uint64_t &n_orphans
+);
+
+// Call fn(view, i) for each read of each parser i, as a ReadView, on a
+// thread per parser (or the calling thread, if there is just one), as with
+// the parsers of get_split_parsers, which no other thread may be using.
+// The first exception stops the other threads at their next read, and is
+// rethrown once they are done.
+template<typename F>
+void for_each_read_split(
+    std::vector< std::unique_ptr< IParser > > const &parsers, F fn)
+{
+    std::exception_ptr error;
+    uint32_t error_spin_lock = 0;
+    std::atomic<bool> failed(false);
+
+    auto run = [&](size_t i) {
+        try {
+            std::vector< ReadView > views;
+            size_t n;
+            while (!failed.load(std::memory_order_relaxed) &&
+                    (n = parsers[i]->imprint_next_read_view_batch(
+                             views, DEFAULT_READ_BATCH_SIZE))) {
+                for (size_t j = 0;
+                        j < n && !failed.load(std::memory_order_relaxed); j++) {
+                    fn(views[j], i);
+                }
+            }
+        } catch (...) {
+            while (!__sync_bool_compare_and_swap(&error_spin_lock, 0, 1));
+            if (!error) {
+                error = std::current_exception();
+            }
+            failed.store(true);
+            __sync_lock_release(&error_spin_lock);
+        }
+    };
+
+    if (parsers.size() == 1) {
+        run(0);
+    } else {
+        std::vector< std::thread > threads;
+        for (size_t i = 0; i < parsers.size(); i++) {
+            threads.push_back(std::thread(run, i));
+        }
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
 inline PartitionID _parse_partition_id(std::string name)
 {
     PartitionID p = 0;
@@ -40,9 +40,13 @@ Contact: khmer-project@idyll.org
 #include <string.h>
 #include <iostream>
 #include <sstream> // IWYU pragma: keep
+#include <algorithm>
+#include <exception>
 #include <map>
 #include <set>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "counting.hh"
 #include "hashtable.hh"
@@ -50,6 +54,7 @@ Contact: khmer-project@idyll.org
 #include "kmer_hash.hh"
 #include "read_parsers.hh"
 #include "subset.hh"
+#include "traversal.hh"
 
 #define IO_BUF_SIZE 250*1000*1000
 #define BIG_TRAVERSALS_ARE 200
@@ -100,12 +105,13 @@ void SubsetPartition::count_partitions(
     // go through all the tagged kmers and count partitions/orphan.
     //
 
-    for (SeenSet::iterator ti = _ht->all_tags.begin();
+    for (ConcurrentTagSet::const_iterator ti = _ht->all_tags.begin();
             ti != _ht->all_tags.end(); ++ti) {
-        PartitionID * partition_p = partition_map[*ti];
-        if (partition_p) {
-            partitions.insert(*partition_p);
+        PartitionID partition_id = _tag_partition(*ti);
+        if (partition_id) {
+            partitions.insert(partition_id);
         } else {
+            partition_map.insert_unassigned(*ti);
             n_unassigned++;
         }
     }
@@ -129,7 +135,6 @@ size_t SubsetPartition::output_partitioned_file(
 
     PartitionSet partitions;
 
-    Read read;
     string seq;
 
     HashIntoType kmer = 0;
@@ -141,12 +146,10 @@ size_t SubsetPartition::output_partitioned_file(
     // and output them.
     //
 
-    while(!parser->is_complete()) {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
 
         seq = read.sequence;
 
@@ -158,7 +161,7 @@ size_t SubsetPartition::output_partitioned_file(
                 kmer = _hash(kmer_s + i, ksize);
 
                 // is this a known tag?
-                if (set_contains(partition_map, kmer)) {
+                if (partition_map.contains(kmer)) {
                     found_tag = true;
                     break;
                 }
@@ -170,12 +173,10 @@ size_t SubsetPartition::output_partitioned_file(
 
             PartitionID partition_id = 0;
             if (found_tag) {
-                PartitionID * partition_p = partition_map[kmer];
-                if (partition_p == NULL ) {
-                    partition_id = 0;
+                partition_id = _tag_partition(kmer);
+                if (partition_id == 0) {
                     n_singletons++;
                 } else {
-                    partition_id = *partition_p;
                     partitions.insert(partition_id);
                 }
             }
@@ -234,7 +235,6 @@ unsigned int SubsetPartition::find_unpart(
     unsigned int reads_kept = 0;
     unsigned int n_singletons = 0;
 
-    Read read;
     string seq;
 
     SeenSet tags_todo;
@@ -250,12 +250,10 @@ unsigned int SubsetPartition::find_unpart(
     // the former is exact, the latter is inexact but way faster :)
     //
 
-    while(!parser->is_complete()) {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    BatchedReads batched_reads(parser);
+    Read * next_read;
+    while ((next_read = batched_reads.next()) != NULL) {
+        Read &read = *next_read;
         seq = read.sequence;
 
         if (_ht->check_and_normalize_read(seq)) {
@@ -268,11 +266,7 @@ unsigned int SubsetPartition::find_unpart(
 
             for (SeenSet::iterator si = found_tags.begin();
                     si != found_tags.end(); ++si) {
-                PartitionMap::iterator pi = partition_map.find(*si);
-                PartitionID partition_id = 0;
-                if (pi != partition_map.end() && pi->second != NULL) {
-                    partition_id = *(pi->second);
-                }
+                PartitionID partition_id = _tag_partition(*si);
                 if (partition_id == 0) {
                     found_zero = true;
                 } else {
@@ -332,6 +326,7 @@ unsigned int SubsetPartition::find_unpart(
 
         unsigned int n = 0;
         SeenSet tagged_kmers;
+        TraversalContext context;
         for (SeenSet::iterator si = tags_todo.begin(); si != tags_todo.end();
                 ++si) {
             n += 1;
@@ -341,7 +336,7 @@ unsigned int SubsetPartition::find_unpart(
             // find all tagged kmers within range.
             tagged_kmers.clear();
             find_all_tags(kmer, tagged_kmers, _ht->all_tags,
-                          true, stop_big_traversals);
+                          true, stop_big_traversals, context);
 
             // std::cout << "found " << tagged_kmers.size() << "\n";
 
@@ -369,45 +364,51 @@ unsigned int SubsetPartition::find_unpart(
 void SubsetPartition::find_all_tags(
     Kmer start_kmer,
     SeenSet&		tagged_kmers,
-    const SeenSet&	all_tags,
+    const ConcurrentTagSet&	all_tags,
     bool		break_on_stop_tags,
     bool		stop_big_traversals)
 {
+    TraversalContext context;
+    find_all_tags(start_kmer, tagged_kmers, all_tags, break_on_stop_tags,
+                  stop_big_traversals, context);
+}
+
+void SubsetPartition::find_all_tags(
+    Kmer start_kmer,
+    SeenSet&		tagged_kmers,
+    const ConcurrentTagSet&	all_tags,
+    bool		break_on_stop_tags,
+    bool		stop_big_traversals,
+    TraversalContext&	context)
+{
 
     bool first = true;
-    KmerQueue node_q;
-    std::queue<unsigned int> breadth_q;
 
-    unsigned int cur_breadth = 0;
     const unsigned int max_breadth = (2 * _ht->_tag_density) + 1;
 
     unsigned int total = 0;
-    unsigned int nfound = 0;
 
     Traverser traverser(_ht);
-    KmerSet keeper;		// keep track of traversed kmers
 
     auto filter = [&] (Kmer& n) -> bool {
-        return !set_contains(keeper, n);
+        return !context.visited(n);
     };
 
-    node_q.push(start_kmer);
-    breadth_q.push(0);
+    context.reset();
+    context.push(start_kmer, 0);
 
-    while(!node_q.empty()) {
+    while(!context.frontier_empty()) {
 
-        if (stop_big_traversals && keeper.size() > BIG_TRAVERSALS_ARE) {
+        if (stop_big_traversals && context.n_visited() > BIG_TRAVERSALS_ARE) {
             tagged_kmers.clear();
             break;
         }
 
-        Kmer node = node_q.front();
-        node_q.pop();
-
-        unsigned int breadth = breadth_q.front();
-        breadth_q.pop();
+        TraversalContext::Entry entry = context.pop();
+        Kmer& node = entry.kmer;
+        unsigned int breadth = entry.breadth;
 
-        if (set_contains(keeper, node)) {
+        if (context.visited(node)) {
             continue;
         }
 
@@ -416,7 +417,7 @@ void SubsetPartition::find_all_tags(
         }
 
         // keep track of seen kmers
-        keeper.insert(node);
+        context.visit(node);
         total++;
 
         // Is this a kmer-to-tag, and have we put this tag in a partition
@@ -427,30 +428,11 @@ void SubsetPartition::find_all_tags(
             continue;
         }
 
-        if (!(breadth >= cur_breadth)) { // keep track of watermark, for
-            // debugging
-            throw khmer_exception("Desynchonization between traversal "
-                                  "and breadth tracking. Did you forget "
-                                  "to pop the node or breadth queue?");
-        }
-        if (breadth > cur_breadth) {
-            cur_breadth = breadth;
-        }
-
         if (breadth >= max_breadth) {
             continue;    // truncate search @CTB exit?
         }
 
-        nfound = traverser.traverse_right(node, node_q, filter);
-        for (unsigned int i = 0; i<nfound; ++i) {
-            breadth_q.push(breadth + 1);
-        }
-
-        nfound = traverser.traverse_left(node, node_q, filter);
-        for (unsigned int i = 0; i<nfound; ++i) {
-            breadth_q.push(breadth + 1);
-        }
-
+        traverser.traverse(node, context, breadth + 1, filter);
 
         first = false;
     }
@@ -463,59 +445,69 @@ void SubsetPartition::find_all_tags(
 unsigned int SubsetPartition::sweep_for_tags(
     const std::string&	seq,
     SeenSet&		tagged_kmers,
-    const SeenSet&	all_tags,
+    const ConcurrentTagSet&	all_tags,
     unsigned int	range,
     bool		break_on_stop_tags,
     bool		stop_big_traversals)
 {
+    TraversalContext context;
+    return sweep_for_tags(seq, tagged_kmers, all_tags, range,
+                          break_on_stop_tags, stop_big_traversals, context);
+}
+
+unsigned int SubsetPartition::sweep_for_tags(
+    const std::string&	seq,
+    SeenSet&		tagged_kmers,
+    const ConcurrentTagSet&	all_tags,
+    unsigned int	range,
+    bool		break_on_stop_tags,
+    bool		stop_big_traversals,
+    TraversalContext&	context)
+{
 
     Traverser traverser(_ht);
-    KmerSet traversed_nodes;
-    KmerQueue node_q;
-    std::queue<unsigned int> breadth_q;
 
     unsigned int max_breadth = range;
     unsigned int total = 0;
-    unsigned int nfound = 0;
+    size_t n_queued = 0;
 
     auto filter = [&] (Kmer& n) -> bool {
-        return !set_contains(traversed_nodes, n);
+        return !context.visited(n);
     };
 
     // Queue up all the sequence's k-mers at breadth zero
     // We are searching around the perimeter of the known k-mers
+    context.reset();
     KmerIterator kmers(seq.c_str(), _ht->ksize());
     while (!kmers.done()) {
         Kmer node = kmers.next();
-        traversed_nodes.insert(node);
+        context.visit(node);
 
-        node_q.push(node);
-        breadth_q.push(0);
+        context.push(node, 0);
+        n_queued++;
     }
 
-    size_t seq_length = node_q.size() / 2;
+    size_t seq_length = n_queued / 2;
     size_t BIG_PERIMETER_TRAVERSALS = BIG_TRAVERSALS_ARE * seq_length;
 
-    while(!node_q.empty()) {
+    while(!context.frontier_empty()) {
         // change this to a better hueristic
-        if (stop_big_traversals && traversed_nodes.size() >
+        if (stop_big_traversals && context.n_visited() >
                 BIG_PERIMETER_TRAVERSALS) {
             tagged_kmers.clear();
             break;
         }
 
-        Kmer node = node_q.front();
-        node_q.pop();
-
-        unsigned int breadth = breadth_q.front();
-        breadth_q.pop();
+        TraversalContext::Entry entry = context.pop();
+        Kmer& node = entry.kmer;
+        unsigned int breadth = entry.breadth;
 
         // Do we want to traverse through this k-mer?  If not, skip.
         if (break_on_stop_tags && set_contains(_ht->stop_tags, node)) {
             continue;
         }
 
-        traversed_nodes.insert(node);
+        context.visit(node);
         total++;
 
         if (set_contains(all_tags, node)) {
@@ -537,15 +529,7 @@ unsigned int SubsetPartition::sweep_for_tags(
             return total;
         }
 
-        nfound = traverser.traverse_right(node, node_q, filter);
-        for (unsigned int i = 0; i<nfound; ++i) {
-            breadth_q.push(breadth + 1);
-        }
-
-        nfound = traverser.traverse_left(node, node_q, filter);
-        for (unsigned int i = 0; i<nfound; ++i) {
-            breadth_q.push(breadth + 1);
-        }
+        traverser.traverse(node, context, breadth + 1, filter);
     }
 
     return total;
@@ -557,48 +541,58 @@ unsigned int SubsetPartition::sweep_for_tags(
 void SubsetPartition::find_all_tags_truncate_on_abundance(
     Kmer start_kmer,
     SeenSet&		tagged_kmers,
-    const SeenSet&	all_tags,
+    const ConcurrentTagSet&	all_tags,
     BoundedCounterType	min_count,
     BoundedCounterType	max_count,
     bool		break_on_stop_tags,
     bool		stop_big_traversals)
 {
+    TraversalContext context;
+    find_all_tags_truncate_on_abundance(start_kmer, tagged_kmers, all_tags,
+                                        min_count, max_count,
+                                        break_on_stop_tags,
+                                        stop_big_traversals, context);
+}
+
+void SubsetPartition::find_all_tags_truncate_on_abundance(
+    Kmer start_kmer,
+    SeenSet&		tagged_kmers,
+    const ConcurrentTagSet&	all_tags,
+    BoundedCounterType	min_count,
+    BoundedCounterType	max_count,
+    bool		break_on_stop_tags,
+    bool		stop_big_traversals,
+    TraversalContext&	context)
+{
 
     bool first = true;
-    KmerQueue node_q;
-    std::queue<unsigned int> breadth_q;
 
-    unsigned int cur_breadth = 0;
     const unsigned int max_breadth = (2 * _ht->_tag_density) + 1;
 
     unsigned int total = 0;
-    unsigned int nfound = 0;
 
     Traverser traverser(_ht);
-    KmerSet keeper;		// keep track of traversed kmers
 
     auto filter = [&] (Kmer& n) -> bool {
-        return !set_contains(keeper, n);
+        return !context.visited(n);
     };
 
-    node_q.push(start_kmer);
-    breadth_q.push(0);
+    context.reset();
+    context.push(start_kmer, 0);
 
-    while(!node_q.empty()) {
-        if (stop_big_traversals && keeper.size() > BIG_TRAVERSALS_ARE) {
+    while(!context.frontier_empty()) {
+        if (stop_big_traversals && context.n_visited() > BIG_TRAVERSALS_ARE) {
             tagged_kmers.clear();
             break;
         }
 
-        Kmer node = node_q.front();
-        node_q.pop();
-
-        unsigned int breadth = breadth_q.front();
-        breadth_q.pop();
+        TraversalContext::Entry entry = context.pop();
+        Kmer& node = entry.kmer;
+        unsigned int breadth = entry.breadth;
 
         // Have we already seen this k-mer?  If so, skip.
         // NOTE: redundant, move this to before while loop
-        if (set_contains(keeper, node)) {
+        if (context.visited(node)) {
             continue;
         }
 
@@ -614,7 +608,7 @@ void SubsetPartition::find_all_tags_truncate_on_abundance(
         }
 
         // keep track of seen kmers
-        keeper.insert(node);
+        context.visit(node);
         total++;
 
         // Is this a kmer-to-tag, and have we put this tag in a partition
@@ -625,30 +619,11 @@ void SubsetPartition::find_all_tags_truncate_on_abundance(
             continue;
         }
 
-        // @cswelcher Do these lines actually do anything?
-        if (!(breadth >= cur_breadth)) { // keep track of watermark, for
-            // debugging.
-            throw khmer_exception("Desynchonization between traversal "
-                                  "and breadth tracking. Did you forget "
-                                  "to pop the node or breadth queue?");
-        }
-        if (breadth > cur_breadth) {
-            cur_breadth = breadth;
-        }
-
         if (breadth >= max_breadth) {
             continue;    // truncate search @CTB exit?
         }
 
-        nfound = traverser.traverse_right(node, node_q, filter);
-        for (unsigned int i = 0; i<nfound; ++i) {
-            breadth_q.push(breadth + 1);
-        }
-
-        nfound = traverser.traverse_left(node, node_q, filter);
-        for (unsigned int i = 0; i<nfound; ++i) {
-            breadth_q.push(breadth + 1);
-        }
+        traverser.traverse(node, context, breadth + 1, filter);
 
         first = false;
     }
@@ -667,7 +642,8 @@ void SubsetPartition::do_partition(
     unsigned int total_reads = 0;
 
     SeenSet tagged_kmers;
-    SeenSet::const_iterator si, end;
+    TraversalContext context;
+    ConcurrentTagSet::const_iterator si, end;
 
     if (first_kmer) {
         si = _ht->all_tags.find(first_kmer);
@@ -688,7 +664,7 @@ void SubsetPartition::do_partition(
         // find all tagged kmers within range.
         tagged_kmers.clear();
         find_all_tags(kmer, tagged_kmers, _ht->all_tags,
-                      break_on_stop_tags, stop_big_traversals);
+                      break_on_stop_tags, stop_big_traversals, context);
 
         // assign the partition ID
         assign_partition_id(kmer, tagged_kmers);
@@ -710,6 +686,120 @@ void SubsetPartition::do_partition(
     }
 }
 
+// the number of tags a thread of do_partition_parallel takes at a time.
+const size_t PARTITION_CHUNK_SIZE = 256;
+
+// do_partition visits the tags in order. A tag reached from another tag
+// joins that tag's partition, but on its own visit the tag is moved to the
+// partition of the tags it reaches (if it reaches none, it loses its
+// partition), which leaves its old partition behind. So that the order of
+// the traversals doesn't matter, each tag has two nodes in the union-find:
+// tag i itself is node i, and n_tags + i stands for it as reached from a
+// tag before it.
+
+void SubsetPartition::do_partition_parallel(
+    unsigned int	n_threads,
+    bool		break_on_stop_tags,
+    bool		stop_big_traversals)
+{
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+
+    // the frozen tags; a tag is known by its index here.
+    const std::vector<HashIntoType>& tags = _ht->all_tags.sorted();
+    const size_t n_tags = tags.size();
+    if (!n_tags) {
+        return;
+    }
+    ConcurrentUnionFind joined(2 * n_tags);
+
+    size_t next_chunk = 0;
+
+    // the first exception in any thread stops the others, and is rethrown
+    // here once they are done.
+    std::exception_ptr error;
+    uint32_t error_spin_lock = 0;
+    volatile bool failed = false;
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < n_threads; t++) {
+        workers.push_back(std::thread([&]() {
+            SeenSet tagged_kmers;
+            TraversalContext context;
+            try {
+                while (!failed) {
+                    size_t start = __sync_fetch_and_add(&next_chunk,
+                                                        PARTITION_CHUNK_SIZE);
+                    if (start >= n_tags) {
+                        break;
+                    }
+                    size_t end = std::min(start + PARTITION_CHUNK_SIZE, n_tags);
+
+                    for (size_t i = start; i < end; i++) {
+                        tagged_kmers.clear();
+                        find_all_tags(_ht->build_kmer(tags[i]), tagged_kmers,
+                                      _ht->all_tags, break_on_stop_tags,
+                                      stop_big_traversals, context);
+
+                        SeenSet::const_iterator si = tagged_kmers.begin();
+                        for (; si != tagged_kmers.end(); ++si) {
+                            size_t j = std::lower_bound(tags.begin(),
+                                                        tags.end(), *si) -
+                                       tags.begin();
+                            joined.unite(i, i < j ? n_tags + j : j);
+                        }
+                    }
+                }
+            } catch (...) {
+                while (!__sync_bool_compare_and_swap(&error_spin_lock, 0, 1));
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+                __sync_lock_release(&error_spin_lock);
+            }
+        }));
+    }
+    for (unsigned int t = 0; t < n_threads; t++) {
+        workers[t].join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    // a tag which reached no other tag, and which no later tag reached, is
+    // left without a partition.
+    std::vector<uint32_t> n_members(2 * n_tags, 0);
+    for (size_t i = 0; i < 2 * n_tags; i++) {
+        n_members[joined.find(i)]++;
+    }
+
+    std::vector<PartitionNode> root_nodes(2 * n_tags,
+                                          PartitionTagMap::NO_PARTITION);
+    for (size_t i = 0; i < n_tags; i++) {
+        size_t root = joined.find(i);
+        if (n_members[root] < 2) {
+            continue;
+        }
+        if (root_nodes[root] == PartitionTagMap::NO_PARTITION) {
+            root_nodes[root] = get_new_partition();
+        }
+
+        // join any partition the tag is in already.
+        PartitionNode node;
+        if (partition_map.find(tags[i], node) &&
+                node != PartitionTagMap::NO_PARTITION) {
+            if (partition_forest.find(node) !=
+                    partition_forest.find(root_nodes[root])) {
+                _merge_two_partitions(root_nodes[root], node);
+            }
+        } else {
+            partition_map.set(tags[i], root_nodes[root]);
+        }
+    }
+}
+
 void SubsetPartition::do_partition_with_abundance(
     HashIntoType	first_kmer,
     HashIntoType	last_kmer,
@@ -723,7 +813,8 @@ void SubsetPartition::do_partition_with_abundance(
     unsigned int total_reads = 0;
 
     SeenSet tagged_kmers;
-    SeenSet::const_iterator si, end;
+    TraversalContext context;
+    ConcurrentTagSet::const_iterator si, end;
 
     if (first_kmer) {
         si = _ht->all_tags.find(first_kmer);
@@ -746,7 +837,7 @@ void SubsetPartition::do_partition_with_abundance(
         find_all_tags_truncate_on_abundance(kmer, tagged_kmers,
                                             _ht->all_tags, min_count,
                                             max_count, break_on_stop_tags,
-                                            stop_big_traversals);
+                                            stop_big_traversals, context);
 
         // assign the partition ID
         assign_partition_id(kmer, tagged_kmers);
@@ -788,17 +879,15 @@ void SubsetPartition::set_partition_id(
     HashIntoType	kmer,
     PartitionID		p)
 {
-    PartitionPtrSet * s = reverse_pmap[p];
-    PartitionID * pp = NULL;
-    if (s == NULL) {
-        s = new PartitionPtrSet();
-        pp = new unsigned int(p);
-        s->insert(pp);
-        reverse_pmap[p] = s;
+    ReversePartitionMap::const_iterator ri = reverse_pmap.find(p);
+    PartitionNode node;
+    if (ri == reverse_pmap.end()) {
+        node = partition_forest.add(p);
+        reverse_pmap[p] = node;
     } else {
-        pp = *(s->begin());
+        node = ri->second;
     }
-    partition_map[kmer] = pp;
+    partition_map.set(kmer, node);
 
     if (next_partition_id <= p) {
         next_partition_id = p + 1;
@@ -814,8 +903,8 @@ PartitionID SubsetPartition::assign_partition_id(
 
     // did we find a tagged kmer?
     if (!tagged_kmers.empty()) {
-        PartitionID * pp = _join_partitions_by_tags(tagged_kmers, kmer);
-        return_val = *pp;
+        PartitionNode node = _join_partitions_by_tags(tagged_kmers, kmer);
+        return_val = partition_forest.id(node);
     } else {
         partition_map.erase(kmer);
         return_val = 0;
@@ -828,93 +917,75 @@ PartitionID SubsetPartition::assign_partition_id(
 // partition, creating or reassigning partitions as necessary.  Low level
 // function!
 
-PartitionID * SubsetPartition::_join_partitions_by_tags(
+PartitionNode SubsetPartition::_join_partitions_by_tags(
     const SeenSet&	tagged_kmers,
     const HashIntoType	kmer)
 {
     SeenSet::const_iterator it = tagged_kmers.begin();
-    unsigned int * this_partition_p = NULL;
+    PartitionNode this_node = PartitionTagMap::NO_PARTITION;
 
     // find first assigned partition ID in tagged set
     while (it != tagged_kmers.end()) {
-        this_partition_p = partition_map[*it];
-        if (this_partition_p != NULL) {
+        PartitionNode node;
+        if (partition_map.find(*it, node) &&
+                node != PartitionTagMap::NO_PARTITION) {
+            this_node = node;
             break;
         }
         ++it;
     }
 
     // no partition ID? allocate new!
-    if (this_partition_p == NULL) {
-        this_partition_p = new PartitionID(next_partition_id);
-        next_partition_id++;
-
-        PartitionPtrSet * s = new PartitionPtrSet();
-        s->insert(this_partition_p);
-        reverse_pmap[*this_partition_p] = s;
+    if (this_node == PartitionTagMap::NO_PARTITION) {
+        this_node = get_new_partition();
     }
 
     // reassign all partitions individually.
     it = tagged_kmers.begin();
     for (; it != tagged_kmers.end(); ++it) {
-        PartitionMap::iterator pi = partition_map.find(*it);
-
-        if (pi == partition_map.end()) { // no entry? insert.
-            partition_map[*it] = this_partition_p;
-        } else {
-            PartitionID * pp_id = pi->second;
+        PartitionNode node;
 
-            if (pp_id == NULL) {	// entry is null? set;
-                pi->second = this_partition_p;
-            } else if (*pp_id != *this_partition_p) {
-                // != entry? join partitions.
-                _merge_two_partitions(this_partition_p, pp_id);
-            }
+        if (!partition_map.find(*it, node) ||
+                node == PartitionTagMap::NO_PARTITION) {
+            // no partition yet? set.
+            partition_map.set(*it, this_node);
+        } else if (partition_forest.find(node) !=
+                   partition_forest.find(this_node)) {
+            // another partition? join partitions.
+            _merge_two_partitions(this_node, node);
         }
     }
 
-    partition_map[kmer] = this_partition_p;
+    partition_map.set(kmer, this_node);
 
-    return this_partition_p;
+    return this_node;
 }
 
-// _merge_two_partitions merges the 'merge_pp' partition into the
-// 'the_pp' partition.  It does this by joining the reverse pointer
-// map structures for two partitions and resetting each partition
-// pointer individually.
+// _merge_two_partitions merges the 'merge_node' partition into the
+// 'the_node' partition, or the other way around if 'merge_node' has been
+// through more merges, and returns the root of the joined partition,
+// which keeps its ID.
 
-PartitionID * SubsetPartition::_merge_two_partitions(
-    PartitionID *the_pp,
-    PartitionID *merge_pp)
+PartitionNode SubsetPartition::_merge_two_partitions(
+    PartitionNode the_node,
+    PartitionNode merge_node)
 {
-    PartitionPtrSet * s = reverse_pmap[*the_pp];
-    PartitionPtrSet * t = reverse_pmap[*merge_pp];
-
-    // Choose the smaller of two sets to loop over.
-    if (s->size() < t->size()) {
-        PartitionPtrSet * tmp = s;
-        s = t;
-        t = tmp;
-        PartitionID * tmp2 = the_pp;
-        the_pp = merge_pp;
-        merge_pp = tmp2;
+    const PartitionID the_id = partition_forest.id(the_node);
+    const PartitionID merge_id = partition_forest.id(merge_node);
+    if (partition_forest.find(the_node) == partition_forest.find(merge_node)) {
+        return partition_forest.find(the_node);
     }
 
-    // Get rid of the reverse pointer for the old partition.
-    reverse_pmap.erase(*merge_pp);
-
-    // Merge all of the elements in the to-be-replaced PartitionPtrSet
-    // into the merged partition.
-    for (PartitionPtrSet::iterator pi = t->begin(); pi != t->end(); ++pi) {
-        PartitionID * iter_pp;
-        iter_pp = *pi;
+    PartitionNode root = partition_forest.unite(the_node, merge_node);
 
-        *iter_pp = *the_pp;	// reset the partition ID to the new one.
-        s->insert(iter_pp);
+    // Get rid of the reverse entry for the ID which went away.
+    if (partition_forest.id(root) == the_id) {
+        reverse_pmap.erase(merge_id);
+    } else {
+        reverse_pmap.erase(the_id);
     }
-    delete t;
 
-    return the_pp;
+    return root;
 }
 
 PartitionID SubsetPartition::join_partitions(
@@ -928,17 +999,13 @@ PartitionID SubsetPartition::join_partitions(
         return 0;
     }
 
-    if (reverse_pmap.find(orig) == reverse_pmap.end() ||
-            reverse_pmap.find(join) == reverse_pmap.end() ||
-            reverse_pmap[orig] == NULL ||
-            reverse_pmap[join] == NULL) {
+    ReversePartitionMap::const_iterator orig_ri = reverse_pmap.find(orig);
+    ReversePartitionMap::const_iterator join_ri = reverse_pmap.find(join);
+    if (orig_ri == reverse_pmap.end() || join_ri == reverse_pmap.end()) {
         return 0;
     }
 
-    PartitionID * orig_pp = *(reverse_pmap[orig]->begin());
-    PartitionID * join_pp = *(reverse_pmap[join]->begin());
-
-    _merge_two_partitions(orig_pp, join_pp);
+    _merge_two_partitions(orig_ri->second, join_ri->second);
 
     return orig;
 }
@@ -956,14 +1023,7 @@ PartitionID SubsetPartition::get_partition_id(std::string kmer_s)
 
 PartitionID SubsetPartition::get_partition_id(HashIntoType kmer)
 {
-    if (partition_map.find(kmer) != partition_map.end()) {
-        PartitionID * pp = partition_map[kmer];
-        if (pp == NULL) {
-            return 0;
-        }
-        return *pp;
-    }
-    return 0;
+    return _tag_partition(kmer);
 }
 
 void SubsetPartition::merge(SubsetPartition * other)
@@ -972,12 +1032,15 @@ void SubsetPartition::merge(SubsetPartition * other)
         return;
     }
 
-    PartitionPtrMap other_to_this;
+    PartitionNodeMap other_to_this;
 
-    PartitionMap::const_iterator pi = other->partition_map.begin();
-    for (; pi != other->partition_map.end(); ++pi) {
-        if (pi->second) {
-            _merge_other(pi->first, *(pi->second), other_to_this);
+    // in order of tag, as the partitions of a saved subset come.
+    std::vector<HashIntoType> tags;
+    other->partition_map.get_sorted_tags(tags);
+    for (size_t i = 0; i < tags.size(); i++) {
+        PartitionID other_partition = other->_tag_partition(tags[i]);
+        if (other_partition) {
+            _merge_other(tags[i], other_partition, other_to_this);
         }
     }
 }
@@ -988,49 +1051,43 @@ void SubsetPartition::merge(SubsetPartition * other)
 void SubsetPartition::_merge_other(
     HashIntoType	tag,
     PartitionID		other_partition,
-    PartitionPtrMap&	diskp_to_pp)
+    PartitionNodeMap&	diskp_to_node)
 {
     if (set_contains(_ht->stop_tags, tag)) { // don't merge if it's a stop_tag
         return;
     }
 
     // OK.  Does our current partitionmap have this?
-    PartitionID * pp_0;
-    pp_0 = partition_map[tag];
-
-    if (pp_0 == NULL) {	// No!  OK, map to new 'un.
-        PartitionID * existing_pp_0 = diskp_to_pp[other_partition];
-
-        if (existing_pp_0) {	// already seen this other_partition
-            partition_map[tag] = existing_pp_0;
+    PartitionNode node_0;
+    bool have_tag = partition_map.find(tag, node_0) &&
+                    node_0 != PartitionTagMap::NO_PARTITION;
+    PartitionNodeMap::iterator di = diskp_to_node.find(other_partition);
+
+    if (!have_tag) {	// No!  OK, map to new 'un.
+        if (di != diskp_to_node.end()) {	// already seen this other_partition
+            partition_map.set(tag, di->second);
         } else {		// new other_partition! create a new partition.
-            pp_0 = get_new_partition();
+            node_0 = get_new_partition();
+            partition_map.set(tag, node_0);
 
-            PartitionPtrSet * pp_set = new PartitionPtrSet();
-            pp_set->insert(pp_0);
-            reverse_pmap[*pp_0] = pp_set;
-            partition_map[tag] = pp_0;
-
-            diskp_to_pp[other_partition] = pp_0;
+            diskp_to_node[other_partition] = node_0;
         }
     } else {			// yes, we've seen this tag before...
-        PartitionID * existing_pp_0 = diskp_to_pp[other_partition];
-
-        if (existing_pp_0) {	// mapping exists.  copacetic?
-            if (*pp_0 == *existing_pp_0) {
+        if (di != diskp_to_node.end()) {	// mapping exists.  copacetic?
+            if (partition_forest.find(node_0) ==
+                    partition_forest.find(di->second)) {
                 ;			// yep! nothing to do, yay!
             } else {
                 // remapping must be done... we need to merge!
-                // the two partitions to merge are *pp_0 and *existing_pp_0.
-                // we also need to reset existing_pp_0 in diskp_to_pp to pp_0.
+                // the two partitions to merge are node_0 and di->second;
+                // the other partition then maps to the merged one.
 
-                pp_0 = _merge_two_partitions(pp_0, existing_pp_0);
-                diskp_to_pp[other_partition] = pp_0;
+                di->second = _merge_two_partitions(node_0, di->second);
             }
         } else {
             // no, does not exist in our mapping yet.  but that's ok,
             // we can fix that.
-            diskp_to_pp[other_partition] = pp_0;
+            diskp_to_node[other_partition] = node_0;
         }
     }
 }
@@ -1107,7 +1164,7 @@ void SubsetPartition::merge_from_disk(string other_filename)
     long remainder;
 
 
-    PartitionPtrMap diskp_to_pp;
+    PartitionNodeMap diskp_to_node;
 
     HashIntoType * kmer_p = NULL;
     PartitionID * diskp = NULL;
@@ -1152,7 +1209,7 @@ void SubsetPartition::merge_from_disk(string other_filename)
 
             assert((*diskp != 0)); // sanity check!
 
-            _merge_other(*kmer_p, *diskp, diskp_to_pp);
+            _merge_other(*kmer_p, *diskp, diskp_to_node);
 
             loaded++;
         }
@@ -1195,12 +1252,13 @@ void SubsetPartition::save_partitionmap(string pmap_filename)
     // For each tag in the partition map, save the tag and the associated
     // partition ID.
 
-    PartitionMap::const_iterator pi = partition_map.begin();
-    for (; pi != partition_map.end(); ++pi) {
-        HashIntoType kmer = pi->first;
-        if (pi->second != NULL) {	// if a partition ID has been
+    std::vector<HashIntoType> tags;
+    partition_map.get_sorted_tags(tags);
+    for (size_t i = 0; i < tags.size(); i++) {
+        HashIntoType kmer = tags[i];
+        PartitionID p_id = _tag_partition(kmer);
+        if (p_id) {	// if a partition ID has been
             /// assigned... save.
-            PartitionID p_id = *(pi->second);
 
             // each record consists of one tag followed by one PartitionID.
             HashIntoType * kmer_p = (HashIntoType *) (buf + n_bytes);
@@ -1243,36 +1301,29 @@ void SubsetPartition::load_partitionmap(string infilename)
 
 void SubsetPartition::_validate_pmap()
 {
-    for (PartitionMap::const_iterator pi = partition_map.begin();
-            pi != partition_map.end(); ++pi) {
-        //HashIntoType kmer = (*pi).first;
-        PartitionID * pp_id = (*pi).second;
-
-        if (pp_id != NULL) {
-            if (!(*pp_id >= 1) || !(*pp_id < next_partition_id)) {
-                throw khmer_exception();
+    bool valid = true;
+    partition_map.for_each([&](HashIntoType, PartitionNode node) {
+        if (node != PartitionTagMap::NO_PARTITION) {
+            PartitionID p_id = partition_forest.id(node);
+            if (!(p_id >= 1) || !(p_id < next_partition_id)) {
+                valid = false;
             }
         }
+    });
+    if (!valid) {
+        throw khmer_exception();
     }
 
+    // each ID must name the root of its partition.
     for (ReversePartitionMap::const_iterator ri = reverse_pmap.begin();
             ri != reverse_pmap.end(); ++ri) {
         PartitionID p = (*ri).first;
-        PartitionPtrSet *s = (*ri).second;
+        PartitionNode node = (*ri).second;
 
-        if (!(s != NULL)) {
+        if (!(partition_forest.find(node) == node) ||
+                !(partition_forest.id(node) == p)) {
             throw khmer_exception();
         }
-
-        for (PartitionPtrSet::const_iterator si = s->begin(); si != s->end();
-                ++si) {
-            PartitionID * pp;
-            pp = *si;
-
-            if (!(p == *pp)) {
-                throw khmer_exception();
-            }
-        }
     }
 }
 
@@ -1280,17 +1331,9 @@ void SubsetPartition::_validate_pmap()
 
 void SubsetPartition::_clear_all_partitions()
 {
-    for (ReversePartitionMap::iterator ri = reverse_pmap.begin();
-            ri != reverse_pmap.end(); ++ri) {
-        PartitionPtrSet * s = (*ri).second;
-
-        for (PartitionPtrSet::iterator pi = s->begin(); pi != s->end(); ++pi) {
-            PartitionID * pp = (*pi);
-            delete pp;
-        }
-        delete s;
-    }
     partition_map.clear();
+    partition_forest.clear();
+    reverse_pmap.clear();
     next_partition_id = 1;
 }
 
@@ -1302,17 +1345,14 @@ bool SubsetPartition::is_single_partition(std::string seq)
     }
 
     PartitionSet partitions;
-    PartitionID *pp;
 
     KmerIterator kmers(seq.c_str(), _ht->ksize());
     while (!kmers.done()) {
         HashIntoType kmer = kmers.next();
 
-        if (partition_map.find(kmer) != partition_map.end()) {
-            pp = partition_map[kmer];
-            if (pp) {
-                partitions.insert(*pp);
-            }
+        PartitionID partition_id = _tag_partition(kmer);
+        if (partition_id) {
+            partitions.insert(partition_id);
         }
     }
 
@@ -1331,7 +1371,7 @@ void SubsetPartition::join_partitions_by_path(std::string seq)
 
     while(!kmers.done()) {
         HashIntoType kmer = kmers.next();
-        if (_ht->all_tags.find(kmer) != _ht->all_tags.end()) {
+        if (set_contains(_ht->all_tags, kmer)) {
             tagged_kmers.insert(kmer);
         }
     }
@@ -1363,14 +1403,13 @@ const
     n_unassigned = 0;
 
     // @CTB: should this be all_tags? See count_partitions.
-    for (PartitionMap::const_iterator pi = partition_map.begin();
-            pi != partition_map.end(); ++pi) {
-        if (pi->second) {
-            cm[*(pi->second)]++;
+    partition_map.for_each([&](HashIntoType, PartitionNode node) {
+        if (node != PartitionTagMap::NO_PARTITION) {
+            cm[partition_forest.id(node)]++;
         } else {
             n_unassigned++;
         }
-    }
+    });
 }
 
 void SubsetPartition::partition_average_coverages(
@@ -1381,14 +1420,13 @@ void SubsetPartition::partition_average_coverages(
     PartitionCountMap cN;
 
     // CTB: should *only* be members of this partition, so *not* all_tags.
-    for (PartitionMap::const_iterator pi = partition_map.begin();
-            pi != partition_map.end(); ++pi) {
-        if (pi->second) {
-            BoundedCounterType count = ht->get_count(pi->first);
-            csum[*(pi->second)] += count;
-            cN[*(pi->second)]++;
+    partition_map.for_each([&](HashIntoType tag, PartitionNode node) {
+        if (node != PartitionTagMap::NO_PARTITION) {
+            BoundedCounterType count = ht->get_count(tag);
+            csum[partition_forest.id(node)] += count;
+            cN[partition_forest.id(node)]++;
         }
-    }
+    });
 
     for (PartitionCountMap::iterator pi = csum.begin();
             pi != csum.end(); ++pi) {
@@ -1412,14 +1450,7 @@ unsigned long long SubsetPartition::repartition_largest_partition(
 #endif // 0
 
     // first, count the number of members in each partition.
-    for (PartitionMap::const_iterator pi = partition_map.begin();
-            pi != partition_map.end(); ++pi) {
-        if (pi->second) {
-            cm[*(pi->second)]++;
-        } else {
-            n_unassigned++;
-        }
-    }
+    partition_sizes(cm, n_unassigned);
 
     // then, build the distribution.
     PartitionCountDistribution d;
@@ -1542,6 +1573,7 @@ unsigned long long SubsetPartition::repartition_largest_partition(
 void SubsetPartition::repartition_a_partition(const SeenSet& partition_tags)
 {
     SeenSet tagged_kmers;
+    TraversalContext context;
     SeenSet::const_iterator si;
 
     unsigned n = 0;
@@ -1556,7 +1588,8 @@ void SubsetPartition::repartition_a_partition(const SeenSet& partition_tags)
         Kmer kmer = _ht->build_kmer(*si);
 
         tagged_kmers.clear();
-        find_all_tags(kmer, tagged_kmers, _ht->all_tags, true, false);
+        find_all_tags(kmer, tagged_kmers, _ht->all_tags, true, false,
+                      context);
 
         // only join things already in bigtags.
         SeenSet::iterator ssi = tagged_kmers.begin();
@@ -1582,26 +1615,20 @@ void SubsetPartition::_clear_partition(
 {
     partition_tags.clear();
 
-    for (PartitionMap::iterator pi = partition_map.begin();
-            pi != partition_map.end(); ++pi) {
-        if (pi->second && *(pi->second) == the_partition) {
-            partition_tags.insert(pi->first);
+    partition_map.for_each([&](HashIntoType tag, PartitionNode node) {
+        if (node != PartitionTagMap::NO_PARTITION &&
+                partition_forest.id(node) == the_partition) {
+            partition_tags.insert(tag);
         }
-    }
+    });
 
     for (SeenSet::const_iterator si = partition_tags.begin();
             si != partition_tags.end(); ++si) {
         partition_map.erase(*si);
     }
 
-    // clear out the reverse partition mapping, too.
-    PartitionPtrSet * ps = reverse_pmap[the_partition];
-    for (PartitionPtrSet::iterator psi = ps->begin(); psi != ps->end();
-            ++psi) {
-        delete *psi;
-    }
-    delete ps;
-
+    // clear out the reverse partition mapping, too; the nodes of the
+    // partition are left, unused.
     reverse_pmap.erase(the_partition);
 }
 
@@ -1610,13 +1637,14 @@ void SubsetPartition::report_on_partitions()
     std::cout << _ht->all_tags.size() << " tags total\n";
     std::cout << reverse_pmap.size() << " partitions total\n";
 
-    for (SeenSet::iterator ti = _ht->all_tags.begin();
+    for (ConcurrentTagSet::const_iterator ti = _ht->all_tags.begin();
             ti != _ht->all_tags.end(); ++ti) {
         std::cout << "TAG: " << _revhash(*ti, _ht->ksize()) << "\n";
-        PartitionID *pid = partition_map[*ti];
+        PartitionID pid = _tag_partition(*ti);
         if (pid) {
-            std::cout << "partition: " << *(partition_map[*ti]) << "\n";
+            std::cout << "partition: " << pid << "\n";
         } else {
+            partition_map.insert_unassigned(*ti);
             std::cout << "NULL.\n";
         }
         std::cout << "--\n";
@@ -1633,26 +1661,25 @@ void SubsetPartition::compare_to_partition(
 {
     SubsetPartition * p1 = this;
 
-    for (PartitionMap::iterator pi = p1->partition_map.begin();
-            pi != p1->partition_map.end(); ++pi) {
-        PartitionID * pid = pi->second;
-        if (pid && *pid == pid1) {
-            PartitionID * pp2 = p2->partition_map[pi->first];
-            if (pp2 && *pp2 == pid2) {
+    p1->partition_map.for_each([&](HashIntoType tag, PartitionNode node) {
+        if (node != PartitionTagMap::NO_PARTITION &&
+                p1->partition_forest.id(node) == pid1) {
+            if (p2->_tag_partition(tag) == pid2) {
                 n_shared++;
             } else {
+                // as before, p2 keeps the tag, without a partition.
+                p2->partition_map.insert_unassigned(tag);
                 n_only1++;
             }
         }
-    }
+    });
 
-    for (PartitionMap::iterator pi = p2->partition_map.begin();
-            pi != p2->partition_map.end(); ++pi) {
-        PartitionID * pid = pi->second;
-        if (pid && *pid == pid2) {
+    p2->partition_map.for_each([&](HashIntoType, PartitionNode node) {
+        if (node != PartitionTagMap::NO_PARTITION &&
+                p2->partition_forest.id(node) == pid2) {
             n_only2++;
         }
-    }
+    });
 
     n_only2 -= n_shared;
 }
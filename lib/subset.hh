@@ -43,13 +43,15 @@ Contact: khmer-project@idyll.org
 #include <string>
 
 #include "khmer.hh"
-#include "traversal.hh"
+#include "partition_map.hh"
+#include "tagset.hh"
 
 namespace khmer
 {
 class CountingHash;
 class Hashbits;
 class Hashtable;
+class TraversalContext;
 
 struct pre_partition_info {
     HashIntoType kmer;
@@ -64,16 +66,28 @@ class SubsetPartition
 protected:
     unsigned int next_partition_id;
     Hashtable * _ht;
-    PartitionMap partition_map;
-    ReversePartitionMap reverse_pmap;
+    PartitionTagMap partition_map;	// tag -> node in partition_forest
+    PartitionForest partition_forest;
+    ReversePartitionMap reverse_pmap;	// partition ID -> root node
 
     void _clear_all_partitions();
 
-    PartitionID * _merge_two_partitions(PartitionID *orig_pp,
-                                        PartitionID *new_pp);
-    PartitionID * _join_partitions_by_tags(const SeenSet& tagged_kmers,
+    PartitionNode _merge_two_partitions(PartitionNode the_node,
+                                        PartitionNode merge_node);
+    PartitionNode _join_partitions_by_tags(const SeenSet& tagged_kmers,
                                            const HashIntoType kmer);
 
+    // the partition of tag, or 0 if it has none.
+    PartitionID _tag_partition(HashIntoType tag) const
+    {
+        PartitionNode node;
+        if (partition_map.find(tag, node) &&
+                node != PartitionTagMap::NO_PARTITION) {
+            return partition_forest.id(node);
+        }
+        return 0;
+    }
+
 public:
     explicit SubsetPartition(Hashtable * ht);
 
@@ -90,16 +104,16 @@ public:
     PartitionID get_partition_id(std::string kmer_s);
     PartitionID get_partition_id(HashIntoType kmer);
 
-    PartitionID * get_new_partition()
+    PartitionNode get_new_partition()
     {
-        PartitionID* pp = new PartitionID(next_partition_id);
+        PartitionNode node = partition_forest.add(next_partition_id);
+        reverse_pmap[next_partition_id] = node;
         next_partition_id++;
-        return pp;
+        return node;
     }
 
     void merge(SubsetPartition *);
     void merge_from_disk(std::string);
-    void _merge_from_disk_consolidate(PartitionPtrMap&);
 
     void save_partitionmap(std::string outfile);
     void load_partitionmap(std::string infile);
@@ -107,25 +121,52 @@ public:
 
     void find_all_tags(Kmer start_kmer,
                        SeenSet& tagged_kmers,
-                       const SeenSet& all_tags,
+                       const ConcurrentTagSet& all_tags,
                        bool break_on_stop_tags=false,
                        bool stop_big_traversals=false);
 
+    // The traversals below may be handed a TraversalContext to reuse, as
+    // the loops which run one per tag do; the forms without one make their
+    // own.
+    void find_all_tags(Kmer start_kmer,
+                       SeenSet& tagged_kmers,
+                       const ConcurrentTagSet& all_tags,
+                       bool break_on_stop_tags,
+                       bool stop_big_traversals,
+                       TraversalContext& context);
+
     unsigned int sweep_for_tags(const std::string& seq,
                                 SeenSet& tagged_kmers,
-                                const SeenSet& all_tags,
+                                const ConcurrentTagSet& all_tags,
                                 unsigned int range,
                                 bool break_on_stop_tags,
                                 bool stop_big_traversals);
 
+    unsigned int sweep_for_tags(const std::string& seq,
+                                SeenSet& tagged_kmers,
+                                const ConcurrentTagSet& all_tags,
+                                unsigned int range,
+                                bool break_on_stop_tags,
+                                bool stop_big_traversals,
+                                TraversalContext& context);
+
     void find_all_tags_truncate_on_abundance(Kmer start_kmer,
             SeenSet& tagged_kmers,
-            const SeenSet& all_tags,
+            const ConcurrentTagSet& all_tags,
             BoundedCounterType min_count,
             BoundedCounterType max_count,
             bool break_on_stop_tags=false,
             bool stop_big_traversals=false);
 
+    void find_all_tags_truncate_on_abundance(Kmer start_kmer,
+            SeenSet& tagged_kmers,
+            const ConcurrentTagSet& all_tags,
+            BoundedCounterType min_count,
+            BoundedCounterType max_count,
+            bool break_on_stop_tags,
+            bool stop_big_traversals,
+            TraversalContext& context);
+
     void do_partition(HashIntoType first_kmer,
                       HashIntoType last_kmer,
                       bool break_on_stop_tags=false,
@@ -142,6 +183,15 @@ public:
                                      CallbackFn callback=0,
                                      void * callback_data=0);
 
+    // Partition all of the tags on n_threads threads, which take the tags
+    // a range at a time and join the tags each one reaches in a shared
+    // ConcurrentUnionFind. The partitions are those do_partition finds
+    // over all of the tags, but their IDs are given in order of their
+    // least tags.
+    void do_partition_parallel(unsigned int n_threads,
+                               bool break_on_stop_tags=false,
+                               bool stop_big_traversals=false);
+
     void count_partitions(size_t& n_partitions,
                           size_t& n_unassigned);
 
@@ -178,7 +228,7 @@ public:
 
     void _merge_other(HashIntoType tag,
                       PartitionID other_partition,
-                      PartitionPtrMap& diskp_to_pp);
+                      PartitionNodeMap& diskp_to_node);
 
     void report_on_partitions();
 
@@ -0,0 +1,237 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2014-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+#include "tagset.hh"
+
+using namespace khmer;
+
+const HashIntoType ConcurrentTagSet::EMPTY;
+
+// keep each table at most half full.
+static size_t _slots_for(size_t n_tags)
+{
+    size_t n_slots = 16;
+    while (n_slots < 2 * n_tags) {
+        n_slots *= 2;
+    }
+    return n_slots;
+}
+
+ConcurrentTagSet::ConcurrentTagSet()
+    : _size(0), _has_empty_value(false), _sorted_valid(true), _sorted_lock(0)
+{
+}
+
+ConcurrentTagSet::~ConcurrentTagSet()
+{
+    clear();
+}
+
+ConcurrentTagSet::Table * ConcurrentTagSet::_new_table(size_t n_slots)
+{
+    Table * table = (Table *) malloc(sizeof(Table) +
+                                     (n_slots - 1) * sizeof(HashIntoType));
+    if (table == NULL) {
+        throw std::bad_alloc();
+    }
+    table->mask = n_slots - 1;
+    table->n_used = 0;
+    // all bits set, i.e. EMPTY.
+    memset(table->slots, 0xff, n_slots * sizeof(HashIntoType));
+    return table;
+}
+
+void ConcurrentTagSet::_grow(Shard &shard, size_t n_slots)
+{
+    Table * old_table = shard.table;
+    if (old_table != NULL && n_slots <= old_table->mask + 1) {
+        return;
+    }
+
+    Table * table = _new_table(n_slots);
+    if (old_table != NULL) {
+        for (size_t j = 0; j <= old_table->mask; j++) {
+            HashIntoType tag = old_table->slots[j];
+            if (tag != EMPTY) {
+                size_t i = _slot(tag, table->mask);
+                while (table->slots[i] != EMPTY) {
+                    i = (i + 1) & table->mask;
+                }
+                table->slots[i] = tag;
+            }
+        }
+        table->n_used = old_table->n_used;
+        shard.retired.push_back(old_table);
+    }
+
+    // readers must not see the new table before its slots.
+    __sync_synchronize();
+    shard.table = table;
+}
+
+bool ConcurrentTagSet::insert(HashIntoType tag)
+{
+    bool inserted = false;
+
+    if (tag == EMPTY) {
+        inserted = __sync_bool_compare_and_swap(&_has_empty_value, false,
+                                                true);
+    } else {
+        Shard &shard = _shard(tag);
+        while (!__sync_bool_compare_and_swap(&shard.lock, 0, 1));
+
+        if (shard.table == NULL ||
+                2 * (shard.table->n_used + 1) > shard.table->mask + 1) {
+            size_t n_used = shard.table ? shard.table->n_used : 0;
+            try {
+                _grow(shard, _slots_for(n_used + 1));
+            } catch (...) {
+                __sync_lock_release(&shard.lock);
+                throw;
+            }
+        }
+
+        Table * table = shard.table;
+        size_t i = _slot(tag, table->mask);
+        while (table->slots[i] != EMPTY && table->slots[i] != tag) {
+            i = (i + 1) & table->mask;
+        }
+        if (table->slots[i] == EMPTY) {
+            table->slots[i] = tag;
+            table->n_used++;
+            inserted = true;
+        }
+
+        __sync_lock_release(&shard.lock);
+    }
+
+    if (inserted) {
+        __sync_add_and_fetch(&_size, 1);
+        _sorted_valid = false;
+    }
+    return inserted;
+}
+
+void ConcurrentTagSet::clear()
+{
+    for (size_t i = 0; i < TAGSET_SHARDS; i++) {
+        Shard &shard = _shards[i];
+        while (!__sync_bool_compare_and_swap(&shard.lock, 0, 1));
+        free(shard.table);
+        shard.table = NULL;
+        for (size_t j = 0; j < shard.retired.size(); j++) {
+            free(shard.retired[j]);
+        }
+        std::vector<Table *>().swap(shard.retired);
+        __sync_lock_release(&shard.lock);
+    }
+    _has_empty_value = false;
+    _size = 0;
+
+    std::vector<HashIntoType>().swap(_sorted);
+    _sorted_valid = true;
+}
+
+void ConcurrentTagSet::reserve(size_t n)
+{
+    // the tables fill evenly; leave some room for the unlucky ones.
+    const size_t per_shard = (size() + n) / TAGSET_SHARDS;
+    const size_t n_slots = _slots_for(per_shard + per_shard / 4 + 1);
+
+    for (size_t i = 0; i < TAGSET_SHARDS; i++) {
+        Shard &shard = _shards[i];
+        while (!__sync_bool_compare_and_swap(&shard.lock, 0, 1));
+        try {
+            _grow(shard, n_slots);
+        } catch (...) {
+            __sync_lock_release(&shard.lock);
+            throw;
+        }
+        __sync_lock_release(&shard.lock);
+    }
+}
+
+const std::vector<HashIntoType>& ConcurrentTagSet::sorted() const
+{
+    if (_sorted_valid) {
+        return _sorted;
+    }
+
+    while (!__sync_bool_compare_and_swap(&_sorted_lock, 0, 1));
+    if (!_sorted_valid) {
+        _sorted.clear();
+        _sorted.reserve(size());
+        for (size_t i = 0; i < TAGSET_SHARDS; i++) {
+            const Table * table = _shards[i].table;
+            if (table == NULL) {
+                continue;
+            }
+            for (size_t j = 0; j <= table->mask; j++) {
+                if (table->slots[j] != EMPTY) {
+                    _sorted.push_back(table->slots[j]);
+                }
+            }
+        }
+        if (_has_empty_value) {
+            _sorted.push_back(EMPTY);
+        }
+        std::sort(_sorted.begin(), _sorted.end());
+
+        __sync_synchronize();
+        _sorted_valid = true;
+    }
+    __sync_lock_release(&_sorted_lock);
+
+    return _sorted;
+}
+
+ConcurrentTagSet::const_iterator ConcurrentTagSet::find(HashIntoType tag) const
+{
+    const std::vector<HashIntoType>& tags = sorted();
+    const_iterator it = std::lower_bound(tags.begin(), tags.end(), tag);
+    if (it != tags.end() && *it != tag) {
+        return tags.end();
+    }
+    return it;
+}
+
+/* vim: set ft=cpp ts=8 sts=4 sw=4 et tw=79 */
@@ -0,0 +1,196 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2014-2015, Michigan State University.
+Copyright (C) 2015, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef TAGSET_HH
+#define TAGSET_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "khmer.hh"
+#include "kmer_hash.hh"
+
+namespace khmer
+{
+
+/**
+ * \class ConcurrentTagSet
+ *
+ * \brief The tags of a graph: a set of k-mer hashes which many threads can
+ * test while others add to it.
+ *
+ * The tags are spread over TAGSET_SHARDS open-addressing tables by a hash
+ * of the tag. Inserts into a table take that table's spin lock; lookups
+ * take no lock at all, since a table is never changed in place except to
+ * fill an empty slot with a single 64-bit store, and a table which has
+ * outgrown its slots is copied rather than rehashed in place. The old
+ * copies are kept until clear(), so a reader still probing one is safe.
+ *
+ * Iterating goes over the frozen form, a sorted array of the tags which
+ * is built on first use after the set changes. Don't insert while any
+ * thread iterates.
+ */
+class ConcurrentTagSet
+{
+public:
+    typedef std::vector<HashIntoType>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    ConcurrentTagSet();
+    ~ConcurrentTagSet();
+
+    /// @return true if tag was not in the set yet.
+    bool insert(HashIntoType tag);
+
+    bool contains(HashIntoType tag) const
+    {
+        if (tag == EMPTY) {
+            return _has_empty_value;
+        }
+
+        const Table * table = _shard(tag).table;
+        if (table == NULL) {
+            return false;
+        }
+
+        size_t i = _slot(tag, table->mask);
+        while (true) {
+            HashIntoType slot = ((volatile HashIntoType *) table->slots)[i];
+            if (slot == tag) {
+                return true;
+            }
+            if (slot == EMPTY) {
+                return false;
+            }
+            i = (i + 1) & table->mask;
+        }
+    }
+
+    size_t size() const
+    {
+        return __sync_add_and_fetch(&_size, 0);
+    }
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    void clear();
+
+    /// Make room for n more tags without growing the tables again.
+    void reserve(size_t n);
+
+    /// The tags in ascending order.
+    const std::vector<HashIntoType>& sorted() const;
+
+    const_iterator begin() const
+    {
+        return sorted().begin();
+    }
+    const_iterator end() const
+    {
+        return sorted().end();
+    }
+    /// The position of tag in sorted(), or end() if it is not a tag.
+    const_iterator find(HashIntoType tag) const;
+
+protected:
+    // marks an empty slot; the tag with this value is kept in a flag.
+    static const HashIntoType EMPTY = ~(HashIntoType) 0;
+
+    struct Table {
+        size_t          mask;		// the number of slots, less one
+        size_t          n_used;
+        HashIntoType    slots[1];	// really mask + 1 of them
+    };
+
+    // padded, so that threads spinning on the locks of neighboring shards
+    // don't share a cache line.
+    struct Shard {
+        Table * volatile    table;
+        uint32_t            lock;
+        std::vector<Table *> retired;	// outgrown copies of the table
+        char                _pad[CACHE_LINE_SIZE];
+
+        Shard() : table(NULL), lock(0) {}
+    };
+
+    Shard _shards[TAGSET_SHARDS];
+    mutable size_t _size;
+    volatile bool _has_empty_value;
+
+    mutable std::vector<HashIntoType> _sorted;
+    mutable volatile bool _sorted_valid;
+    mutable uint32_t _sorted_lock;
+
+    const Shard& _shard(HashIntoType tag) const
+    {
+        return _shards[_mix_hash(tag) % TAGSET_SHARDS];
+    }
+    Shard& _shard(HashIntoType tag)
+    {
+        return _shards[_mix_hash(tag) % TAGSET_SHARDS];
+    }
+
+    // the low bits of the mixed hash picked the shard; use the high ones.
+    static size_t _slot(HashIntoType tag, size_t mask)
+    {
+        return (_mix_hash(tag) >> 32) & mask;
+    }
+
+    static Table * _new_table(size_t n_slots);
+
+    // replace the shard's table with a copy of n_slots slots; the shard
+    // must be locked.
+    static void _grow(Shard &shard, size_t n_slots);
+
+private:
+    ConcurrentTagSet(const ConcurrentTagSet&);
+    ConcurrentTagSet& operator=(const ConcurrentTagSet&);
+};
+
+// preferred over the set_contains() template in hashtable.hh.
+template<typename E>
+inline bool set_contains(const ConcurrentTagSet &s, const E& e)
+{
+    return s.contains(e);
+}
+
+}
+
+#endif // TAGSET_HH
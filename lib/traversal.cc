@@ -34,12 +34,66 @@ LICENSE (END)
 
 Contact: khmer-project@idyll.org
 */
+#include <algorithm>
+
 #include "hashtable.hh"
 #include "traversal.hh"
 
 using namespace khmer;
 using namespace std;
 
+TraversalContext::TraversalContext() :
+    _keys(64), _epochs(64, 0), _epoch(1), _mask(63), _shift(64 - 6),
+    _n_visited(0), _ring(64), _ring_mask(63), _head(0), _tail(0)
+{
+}
+
+void TraversalContext::reset()
+{
+    if (++_epoch == 0) {
+        // after 2^32 traversals, the old epochs could come around again.
+        std::fill(_epochs.begin(), _epochs.end(), 0);
+        _epoch = 1;
+    }
+    _n_visited = 0;
+    _head = _tail = 0;
+}
+
+void TraversalContext::_grow_visited()
+{
+    std::vector<HashIntoType> keys(_keys.size() * 2);
+    std::vector<uint32_t> epochs(_epochs.size() * 2, 0);
+    keys.swap(_keys);
+    epochs.swap(_epochs);
+    _mask = _keys.size() - 1;
+    _shift--;
+
+    for (size_t j = 0; j < keys.size(); j++) {
+        if (epochs[j] != _epoch) {
+            continue;
+        }
+        size_t i = _slot(keys[j]);
+        while (_epochs[i] == _epoch) {
+            i = (i + 1) & _mask;
+        }
+        _keys[i] = keys[j];
+        _epochs[i] = _epoch;
+    }
+}
+
+void TraversalContext::_grow_frontier()
+{
+    std::vector<Entry> ring(_ring.size() * 2);
+    size_t n = _tail - _head;
+    for (size_t i = 0; i < n; i++) {
+        ring[i] = _ring[(_head + i) & _ring_mask];
+    }
+    ring.swap(_ring);
+    _ring_mask = _ring.size() - 1;
+    _head = 0;
+    _tail = n;
+}
+
 Traverser::Traverser(const Hashtable * ht) :
     KmerFactory(ht->ksize()), graph(ht)
 {
@@ -50,7 +104,7 @@ Traverser::Traverser(const Hashtable * ht) :
     rc_left_shift = _ksize * 2 - 2;
 }
 
-Kmer Traverser::get_left(Kmer& node, const char ch)
+Kmer Traverser::get_left(const Kmer& node, const char ch) const
 {
     HashIntoType kmer_f, kmer_r;
     kmer_f = ((node.kmer_f) >> 2 | twobit_repr(ch) << rc_left_shift);
@@ -59,7 +113,7 @@ Kmer Traverser::get_left(Kmer& node, const char ch)
 }
 
 
-Kmer Traverser::get_right(Kmer& node, const char ch)
+Kmer Traverser::get_right(const Kmer& node, const char ch) const
 {
     HashIntoType kmer_f, kmer_r;
     kmer_f = (((node.kmer_f) << 2) & bitmask) | (twobit_repr(ch));
@@ -67,21 +121,58 @@ Kmer Traverser::get_right(Kmer& node, const char ch)
     return build_kmer(kmer_f, kmer_r);
 }
 
+unsigned int Traverser::_present(const Kmer * nbrs, unsigned int n) const
+{
+    HashIntoType hashes[8];
+
+    for (unsigned int i = 0; i < n; i++) {
+        hashes[i] = nbrs[i].kmer_u;
+    }
+    // one call for all of them, which fetches their bins together.
+    return graph->_get_present(hashes, n);
+}
+
+unsigned int Traverser::neighbors(const Kmer& node, Kmer * nbrs) const
+{
+    const char bases[] = "ACGT";
+    for (unsigned int i = 0; i < 4; i++) {
+        nbrs[i] = get_right(node, bases[i]);
+        nbrs[4 + i] = get_left(node, bases[i]);
+    }
+    return _present(nbrs, 8);
+}
+
+unsigned int Traverser::left_neighbors(const Kmer& node, Kmer * nbrs) const
+{
+    const char bases[] = "ACGT";
+    for (unsigned int i = 0; i < 4; i++) {
+        nbrs[i] = get_left(node, bases[i]);
+    }
+    return _present(nbrs, 4);
+}
+
+unsigned int Traverser::right_neighbors(const Kmer& node, Kmer * nbrs) const
+{
+    const char bases[] = "ACGT";
+    for (unsigned int i = 0; i < 4; i++) {
+        nbrs[i] = get_right(node, bases[i]);
+    }
+    return _present(nbrs, 4);
+}
+
 unsigned int Traverser::traverse_left(Kmer& node,
                                       KmerQueue & node_q,
                                       std::function<bool (Kmer&)> filter)
 {
     unsigned int found = 0;
 
-    char bases[] = "ACGT";
-    char * base = bases;
-    while(*base != '\0') {
-        Kmer prev_node = get_left(node, *base);
-        if (graph->get_count(prev_node) && filter(prev_node)) {
-            node_q.push(prev_node);
+    Kmer nbrs[4];
+    unsigned int present = left_neighbors(node, nbrs);
+    for (unsigned int i = 0; i < 4; i++) {
+        if ((present >> i & 1) && filter(nbrs[i])) {
+            node_q.push(nbrs[i]);
             ++found;
         }
-        ++base;
     }
 
     return found;
@@ -93,15 +184,13 @@ unsigned int Traverser::traverse_right(Kmer& node,
 {
     unsigned int found = 0;
 
-    char bases[] = "ACGT";
-    char * base = bases;
-    while(*base != '\0') {
-        Kmer next_node = get_right(node, *base);
-        if (graph->get_count(next_node) && filter(next_node)) {
-            node_q.push(next_node);
+    Kmer nbrs[4];
+    unsigned int present = right_neighbors(node, nbrs);
+    for (unsigned int i = 0; i < 4; i++) {
+        if ((present >> i & 1) && filter(nbrs[i])) {
+            node_q.push(nbrs[i]);
             ++found;
         }
-        ++base;
     }
 
     return found;
@@ -109,39 +198,18 @@ unsigned int Traverser::traverse_right(Kmer& node,
 
 unsigned int Traverser::degree_left(Kmer& node)
 {
-    unsigned int degree = 0;
-
-    char bases[] = "ACGT";
-    char * base = bases;
-    while(*base != '\0') {
-        Kmer prev_node = get_left(node, *base);
-        if (graph->get_count(prev_node)) {
-            ++degree;
-        }
-        ++base;
-    }
-
-    return degree;
+    Kmer nbrs[4];
+    return __builtin_popcount(left_neighbors(node, nbrs));
 }
 
 unsigned int Traverser::degree_right(Kmer& node)
 {
-    unsigned int degree = 0;
-
-    char bases[] = "ACGT";
-    char * base = bases;
-    while(*base != '\0') {
-        Kmer next_node = get_right(node, *base);
-        if (graph->get_count(next_node)) {
-            ++degree;
-        }
-        ++base;
-    }
-
-    return degree;
+    Kmer nbrs[4];
+    return __builtin_popcount(right_neighbors(node, nbrs));
 }
 
 unsigned int Traverser::degree(Kmer& node)
 {
-    return degree_right(node) + degree_left(node);
+    Kmer nbrs[8];
+    return __builtin_popcount(neighbors(node, nbrs));
 }
@@ -37,8 +37,10 @@ Contact: khmer-project@idyll.org
 #ifndef TRAVERSAL_HH
 #define TRAVERSAL_HH
 
+#include <stdint.h>
 #include <queue>
 #include <functional>
+#include <vector>
 
 #include "khmer.hh"
 
@@ -52,6 +54,109 @@ namespace khmer
 
 class Hashtable;
 
+// The state of one breadth-first traversal, kept for the next: a set of
+// the visited k-mers and a FIFO frontier of k-mers with their breadths.
+// Starting a new traversal with reset() only bumps an epoch and rewinds
+// the frontier, so a context reused by one thread stops allocating once
+// it has grown to its largest traversal. Not thread-safe; give each
+// thread its own.
+class TraversalContext
+{
+public:
+    struct Entry {
+        Kmer kmer;
+        unsigned int breadth;
+    };
+
+    TraversalContext();
+
+    // forget the visited k-mers and empty the frontier.
+    void reset();
+
+    // mark kmer visited; false if it was already.
+    bool visit(const Kmer& kmer)
+    {
+        size_t i = _slot(kmer.kmer_u);
+        while (_epochs[i] == _epoch) {
+            if (_keys[i] == kmer.kmer_u) {
+                return false;
+            }
+            i = (i + 1) & _mask;
+        }
+        _keys[i] = kmer.kmer_u;
+        _epochs[i] = _epoch;
+        if (++_n_visited * 2 > _keys.size()) {
+            _grow_visited();
+        }
+        return true;
+    }
+
+    bool visited(const Kmer& kmer) const
+    {
+        size_t i = _slot(kmer.kmer_u);
+        while (_epochs[i] == _epoch) {
+            if (_keys[i] == kmer.kmer_u) {
+                return true;
+            }
+            i = (i + 1) & _mask;
+        }
+        return false;
+    }
+
+    size_t n_visited() const
+    {
+        return _n_visited;
+    }
+
+    void push(const Kmer& kmer, unsigned int breadth)
+    {
+        if (_tail - _head == _ring.size()) {
+            _grow_frontier();
+        }
+        Entry& e = _ring[_tail++ & _ring_mask];
+        e.kmer = kmer;
+        e.breadth = breadth;
+    }
+
+    // the oldest entry, removed from the frontier; it stays valid until
+    // the next push.
+    const Entry& pop()
+    {
+        return _ring[_head++ & _ring_mask];
+    }
+
+    bool frontier_empty() const
+    {
+        return _head == _tail;
+    }
+
+protected:
+    // the visited set: open addressing, where a slot is in use only if its
+    // epoch is the current one.
+    std::vector<HashIntoType> _keys;
+    std::vector<uint32_t> _epochs;
+    uint32_t _epoch;
+    size_t _mask;
+    unsigned int _shift;
+    size_t _n_visited;
+
+    // the frontier: a ring buffer of a power of two entries, between the
+    // free-running counters _head and _tail.
+    std::vector<Entry> _ring;
+    size_t _ring_mask;
+    size_t _head;
+    size_t _tail;
+
+    size_t _slot(HashIntoType key) const
+    {
+        // Fibonacci hashing: the low bits of a k-mer are its last bases.
+        return (key * 0x9E3779B97F4A7C15ULL) >> _shift;
+    }
+
+    void _grow_visited();
+    void _grow_frontier();
+};
+
 class Traverser: public KmerFactory
 {
     friend class Hashtable;
@@ -67,8 +172,19 @@ public:
 
     explicit Traverser(const Hashtable * ht);
 
-    Kmer get_left(Kmer& node, const char ch);
-    Kmer get_right(Kmer& node, const char ch);
+    Kmer get_left(const Kmer& node, const char ch) const;
+    Kmer get_right(const Kmer& node, const char ch) const;
+
+    // The neighbors of node which are in the graph, as a bitmask where bit
+    // i stands for nbrs[i]: nbrs[0..3] are the right neighbors, ending in
+    // A, C, G and T, and nbrs[4..7] the left ones, starting with them. The
+    // bins of all eight are looked up in one batch, so on a large graph
+    // they come from memory together rather than one after another.
+    unsigned int neighbors(const Kmer& node, Kmer * nbrs) const;
+
+    // the same for one side only, in bits and nbrs 0..3.
+    unsigned int left_neighbors(const Kmer& node, Kmer * nbrs) const;
+    unsigned int right_neighbors(const Kmer& node, Kmer * nbrs) const;
 
     unsigned int traverse_left(Kmer& node,
                                KmerQueue &node_q,
@@ -77,9 +193,70 @@ public:
                                 KmerQueue &node_q,
                                 std::function<bool (Kmer&)> filter);
 
+    // Push the neighbors of node which are in the graph and pass filter
+    // onto the frontier of context at the given breadth, right neighbors
+    // first.
+    template<typename Filter>
+    unsigned int traverse(Kmer& node,
+                          TraversalContext& context,
+                          unsigned int breadth,
+                          Filter filter)
+    {
+        Kmer nbrs[8];
+        return _push_neighbors(nbrs, neighbors(node, nbrs), context,
+                               breadth, filter);
+    }
+
+    template<typename Filter>
+    unsigned int traverse_left(Kmer& node,
+                               TraversalContext& context,
+                               unsigned int breadth,
+                               Filter filter)
+    {
+        Kmer nbrs[4];
+        return _push_neighbors(nbrs, left_neighbors(node, nbrs), context,
+                               breadth, filter);
+    }
+
+    template<typename Filter>
+    unsigned int traverse_right(Kmer& node,
+                                TraversalContext& context,
+                                unsigned int breadth,
+                                Filter filter)
+    {
+        Kmer nbrs[4];
+        return _push_neighbors(nbrs, right_neighbors(node, nbrs), context,
+                               breadth, filter);
+    }
+
     unsigned int degree_left(Kmer& node);
     unsigned int degree_right(Kmer& node);
     unsigned int degree(Kmer& node);
+
+protected:
+
+    // look up n (at most 8) k-mers in the graph; bit i of the result is set
+    // if nbrs[i] is there.
+    unsigned int _present(const Kmer * nbrs, unsigned int n) const;
+
+    template<typename Filter>
+    unsigned int _push_neighbors(Kmer * nbrs,
+                                 unsigned int present,
+                                 TraversalContext& context,
+                                 unsigned int breadth,
+                                 Filter& filter)
+    {
+        unsigned int found = 0;
+
+        for (unsigned int i = 0; present; i++, present >>= 1) {
+            if ((present & 1) && filter(nbrs[i])) {
+                context.push(nbrs[i], breadth);
+                ++found;
+            }
+        }
+
+        return found;
+    }
 };
 
 }
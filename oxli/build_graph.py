@@ -68,6 +68,9 @@ def build_parser(parser):
                         nargs='+', help='input FAST[AQ] sequence filename')
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Overwrite output file if it exists')
+    parser.add_argument('--page-aligned', default=False, action='store_true',
+                        help='Save the nodegraph so that later scripts can '
+                        'map it into memory instead of reading it')
     return parser
 
 
@@ -101,7 +104,7 @@ def main(args):
         nodegraph.n_unique_kmers()), file=sys.stderr)
 
     print('saving k-mer nodegraph in', base, file=sys.stderr)
-    nodegraph.save(base)
+    nodegraph.save(base, page_aligned=args.page_aligned)
 
     if not args.no_build_tagset:
         print('saving tagset in', base + '.tagset', file=sys.stderr)
@@ -52,13 +52,14 @@ def build_graph(ifilenames, graph, num_threads=1, tags=False):
     optionally, number of threads and if there should be tags
     """
 
-    if tags:
-        eat = graph.consume_fasta_and_tag_with_reads_parser
-    else:
-        eat = graph.consume_fasta_with_reads_parser
-
     for _, ifile in enumerate(ifilenames):
         rparser = khmer.ReadParser(ifile)
+        if not tags:
+            graph.consume_fasta_with_reads_parser(rparser,
+                                                  threads=num_threads)
+            continue
+
+        eat = graph.consume_fasta_and_tag_with_reads_parser
         threads = []
 
         for _ in range(num_threads):
@@ -123,7 +123,13 @@ def main():  # pylint: disable=too-many-locals,too-many-branches
 
     print('making countgraph', file=sys.stderr)
     countgraph = khmer_args.create_countgraph(args, multiplier=1.1)
-    countgraph.set_use_bigcount(args.bigcount)
+    counter_bits = countgraph.get_counter_bits()
+    if args.bigcount and counter_bits != 8:
+        print('WARNING: bigcount needs 8-bit counters; with --counter-bits '
+              '%d, counts stop at %d.' % (counter_bits, 2 ** counter_bits - 1),
+              file=sys.stderr)
+    else:
+        countgraph.set_use_bigcount(args.bigcount)
 
     print('building k-mer tracking graph', file=sys.stderr)
     tracking = khmer_args.create_nodegraph(args, multiplier=1.1)
@@ -104,15 +104,18 @@ def main():
     print('Counting graph from', args.input_count_graph_filename,
           file=sys.stderr)
     countgraph = khmer.load_countgraph(
-        args.input_count_graph_filename)
+        args.input_count_graph_filename, mmap_mode='r')
 
+    counter_bits = countgraph.get_counter_bits()
     if not countgraph.get_use_bigcount() and args.bigcount:
         print("WARNING: The loaded graph has bigcount DISABLED while bigcount"
-              " reporting is ENABLED--counts higher than 255 will not be "
-              "reported.",
+              " reporting is ENABLED--counts higher than %d will not be "
+              "reported." % (2 ** counter_bits - 1),
               file=sys.stderr)
 
-    countgraph.set_use_bigcount(args.bigcount)
+    # packed counters can't use bigcount.
+    if counter_bits == 8:
+        countgraph.set_use_bigcount(args.bigcount)
 
     kmer_size = countgraph.ksize()
     hashsizes = countgraph.hashsizes()
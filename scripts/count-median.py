@@ -111,7 +111,7 @@ def main():
     check_space(infiles, args.force)
 
     print('loading k-mer countgraph from', htfile, file=sys.stderr)
-    countgraph = load_countgraph(htfile)
+    countgraph = load_countgraph(htfile, mmap_mode='r')
     ksize = countgraph.ksize()
     print('writing to', output.name, file=sys.stderr)
 
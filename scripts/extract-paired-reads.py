@@ -45,21 +45,18 @@ extract them into separate files (.pe and .se).
 Reads FASTQ and FASTA input, retains format for output.
 """
 from __future__ import print_function
-import screed
 import sys
 import os.path
 import textwrap
 import argparse
 
-from khmer import __version__
+from khmer import __version__, paired_reads_to_files
 from khmer.kfile import check_input_files, check_space
 from khmer.khmer_args import (info, sanitize_help, ComboFormatter,
                               _VersionStdErrAction)
 from khmer.kfile import add_output_compression_type
 from khmer.kfile import get_file_writer
 
-from khmer.utils import broken_paired_reader, write_record, write_record_pair
-
 
 def get_parser():
     epilog = """\
@@ -153,20 +150,11 @@ def main():
     print('outputting interleaved pairs to "%s"' % out2, file=sys.stderr)
     print('outputting orphans to "%s"' % out1, file=sys.stderr)
 
-    n_pe = 0
-    n_se = 0
-
-    screed_iter = screed.open(infile)
-    for index, is_pair, read1, read2 in broken_paired_reader(screed_iter):
-        if index % 100000 == 0 and index > 0:
-            print('...', index, file=sys.stderr)
+    if infile == '-':
+        infile = '/dev/stdin'
 
-        if is_pair:
-            write_record_pair(read1, read2, paired_fp)
-            n_pe += 1
-        else:
-            write_record(read1, single_fp)
-            n_se += 1
+    # pairs go to paired_fp interleaved; read and written in C++.
+    n_pe, n_se = paired_reads_to_files(infile, paired_fp, None, single_fp)
 
     single_fp.close()
     paired_fp.close()
@@ -126,7 +126,8 @@ def main():
 
     print('loading countgraph:', args.input_graph,
           file=sys.stderr)
-    countgraph = khmer.load_countgraph(args.input_graph)
+    countgraph = khmer.load_countgraph(args.input_graph, mmap_mode='r',
+                                        threads=args.threads)
     ksize = countgraph.ksize()
 
     print("K:", ksize, file=sys.stderr)
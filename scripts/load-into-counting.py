@@ -46,7 +46,6 @@ from __future__ import print_function, unicode_literals
 import json
 import os
 import sys
-import threading
 import textwrap
 import khmer
 from khmer import khmer_args
@@ -97,9 +96,23 @@ def get_parser():
                         " default)")
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Overwrite output file if it exists')
+    parser.add_argument('--page-aligned', default=False, action='store_true',
+                        help='Save the countgraph so that later scripts can '
+                        'map it into memory instead of reading it')
+    parser.add_argument('--chunked', default=False, action='store_true',
+                        help='Save the countgraph compressed in blocks, '
+                        'using all of the threads')
     return parser
 
 
+def save_countgraph(countgraph, base, args):
+    """Save countgraph to base in the layout chosen by args."""
+    if args.chunked:
+        countgraph.save_chunked(base, threads=args.threads)
+    else:
+        countgraph.save(base, page_aligned=args.page_aligned)
+
+
 def main():
 
     info('load-into-counting.py', ['counting', 'SeqAn'])
@@ -130,7 +143,13 @@ def main():
 
     print('making countgraph', file=sys.stderr)
     countgraph = khmer_args.create_countgraph(args)
-    countgraph.set_use_bigcount(args.bigcount)
+    counter_bits = countgraph.get_counter_bits()
+    if args.bigcount and counter_bits != 8:
+        print('WARNING: bigcount needs 8-bit counters; with --counter-bits '
+              '%d, counts stop at %d.' % (counter_bits, 2 ** counter_bits - 1),
+              file=sys.stderr)
+    else:
+        countgraph.set_use_bigcount(args.bigcount)
 
     filename = None
 
@@ -139,26 +158,16 @@ def main():
     for index, filename in enumerate(filenames):
 
         rparser = khmer.ReadParser(filename)
-        threads = []
         print('consuming input', filename, file=sys.stderr)
-        for _ in range(args.threads):
-            cur_thrd = \
-                threading.Thread(
-                    target=countgraph.consume_fasta_with_reads_parser,
-                    args=(rparser, )
-                )
-            threads.append(cur_thrd)
-            cur_thrd.start()
-
-        for thread in threads:
-            thread.join()
+        countgraph.consume_fasta_with_reads_parser(rparser,
+                                                   threads=args.threads)
 
         if index > 0 and index % 10 == 0:
             tablesize = calculate_graphsize(args, 'countgraph')
             check_space_for_graph(base, tablesize, args.force)
             print('mid-save', base, file=sys.stderr)
 
-            countgraph.save(base)
+            save_countgraph(countgraph, base, args)
         with open(base + '.info', 'a') as info_fh:
             print('through', filename, file=info_fh)
         total_num_reads += rparser.num_reads
@@ -169,7 +178,7 @@ def main():
         print('Total number of unique k-mers:', n_kmers, file=info_fp)
 
     print('saving', base, file=sys.stderr)
-    countgraph.save(base)
+    save_countgraph(countgraph, base, args)
 
     # Change max_false_pos=0.2 only if you really grok it. HINT: You don't
     fp_rate = \
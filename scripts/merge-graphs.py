@@ -0,0 +1,122 @@
+#! /usr/bin/env python
+# This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+# Copyright (C) 2015, The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above
+#       copyright notice, this list of conditions and the following
+#       disclaimer in the documentation and/or other materials provided
+#       with the distribution.
+#
+#     * Neither the name of the Michigan State University nor the names
+#       of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written
+#       permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Contact: khmer-project@idyll.org
+# pylint: disable=missing-docstring,invalid-name
+"""
+Merge saved k-mer countgraphs or nodegraphs into one, without loading them.
+
+% merge-graphs.py <output> <graph1> <graph2> [ <...> ]
+
+Use '-h' for parameter help.
+"""
+from __future__ import print_function
+
+import argparse
+import sys
+import textwrap
+
+import khmer
+from khmer.kfile import check_input_files, check_file_writable
+from khmer.khmer_args import (info, sanitize_help, ComboFormatter,
+                              _VersionStdErrAction)
+
+
+def get_parser():
+    epilog = """\
+    The graphs must all be countgraphs, or all nodegraphs, of the same type,
+    k-mer size and table sizes, as they are when built with the same
+    :option:`-k`, :option:`-N` and :option:`-x` options. The counts of
+    countgraphs are added, stopping at 255, and nodegraphs are ORed
+    together. A k-mer that one of the inputs already counted past 255 with
+    bigcount is counted past it in the output too, its counts in the inputs
+    summed. A k-mer that only reaches 255 through the merge stops there,
+    bigcount or not (counts of 200 and 150 merge to 255, not 350), since
+    the inputs don't record which k-mers are at their limit.
+
+    The tables are read and merged a block at a time and written straight
+    to the output, so this uses about twice :option:`--block-size` bytes of
+    memory, however big the graphs are, plus room for the bigcounts. The
+    output is always a plain, uncompressed graph file.
+
+    Example::
+
+        load-into-counting.py -k 20 -x 5e7 sample1.ct sample1.fq.gz
+        load-into-counting.py -k 20 -x 5e7 sample2.ct sample2.fq.gz
+        merge-graphs.py all.ct sample1.ct sample2.ct
+    """
+    parser = argparse.ArgumentParser(
+        description='Merge k-mer countgraphs or nodegraphs.',
+        epilog=textwrap.dedent(epilog), formatter_class=ComboFormatter)
+
+    parser.add_argument('output_graph_filename',
+                        help='The name of the file to write the merged '
+                        'graph to.')
+    parser.add_argument('input_graph_filename', nargs='+',
+                        help='The names of the graphs to merge.')
+    parser.add_argument('--block-size', type=int, default=4 * 1024 * 1024,
+                        help='The number of bytes of each table of each '
+                        'graph to merge at a time.')
+    parser.add_argument('--version', action=_VersionStdErrAction,
+                        version='khmer {v}'.format(v=khmer.__version__))
+    parser.add_argument('-f', '--force', default=False, action='store_true',
+                        help='Overwrite output file if it exists')
+    return parser
+
+
+def main():
+    info('merge-graphs.py', ['counting'])
+    args = sanitize_help(get_parser()).parse_args()
+
+    for name in args.input_graph_filename:
+        check_input_files(name, args.force)
+    check_file_writable(args.output_graph_filename)
+    if args.block_size < 1:
+        print('** ERROR: --block-size must be positive', file=sys.stderr)
+        sys.exit(1)
+
+    print('merging', len(args.input_graph_filename), 'graphs into',
+          args.output_graph_filename, file=sys.stderr)
+    try:
+        khmer.merge_graph_files(args.output_graph_filename,
+                                args.input_graph_filename, args.block_size)
+    except (OSError, ValueError) as error:
+        print('** ERROR: {error}'.format(error=error), file=sys.stderr)
+        sys.exit(1)
+
+    print('wrote to:', args.output_graph_filename, file=sys.stderr)
+
+if __name__ == '__main__':
+    main()
+
+# vim: set ft=python ts=4 sts=4 sw=4 et tw=79:
@@ -171,22 +171,25 @@ class Normalizer(object):
         """
         desired_coverage = self.desired_coverage
 
-        passed_filter = False
-
         batch = []
         batch.append(read0)
         if read1 is not None:
             batch.append(read1)
 
-        for record in batch:
+        # the first read below desired coverage is consumed as its median
+        # is checked, hashing it once; the rest of the batch after it.
+        passed = None
+        for i, record in enumerate(batch):
             seq = record.sequence.replace('N', 'A')
-            if not self.countgraph.median_at_least(seq, desired_coverage):
-                passed_filter = True
-
-        if passed_filter:
-            for record in batch:
-                seq = record.sequence.replace('N', 'A')
-                self.countgraph.consume(seq)
+            if self.countgraph.consume_if_median_below(seq, desired_coverage):
+                passed = i
+                break
+
+        if passed is not None:
+            for i, record in enumerate(batch):
+                if i != passed:
+                    seq = record.sequence.replace('N', 'A')
+                    self.countgraph.consume(seq)
                 yield record
 
 
@@ -345,7 +348,7 @@ def main():  # pylint: disable=too-many-branches,too-many-statements
     if args.loadgraph:
         log_info('loading k-mer countgraph from {graph}',
                  graph=args.loadgraph)
-        countgraph = khmer.load_countgraph(args.loadgraph)
+        countgraph = khmer.load_countgraph(args.loadgraph, mmap_mode='c')
     else:
         log_info('making countgraph')
         countgraph = khmer_args.create_countgraph(args)
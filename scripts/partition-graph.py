@@ -97,6 +97,11 @@ def get_parser():
     epilog = """\
     The resulting partition maps are saved as ``${basename}.subset.#.pmap``
     files.
+
+    With :option:`--no-subsets`, all of the tags are partitioned in memory
+    on :option:`--threads` threads, and the partition map is saved directly
+    as ``${basename}.pmap.merged``, with no subset files;
+    :program:`merge-partitions.py` is then not needed.
     """
     parser = argparse.ArgumentParser(
         description="Partition a sequence graph based upon waypoint "
@@ -113,6 +118,9 @@ def get_parser():
     parser.add_argument('--no-big-traverse', action='store_true',
                         default=False, help='Truncate graph joins at big '
                         'traversals')
+    parser.add_argument('--no-subsets', action='store_true', default=False,
+                        help='Partition in memory and save the merged '
+                        'partition map, without subset files')
     parser.add_argument('--version', action=_VersionStdErrAction,
                         version='khmer {v}'.format(v=__version__))
     parser.add_argument('-f', '--force', default=False, action='store_true',
@@ -159,6 +167,16 @@ def main():
     # now, partition!
     #
 
+    if args.no_subsets:
+        print('partitioning on %d threads' % args.threads, file=sys.stderr)
+        nodegraph.do_partition(threads=args.threads, break_on_stop_tags=True,
+                               stop_big_traversals=stop_big_traversals)
+
+        output_file = basename + '.pmap.merged'
+        print('saving merged to', output_file, file=sys.stderr)
+        nodegraph.save_partitionmap(output_file)
+        return
+
     # divide the tags up into subsets
     divvy = nodegraph.divide_tags_into_subsets(int(args.subset_size))
     n_subsets = len(divvy)
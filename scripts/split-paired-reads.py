@@ -45,16 +45,13 @@ files (.1 and .2).
 Reads FASTQ and FASTA input, retains format for output.
 """
 from __future__ import print_function
-import screed
 import sys
 import os
 import textwrap
 import argparse
-from khmer import __version__
+from khmer import __version__, ReadParser, paired_reads_to_files
 from khmer.khmer_args import (info, sanitize_help, ComboFormatter,
                               _VersionStdErrAction)
-from khmer.utils import (write_record, broken_paired_reader,
-                         UnpairedReadsError)
 from khmer.kfile import (check_input_files, check_space,
                          add_output_compression_type,
                          get_file_writer, is_block, describe_file_handle)
@@ -165,34 +162,23 @@ def main():
         fp_out0 = get_file_writer(args.output_orphaned, args.gzip, args.bzip)
         out0 = describe_file_handle(args.output_orphaned)
 
-    counter1 = 0
-    counter2 = 0
-    counter3 = 0
-    index = None
+    if infile == '-':
+        infile = '/dev/stdin'
 
-    screed_iter = screed.open(infile)
-
-    # walk through all the reads in broken-paired mode.
-    paired_iter = broken_paired_reader(screed_iter,
-                                       require_paired=not args.output_orphaned)
+    # walk through all the reads in broken-paired mode, in C++.
+    if args.output_orphaned:
+        pair_mode = ReadParser.PAIR_MODE_ALLOW_UNPAIRED
+    else:
+        pair_mode = ReadParser.PAIR_MODE_ERROR_ON_UNPAIRED
+        fp_out0 = None
 
     try:
-        for index, is_pair, record1, record2 in paired_iter:
-            if index % 10000 == 0:
-                print('...', index, file=sys.stderr)
-
-            if is_pair:
-                write_record(record1, fp_out1)
-                counter1 += 1
-                write_record(record2, fp_out2)
-                counter2 += 1
-            elif args.output_orphaned:
-                write_record(record1, fp_out0)
-                counter3 += 1
-    except UnpairedReadsError as e:
-        print("Unpaired reads found starting at {name}; exiting".format(
-            name=e.r1.name), file=sys.stderr)
+        counter1, counter3 = paired_reads_to_files(infile, fp_out1, fp_out2,
+                                                   fp_out0, pair_mode)
+    except ValueError as err:
+        print("%s; exiting" % err, file=sys.stderr)
         sys.exit(1)
+    counter2 = counter1
 
     print("DONE; split %d sequences (%d left, %d right, %d orphans)" %
           (counter1 + counter2, counter1, counter2, counter3), file=sys.stderr)
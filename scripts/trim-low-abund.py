@@ -169,7 +169,7 @@ def main():
 
     if args.loadgraph:
         print('loading countgraph from', args.loadgraph, file=sys.stderr)
-        ct = khmer.load_countgraph(args.loadgraph)
+        ct = khmer.load_countgraph(args.loadgraph, mmap_mode='c')
     else:
         print('making countgraph', file=sys.stderr)
         ct = khmer_args.create_countgraph(args)
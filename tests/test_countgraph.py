@@ -38,7 +38,9 @@ from __future__ import absolute_import, unicode_literals
 import gzip
 
 import os
+import random
 import shutil
+import threading
 
 import khmer
 from . import khmer_tst_utils as utils
@@ -287,6 +289,22 @@ def test_median_at_least():
     assert hi.median_at_least("AAAAAA", 6) is False
 
 
+def test_consume_if_median_below():
+    hi = khmer.Countgraph(6, 1e6, 2)
+
+    for count in range(1, 4):
+        assert hi.consume_if_median_below("AAAAAA", 3) is True
+        assert hi.get("AAAAAA") == count
+    assert hi.consume_if_median_below("AAAAAA", 3) is False
+    assert hi.get("AAAAAA") == 3
+
+    try:
+        hi.consume_if_median_below("A", 3)
+        assert 0, "this should fail"
+    except ValueError:
+        pass
+
+
 def test_median_at_least_single_gt():
     K = 20
     hi = khmer.Countgraph(K, 1e6, 2)
@@ -340,6 +358,28 @@ def test_median_at_least_odd_lt():
         assert hi.median_at_least(seq, 2) is False
 
 
+def test_median_at_least_then_consume_similar_reads():
+    # all tables on a thread hash reads into the same block; make sure a
+    # read differing in one base, or a table with a different k, doesn't
+    # get the hashes of the last read.
+    hi = khmer.Countgraph(20, 1e6, 2)
+    hi_k21 = khmer.Countgraph(21, 1e6, 2)
+
+    seq1 = 'ATCGATCGATCGATCGATCGCC'
+    seq2 = 'ATCGATCGATCGATCGATCGCG'
+
+    assert hi.median_at_least(seq1, 1) is False
+    hi.consume(seq1)
+    assert hi.median_at_least(seq1, 1) is True
+    assert hi_k21.median_at_least(seq1, 1) is False
+
+    hi.consume(seq2)
+    assert hi.get(seq1[:20]) == 2
+    assert hi.get(seq1[-20:]) == 1
+    assert hi.get(seq2[-20:]) == 1
+    assert hi_k21.consume(seq1) == 2
+
+
 # Test median with even number of k-mers
 def test_median_at_least_even_gt():
     K = 20
@@ -933,6 +973,134 @@ def test_bigcount_overflow():
     assert kh.get('GGTTGACGGGGCTCAGGG') == MAX_BIGCOUNT
 
 
+def test_bigcount_many_kmers_save_load():
+    # enough k-mers above MAX_COUNT to grow every shard of the bigcounts.
+    random.seed(1)
+    seq = ''.join(random.choice('ACGT') for _ in range(2000))
+    kh = khmer.Countgraph(12, 1e6, 4)
+    kh.set_use_bigcount(True)
+    for i in range(300):
+        kh.consume(seq)
+    kh.consume(seq[:1000])
+
+    kmers = [seq[i:i + 12] for i in range(len(seq) - 11)]
+    counts = [kh.get(kmer) for kmer in kmers]
+    assert min(counts) >= 300, min(counts)
+    assert max(counts) > 300, max(counts)
+
+    for name in ('tempbigcount.ct', 'tempbigcount.ct.gz'):
+        savepath = utils.get_temp_filename(name)
+        kh.save(savepath)
+
+        loaded = khmer.load_countgraph(savepath)
+        assert loaded.get_use_bigcount()
+        assert [loaded.get(kmer) for kmer in kmers] == counts
+
+
+def test_bigcount_threaded():
+    seqpath = utils.get_test_data('test-abund-read-2.fa')
+
+    single = khmer.Countgraph(18, 1e7, 4)
+    single.set_use_bigcount(True)
+    single.consume_fasta(seqpath)
+
+    kh = khmer.Countgraph(18, 1e7, 4)
+    kh.set_use_bigcount(True)
+    rparser = ReadParser(seqpath)
+    threads = [threading.Thread(target=kh.consume_fasta_with_reads_parser,
+                                args=(rparser,)) for _ in range(8)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    assert kh.get('GGTTGACGGGGCTCAGGG') == 1001
+    for record in screed.open(seqpath):
+        assert kh.get_kmer_counts(record.sequence) == \
+            single.get_kmer_counts(record.sequence), record.name
+
+
+def test_consume_fasta_threads():
+    seqpath = utils.get_test_data('random-20-a.fa')
+
+    single = khmer.Countgraph(12, 1e5, 4)
+    n_reads, n_consumed = single.consume_fasta(seqpath)
+
+    for n_threads in (2, 4, 16):
+        kh = khmer.Countgraph(12, 1e5, 4)
+        assert kh.consume_fasta(seqpath, threads=n_threads) == \
+            (n_reads, n_consumed)
+        assert kh.n_unique_kmers() == single.n_unique_kmers()
+        for record in screed.open(seqpath):
+            assert kh.get_kmer_counts(record.sequence) == \
+                single.get_kmer_counts(record.sequence), record.name
+
+
+def test_consume_fasta_with_reads_parser_threads():
+    seqpath = utils.get_test_data('test-abund-read-2.fa')
+
+    single = khmer.Countgraph(18, 1e7, 4)
+    single.set_use_bigcount(True)
+    n_reads, n_consumed = single.consume_fasta(seqpath)
+
+    kh = khmer.Countgraph(18, 1e7, 4)
+    kh.set_use_bigcount(True)
+    rparser = ReadParser(seqpath)
+    assert kh.consume_fasta_with_reads_parser(rparser, threads=4) == \
+        (n_reads, n_consumed)
+    assert rparser.num_reads == n_reads
+    assert kh.get('GGTTGACGGGGCTCAGGG') == 1001
+
+
+def test_consume_fasta_threads_truncated():
+    kh = khmer.Countgraph(12, 1e5, 4)
+    try:
+        kh.consume_fasta(utils.get_test_data('truncated.fq'), threads=4)
+        assert 0, "should raise ValueError on a truncated file"
+    except ValueError as err:
+        assert "Sequence is empty" in str(err), str(err)
+
+
+def _write_split_test_reads(filename, fastq, wrap=0):
+    # enough reads that the file is split into several byte ranges, with
+    # quality lines that start with '@' and look like records.
+    rng = random.Random(1)
+    with open(filename, 'w') as fp:
+        for i in range(4000):
+            seq = ''.join(rng.choice('ACGT') for _ in range(rng.randint(40,
+                                                                        120)))
+            lines = [seq[j:j + wrap] for j in range(0, len(seq), wrap)] \
+                if wrap else [seq]
+            if fastq:
+                qual = rng.choice('@I') * len(seq)
+                fp.write('@read%d\n%s\n+\n%s\n' % (i, '\n'.join(lines), qual))
+            else:
+                fp.write('>read%d\n%s\n' % (i, '\n'.join(lines)))
+
+
+def test_consume_fasta_split():
+    for fastq, wrap in ((True, 0), (False, 0), (False, 30), (True, 30)):
+        seqpath = utils.get_temp_filename('split.fq')
+        _write_split_test_reads(seqpath, fastq, wrap)
+
+        single = khmer.Countgraph(12, 1e6, 4)
+        n_reads, n_consumed = single.consume_fasta(seqpath)
+        assert n_reads == 4000, n_reads
+        tracking = khmer.Nodegraph(12, 1e7, 4)
+        dist = single.abundance_distribution(seqpath, tracking)
+
+        for n_threads in (2, 3, 8):
+            kh = khmer.Countgraph(12, 1e6, 4)
+            assert kh.consume_fasta(seqpath, threads=n_threads) == \
+                (n_reads, n_consumed)
+            for read in ReadParser(seqpath):
+                assert kh.get_kmer_counts(read.sequence) == \
+                    single.get_kmer_counts(read.sequence), read.name
+            tracking = khmer.Nodegraph(12, 1e7, 4)
+            assert kh.abundance_distribution(seqpath, tracking,
+                                             n_threads) == dist
+
+
 def test_get_ksize():
     kh = khmer.Countgraph(22, 1, 1)
     assert kh.ksize() == 22
@@ -1286,6 +1454,27 @@ def test_consume_fasta_and_tag():
     countgraph.consume_fasta_and_tag(utils.get_test_data("test-graph2.fa"))
 
 
+def test_consume_and_tag_table_layouts():
+    # each table type tests and sets a read's k-mers a batch at a time;
+    # with tables this large they should all agree.
+    graphs = [khmer.Countgraph(20, 1e6, 4),
+              khmer.BlockedCountgraph(20, 1e6, 4),
+              khmer.Nodegraph(20, 1e6, 4),
+              khmer.BlockedNodegraph(20, 1e6, 4)]
+    filename = utils.get_test_data('random-20-a.fa')
+
+    results = []
+    for graph in graphs:
+        n_consumed = 0
+        for record in screed.open(filename):
+            n_consumed += graph.consume_and_tag(record.sequence)
+        results.append((n_consumed, sorted(graph.get_tagset())))
+
+    assert results[0][1]
+    for result in results[1:]:
+        assert result == results[0]
+
+
 def test_consume_and_retrieve_tags_1():
     ct = khmer.Countgraph(4, 4 ** 4, 4)
 
@@ -1434,3 +1623,724 @@ def test_counting_load_bigcount():
         print(i, count_table.count('ATATATATAT'))
     count = count_table.get('ATATATATAT')
     assert count == 500
+
+
+def test_blocked_count_get():
+    kh = khmer.BlockedCountgraph(12, 1e4, 4)
+    assert kh.n_tables() == 4
+    assert kh.hashsizes() == utils.longify([40000]), kh.hashsizes()
+
+    kh.consume('AAAAAAAAAAAACCCCCCCCCCCC')
+    assert kh.get('AAAAAAAAAAAA') == 1
+    assert kh.get('AAAAAAAAAACC') == 1
+    assert kh.get('GGGGGGGGGGGG') == 1        # reverse complement
+    assert kh.get('ACGTACGTACGT') == 0
+    assert kh.n_unique_kmers() == 13
+    # two of the k-mers share one slot of a block.
+    assert kh.n_occupied() == 13 * 4 - 1, kh.n_occupied()
+
+
+def test_blocked_tablesize_rounding():
+    kh = khmer.BlockedCountgraph(12, 10, 1)
+    assert kh.hashsizes() == utils.longify([64]), kh.hashsizes()
+
+    kh = khmer.BlockedCountgraph(12, 33, 2)
+    assert kh.hashsizes() == utils.longify([128]), kh.hashsizes()
+
+
+def test_blocked_bad_n_tables():
+    assert_raises(ValueError, khmer.BlockedCountgraph, 12, 1e4, 0)
+    assert_raises(ValueError, khmer.BlockedCountgraph, 12, 1e4, 65)
+
+
+def test_blocked_matches_countgraph():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    kh = khmer.Countgraph(12, 1e6, 4)
+    kh.consume_fasta(inpath)
+
+    bh = khmer.BlockedCountgraph(12, 1e6, 4)
+    bh.consume_fasta(inpath)
+
+    for record in screed.open(inpath):
+        assert kh.get_kmer_counts(record.sequence) == \
+            bh.get_kmer_counts(record.sequence), record.name
+
+
+def test_blocked_bigcount():
+    kh = khmer.BlockedCountgraph(18, 1e5, 4)
+    kh.set_use_bigcount(True)
+
+    for i in range(0, 1000):
+        kh.count('GGTTGACGGGGCTCAGGG')
+
+    assert kh.get('GGTTGACGGGGCTCAGGG') == 1000
+
+
+def test_blocked_save_load():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for name in ('tempblocked.ct', 'tempblocked.ct.gz'):
+        savepath = utils.get_temp_filename(name)
+
+        hi = khmer.BlockedCountgraph(12, 1e5, 4)
+        hi.set_use_bigcount(True)
+        hi.consume_fasta(inpath)
+        for i in range(0, 300):
+            hi.count('GGTTGACGGGGC')
+        hi.save(savepath)
+
+        ht = khmer.load_countgraph(savepath)
+        assert isinstance(ht, khmer._BlockedCountgraph), type(ht)
+        assert ht.n_tables() == 4
+        assert ht.hashsizes() == hi.hashsizes()
+        assert ht.n_occupied() == hi.n_occupied()
+        assert ht.get('GGTTGACGGGGC') == 300
+
+        for record in screed.open(inpath):
+            assert hi.get_kmer_counts(record.sequence) == \
+                ht.get_kmer_counts(record.sequence), record.name
+
+
+def test_blocked_load_wrong_type():
+    savepath = utils.get_temp_filename('tempblocked.ct')
+    countpath = utils.get_temp_filename('tempcounting.ct')
+
+    khmer.BlockedCountgraph(12, 1000, 2).save(savepath)
+    khmer.Countgraph(12, 1000, 2).save(countpath)
+
+    try:
+        khmer._Countgraph(1, [1]).load(savepath)
+        assert 0, "load should fail"
+    except OSError as e:
+        assert 'Incorrect file format type' in str(e), str(e)
+
+    try:
+        khmer._BlockedCountgraph(1, 1, 1).load(countpath)
+        assert 0, "load should fail"
+    except OSError as e:
+        assert 'Incorrect file format type' in str(e), str(e)
+
+
+def test_fastrange_count_get():
+    kh = khmer.Countgraph(12, 1e4, 4, fastrange=True)
+    assert kh.get_use_fastrange()
+    assert kh.hashsizes() == utils.longify([10000] * 4), kh.hashsizes()
+    assert not khmer.Countgraph(12, 1e4, 4).get_use_fastrange()
+
+    kh.consume('AAAAAAAAAAAACCCCCCCCCCCC')
+    kh.consume('AAAAAAAAAAAACCCCCCCCCCCC')
+    assert kh.get('AAAAAAAAAAAA') == 2
+    assert kh.get('GGGGGGGGGGGG') == 2        # reverse complement
+    assert kh.get('ACGTACGTACGT') == 0
+    assert kh.n_unique_kmers() == 13
+    assert kh.n_occupied() == 13, kh.n_occupied()
+
+
+def test_fastrange_matches_countgraph():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    kh = khmer.Countgraph(12, 1e6, 4)
+    kh.consume_fasta(inpath)
+
+    fh = khmer.Countgraph(12, 1e6, 4, fastrange=True)
+    fh.consume_fasta(inpath)
+
+    for record in screed.open(inpath):
+        assert kh.get_kmer_counts(record.sequence) == \
+            fh.get_kmer_counts(record.sequence), record.name
+
+
+def test_fastrange_save_load():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for name in ('tempfastrange.ct', 'tempfastrange.ct.gz'):
+        savepath = utils.get_temp_filename(name)
+
+        hi = khmer.Countgraph(12, 1e5, 3, fastrange=True)
+        hi.consume_fasta(inpath)
+        hi.save(savepath)
+
+        ht = khmer.load_countgraph(savepath)
+        assert ht.get_use_fastrange()
+        assert ht.hashsizes() == hi.hashsizes()
+
+        for record in screed.open(inpath):
+            assert hi.get_kmer_counts(record.sequence) == \
+                ht.get_kmer_counts(record.sequence), record.name
+
+        # loading a modulo-prime table turns fastrange off again.
+        plain = khmer.Countgraph(12, 1e5, 3)
+        plain.save(savepath)
+        ht.load(savepath)
+        assert not ht.get_use_fastrange()
+
+
+def test_prefetch_distance():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for make in (lambda: khmer.Countgraph(12, 1e4, 4),
+                 lambda: khmer.Countgraph(12, 1e4, 4, fastrange=True),
+                 lambda: khmer.BlockedCountgraph(12, 1e4, 4)):
+        plain = make()
+        plain.set_prefetch_distance(0)
+        assert plain.get_prefetch_distance() == 0
+
+        batched = make()
+        assert batched.get_prefetch_distance() > 0
+        batched.set_prefetch_distance(7)
+        assert batched.get_prefetch_distance() == 7
+
+        plain.consume_fasta(inpath)
+        batched.consume_fasta(inpath)
+        assert plain.n_occupied() == batched.n_occupied()
+
+        for record in screed.open(inpath):
+            seq = record.sequence
+            assert plain.get_kmer_counts(seq) == batched.get_kmer_counts(seq)
+            assert plain.get_median_count(seq) == \
+                batched.get_median_count(seq)
+            for cutoff in (1, 2, 3):
+                assert plain.median_at_least(seq, cutoff) == \
+                    batched.median_at_least(seq, cutoff)
+
+
+def test_packed_count_get():
+    for bits, max_count in ((4, 15), (2, 3)):
+        kh = khmer.PackedCountgraph(12, 1e4, 4, bits)
+        assert kh.get_counter_bits() == bits
+        assert kh.hashsizes() == khmer.Countgraph(12, 1e4, 4).hashsizes()
+
+        for i in range(20):
+            kh.count('AAAAAAAAAAAA')
+            assert kh.get('AAAAAAAAAAAA') == min(i + 1, max_count)
+        assert kh.get('TTTTTTTTTTTT') == max_count    # reverse complement
+        assert kh.get('ACGTACGTACGT') == 0
+        assert kh.n_unique_kmers() == 1
+        assert kh.n_occupied() == 1
+
+        # neighboring counters are left alone.
+        kh.consume('AAAAAAAAAAAACCCCCCCCCCCC')
+        assert kh.get('AAAAAAAAAACC') == 1
+        assert kh.get('AAAAAAAAAAAA') == max_count
+
+    assert khmer.Countgraph(12, 1e4, 4).get_counter_bits() == 8
+
+
+def test_packed_bad_counter_bits():
+    for bits in (0, 1, 3, 8, 16):
+        assert_raises(ValueError, khmer.PackedCountgraph, 12, 1e4, 4, bits)
+
+
+def test_packed_no_bigcount():
+    for bits in (4, 2):
+        kh = khmer.PackedCountgraph(12, 1e4, 4, bits)
+        assert_raises(ValueError, kh.set_use_bigcount, True)
+        assert not kh.get_use_bigcount()
+        kh.set_use_bigcount(False)
+        assert not kh.get_use_bigcount()
+
+
+def test_packed_matches_countgraph():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for fastrange in (False, True):
+        kh = khmer.Countgraph(12, 1e5, 4, fastrange)
+        kh.consume_fasta(inpath)
+        kh.consume_fasta(inpath)
+
+        for bits in (4, 2):
+            ph = khmer.PackedCountgraph(12, 1e5, 4, bits, fastrange)
+            ph.consume_fasta(inpath)
+            ph.consume_fasta(inpath)
+            assert ph.n_occupied() == kh.n_occupied()
+
+            for record in screed.open(inpath):
+                counts = kh.get_kmer_counts(record.sequence)
+                expected = [min(c, 2 ** bits - 1) for c in counts]
+                assert ph.get_kmer_counts(record.sequence) == expected
+
+
+def test_packed_raw_tables():
+    kh = khmer.PackedCountgraph(12, 1e4, 2, 4)
+    tables = kh.get_raw_tables()
+    assert [len(t) for t in tables] == \
+        [(size + 1) // 2 for size in kh.hashsizes()]
+
+    kh = khmer.PackedCountgraph(12, 1e4, 2, 2)
+    tables = kh.get_raw_tables()
+    assert [len(t) for t in tables] == \
+        [(size + 3) // 4 for size in kh.hashsizes()]
+
+
+def test_packed_save_load():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for bits in (4, 2):
+        for name in ('temppacked.ct', 'temppacked.ct.gz'):
+            savepath = utils.get_temp_filename(name)
+
+            hi = khmer.PackedCountgraph(12, 1e5, 3, bits, True)
+            hi.consume_fasta(inpath)
+            hi.consume_fasta(inpath)
+            hi.save(savepath)
+
+            ht = khmer.load_countgraph(savepath)
+            assert isinstance(ht, khmer._PackedCountgraph), type(ht)
+            assert ht.get_counter_bits() == bits
+            assert ht.get_use_fastrange()
+            assert ht.hashsizes() == hi.hashsizes()
+            assert ht.n_occupied() == hi.n_occupied()
+
+            for record in screed.open(inpath):
+                assert hi.get_kmer_counts(record.sequence) == \
+                    ht.get_kmer_counts(record.sequence), record.name
+
+
+def test_packed_file_type():
+    savepath = utils.get_temp_filename('temppacked.ct')
+
+    for bits, ht_type in ((4, 9), (2, 10)):
+        khmer.PackedCountgraph(12, 1000, 2, bits).save(savepath)
+        info = khmer.extract_countgraph_info(savepath)
+        assert info[5] == ht_type, info
+
+
+def test_packed_load_wrong_type():
+    savepath = utils.get_temp_filename('temppacked.ct')
+    countpath = utils.get_temp_filename('tempcounting.ct')
+
+    khmer.PackedCountgraph(12, 1000, 2, 4).save(savepath)
+    khmer.Countgraph(12, 1000, 2).save(countpath)
+
+    try:
+        khmer._Countgraph(1, [1]).load(savepath)
+        assert 0, "load should fail"
+    except OSError as e:
+        assert 'Incorrect file format type' in str(e), str(e)
+
+    for bits in (4, 2):
+        try:
+            khmer._PackedCountgraph(1, [1], bits).load(countpath)
+            assert 0, "load should fail"
+        except OSError as e:
+            assert 'Incorrect file format type' in str(e), str(e)
+
+
+def test_page_aligned_save_load():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('tempaligned.ct')
+
+    for hi, graph_type in \
+            ((khmer.Countgraph(12, 1e5, 4, fastrange=True), khmer._Countgraph),
+             (khmer.BlockedCountgraph(12, 1e5, 4), khmer._BlockedCountgraph),
+             (khmer.PackedCountgraph(12, 1e5, 3, 4), khmer._PackedCountgraph)):
+        hi.set_use_bigcount(hi.get_counter_bits() == 8)
+        hi.consume_fasta(inpath)
+        for i in range(0, 300):
+            hi.count('GGTTGACGGGGC')
+        hi.save(savepath, page_aligned=True)
+
+        info = khmer.extract_countgraph_info(savepath)
+        assert info[5] & 0x40, info
+
+        for mode in (None, 'r', 'c'):
+            ht = khmer.load_countgraph(savepath, mmap_mode=mode)
+            assert isinstance(ht, graph_type), type(ht)
+            assert ht.is_read_only() == (mode == 'r')
+            assert ht.hashsizes() == hi.hashsizes()
+            assert ht.n_occupied() == hi.n_occupied()
+            assert ht.get('GGTTGACGGGGC') == hi.get('GGTTGACGGGGC')
+
+            for record in screed.open(inpath):
+                assert hi.get_kmer_counts(record.sequence) == \
+                    ht.get_kmer_counts(record.sequence), record.name
+
+
+def test_page_aligned_read_only():
+    savepath = utils.get_temp_filename('tempaligned.ct')
+    otherpath = utils.get_temp_filename('tempother.ct')
+
+    hi = khmer.Countgraph(12, 1e4, 2)
+    hi.consume('GGTTGACGGGGCTCAGGG')
+    hi.save(savepath, page_aligned=True)
+
+    ht = khmer.load_countgraph(savepath, mmap_mode='r')
+    for change in (lambda: ht.count('GGTTGACGGGGC'),
+                   lambda: ht.consume('GGTTGACGGGGCTCAGGG')):
+        try:
+            change()
+            assert 0, "changing a read-only table should fail"
+        except ValueError as e:
+            assert 'read-only' in str(e), str(e)
+    assert ht.get('GGTTGACGGGGC') == 1
+    assert ht.get_raw_tables()[0].readonly
+
+    try:
+        ht.save(savepath)
+        assert 0, "saving over the mapped file should fail"
+    except OSError as e:
+        assert 'loaded from' in str(e), str(e)
+
+    ht.save(otherpath)
+    assert khmer.load_countgraph(otherpath).get('GGTTGACGGGGC') == 1
+
+
+def test_page_aligned_copy_on_write():
+    savepath = utils.get_temp_filename('tempaligned.ct')
+
+    hi = khmer.Countgraph(12, 1e4, 2)
+    hi.consume('GGTTGACGGGGCTCAGGG')
+    hi.save(savepath, page_aligned=True)
+
+    ht = khmer.load_countgraph(savepath, mmap_mode='c')
+    ht.count('GGTTGACGGGGC')
+    assert ht.get('GGTTGACGGGGC') == 2
+
+    # the file is unchanged.
+    assert khmer.load_countgraph(savepath).get('GGTTGACGGGGC') == 1
+
+
+def test_page_aligned_bad_args():
+    savepath = utils.get_temp_filename('tempaligned.ct')
+    plainpath = utils.get_temp_filename('tempplain.ct')
+
+    hi = khmer.Countgraph(12, 1e4, 2)
+    hi.consume('GGTTGACGGGGCTCAGGG')
+    hi.save(plainpath)
+
+    try:
+        hi.save(savepath + '.gz', page_aligned=True)
+        assert 0, "saving a gzipped page-aligned file should fail"
+    except ValueError as e:
+        assert 'gzipped' in str(e), str(e)
+
+    try:
+        khmer.load_countgraph(plainpath, mmap_mode='w')
+        assert 0, "load should fail"
+    except ValueError as e:
+        assert 'mmap_mode' in str(e), str(e)
+
+    # files saved without page_aligned are read.
+    ht = khmer.load_countgraph(plainpath, mmap_mode='r')
+    assert not ht.is_read_only()
+    assert ht.get('GGTTGACGGGGC') == 1
+
+
+def test_page_aligned_load_truncated():
+    savepath = utils.get_temp_filename('tempaligned.ct')
+
+    hi = khmer.Countgraph(12, 1e5, 2)
+    hi.save(savepath, page_aligned=True)
+
+    with open(savepath, 'rb') as fp:
+        data = fp.read()
+    with open(savepath, 'wb') as fp:
+        fp.write(data[:len(data) // 2])
+
+    for mode in (None, 'r', 'c'):
+        try:
+            khmer.load_countgraph(savepath, mmap_mode=mode)
+            assert 0, "load should fail"
+        except OSError as e:
+            assert 'end of k-mer' in str(e), str(e)
+
+
+def test_chunked_save_load():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('tempchunked.ct')
+
+    for hi, graph_type in \
+            ((khmer.Countgraph(12, 3e6, 2), khmer._Countgraph),
+             (khmer.BlockedCountgraph(12, 1e5, 4), khmer._BlockedCountgraph),
+             (khmer.PackedCountgraph(12, 1e5, 3, 4), khmer._PackedCountgraph)):
+        hi.set_use_bigcount(hi.get_counter_bits() == 8)
+        hi.consume_fasta(inpath)
+        for i in range(0, 300):
+            hi.count('GGTTGACGGGGC')
+
+        for codec in ('zlib', 'none'):
+            for threads in (1, 3):
+                hi.save_chunked(savepath, codec, threads)
+
+                info = khmer.extract_countgraph_info(savepath)
+                assert info[5] & 0x20, info
+
+                ht = khmer.load_countgraph(savepath, threads=threads)
+                assert isinstance(ht, graph_type), type(ht)
+                assert ht.hashsizes() == hi.hashsizes()
+                assert ht.n_occupied() == hi.n_occupied()
+                assert ht.get('GGTTGACGGGGC') == hi.get('GGTTGACGGGGC')
+                assert [bytes(t) for t in ht.get_raw_tables()] == \
+                    [bytes(t) for t in hi.get_raw_tables()]
+
+        for record in screed.open(inpath):
+            assert hi.get_kmer_counts(record.sequence) == \
+                ht.get_kmer_counts(record.sequence), record.name
+
+
+def test_chunked_bigcount():
+    savepath = utils.get_temp_filename('tempchunked.ct')
+
+    hi = khmer.Countgraph(12, 1e4, 2)
+    hi.set_use_bigcount(True)
+    for i in range(0, 300):
+        hi.count('GGTTGACGGGGC')
+    hi.save_chunked(savepath)
+
+    # the bigcounts follow the tables.
+    assert len(khmer.read_chunked_table(savepath, 2)) > 0
+    ht = khmer.load_countgraph(savepath)
+    assert ht.get('GGTTGACGGGGC') == 300
+
+
+def test_read_chunked_table():
+    savepath = utils.get_temp_filename('tempchunked.ct')
+
+    hi = khmer.Countgraph(12, 3e6, 2)
+    hi.consume_fasta(utils.get_test_data('random-20-a.fa'))
+    hi.save_chunked(savepath, threads=2)
+
+    for i, table in enumerate(hi.get_raw_tables()):
+        assert khmer.read_chunked_table(savepath, i, 2) == bytes(table)
+
+    try:
+        khmer.read_chunked_table(savepath, 3)
+        assert 0, "reading a missing table should fail"
+    except ValueError as e:
+        assert 'no such table' in str(e), str(e)
+
+
+def test_chunked_bad_args():
+    savepath = utils.get_temp_filename('tempchunked.ct')
+
+    hi = khmer.Countgraph(12, 1e4, 2)
+    try:
+        hi.save_chunked(savepath, 'lz4')
+        assert 0, "save_chunked should fail"
+    except ValueError as e:
+        assert 'codec' in str(e), str(e)
+
+    try:
+        hi.save_chunked(savepath, threads=0)
+        assert 0, "save_chunked should fail"
+    except ValueError as e:
+        assert 'threads' in str(e), str(e)
+
+
+def test_chunked_load_corrupt():
+    savepath = utils.get_temp_filename('tempchunked.ct')
+
+    hi = khmer.Countgraph(12, 1e5, 2)
+    hi.consume_fasta(utils.get_test_data('random-20-a.fa'))
+    hi.save_chunked(savepath)
+
+    with open(savepath, 'rb') as fp:
+        data = fp.read()
+
+    # a truncated file has lost its index; a damaged block fails its check.
+    for damaged, message in ((data[:-20], 'block index'),
+                             (data[:200] + b'x' * 50 + data[250:],
+                              'Corrupt block')):
+        with open(savepath, 'wb') as fp:
+            fp.write(damaged)
+        try:
+            khmer.load_countgraph(savepath)
+            assert 0, "load should fail"
+        except OSError as e:
+            assert message in str(e), str(e)
+
+
+def test_save_load_sparse():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for hi, graph_type in \
+            ((khmer.Countgraph(12, 1e6, 4), khmer._Countgraph),
+             (khmer.PackedCountgraph(12, 1e6, 3, 4), khmer._PackedCountgraph),
+             (khmer.PackedCountgraph(12, 1e6, 3, 2), khmer._PackedCountgraph)):
+        hi.set_use_bigcount(hi.get_counter_bits() == 8)
+        hi.consume_fasta(inpath)
+        for i in range(0, 300):
+            hi.count('GGTTGACGGGGC')
+
+        for savepath in (utils.get_temp_filename('tempsparse.ct'),
+                         utils.get_temp_filename('tempsparse.ct.gz')):
+            hi.save(savepath)
+            if not savepath.endswith('.gz'):
+                info = khmer.extract_countgraph_info(savepath)
+                assert info[5] & 0x10, info
+                assert os.path.getsize(savepath) < \
+                    sum(len(t) for t in hi.get_raw_tables()) / 2
+
+            ht = khmer.load_countgraph(savepath)
+            assert isinstance(ht, graph_type), type(ht)
+            assert ht.hashsizes() == hi.hashsizes()
+            assert ht.n_occupied() == hi.n_occupied()
+            assert ht.get('GGTTGACGGGGC') == hi.get('GGTTGACGGGGC')
+            assert [bytes(t) for t in ht.get_raw_tables()] == \
+                [bytes(t) for t in hi.get_raw_tables()]
+
+
+def test_save_dense_when_full():
+    savepath = utils.get_temp_filename('tempdense.ct')
+
+    hi = khmer.Countgraph(12, 1000, 2)
+    hi.consume_fasta(utils.get_test_data('random-20-a.fa'))
+    hi.save(savepath)
+
+    info = khmer.extract_countgraph_info(savepath)
+    assert not info[5] & 0x10, info
+
+
+def test_load_sparse_truncated():
+    savepath = utils.get_temp_filename('tempsparse.ct')
+    truncpath = utils.get_temp_filename('temptrunc.ct')
+
+    hi = khmer._Countgraph(12, khmer.get_n_primes_near_x(2, 70000))
+    hi.consume('GGTTGACGGGGCTCAGGGGGCGGCTCACTCCAGGGTGTGGGAGCGT')
+    hi.save(savepath)
+
+    with open(savepath, 'rb') as fp:
+        data = fp.read()
+    assert khmer.extract_countgraph_info(savepath)[5] & 0x10
+
+    for i in range(len(data)):
+        with open(truncpath, 'wb') as fp:
+            fp.write(data[:i])
+        try:
+            khmer.load_countgraph(truncpath)
+            assert 0, "load should fail"
+        except OSError as e:
+            print(str(e))
+
+
+def test_load_sparse_corrupt():
+    savepath = utils.get_temp_filename('tempsparse.ct')
+
+    hi = khmer._Countgraph(12, khmer.get_n_primes_near_x(2, 70000))
+    hi.consume('GGTTGACGGGGCTCAGGGGGCGGCTCACTCCAGGGTGTGGGAGCGT')
+    hi.save(savepath)
+
+    with open(savepath, 'rb') as fp:
+        data = bytearray(fp.read())
+
+    # the encoding byte of the first table follows the 20 byte header and
+    # the table size; then come the encoded size and the first gap, here
+    # made an unknown encoding and a gap too long for a varint.
+    for offset, damage in ((28, [7]), (37, [0xff] * 11)):
+        damaged = bytearray(data)
+        damaged[offset:offset + len(damage)] = bytearray(damage)
+        with open(savepath, 'wb') as fp:
+            fp.write(damaged)
+        try:
+            khmer.load_countgraph(savepath)
+            assert 0, "load should fail"
+        except OSError as e:
+            assert 'Corrupt table' in str(e), str(e)
+
+
+def test_merge_graph_files():
+    inpath = utils.get_test_data('random-20-a.fa')
+    records = list(screed.open(inpath))
+    outpath = utils.get_temp_filename('tempmerged.ct')
+
+    for make_graph, graph_type in \
+            ((lambda: khmer.Countgraph(12, 1e5, 3), khmer._Countgraph),
+             (lambda: khmer.BlockedCountgraph(12, 1e5, 3),
+              khmer._BlockedCountgraph),
+             (lambda: khmer.PackedCountgraph(12, 1e5, 3, 4),
+              khmer._PackedCountgraph),
+             (lambda: khmer.PackedCountgraph(12, 1e5, 3, 2),
+              khmer._PackedCountgraph)):
+        whole = make_graph()
+        parts = [make_graph(), make_graph(), make_graph()]
+        for i, record in enumerate(records):
+            whole.consume(record.sequence)
+            parts[i % 3].consume(record.sequence)
+
+        # one input of each layout.
+        inpaths = [utils.get_temp_filename('tempmerge%d.ct' % i)
+                   for i in range(3)]
+        inpaths[2] += '.gz'
+        parts[0].save(inpaths[0], page_aligned=True)
+        parts[1].save_chunked(inpaths[1])
+        parts[2].save(inpaths[2])
+
+        for block_size in (1000, 1 << 22):
+            khmer.merge_graph_files(outpath, inpaths, block_size)
+
+            merged = khmer.load_countgraph(outpath)
+            assert isinstance(merged, graph_type), type(merged)
+            assert merged.get_counter_bits() == whole.get_counter_bits()
+            assert merged.hashsizes() == whole.hashsizes()
+            assert merged.n_occupied() == whole.n_occupied()
+            assert [bytes(t) for t in merged.get_raw_tables()] == \
+                [bytes(t) for t in whole.get_raw_tables()]
+
+
+def test_merge_graph_files_bigcount():
+    kmer = 'GGTTGACGGGGC'
+    inpaths = [utils.get_temp_filename('tempmerge%d.ct' % i)
+               for i in range(3)]
+    outpath = utils.get_temp_filename('tempmerged.ct')
+
+    for use_bigcount, counts, expected in ((True, (300, 200, 100), 600),
+                                           (True, (100, 100, 100), 255),
+                                           (False, (300, 200, 100), 255)):
+        for inpath, count in zip(inpaths, counts):
+            hi = khmer.Countgraph(12, 1e5, 4)
+            hi.set_use_bigcount(use_bigcount)
+            for i in range(count):
+                hi.count(kmer)
+            hi.save(inpath)
+
+        khmer.merge_graph_files(outpath, inpaths)
+        merged = khmer.load_countgraph(outpath)
+        assert merged.get_use_bigcount() == use_bigcount
+        assert merged.get(kmer) == expected, merged.get(kmer)
+
+
+def test_merge_graph_files_mismatch():
+    inpath = utils.get_temp_filename('tempmerge.ct')
+    outpath = utils.get_temp_filename('tempmerged.ct')
+    khmer.Countgraph(12, 1e5, 4).save(inpath)
+
+    for other in (khmer.Countgraph(13, 1e5, 4),
+                  khmer.Countgraph(12, 1e5, 3),
+                  khmer.Countgraph(12, 2e5, 4),
+                  khmer.PackedCountgraph(12, 1e5, 4, 4),
+                  khmer.Nodegraph(12, 1e5, 4)):
+        otherpath = utils.get_temp_filename('tempother')
+        other.save(otherpath)
+        try:
+            khmer.merge_graph_files(outpath, [inpath, otherpath])
+            assert 0, "merge should fail"
+        except ValueError as e:
+            assert 'graphs to merge must' in str(e), str(e)
+
+    try:
+        khmer.merge_graph_files(inpath, [inpath])
+        assert 0, "merge should fail"
+    except ValueError as e:
+        assert 'into itself' in str(e), str(e)
+
+
+def test_merge_graph_files_truncated():
+    inpath = utils.get_temp_filename('tempmerge.ct')
+    truncpath = utils.get_temp_filename('temptrunc.ct')
+    outpath = utils.get_temp_filename('tempmerged.ct')
+
+    hi = khmer.Countgraph(12, 1000, 2)
+    hi.consume_fasta(utils.get_test_data('random-20-a.fa'))
+    hi.save(inpath)
+    with open(inpath, 'rb') as fp:
+        data = fp.read()
+
+    for i in range(0, len(data), 7):
+        with open(truncpath, 'wb') as fp:
+            fp.write(data[:i])
+        try:
+            khmer.merge_graph_files(outpath, [inpath, truncpath])
+            assert 0, "merge should fail"
+        except OSError as e:
+            print(str(e))
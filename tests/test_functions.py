@@ -131,6 +131,12 @@ def test_get_primes_fal():
         assert "unable to find 5 prime numbers < 5" in str(err)
 
 
+def test_get_primes_fastrange():
+    sizes = khmer.get_n_primes_near_x(3, 20.5, fastrange=True)
+
+    assert sizes == [20, 20, 20]
+
+
 def test_extract_countgraph_info_badfile():
     try:
         khmer.extract_countgraph_info(
@@ -118,6 +118,27 @@ def test_hll_consume_fasta():
     assert abs(1 - float(hllcpp.estimate_cardinality()) / N_UNIQUE) < ERR_RATE
 
 
+def test_hll_consume_fasta_normalizes():
+    # reads with lowercase bases and Ns are counted as their uppercased,
+    # N-to-A forms are.
+    filename = utils.get_temp_filename('mixed.fa')
+    seqs = ['ACGTACGTacgtacgtNNACGTACGTAC', 'acgtacgtacgtacgtacgtac',
+            'GGCATTAGCCATTAGGCATTCCAT', 'ACGT']
+    with open(filename, 'w') as fp:
+        for i, seq in enumerate(seqs):
+            fp.write('>read%d\n%s\n' % (i, seq))
+
+    hll = khmer.HLLCounter(ERR_RATE, K)
+    n, n_consumed = hll.consume_fasta(filename)
+
+    expected = khmer.HLLCounter(ERR_RATE, K)
+    for seq in seqs:
+        expected.consume_string(seq.upper().replace('N', 'A'))
+    assert n == 3, n
+    assert n_consumed == 9 + 3 + 5, n_consumed
+    assert hll.counters == expected.counters
+
+
 def test_hll_consume_fasta_ep():
     # During estimation trigger the _Ep() method,
     # we need all internal counters values to be different than zero for this.
@@ -38,6 +38,7 @@ from __future__ import print_function
 from __future__ import absolute_import
 
 import khmer
+import random
 from khmer import ReadParser
 
 import screed
@@ -365,6 +366,29 @@ def test_count_kmer_degree():
     assert nodegraph.kmer_degree('TAAA') == 1
 
 
+def test_kmer_degree_table_layouts():
+    # the neighbors of a k-mer are looked up together; check each table
+    # layout agrees with the others and with the sequence.
+    random.seed(1)
+    seq = ''.join(random.choice('ACGT') for _ in range(200))
+    graphs = [khmer.Nodegraph(20, 1e5, 4),
+              khmer.Nodegraph(20, 1e5, 4, fastrange=True),
+              khmer.BlockedNodegraph(20, 1e5, 4)]
+    for nodegraph in graphs:
+        nodegraph.consume(seq)
+
+    for i in range(len(seq) - 20 + 1):
+        kmer = seq[i:i + 20]
+        degrees = [nodegraph.kmer_degree(kmer) for nodegraph in graphs]
+        assert degrees[0] == degrees[1] == degrees[2], (i, degrees)
+        if 0 < i < len(seq) - 20:
+            assert degrees[0] >= 2, i
+
+    for nodegraph in graphs:
+        size = nodegraph.calc_connected_graph_size(seq[:20])
+        assert size == len(seq) - 20 + 1, size
+
+
 def test_save_load_tagset():
     nodegraph = khmer._Nodegraph(32, [1])
 
@@ -409,6 +433,29 @@ def test_save_load_tagset_noclear():
     assert len(data) == 38, len(data)
 
 
+def test_save_load_tagset_many():
+    # enough tags to make the tag set grow several times over.
+    nodegraph = khmer._Nodegraph(12, [1])
+    rng = random.Random(1)
+    seq = "".join(rng.choice("ACGT") for _ in range(20000))
+
+    for i in range(0, len(seq) - 12, 3):
+        nodegraph.add_tag(seq[i:i + 12])
+        nodegraph.add_tag(seq[i:i + 12])  # again; tags are a set
+    tags = nodegraph.get_tagset()
+    assert len(tags) == nodegraph.n_tags()
+    assert len(set(tags)) == len(tags)
+    hashes = [khmer.forward_hash(tag, 12) for tag in tags]
+    assert hashes == sorted(hashes)
+
+    outfile = utils.get_temp_filename('tagset')
+    nodegraph.save_tagset(outfile)
+
+    nodegraph2 = khmer._Nodegraph(12, [1])
+    nodegraph2.load_tagset(outfile)
+    assert nodegraph2.get_tagset() == tags
+
+
 def test_stop_traverse():
     filename = utils.get_test_data('random-20-a.fa')
 
@@ -1038,3 +1085,260 @@ def test_n_occupied_vs_countgraph_another_size():
 
     assert nodegraph.n_unique_kmers() == 3916, nodegraph.n_unique_kmers()
     assert countgraph.n_unique_kmers() == 3916, countgraph.n_unique_kmers()
+
+
+def test_blocked_count_get():
+    nodegraph = khmer.BlockedNodegraph(12, 1e4, 4)
+    assert nodegraph.n_tables() == 4
+    assert nodegraph.hashsizes() == utils.longify([40000])
+
+    nodegraph.consume('AAAAAAAAAAAACCCCCCCCCCCC')
+    assert nodegraph.get('AAAAAAAAAAAA') == 1
+    assert nodegraph.get('GGGGGGGGGGGG') == 1     # reverse complement
+    assert nodegraph.get('AAAAAAAAAACC') == 1
+    assert nodegraph.get('ACGTACGTACGT') == 0
+    assert nodegraph.n_unique_kmers() == 13
+    # two of the k-mers share one slot of a block.
+    assert nodegraph.n_occupied() == 13 * 4 - 1, nodegraph.n_occupied()
+
+    # k-mers already present set no new bits.
+    nodegraph.consume('AAAAAAAAAAAACCCCCCCCCCCC')
+    assert nodegraph.n_unique_kmers() == 13
+    assert nodegraph.n_occupied() == 13 * 4 - 1, nodegraph.n_occupied()
+
+
+def test_blocked_tablesize_rounding():
+    nodegraph = khmer.BlockedNodegraph(12, 10, 1)
+    assert nodegraph.hashsizes() == utils.longify([64])
+
+    nodegraph = khmer.BlockedNodegraph(12, 33, 2)
+    assert nodegraph.hashsizes() == utils.longify([128])
+
+
+def test_blocked_bad_n_tables():
+    for n_tables in (0, 65):
+        try:
+            khmer.BlockedNodegraph(12, 1e4, n_tables)
+            assert 0, "should not be reached"
+        except ValueError as err:
+            print(str(err))
+
+
+def test_blocked_matches_nodegraph():
+    filename = utils.get_test_data('random-20-a.fa')
+
+    nodegraph = khmer.Nodegraph(20, 1e6, 4)
+    nodegraph.consume_fasta(filename)
+
+    blocked = khmer.BlockedNodegraph(20, 1e6, 4)
+    blocked.consume_fasta(filename)
+
+    assert nodegraph.n_unique_kmers() == blocked.n_unique_kmers()
+    for record in screed.open(filename):
+        assert nodegraph.get_kmer_counts(record.sequence) == \
+            blocked.get_kmer_counts(record.sequence), record.name
+
+
+def test_blocked_save_load():
+    filename = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('tempblocked.pt')
+
+    nodegraph = khmer.BlockedNodegraph(20, 1e5, 4)
+    nodegraph.consume_fasta(filename)
+    nodegraph.save(savepath)
+
+    loaded = khmer.load_nodegraph(savepath)
+    assert isinstance(loaded, khmer._BlockedNodegraph), type(loaded)
+    assert loaded.n_tables() == 4
+    assert loaded.hashsizes() == nodegraph.hashsizes()
+    assert loaded.n_occupied() == nodegraph.n_occupied()
+
+    for record in screed.open(filename):
+        assert loaded.get_kmer_counts(record.sequence) == \
+            nodegraph.get_kmer_counts(record.sequence), record.name
+
+    try:
+        khmer._Nodegraph(1, [1]).load(savepath)
+        assert 0, "load should fail"
+    except OSError as err:
+        assert 'Incorrect file format type' in str(err), str(err)
+
+
+def test_blocked_update_from():
+    ng1 = khmer.BlockedNodegraph(20, 1e4, 4)
+    ng2 = khmer.BlockedNodegraph(20, 1e4, 4)
+
+    ng2.consume('ACGTACGTACGTACGTACGTAAAA')
+    ng1.update(ng2)
+
+    assert ng1.get('ACGTACGTACGTACGTACGT') == 1
+    assert ng1.n_occupied() == ng2.n_occupied()
+
+    try:
+        khmer.Nodegraph(20, 1e4, 4).update(ng2)
+        assert 0, "should not be reached"
+    except ValueError as err:
+        print(str(err))
+
+
+def test_fastrange_save_load():
+    filename = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('tempfastrange.pt')
+
+    nodegraph = khmer.Nodegraph(20, 1e5, 4, fastrange=True)
+    assert nodegraph.get_use_fastrange()
+    assert nodegraph.hashsizes() == utils.longify([100000] * 4)
+    nodegraph.consume_fasta(filename)
+    nodegraph.save(savepath)
+
+    loaded = khmer.load_nodegraph(savepath)
+    assert loaded.get_use_fastrange()
+    assert loaded.n_occupied() == nodegraph.n_occupied()
+    for record in screed.open(filename):
+        assert loaded.get_kmer_counts(record.sequence) == \
+            nodegraph.get_kmer_counts(record.sequence), record.name
+
+
+def test_fastrange_update_from():
+    ng1 = khmer.Nodegraph(20, 1e4, 4, fastrange=True)
+    ng2 = khmer.Nodegraph(20, 1e4, 4, fastrange=True)
+
+    ng2.consume('ACGTACGTACGTACGTACGTAAAA')
+    ng1.update(ng2)
+    assert ng1.get('ACGTACGTACGTACGTACGT') == 1
+
+    # the same table sizes, but a different indexing scheme.
+    ng3 = khmer._Nodegraph(20, ng2.hashsizes())
+    try:
+        ng3.update(ng2)
+        assert 0, "should not be reached"
+    except ValueError as err:
+        print(str(err))
+
+
+def test_prefetch_distance():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for make in (lambda: khmer.Nodegraph(12, 1e4, 4),
+                 lambda: khmer.BlockedNodegraph(12, 1e4, 4)):
+        plain = make()
+        plain.set_prefetch_distance(0)
+        batched = make()
+        batched.set_prefetch_distance(5)
+
+        plain.consume_fasta(inpath)
+        batched.consume_fasta(inpath)
+        assert plain.n_occupied() == batched.n_occupied()
+        assert plain.n_unique_kmers() == batched.n_unique_kmers()
+
+        for record in screed.open(inpath):
+            seq = record.sequence
+            assert plain.get_kmer_counts(seq) == batched.get_kmer_counts(seq)
+            assert plain.get_median_count(seq) == \
+                batched.get_median_count(seq)
+
+
+def test_page_aligned_save_load():
+    filename = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('tempaligned.pt')
+
+    for nodegraph, graph_type in \
+            ((khmer.Nodegraph(20, 1e5, 4), khmer._Nodegraph),
+             (khmer.BlockedNodegraph(20, 1e5, 4), khmer._BlockedNodegraph)):
+        nodegraph.consume_fasta(filename)
+        nodegraph.save(savepath, page_aligned=True)
+
+        for mode in (None, 'r', 'c'):
+            loaded = khmer.load_nodegraph(savepath, mmap_mode=mode)
+            assert isinstance(loaded, graph_type), type(loaded)
+            assert loaded.is_read_only() == (mode == 'r')
+            assert loaded.hashsizes() == nodegraph.hashsizes()
+            assert loaded.n_occupied() == nodegraph.n_occupied()
+
+            for record in screed.open(filename):
+                assert loaded.get_kmer_counts(record.sequence) == \
+                    nodegraph.get_kmer_counts(record.sequence), record.name
+
+        loaded = khmer.load_nodegraph(savepath, mmap_mode='r')
+        try:
+            loaded.update(nodegraph)
+            assert 0, "update should fail"
+        except ValueError as err:
+            assert 'read-only' in str(err), str(err)
+        try:
+            loaded.consume_and_tag('ACGTACGTACGTACGTACGTACGT')
+            assert 0, "consume_and_tag should fail"
+        except ValueError as err:
+            assert 'read-only' in str(err), str(err)
+
+
+def test_chunked_save_load():
+    filename = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('tempchunked.pt')
+
+    for nodegraph, graph_type in \
+            ((khmer.Nodegraph(20, 1e7, 2), khmer._Nodegraph),
+             (khmer.BlockedNodegraph(20, 1e5, 4), khmer._BlockedNodegraph)):
+        nodegraph.consume_fasta(filename)
+        nodegraph.save_chunked(savepath, threads=2)
+
+        for threads in (1, 2):
+            loaded = khmer.load_nodegraph(savepath, threads=threads)
+            assert isinstance(loaded, graph_type), type(loaded)
+            assert loaded.hashsizes() == nodegraph.hashsizes()
+            assert loaded.n_occupied() == nodegraph.n_occupied()
+
+            for record in screed.open(filename):
+                assert loaded.get_kmer_counts(record.sequence) == \
+                    nodegraph.get_kmer_counts(record.sequence), record.name
+
+
+def test_save_load_sparse():
+    filename = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('tempsparse.pt')
+
+    for nodegraph, graph_type in \
+            ((khmer.Nodegraph(20, 1e6, 4), khmer._Nodegraph),
+             (khmer.BlockedNodegraph(20, 1e6, 4), khmer._BlockedNodegraph)):
+        nodegraph.consume_fasta(filename)
+        nodegraph.save(savepath)
+
+        info = khmer.extract_nodegraph_info(savepath)
+        assert info[4] & 0x10, info
+
+        loaded = khmer.load_nodegraph(savepath)
+        assert isinstance(loaded, graph_type), type(loaded)
+        assert loaded.hashsizes() == nodegraph.hashsizes()
+        assert loaded.n_occupied() == nodegraph.n_occupied()
+
+        for record in screed.open(filename):
+            assert loaded.get_kmer_counts(record.sequence) == \
+                nodegraph.get_kmer_counts(record.sequence), record.name
+
+
+def test_merge_graph_files():
+    parts = [utils.get_test_data('random-20-a.even.fa'),
+             utils.get_test_data('random-20-a.odd.fa')]
+    whole = khmer.Nodegraph(20, 1e5, 4)
+    whole.consume_fasta(utils.get_test_data('random-20-a.fa'))
+
+    savepaths = []
+    for i, filename in enumerate(parts):
+        nodegraph = khmer.Nodegraph(20, 1e5, 4)
+        nodegraph.consume_fasta(filename)
+        savepaths.append(utils.get_temp_filename('part%d.pt' % i))
+        if i:
+            nodegraph.save(savepaths[-1], page_aligned=True)
+        else:
+            nodegraph.save(savepaths[-1])
+
+    outpath = utils.get_temp_filename('merged.pt')
+    khmer.merge_graph_files(outpath, savepaths, 1000)
+
+    merged = khmer.load_nodegraph(outpath)
+    assert isinstance(merged, khmer._Nodegraph), type(merged)
+    assert merged.hashsizes() == whole.hashsizes()
+    assert merged.n_occupied() == whole.n_occupied()
+    for record in screed.open(utils.get_test_data('random-20-a.fa')):
+        assert merged.get_kmer_counts(record.sequence) == \
+            whole.get_kmer_counts(record.sequence), record.name
@@ -38,9 +38,14 @@ from __future__ import print_function
 from __future__ import absolute_import
 import khmer
 from khmer import ReadParser
+import khmer.utils
 from . import khmer_tst_utils as utils
 from nose.plugins.attrib import attr
 from functools import reduce
+import gzip
+import io
+import struct
+import zlib
 
 
 def test_read_properties():
@@ -305,6 +310,65 @@ def test_read_truncated():
         assert "Sequence is empty" in str(err), str(err)
 
 
+def test_iter_read_batches():
+    filename = utils.get_test_data("100-reads.fq.gz")
+    reads = [(read.name, read.sequence, read.quality)
+             for read in ReadParser(filename)]
+
+    for batch_size in (1, 7, 64, 1000):
+        rparser = ReadParser(filename)
+        batches = list(rparser.iter_read_batches(batch_size))
+        assert all(len(batch) == batch_size for batch in batches[:-1])
+        assert 0 < len(batches[-1]) <= batch_size
+        assert [(read.name, read.sequence, read.quality)
+                for batch in batches for read in batch] == reads
+        assert rparser.num_reads == 100
+
+
+def test_iter_read_batches_truncated():
+    # the good read comes in its own batch, and the error with the next one.
+    rparser = ReadParser(utils.get_test_data("truncated.fq"))
+    batches = rparser.iter_read_batches(10)
+    assert len(next(batches)) == 1
+    try:
+        next(batches)
+        assert 0, "No exception raised on a truncated file"
+    except ValueError as err:
+        assert "Sequence is empty" in str(err), str(err)
+
+
+def test_iter_read_batches_bad_size():
+    rparser = ReadParser(utils.get_test_data("100-reads.fq.gz"))
+    try:
+        rparser.iter_read_batches(0)
+        assert 0, "should not accept an empty batch size"
+    except ValueError as err:
+        print(str(err))
+
+
+@attr('multithread')
+def test_iter_read_batches_threads():
+    import threading
+
+    names = []
+
+    def collect_names(rparser):
+        for batch in rparser.iter_read_batches(8):
+            names.extend(read.name for read in batch)
+
+    rparser = ReadParser(utils.get_test_data("100-reads.fq.gz"))
+    threads = [threading.Thread(target=collect_names, args=[rparser, ])
+               for _ in range(4)]
+    for thr in threads:
+        thr.start()
+    for thr in threads:
+        thr.join()
+
+    assert sorted(names) == sorted(read.name for read in ReadParser(
+        utils.get_test_data("100-reads.fq.gz")))
+    assert rparser.num_reads == 100
+
+
 def test_iterator_identities():
 
     rparser = \
@@ -424,4 +488,135 @@ def test_iternext():
         print(str(err))
     except ValueError as err:
         print(str(err))
+
+
+def test_read_wrapped_records():
+    # wrapped sequences and qualities, Windows line ends, blanks in the
+    # sequence and a '+' line that repeats the name.
+    filename = utils.get_temp_filename('wrapped.fq')
+    with open(filename, 'wb') as fp:
+        fp.write(b'@read1 1:N:0:NNNNN\r\nACGT\r\nAC GT\r\n+\r\n'
+                 b'IIII\r\nIIIJ\r\n@read2\nGG\n+read2\n@I\n')
+
+    reads = [(read.name, read.sequence, read.quality)
+             for read in ReadParser(filename)]
+    assert reads == [('read1 1:N:0:NNNNN', 'ACGTACGT', 'IIIIIIIJ'),
+                     ('read2', 'GG', '@I')], reads
+
+
+def test_read_bad_plus_line():
+    filename = utils.get_temp_filename('badplus.fq')
+    with open(filename, 'wb') as fp:
+        fp.write(b'@read1\nACGT\n+read2\nIIII\n')
+
+    try:
+        for read in ReadParser(filename):
+            pass
+        assert 0, "the '+' line names another read"
+    except OSError as err:
+        assert "'+' line of read1" in str(err), str(err)
+
+
+def test_bzip2_multiple_streams():
+    # each stream of a .bz2 file is read, as bzcat does.
+    filename = utils.get_temp_filename('twice.fq.bz2')
+    data = open(utils.get_test_data('100-reads.fq.bz2'), 'rb').read()
+    with open(filename, 'wb') as fp:
+        fp.write(data + data)
+
+    names = [read.name for read in ReadParser(filename)]
+    assert len(names) == 200, len(names)
+    assert names[:100] == names[100:]
+
+
+def _write_bgzf(filename, data, member_size):
+    # BGZF: gzip members of at most 64 KiB, each recording its own size.
+    with open(filename, 'wb') as fp:
+        for start in range(0, len(data), member_size):
+            chunk = data[start:start + member_size]
+            deflate = zlib.compressobj(6, zlib.DEFLATED, -15)
+            packed = deflate.compress(chunk) + deflate.flush()
+            fp.write(struct.pack('<BBBBIBBHBBHH', 31, 139, 8, 4, 0, 0, 255,
+                                 6, 66, 67, 2, len(packed) + 25))
+            fp.write(packed)
+            fp.write(struct.pack('<II', zlib.crc32(chunk) & 0xffffffff,
+                                 len(chunk)))
+
+
+def test_bgzf_decompression():
+    data = gzip.open(utils.get_test_data('100-reads.fq.gz')).read()
+    reads = [(read.name, read.sequence, read.quality)
+             for read in ReadParser(utils.get_test_data('100-reads.fq.gz'))]
+
+    filename = utils.get_temp_filename('100-reads.fq.bgz')
+    _write_bgzf(filename, data, 1000)
+    assert [(read.name, read.sequence, read.quality)
+            for read in ReadParser(filename)] == reads
+
+    # a file cut short fails after the reads before the cut.
+    packed = open(filename, 'rb').read()
+    with open(filename, 'wb') as fp:
+        fp.write(packed[:len(packed) // 2])
+    rparser = ReadParser(filename)
+    try:
+        for read in rparser:
+            pass
+        assert 0, "No exception raised on a truncated file"
+    except OSError as err:
+        print(str(err))
+    assert 0 < rparser.num_reads < 100, rparser.num_reads
+
+
+def _write_mixed_pairs(filename):
+    # pairs of each kind of name khmer.utils.check_is_pair knows, and orphans.
+    names = ['read/1', 'read/2', 'a/1', 'b/2', 'x 1:N:0:AC', 'x 2:N:0:AC',
+             'y 1::foo', 'y 2::foo', 'SRR1 seq/1', 'SRR1 seq/2', 'z/1']
+    with open(filename, 'w') as fp:
+        for name in names:
+            fp.write('>%s\nACGT\n' % name)
+
+
+def _names(data):
+    return [line[1:] for line in data.decode('utf-8').split('\n')
+            if line.startswith('>')]
+
+
+def test_paired_reads_to_files():
+    filename = utils.get_temp_filename('mixed-pairs.fa')
+    _write_mixed_pairs(filename)
+
+    pairs, orphans = [], []
+    for _, is_pair, read1, read2 in \
+            khmer.utils.broken_paired_reader(ReadParser(filename)):
+        if is_pair:
+            pairs.extend([read1.name, read2.name])
+        else:
+            orphans.append(read1.name)
+
+    paired_fp, orphans_fp = io.BytesIO(), io.BytesIO()
+    counts = khmer.paired_reads_to_files(filename, paired_fp, None,
+                                         orphans_fp)
+    assert counts == (4, 3), counts
+    assert _names(paired_fp.getvalue()) == pairs
+    assert _names(orphans_fp.getvalue()) == orphans
+
+    # orphans are skipped in PAIR_MODE_IGNORE_UNPAIRED ...
+    left_fp, right_fp = io.BytesIO(), io.BytesIO()
+    counts = khmer.paired_reads_to_files(
+        filename, left_fp, right_fp, None,
+        ReadParser.PAIR_MODE_IGNORE_UNPAIRED)
+    assert counts == (4, 0), counts
+    assert _names(left_fp.getvalue()) == pairs[::2]
+    assert _names(right_fp.getvalue()) == pairs[1::2]
+
+    # ... and fail in PAIR_MODE_ERROR_ON_UNPAIRED, after the pairs before.
+    paired_fp = io.BytesIO()
+    try:
+        khmer.paired_reads_to_files(filename, paired_fp, None, None,
+                                    ReadParser.PAIR_MODE_ERROR_ON_UNPAIRED)
+        assert 0, "No exception raised on an orphan"
+    except ValueError as err:
+        assert 'starting at a/1' in str(err), str(err)
+    assert _names(paired_fp.getvalue()) == ['read/1', 'read/2']
+
 # vim: set ft=python ts=4 sts=4 sw=4 et tw=79:
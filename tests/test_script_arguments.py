@@ -219,6 +219,24 @@ def test_create_countgraph_4_multiplier():
         sum(countgraph.hashsizes())
 
 
+def test_create_countgraph_packed():
+    ksize = khmer_args.DEFAULT_K
+    n_tables = khmer_args.DEFAULT_N_TABLES
+    max_tablesize = khmer_args.DEFAULT_MAX_TABLESIZE
+    max_mem = 1e7
+
+    PackedArgs = collections.namedtuple('PackedArgs', FakeArgparseObject._fields
+                                        + ('counter_bits',))
+    args = PackedArgs(ksize, n_tables, max_tablesize, max_mem, 0, 4)
+
+    countgraph = khmer_args.create_countgraph(args)
+    assert isinstance(countgraph, khmer.PackedCountgraph)
+    assert countgraph.get_counter_bits() == 4
+    # twice as many counters in the same memory.
+    assert sum(countgraph.hashsizes()) < 2 * max_mem
+    assert sum(countgraph.hashsizes()) > 1.9 * max_mem
+
+
 def test_create_nodegraph_1():
     ksize = khmer_args.DEFAULT_K
     n_tables = khmer_args.DEFAULT_N_TABLES
@@ -283,6 +301,34 @@ def test_create_nodegraph_4_multiplier():
         sum(nodegraph.hashsizes())
 
 
+def test_create_graph_blocked_fastrange():
+    # blocked tables don't have a fastrange mode to turn on.
+    ksize = khmer_args.DEFAULT_K
+    n_tables = khmer_args.DEFAULT_N_TABLES
+    max_tablesize = khmer_args.DEFAULT_MAX_TABLESIZE
+    max_mem = 1e7
+
+    BlockedArgs = collections.namedtuple('BlockedArgs',
+                                         FakeArgparseObject._fields +
+                                         ('blocked_tables',
+                                          'fastrange_tables'))
+    args = BlockedArgs(ksize, n_tables, max_tablesize, max_mem, 0, True, True)
+
+    for create in (khmer_args.create_countgraph,
+                   khmer_args.create_nodegraph):
+        old_stderr = sys.stderr
+        sys.stderr = capture = StringIO()
+
+        try:
+            create(args)
+            assert 0, "should not reach this"
+        except SystemExit:
+            err = capture.getvalue()
+            assert 'drop --fastrange-tables' in err, err
+        finally:
+            sys.stderr = old_stderr
+
+
 def test_report_on_config_bad_graphtype():
     ksize = khmer_args.DEFAULT_K
     n_tables = khmer_args.DEFAULT_N_TABLES
@@ -82,6 +82,44 @@ def test_load_into_counting():
     assert os.path.exists(outfile)
 
 
+def test_load_into_counting_blocked():
+    script = 'load-into-counting.py'
+    args = ['-x', '1e5', '-N', '2', '-k', '20', '--blocked-tables']
+
+    outfile = utils.get_temp_filename('out.ct')
+    infile = utils.get_test_data('test-abund-read-2.fa')
+
+    args.extend([outfile, infile])
+
+    (status, out, err) = utils.runscript(script, args)
+    assert 'Total number of unique k-mers: 95' in err, err
+    assert os.path.exists(outfile)
+
+    countgraph = khmer.load_countgraph(outfile)
+    assert countgraph.n_tables() == 2
+    assert countgraph.hashsizes() == utils.longify([200000])
+
+
+def test_load_into_counting_packed():
+    script = 'load-into-counting.py'
+    args = ['-x', '1e5', '-N', '2', '-k', '20', '--counter-bits', '4']
+
+    outfile = utils.get_temp_filename('out.ct')
+    infile = utils.get_test_data('test-abund-read-2.fa')
+
+    args.extend([outfile, infile])
+
+    (status, out, err) = utils.runscript(script, args)
+    assert 'Total number of unique k-mers: 95' in err, err
+    assert 'counts stop at 15' in err, err
+    assert os.path.exists(outfile)
+
+    countgraph = khmer.load_countgraph(outfile)
+    assert countgraph.get_counter_bits() == 4
+    assert countgraph.n_tables() == 2
+    assert not countgraph.get_use_bigcount()
+
+
 def test_load_into_counting_autoargs_0():
     script = 'load-into-counting.py'
 
@@ -143,6 +181,55 @@ def test_load_into_counting_max_memory_usage_parameter():
     assert sum(kh.hashsizes()) < 3e8
 
 
+def test_load_into_counting_page_aligned():
+    script = 'load-into-counting.py'
+    args = ['-x', '1e5', '-N', '2', '-k', '17', '--page-aligned']
+
+    outfile = utils.get_temp_filename('out.ct')
+    infile = utils.get_temp_filename('test.fa')
+    in_dir = os.path.dirname(infile)
+    shutil.copyfile(utils.get_test_data('test-abund-read-2.fa'), infile)
+
+    args.extend([outfile, infile])
+
+    (status, out, err) = utils.runscript(script, args)
+    assert os.path.exists(outfile)
+
+    info = khmer.extract_countgraph_info(outfile)
+    assert info[5] & 0x40, info
+    assert khmer.load_countgraph(outfile, mmap_mode='r').is_read_only()
+
+    # filter-abund.py maps the tables read-only.
+    utils.runscript('filter-abund.py', [outfile, infile], in_dir)
+
+    seqs = set([r.sequence for r in screed.open(infile + '.abundfilt')])
+    assert seqs == set(['GGTTGACGGGGCTCAGGG']), seqs
+
+
+def test_load_into_counting_chunked():
+    script = 'load-into-counting.py'
+    args = ['-x', '1e5', '-N', '2', '-k', '17', '--chunked', '-T', '2']
+
+    outfile = utils.get_temp_filename('out.ct')
+    infile = utils.get_temp_filename('test.fa')
+    in_dir = os.path.dirname(infile)
+    shutil.copyfile(utils.get_test_data('test-abund-read-2.fa'), infile)
+
+    args.extend([outfile, infile])
+
+    (status, out, err) = utils.runscript(script, args)
+    assert os.path.exists(outfile)
+
+    info = khmer.extract_countgraph_info(outfile)
+    assert info[5] & 0x20, info
+
+    utils.runscript('filter-abund.py', ['-T', '2', outfile, infile], in_dir)
+
+    seqs = set([r.sequence for r in screed.open(infile + '.abundfilt')])
+    assert seqs == set(['GGTTGACGGGGCTCAGGG']), seqs
+
+
+
 def test_load_into_counting_abundance_dist_nobig():
     script = 'load-into-counting.py'
     args = ['-x', '1e3', '-N', '2', '-k', '20', '-b']
@@ -333,6 +420,44 @@ def test_load_into_counting_bad_summary_fmt():
     assert "invalid choice: 'badfmt'" in err, err
 
 
+def test_merge_graphs():
+    graphs = []
+    for name in ('random-20-a.even.fa', 'random-20-a.odd.fa',
+                 'random-20-a.fa'):
+        outfile = utils.get_temp_filename(name + '.ct')
+        utils.runscript('load-into-counting.py',
+                        ['-x', '1e5', '-N', '2', '-k', '20', outfile,
+                         utils.get_test_data(name)])
+        graphs.append(outfile)
+
+    merged = utils.get_temp_filename('merged.ct')
+    args = ['--block-size', '1000', merged, graphs[0], graphs[1]]
+    utils.runscript('merge-graphs.py', args)
+
+    whole = khmer.load_countgraph(graphs[2])
+    loaded = khmer.load_countgraph(merged)
+    assert loaded.n_occupied() == whole.n_occupied()
+    for record in screed.open(utils.get_test_data('random-20-a.fa')):
+        assert loaded.get_kmer_counts(record.sequence) == \
+            whole.get_kmer_counts(record.sequence), record.name
+
+
+def test_merge_graphs_different_k():
+    graphs = []
+    for k in (20, 21):
+        outfile = utils.get_temp_filename('k%d.ct' % k)
+        utils.runscript('load-into-counting.py',
+                        ['-x', '1e5', '-N', '2', '-k', str(k), outfile,
+                         utils.get_test_data('random-20-a.fa')])
+        graphs.append(outfile)
+
+    merged = utils.get_temp_filename('merged.ct')
+    (status, out, err) = utils.runscript('merge-graphs.py',
+                                         [merged] + graphs, fail_ok=True)
+    assert status == 1, status
+    assert 'same type, k-mer size and number of tables' in err, err
+
+
 def _make_counting(infilename, SIZE=1e7, N=2, K=20, BIGCOUNT=True):
     script = 'load-into-counting.py'
     args = ['-x', str(SIZE), '-N', str(N), '-k', str(K)]
@@ -1146,6 +1271,32 @@ def test_partition_graph_1():
     assert x == (1, 0), x          # should be exactly one partition.
 
 
+def test_partition_graph_blocked():
+    script = 'load-graph.py'
+    args = ['-x', '1e7', '-N', '2', '-k', '20', '--blocked-tables']
+
+    graphbase = utils.get_temp_filename('out')
+    infile = utils.get_test_data('random-20-a.fa')
+    args.extend([graphbase, infile])
+
+    (status, out, err) = utils.runscript(script, args)
+    assert 'Total number of unique k-mers: 3960' in err, err
+
+    utils.runscript('partition-graph.py', [graphbase])
+    utils.runscript('merge-partitions.py', [graphbase, '-k', '20'])
+
+    final_pmap_file = graphbase + '.pmap.merged'
+    assert os.path.exists(final_pmap_file)
+
+    ht = khmer.load_nodegraph(graphbase)
+    assert isinstance(ht, khmer._BlockedNodegraph), type(ht)
+    ht.load_tagset(graphbase + '.tagset')
+    ht.load_partitionmap(final_pmap_file)
+
+    x = ht.count_partitions()
+    assert x == (1, 0), x          # should be exactly one partition.
+
+
 def test_partition_graph_nojoin_k21():
     # test with K=21
     graphbase = _make_graph(utils.get_test_data('random-20-a.fa'), ksize=21)
@@ -1233,6 +1384,38 @@ def test_partition_graph_no_big_traverse():
     assert x[0] == 4, x       # should be four partitions, broken at knot.
 
 
+def test_partition_graph_no_subsets():
+    graphbase = _make_graph(utils.get_test_data('random-20-a.fa'))
+
+    utils.runscript('partition-graph.py', ['--no-subsets', '-T', '4',
+                                           graphbase])
+
+    final_pmap_file = graphbase + '.pmap.merged'
+    assert os.path.exists(final_pmap_file)
+    assert not os.path.exists(graphbase + '.subset.0.pmap')
+
+    ht = khmer.load_nodegraph(graphbase)
+    ht.load_tagset(graphbase + '.tagset')
+    ht.load_partitionmap(final_pmap_file)
+
+    x = ht.count_partitions()
+    assert x == (1, 0), x          # should be exactly one partition.
+
+
+def test_partition_graph_no_subsets_no_big_traverse():
+    graphbase = _make_graph(utils.get_test_data('biglump-random-20-a.fa'))
+
+    utils.runscript('partition-graph.py', ['--no-subsets', '-T', '4',
+                                           '--no-big-traverse', graphbase])
+
+    ht = khmer.load_nodegraph(graphbase)
+    ht.load_tagset(graphbase + '.tagset')
+    ht.load_partitionmap(graphbase + '.pmap.merged')
+
+    x = ht.count_partitions()
+    assert x[0] == 4, x       # should be four partitions, broken at knot.
+
+
 def test_partition_find_knots_execute():
     graphbase = _make_graph(utils.get_test_data('random-20-a.fa'))
 
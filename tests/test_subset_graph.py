@@ -556,6 +556,62 @@ def test_output_partitions():
 test_output_partitions.runme = True
 
 
+def test_join_partitions_ids():
+    ht = khmer._Nodegraph(10, [1])
+    kmers = ['TTAGGACTGC', 'TGCGTTTCAA', 'ATACTGTAAA', 'GGACCTAAGC',
+             'CCGATTAGCA', 'AGGCTTACGT']
+    for pid, kmer in enumerate(kmers, 2):
+        ht.set_partition_id(kmer, pid)
+
+    # joining keeps the ID of the partition that has taken in more;
+    # the first one on a tie.
+    assert ht.join_partitions(2, 3) == 2
+    assert ht.join_partitions(4, 5) == 4
+    ht.join_partitions(6, 2)
+    assert [ht.get_partition_id(k) for k in kmers] == [2, 2, 4, 4, 2, 7]
+
+    ht.join_partitions(4, 2)
+    assert [ht.get_partition_id(k) for k in kmers] == [2, 2, 2, 2, 2, 7]
+
+    # 3, 4, 5 and 6 are gone.
+    assert ht.join_partitions(3, 7) == 0
+    assert ht.join_partitions(2, 7) == 2
+    assert [ht.get_partition_id(k) for k in kmers] == [2] * 6
+
+    outfile = utils.get_temp_filename('pmap')
+    ht.save_partitionmap(outfile)
+
+    ht2 = khmer._Nodegraph(10, [1])
+    ht2.load_partitionmap(outfile)
+    assert len(set(ht2.get_partition_id(k) for k in kmers)) == 1
+
+
+def test_do_partition_threads():
+    filename = utils.get_test_data('random-20-a.fa')
+
+    for n_threads in (1, 4):
+        ht = khmer.Nodegraph(20, 1e4, 3)
+        ht.add_stop_tag('TTGCATACGTTGAGCCAGCG')
+        ht.consume_fasta_and_tag(filename)
+
+        ht.do_partition(threads=n_threads, break_on_stop_tags=True)
+        assert ht.count_partitions() == (2, 0), n_threads
+
+    # the same partitions as do_subset_partition finds.
+    ht2 = khmer.Nodegraph(20, 1e4, 3)
+    ht2.add_stop_tag('TTGCATACGTTGAGCCAGCG')
+    ht2.consume_fasta_and_tag(filename)
+    ht2.merge_subset(ht2.do_subset_partition(0, 0, True))
+
+    for record in screed.open(filename):
+        for other in screed.open(filename):
+            same = (ht.get_partition_id(record.sequence[:20]) ==
+                    ht.get_partition_id(other.sequence[:20]))
+            same2 = (ht2.get_partition_id(record.sequence[:20]) ==
+                     ht2.get_partition_id(other.sequence[:20]))
+            assert same == same2
+
+
 def test_tiny_real_partitions():
     filename = utils.get_test_data('real-partition-tiny.fa')
 